@@ -87,6 +87,8 @@
 #define HCR_EL2_AMO_EL2		(1 <<  5) /* Route SErrors to EL2             */
 
 #define ID_AA64ISAR0_EL1_RNDR	(0xFUL << 60) /* RNDR random registers */
+#define ID_AA64ISAR0_EL1_SHA2	(0xFUL << 12) /* SHA2 instructions */
+#define ID_AA64ISAR0_EL1_SHA2_SHA512	(0x2UL << 12) /* ... and SHA512 too */
 /*
  * ID_AA64ISAR1_EL1 bits definitions
  */
@@ -339,6 +341,16 @@ void mmu_change_region_attr_nobreak(phys_addr_t addr, size_t size, u64 attrs);
  */
 void smc_call(struct pt_regs *args);
 
+/**
+ * cpu_has_sha512() - check for the SHA-512 Crypto Extensions instructions
+ *
+ * Unlike the SHA-1/SHA-256 ones, these are optional even when the Crypto
+ * Extensions are implemented.
+ *
+ * Return: true if this CPU implements the SHA-512 instructions
+ */
+bool cpu_has_sha512(void);
+
 void __noreturn psci_system_reset(void);
 void __noreturn psci_system_reset2(u32 reset_level, u32 cookie);
 void __noreturn psci_system_off(void);
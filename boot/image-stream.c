@@ -0,0 +1,596 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Decompression of images while they are read from storage
+ *
+ * The one-shot decompressors used by image_decomp() need the whole compressed
+ * image in memory. Here the compressed data is read a window at a time and
+ * each window is handed to a streaming decompressor which writes straight to
+ * the final location, so only the window and the decompressor state need to
+ * be held in memory alongside the output.
+ */
+
+#define LOG_CATEGORY	LOGC_BOOT
+
+#include <gzip.h>
+#include <hash.h>
+#include <image.h>
+#include <log.h>
+#include <malloc.h>
+#include <time.h>
+#include <watchdog.h>
+#include <asm/unaligned.h>
+#include <u-boot/lz4.h>
+#include <u-boot/zlib.h>
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/zstd.h>
+#include <lzma/LzmaTypes.h>
+#include <lzma/LzmaDec.h>
+
+#define LZ4F_MAGIC			0x184D2204
+#define LZ4F_BLOCKUNCOMPRESSED_FLAG	0x80000000U
+
+/* LZMA header: properties followed by the 64-bit uncompressed size */
+#define LZMA_HEADER_SIZE		(LZMA_PROPS_SIZE + sizeof(u64))
+
+/**
+ * struct stream_buf - window over the compressed data
+ *
+ * @strm: Source of the data
+ * @buf: Window buffer
+ * @size: Size of @buf in bytes
+ * @in: Next byte in @buf not yet consumed by the decompressor
+ * @avail: Number of bytes at @in not yet consumed
+ * @pos: Number of bytes of compressed data read so far
+ * @hash_ctx: Progressive hash context, or NULL if not hashing
+ */
+struct stream_buf {
+	struct image_stream *strm;
+	u8 *buf;
+	ulong size;
+	u8 *in;
+	ulong avail;
+	ulong pos;
+	void *hash_ctx;
+};
+
+static int stream_hash(struct stream_buf *sb, const void *buf, ulong len)
+{
+	struct hash_algo *algo = sb->strm->algo;
+	int ret;
+
+	if (!sb->hash_ctx)
+		return 0;
+	ret = algo->hash_update(algo, sb->hash_ctx, buf, len,
+				sb->pos + len == sb->strm->size);
+	if (ret) {
+		/* the context has been freed */
+		sb->hash_ctx = NULL;
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/*
+ * Read up to @len bytes of the next part of the compressed data into @buf.
+ * Returns the number of bytes read, 0 at the end of the data, or -ve on error
+ */
+static long stream_read(struct stream_buf *sb, void *buf, ulong len)
+{
+	struct image_stream *strm = sb->strm;
+	ulong start;
+	long ret;
+
+	len = min(len, strm->size - sb->pos);
+	if (!len)
+		return 0;
+
+	start = timer_get_us();
+	ret = strm->read(strm, buf, strm->offset + sb->pos, len);
+	strm->read_us += timer_get_us() - start;
+	if (ret < 0)
+		return ret;
+	if (ret != len)
+		return -EIO;
+
+	ret = stream_hash(sb, buf, len);
+	if (ret)
+		return ret;
+	sb->pos += len;
+	schedule();
+
+	return len;
+}
+
+/*
+ * Move the unconsumed bytes to the start of the window and fill the rest of
+ * it. Returns the number of bytes added, 0 at the end of the data, or -ve on
+ * error
+ */
+static long stream_refill(struct stream_buf *sb)
+{
+	long ret;
+
+	if (sb->avail && sb->in != sb->buf)
+		memmove(sb->buf, sb->in, sb->avail);
+	sb->in = sb->buf;
+
+	ret = stream_read(sb, sb->buf + sb->avail, sb->size - sb->avail);
+	if (ret > 0)
+		sb->avail += ret;
+
+	return ret;
+}
+
+/* Make sure that at least @len unconsumed bytes are in the window */
+static int stream_ensure(struct stream_buf *sb, ulong len)
+{
+	long ret;
+
+	if (len > sb->size)
+		return -E2BIG;
+	while (sb->avail < len) {
+		ret = stream_refill(sb);
+		if (ret < 0)
+			return ret;
+		if (!ret)
+			return -EINVAL;	/* truncated input */
+	}
+
+	return 0;
+}
+
+/* Enlarge the window to at least @size bytes, keeping its contents */
+static int stream_grow(struct stream_buf *sb, ulong size)
+{
+	u8 *buf;
+
+	if (size <= sb->size)
+		return 0;
+	buf = malloc(size);
+	if (!buf)
+		return -ENOMEM;
+	memcpy(buf, sb->in, sb->avail);
+	free(sb->buf);
+	sb->buf = buf;
+	sb->in = buf;
+	sb->size = size;
+
+	return 0;
+}
+
+static void stream_consume(struct stream_buf *sb, ulong len)
+{
+	sb->in += len;
+	sb->avail -= len;
+}
+
+static int stream_copy(struct stream_buf *sb, void *dst, ulong dstlen,
+		       ulong *out_len)
+{
+	ulong len = sb->strm->size;
+	long ret;
+
+	if (len > dstlen)
+		return -ENOBUFS;
+
+	/* nothing to decompress, so read straight into place */
+	while ((ret = stream_read(sb, dst + sb->pos, sb->strm->window)) > 0)
+		;
+	if (ret < 0)
+		return ret;
+	*out_len = len;
+
+	return 0;
+}
+
+static void *stream_zalloc(void *x, unsigned int items, unsigned int size)
+{
+	return malloc(items * size);
+}
+
+static void stream_zfree(void *x, void *addr, unsigned int nb)
+{
+	free(addr);
+}
+
+static int stream_gunzip(struct stream_buf *sb, void *dst, ulong dstlen,
+			 ulong *out_len)
+{
+	z_stream s = {};
+	int offset, r;
+	int ret;
+
+	ret = stream_ensure(sb, 1);
+	if (ret)
+		return ret;
+	offset = gzip_parse_header(sb->in, sb->avail);
+	if (offset < 0)
+		return -EINVAL;
+	stream_consume(sb, offset);
+
+	s.zalloc = stream_zalloc;
+	s.zfree = stream_zfree;
+	r = inflateInit2(&s, -MAX_WBITS);
+	if (r != Z_OK) {
+		log_err("inflateInit2() returned %d\n", r);
+		return -ENOMEM;
+	}
+	s.next_out = dst;
+	s.avail_out = dstlen;
+
+	do {
+		ret = stream_ensure(sb, 1);
+		if (ret)
+			break;
+		s.next_in = sb->in;
+		s.avail_in = sb->avail;
+		r = inflate(&s, Z_SYNC_FLUSH);
+		stream_consume(sb, sb->avail - s.avail_in);
+		if (r == Z_STREAM_END)
+			break;
+		if (r != Z_OK)
+			ret = !s.avail_out ? -ENOBUFS : -EINVAL;
+	} while (!ret);
+	*out_len = s.next_out - (Bytef *)dst;
+	inflateEnd(&s);
+
+	return ret;
+}
+
+/*
+ * Read the header of the next zstd frame into @fh. Returns 0 if there is one,
+ * -ENOENT at the end of the data or if what follows is not a frame, or -ve on
+ * error
+ */
+static int stream_zstd_header(struct stream_buf *sb, zstd_frame_header *fh)
+{
+	size_t r;
+	int ret;
+
+	ret = stream_ensure(sb, 1);
+	if (ret == -EINVAL)
+		return -ENOENT;
+	if (ret)
+		return ret;
+	while ((r = zstd_get_frame_header(fh, sb->in, sb->avail))) {
+		if (zstd_is_error(r))
+			return -ENOENT;
+		/* only part of the header is here, @r is its full size */
+		ret = stream_grow(sb, r);
+		if (!ret)
+			ret = stream_ensure(sb, r);
+		if (ret == -EINVAL)
+			return -ENOENT;
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int stream_unzstd(struct stream_buf *sb, void *dst, ulong dstlen,
+			 ulong *out_len)
+{
+	zstd_out_buffer out = { .dst = dst, .size = dstlen };
+	zstd_frame_header fh;
+	zstd_dstream *ds = NULL;
+	void *workspace = NULL;
+	ulong window = 0;
+	int frames, ret;
+	size_t wsize, r;
+
+	/*
+	 * The data may be made of several frames, e.g. from mkimage
+	 * --zstd-frames, so decode frames until it runs out. Anything after the
+	 * last frame which is not a frame is ignored, as zstd_decompress() does.
+	 */
+	for (frames = 0;; frames++) {
+		ret = stream_zstd_header(sb, &fh);
+		if (ret == -ENOENT) {
+			ret = frames ? 0 : -EINVAL;
+			break;
+		}
+		if (ret)
+			break;
+
+		/* the decoder keeps one window of history, sized from the frame */
+		if (!ds || fh.windowSize > window) {
+			free(workspace);
+			window = fh.windowSize;
+			wsize = zstd_dstream_workspace_bound(window);
+			workspace = malloc(wsize);
+			if (!workspace) {
+				ret = -ENOMEM;
+				break;
+			}
+			ds = zstd_init_dstream(window, workspace, wsize);
+			if (!ds) {
+				ret = -EPERM;
+				break;
+			}
+		} else {
+			zstd_reset_dstream(ds);
+		}
+
+		do {
+			zstd_in_buffer in;
+			size_t out_pos = out.pos;
+
+			ret = stream_ensure(sb, 1);
+			if (ret)
+				break;
+			in.src = sb->in;
+			in.size = sb->avail;
+			in.pos = 0;
+			r = zstd_decompress_stream(ds, &out, &in);
+			stream_consume(sb, in.pos);
+			if (zstd_is_error(r)) {
+				log_debug("zstd error: %s\n",
+					  zstd_get_error_name(r));
+				ret = -EINVAL;
+			} else if (!r) {
+				break;		/* frame complete and flushed */
+			} else if (out.pos == out.size && !in.pos &&
+				   out.pos == out_pos) {
+				ret = -ENOBUFS;
+			}
+		} while (!ret);
+		if (ret)
+			break;
+	}
+	*out_len = out.pos;
+	free(workspace);
+
+	return ret;
+}
+
+static void *stream_lzma_alloc(ISzAllocPtr p, size_t size)
+{
+	return malloc(size);
+}
+
+static void stream_lzma_free(ISzAllocPtr p, void *address)
+{
+	free(address);
+}
+
+static int stream_unlzma(struct stream_buf *sb, void *dst, ulong dstlen,
+			 ulong *out_len)
+{
+	ISzAlloc alloc = {
+		.Alloc = stream_lzma_alloc,
+		.Free = stream_lzma_free,
+	};
+	ELzmaFinishMode mode = LZMA_FINISH_ANY;
+	ELzmaStatus status;
+	ulong limit = dstlen;
+	CLzmaDec dec;
+	u64 size;
+	int ret;
+
+	ret = stream_ensure(sb, LZMA_HEADER_SIZE);
+	if (ret)
+		return ret;
+	size = get_unaligned_le64(sb->in + LZMA_PROPS_SIZE);
+	if (size != -1ULL) {
+		if (size > dstlen)
+			return -ENOBUFS;
+		limit = size;
+		mode = LZMA_FINISH_END;
+	}
+
+	/* decode straight into the output, which acts as the dictionary */
+	LzmaDec_Construct(&dec);
+	if (LzmaDec_AllocateProbs(&dec, sb->in, LZMA_PROPS_SIZE, &alloc))
+		return -EINVAL;
+	stream_consume(sb, LZMA_HEADER_SIZE);
+	dec.dic = dst;
+	dec.dicBufSize = limit;
+	LzmaDec_Init(&dec);
+
+	do {
+		SizeT len;
+
+		ret = stream_ensure(sb, 1);
+		if (ret)
+			break;
+		len = sb->avail;
+		if (LzmaDec_DecodeToDic(&dec, limit, sb->in, &len, mode,
+					&status) != SZ_OK) {
+			ret = -EINVAL;
+			break;
+		}
+		stream_consume(sb, len);
+		if (status == LZMA_STATUS_FINISHED_WITH_MARK)
+			break;
+		if (dec.dicPos == limit) {
+			if (mode != LZMA_FINISH_END)
+				ret = -ENOBUFS;
+			break;
+		}
+	} while (!ret);
+	*out_len = dec.dicPos;
+	LzmaDec_FreeProbs(&dec, &alloc);
+
+	return ret;
+}
+
+static int stream_unlz4(struct stream_buf *sb, void *dst, ulong dstlen,
+			ulong *out_len)
+{
+	bool has_block_checksum, has_content_size;
+	ulong max_block, hdr_len;
+	void *out = dst;
+	u8 flags, block_desc;
+	int ret;
+
+	ret = stream_ensure(sb, 7);
+	if (ret)
+		return ret;
+	if (get_unaligned_le32(sb->in) != LZ4F_MAGIC)
+		return -EPROTONOSUPPORT;
+	flags = sb->in[4];
+	block_desc = sb->in[5];
+	if (((flags >> 6) & 0x3) != 1)
+		return -EPROTONOSUPPORT;
+	if ((flags & 0x03) || (block_desc & 0x8f))
+		return -EINVAL;
+	if (!(flags & BIT(5)))
+		return -EPROTONOSUPPORT; /* linked blocks */
+	has_block_checksum = flags & BIT(4);
+	has_content_size = flags & BIT(3);
+	hdr_len = 7 + (has_content_size ? sizeof(u64) : 0);
+	ret = stream_ensure(sb, hdr_len);
+	if (ret)
+		return ret;
+	stream_consume(sb, hdr_len);
+
+	/* 64KB, 256KB, 1MB or 4MB; a whole block must fit in the window */
+	max_block = 1UL << (8 + 2 * ((block_desc >> 4) & 0x7));
+	ret = stream_grow(sb, min(max_block, sb->strm->size));
+	if (ret)
+		return ret;
+
+	while (1) {
+		u32 header, block_size;
+
+		ret = stream_ensure(sb, sizeof(u32));
+		if (ret)
+			break;
+		header = get_unaligned_le32(sb->in);
+		stream_consume(sb, sizeof(u32));
+		block_size = header & ~LZ4F_BLOCKUNCOMPRESSED_FLAG;
+		if (!block_size)
+			break;		/* end mark */
+		if (block_size > max_block) {
+			ret = -EINVAL;
+			break;
+		}
+		ret = stream_ensure(sb, block_size);
+		if (ret)
+			break;
+
+		if (header & LZ4F_BLOCKUNCOMPRESSED_FLAG) {
+			if (block_size > dst + dstlen - out) {
+				ret = -ENOBUFS;
+				break;
+			}
+			memcpy(out, sb->in, block_size);
+			out += block_size;
+		} else {
+			ret = LZ4_decompress_safe((const char *)sb->in, out,
+						  block_size,
+						  dst + dstlen - out);
+			if (ret < 0) {
+				ret = -EPROTO;
+				break;
+			}
+			out += ret;
+			ret = 0;
+		}
+		stream_consume(sb, block_size);
+
+		if (has_block_checksum) {
+			ret = stream_ensure(sb, sizeof(u32));
+			if (ret)
+				break;
+			stream_consume(sb, sizeof(u32));
+		}
+	}
+	*out_len = out - dst;
+
+	return ret;
+}
+
+int image_decomp_stream(struct image_stream *strm, int comp, void *load_buf,
+			ulong unc_len, ulong *load_len)
+{
+	int (*decomp)(struct stream_buf *sb, void *dst, ulong dstlen,
+		      ulong *out_len) = NULL;
+	struct stream_buf sb = { .strm = strm };
+	ulong start;
+	int ret;
+
+	switch (comp) {
+	case IH_COMP_NONE:
+		decomp = stream_copy;
+		break;
+	case IH_COMP_GZIP:
+		if (CONFIG_IS_ENABLED(GZIP))
+			decomp = stream_gunzip;
+		break;
+	case IH_COMP_LZMA:
+		if (CONFIG_IS_ENABLED(LZMA))
+			decomp = stream_unlzma;
+		break;
+	case IH_COMP_LZ4:
+		if (CONFIG_IS_ENABLED(LZ4))
+			decomp = stream_unlz4;
+		break;
+	case IH_COMP_ZSTD:
+		if (CONFIG_IS_ENABLED(ZSTD))
+			decomp = stream_unzstd;
+		break;
+	}
+	if (!decomp) {
+		printf("Unimplemented compression type %d\n", comp);
+		return -ENOSYS;
+	}
+
+	strm->read_us = 0;
+	strm->decomp_us = 0;
+	*load_len = 0;
+	if (!strm->window)
+		strm->window = CONFIG_IMAGE_DECOMP_STREAM_WINDOW;
+	if (comp != IH_COMP_NONE) {
+		sb.size = min(strm->window, strm->size);
+		sb.buf = malloc(sb.size);
+		if (!sb.buf)
+			return -ENOMEM;
+		sb.in = sb.buf;
+	}
+	if (strm->algo) {
+		ret = strm->algo->hash_init(strm->algo, &sb.hash_ctx);
+		if (ret) {
+			ret = -EIO;
+			goto out;
+		}
+	}
+
+	start = timer_get_us();
+	ret = decomp(&sb, load_buf, unc_len, load_len);
+	strm->decomp_us = timer_get_us() - start - strm->read_us;
+	if (ret)
+		goto out;
+	if (sb.pos != strm->size) {
+		/* hash anything after the end of the compressed stream */
+		while ((ret = stream_read(&sb, sb.buf, sb.size)) > 0)
+			;
+		if (ret)
+			goto out;
+	}
+
+	if (sb.hash_ctx) {
+		ret = strm->algo->hash_finish(strm->algo, sb.hash_ctx,
+					      strm->digest,
+					      sizeof(strm->digest));
+		sb.hash_ctx = NULL;
+		if (ret) {
+			ret = -EIO;
+			goto out;
+		}
+		if (!strcmp(strm->algo->name, "crc32"))
+			put_unaligned_be32(*(u32 *)strm->digest, strm->digest);
+	}
+
+out:
+	if (sb.hash_ctx)
+		strm->algo->hash_finish(strm->algo, sb.hash_ctx, strm->digest,
+					sizeof(strm->digest));
+	free(sb.buf);
+
+	return ret;
+}
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * The 'sha512bench' command compares the speed of the ARMv8 Crypto Extensions
+ * SHA-512 transform with the generic C one.
+ */
+
+#include <command.h>
+#include <mapmem.h>
+#include <time.h>
+#include <vsprintf.h>
+#include <asm/system.h>
+#include <linux/bitops.h>
+#include <linux/string.h>
+#include <u-boot/sha512.h>
+
+#define PMCR_EL0_E		BIT(0)	/* enable all counters */
+#define PMCNTENSET_EL0_C	BIT(31)	/* enable the cycle counter */
+#define PMCCFILTR_EL0_NSH	BIT(27)	/* also count cycles at EL2 */
+
+typedef void (*sha512_process_t)(sha512_context *ctx,
+				 const unsigned char *data,
+				 unsigned int blocks);
+
+static void cycles_enable(void)
+{
+	u64 pmcr;
+
+	asm volatile("msr pmccfiltr_el0, %0" : : "r" (PMCCFILTR_EL0_NSH));
+	asm volatile("msr pmcntenset_el0, %0" : : "r" (PMCNTENSET_EL0_C));
+	asm volatile("mrs %0, pmcr_el0" : "=r" (pmcr));
+	asm volatile("msr pmcr_el0, %0" : : "r" (pmcr | PMCR_EL0_E));
+	isb();
+}
+
+static u64 cycles_read(void)
+{
+	u64 val;
+
+	isb();
+	asm volatile("mrs %0, pmccntr_el0" : "=r" (val));
+
+	return val;
+}
+
+/* Run @process over @blocks blocks of @buf and report the time taken */
+static void bench(const char *name, sha512_process_t process, const void *buf,
+		  uint blocks, sha512_context *ctx)
+{
+	ulong len = blocks * SHA512_BLOCK_SIZE;
+	ulong start, us;
+	u64 cycles;
+
+	sha512_starts(ctx);
+	start = timer_get_us();
+	cycles = cycles_read();
+	process(ctx, buf, blocks);
+	cycles = cycles_read() - cycles;
+	us = max(timer_get_us() - start, 1UL);
+
+	printf("%-8s %12llu cycles %4llu.%02llu cycles/byte %6lu KiB/s\n",
+	       name, cycles, cycles / len, cycles * 100 / len % 100,
+	       (ulong)((u64)len * 1000000 / 1024 / us));
+}
+
+static int do_sha512bench(struct cmd_tbl *cmdtp, int flag, int argc,
+			  char *const argv[])
+{
+	sha512_context generic, ce;
+	ulong addr, len;
+	uint blocks;
+	void *buf;
+
+	if (argc != 3)
+		return CMD_RET_USAGE;
+	addr = hextoul(argv[1], NULL);
+	len = hextoul(argv[2], NULL);
+	blocks = len / SHA512_BLOCK_SIZE;
+	if (!blocks)
+		return CMD_RET_USAGE;
+	len = blocks * SHA512_BLOCK_SIZE;
+
+	cycles_enable();
+	buf = map_sysmem(addr, len);
+	printf("Hashing %lu bytes at %lx\n", len, addr);
+	bench("generic", sha512_process_generic, buf, blocks, &generic);
+	if (!cpu_has_sha512()) {
+		unmap_sysmem(buf);
+		puts("SHA-512 instructions not supported by this CPU\n");
+		return CMD_RET_SUCCESS;
+	}
+	bench("ce", sha512_process, buf, blocks, &ce);
+	unmap_sysmem(buf);
+
+	if (memcmp(generic.state, ce.state, sizeof(ce.state))) {
+		puts("Results differ\n");
+		return CMD_RET_FAILURE;
+	}
+
+	return CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(
+	sha512bench, 3, 0, do_sha512bench,
+	"compare SHA-512 implementations",
+	"<addr> <len>\n"
+	"    - hash 'len' bytes at 'addr' with the generic and the ARMv8 Crypto\n"
+	"      Extensions SHA-512 transforms and report the cycles taken"
+);
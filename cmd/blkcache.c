@@ -4,8 +4,10 @@
  * Author: Eric Nelson<eric@nelint.com>
  *
  */
+#include <blk.h>
 #include <command.h>
 #include <config.h>
+#include <dm.h>
 #include <malloc.h>
 #include <part.h>
 #include <vsprintf.h>
@@ -13,37 +15,79 @@
 static int blkc_show(struct cmd_tbl *cmdtp, int flag,
 		     int argc, char *const argv[])
 {
+	struct block_cache_dev_stats dev;
 	struct block_cache_stats stats;
+	int i;
+
 	blkcache_stats(&stats);
 
 	printf("hits: %u\n"
 	       "misses: %u\n"
+	       "evictions: %u\n"
+	       "write-through updates: %u\n"
 	       "entries: %u\n"
-	       "max blocks/entry: %u\n"
-	       "max cache entries: %u\n",
-	       stats.hits, stats.misses, stats.entries,
-	       stats.max_blocks_per_entry, stats.max_entries);
+	       "cached bytes: %lu\n"
+	       "capacity: %lu bytes, %u sets of %u ways\n"
+	       "max blocks/read: %u\n",
+	       stats.hits, stats.misses, stats.evictions, stats.writes,
+	       stats.entries, stats.bytes, stats.max_bytes, stats.sets,
+	       stats.ways, stats.max_blocks);
+	if (stats.max_dev_bytes)
+		printf("max bytes/device: %lu\n", stats.max_dev_bytes);
+	else
+		printf("max bytes/device: unlimited\n");
+
+	for (i = 0; !blkcache_dev_stats(i, &dev, true); i++)
+		printf("%s %d: hits %u, misses %u, entries %u, bytes %lu\n",
+		       blk_get_uclass_name(dev.iftype), dev.devnum, dev.hits,
+		       dev.misses, dev.entries, dev.bytes);
+
+	if (CONFIG_IS_ENABLED(BLK_READAHEAD)) {
+		struct blk_readahead_stats ra;
+		struct udevice *bdev;
+		struct uclass *uc;
+
+		uclass_id_foreach_dev(UCLASS_BLK, bdev, uc) {
+			if (blk_readahead_stats(bdev, &ra, true) ||
+			    !ra.windows)
+				continue;
+			printf("%s: read-ahead %lu windows, %lu blocks fetched, %lu used\n",
+			       bdev->name, ra.windows, ra.fetched, ra.used);
+		}
+	}
+
 	return 0;
 }
 
 static int blkc_configure(struct cmd_tbl *cmdtp, int flag,
 			  int argc, char *const argv[])
 {
-	unsigned blocks_per_entry, max_entries;
-	if (argc != 3)
+	struct block_cache_stats stats;
+	unsigned ways, max_blocks;
+	ulong max_bytes, max_dev_bytes;
+
+	if (argc < 2 || argc > 5)
+		return CMD_RET_USAGE;
+
+	blkcache_stats(&stats);
+	max_bytes = simple_strtoul(argv[1], 0, 0);
+	ways = argc > 2 ? simple_strtoul(argv[2], 0, 0) : stats.ways;
+	max_blocks = argc > 3 ? simple_strtoul(argv[3], 0, 0) :
+		stats.max_blocks;
+	max_dev_bytes = argc > 4 ? simple_strtoul(argv[4], 0, 0) :
+		stats.max_dev_bytes;
+	if (!ways)
 		return CMD_RET_USAGE;
 
-	blocks_per_entry = simple_strtoul(argv[1], 0, 0);
-	max_entries = simple_strtoul(argv[2], 0, 0);
-	blkcache_configure(blocks_per_entry, max_entries);
-	printf("changed to max of %u entries of %u blocks each\n",
-	       max_entries, blocks_per_entry);
+	blkcache_configure(max_bytes, ways, max_blocks, max_dev_bytes);
+	printf("changed to %lu bytes in %u-way sets, caching reads of up to %u blocks\n",
+	       max_bytes, ways, max_blocks);
 	return 0;
 }
 
 static struct cmd_tbl cmd_blkc_sub[] = {
 	U_BOOT_CMD_MKENT(show, 0, 0, blkc_show, "", ""),
-	U_BOOT_CMD_MKENT(configure, 3, 0, blkc_configure, "", ""),
+	U_BOOT_CMD_MKENT(configure, 5, 0, blkc_configure, "", ""),
 };
 
 static int do_blkcache(struct cmd_tbl *cmdtp, int flag,
@@ -67,9 +111,10 @@ static int do_blkcache(struct cmd_tbl *cmdtp, int flag,
 }
 
 U_BOOT_CMD(
-	blkcache, 4, 0, do_blkcache,
+	blkcache, 6, 0, do_blkcache,
 	"block cache diagnostics and control",
 	"show - show and reset statistics\n"
-	"blkcache configure <blocks> <entries> "
-	"- set max blocks per entry and max cache entries\n"
+	"blkcache configure <bytes> [<ways> [<blocks> [<devbytes>]]]\n"
+	"    - set cache capacity, associativity, largest cached read in\n"
+	"      blocks and max bytes per device (0 for no limit)\n"
 );
@@ -5,6 +5,7 @@
  * Inspired by cmd_ext_common.c, cmd_fat.c.
  */
 
+#include <blk.h>
 #include <command.h>
 #include <fs.h>
 
@@ -152,3 +153,45 @@ U_BOOT_CMD(
 	"    - renames/moves a file/directory in 'dev' on 'interface' from\n"
 	"      'old_path' to 'new_path'"
 );
+
+#if IS_ENABLED(CONFIG_FS_MOUNT_CACHE)
+static int do_fs_cache(struct cmd_tbl *cmdtp, int flag, int argc,
+		       char *const argv[])
+{
+	struct fs_cache_stats stats;
+
+	if (argc == 2 && !strcmp(argv[1], "flush")) {
+		fs_cache_invalidate(NULL);
+		return CMD_RET_SUCCESS;
+	}
+	if (argc == 2 && (!strcmp(argv[1], "on") || !strcmp(argv[1], "off"))) {
+		fs_cache_enable(!strcmp(argv[1], "on"));
+		return CMD_RET_SUCCESS;
+	}
+	if (argc != 1)
+		return CMD_RET_USAGE;
+
+	fs_cache_get_stats(&stats);
+	if (stats.desc)
+		printf("mounted: %s on %s %d:%d\n", stats.fstype_name,
+		       blk_get_uclass_name(stats.desc->uclass_id),
+		       stats.desc->devnum, stats.part);
+	else
+		printf("mounted: none\n");
+	printf("hits: %lu\n"
+	       "misses: %lu\n"
+	       "invalidations: %lu\n",
+	       stats.hits, stats.misses, stats.invalidations);
+
+	return CMD_RET_SUCCESS;
+}
+
+U_BOOT_LONGHELP(fs,
+	"cache - show the filesystem kept mounted and the cache statistics\n"
+	"fs cache flush - close the filesystem kept mounted\n"
+	"fs cache on|off - keep filesystems mounted, or close them after each\n"
+	"    access");
+
+U_BOOT_CMD_WITH_SUBCMDS(fs, "filesystem mount cache", fs_help_text,
+	U_BOOT_SUBCMD_MKENT(cache, 2, 1, do_fs_cache));
+#endif
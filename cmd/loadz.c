@@ -0,0 +1,268 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Load a compressed image from a filesystem, decompressing it on the fly
+ */
+
+#include <command.h>
+#include <env.h>
+#include <fs.h>
+#include <hash.h>
+#include <image.h>
+#include <log.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <time.h>
+#include <vsprintf.h>
+#include <asm/unaligned.h>
+#include <linux/errno.h>
+#include <linux/libfdt.h>
+
+static long loadz_read(struct image_stream *strm, void *buf, ulong offset,
+		       ulong len)
+{
+	const char *filename = strm->priv;
+	loff_t actread;
+
+	if (fs_read(filename, map_to_sysmem(buf), offset, len, &actread))
+		return -EIO;
+
+	return actread;
+}
+
+/*
+ * Set up @strm for the data of a legacy image and the crc32 it must match.
+ * Returns the compression type of the image, or -ve on error
+ */
+static int loadz_legacy(struct image_stream *strm,
+			const struct legacy_img_hdr *hdr, u8 *expect)
+{
+	if (!image_check_hcrc(hdr)) {
+		puts("Bad Header Checksum\n");
+		return -EINVAL;
+	}
+	if (image_check_type(hdr, IH_TYPE_MULTI)) {
+		puts("Multi-file images are not supported\n");
+		return -EPROTONOSUPPORT;
+	}
+	printf("   Image Name:   %.*s\n", IH_NMLEN, image_get_name(hdr));
+
+	strm->offset = image_get_header_size();
+	strm->size = image_get_data_size(hdr);
+	if (hash_lookup_algo("crc32", &strm->algo))
+		strm->algo = NULL;
+	put_unaligned_be32(image_get_dcrc(hdr), expect);
+
+	return image_get_comp(hdr);
+}
+
+/*
+ * Set up @strm for the kernel of the default configuration of a FIT, and the
+ * value of its first hash node. Only the FIT structure is read here, so the
+ * kernel data must be external. With CONFIG_FIT_SIGNATURE the configuration
+ * must pass its required signatures and the kernel must have a hash, as the
+ * data is only checked against that. Returns the compression type of the
+ * kernel, or -ve on error
+ */
+static int loadz_fit(struct image_stream *strm, ulong totalsize,
+		     ulong file_size, u8 *expect)
+{
+	const char *algo_name;
+	int noffset, conf, node, len;
+	int data_offset;
+	u8 comp, *value;
+	void *fit;
+	int ret;
+
+	if (totalsize > file_size)
+		return -EINVAL;
+	fit = malloc(totalsize);
+	if (!fit)
+		return -ENOMEM;
+	ret = loadz_read(strm, fit, 0, totalsize);
+	if (ret != totalsize) {
+		ret = ret < 0 ? ret : -EIO;
+		goto out;
+	}
+	ret = fit_check_format(fit, totalsize);
+	if (ret) {
+		puts("Bad FIT image format\n");
+		goto out;
+	}
+
+	conf = fit_conf_get_node(fit, NULL);
+	if (conf < 0) {
+		puts("No default configuration in FIT\n");
+		ret = conf;
+		goto out;
+	}
+	if (IS_ENABLED(CONFIG_FIT_SIGNATURE)) {
+		puts("   Verifying Hash Integrity ... ");
+		if (fit_config_verify(fit, conf)) {
+			puts("Bad Data Hash\n");
+			ret = -EACCES;
+			goto out;
+		}
+		puts("OK\n");
+	}
+	node = fit_conf_get_prop_node(fit, conf, FIT_KERNEL_PROP,
+				      IH_PHASE_NONE);
+	if (node < 0) {
+		puts("No kernel in default FIT configuration\n");
+		ret = node;
+		goto out;
+	}
+	printf("   Using '%s' kernel subimage\n", fit_get_name(fit, node, NULL));
+
+	if (!fit_image_get_data_position(fit, node, &data_offset)) {
+		strm->offset = data_offset;
+	} else if (!fit_image_get_data_offset(fit, node, &data_offset)) {
+		strm->offset = ALIGN(totalsize, 4) + data_offset;
+	} else {
+		puts("FIT kernel data must be external (mkimage -E)\n");
+		ret = -EPROTONOSUPPORT;
+		goto out;
+	}
+	ret = fit_image_get_data_size(fit, node, &len);
+	if (ret || strm->offset + len > file_size) {
+		puts("Bad FIT kernel data size\n");
+		ret = -EINVAL;
+		goto out;
+	}
+	strm->size = len;
+	if (fit_image_get_comp(fit, node, &comp))
+		comp = IH_COMP_NONE;
+
+	fdt_for_each_subnode(noffset, fit, node) {
+		if (strncmp(fit_get_name(fit, noffset, NULL), FIT_HASH_NODENAME,
+			    strlen(FIT_HASH_NODENAME)))
+			continue;
+		if (fit_image_hash_get_algo(fit, noffset, &algo_name) ||
+		    fit_image_hash_get_value(fit, noffset, &value, &len) ||
+		    hash_lookup_algo(algo_name, &strm->algo) ||
+		    len != strm->algo->digest_size) {
+			strm->algo = NULL;
+			continue;
+		}
+		memcpy(expect, value, len);
+		break;
+	}
+	if (!strm->algo) {
+		if (IS_ENABLED(CONFIG_FIT_SIGNATURE)) {
+			puts("No usable hash in FIT kernel\n");
+			ret = -EACCES;
+			goto out;
+		}
+		puts("   No usable hash, kernel data is not verified\n");
+	}
+	ret = comp;
+out:
+	free(fit);
+
+	return ret;
+}
+
+static int do_loadz(struct cmd_tbl *cmdtp, int flag, int argc,
+		    char *const argv[])
+{
+	struct image_stream strm = {
+		.read = loadz_read,
+	};
+	u8 head[sizeof(struct legacy_img_hdr)] __aligned(8);
+	u8 expect[HASH_MAX_DIGEST_SIZE];
+	ulong addr, max_len, len, time;
+	const char *filename;
+	loff_t size;
+	void *buf;
+	int rcode = CMD_RET_FAILURE;
+	long ret;
+	int comp;
+
+	if (argc < 5 || argc > 6)
+		return CMD_RET_USAGE;
+	addr = hextoul(argv[3], NULL);
+	filename = argv[4];
+	max_len = argc > 5 ? hextoul(argv[5], NULL) : CONFIG_SYS_BOOTM_LEN;
+	strm.priv = (void *)filename;
+
+	if (fs_set_blk_dev(argv[1], argv[2], FS_TYPE_ANY)) {
+		log_err("Can't set block device\n");
+		return CMD_RET_FAILURE;
+	}
+	/* the file is read a window at a time, so do not probe for each one */
+	fs_keep_open(true);
+	if (fs_size(filename, &size) < 0) {
+		log_err("Can't find '%s'\n", filename);
+		goto out;
+	}
+	ret = loadz_read(&strm, head, 0, min_t(loff_t, size, sizeof(head)));
+	if (ret < 0)
+		goto out;
+
+	time = get_timer(0);
+	if (ret == sizeof(head) && image_check_magic((void *)head)) {
+		puts("## Legacy image\n");
+		if (!CONFIG_IS_ENABLED(LEGACY_IMAGE_FORMAT)) {
+			puts("Legacy images are not supported\n");
+			goto out;
+		}
+		comp = loadz_legacy(&strm, (void *)head, expect);
+	} else if (ret >= FDT_V17_SIZE && fdt_magic(head) == FDT_MAGIC) {
+		puts("## FIT image\n");
+		comp = loadz_fit(&strm, fdt_totalsize(head), size, expect);
+	} else {
+		comp = image_decomp_type(head, ret);
+		if (comp == IH_COMP_NONE) {
+			printf("'%s' is not a compressed image\n", filename);
+			goto out;
+		}
+		strm.offset = 0;
+		strm.size = size;
+	}
+	if (comp < 0)
+		goto out;
+
+	printf("   Uncompressing %s data to %lx\n", genimg_get_comp_name(comp),
+	       addr);
+	buf = map_sysmem(addr, max_len);
+	ret = image_decomp_stream(&strm, comp, buf, max_len, &len);
+	unmap_sysmem(buf);
+	time = get_timer(time);
+	if (ret == -ENOBUFS) {
+		printf("Image too large: increase maximum size (> %#lx)\n",
+		       max_len);
+		goto out;
+	} else if (ret) {
+		printf("Decompression error %ld\n", ret);
+		goto out;
+	}
+	if (strm.algo) {
+		printf("   Verifying %s ... ", strm.algo->name);
+		if (memcmp(strm.digest, expect, strm.algo->digest_size)) {
+			puts("Bad Data Hash\n");
+			goto out;
+		}
+		puts("OK\n");
+	}
+
+	printf("%lu bytes read, %lu bytes uncompressed in %lu ms", strm.size,
+	       len, time);
+	printf(" (read %lu ms, decompress %lu ms)\n", strm.read_us / 1000,
+	       strm.decomp_us / 1000);
+
+	env_set_hex("fileaddr", addr);
+	env_set_hex("filesize", len);
+	rcode = CMD_RET_SUCCESS;
+out:
+	fs_keep_open(false);
+
+	return rcode;
+}
+
+U_BOOT_CMD(
+	loadz,	6,	0,	do_loadz,
+	"load a compressed image from a filesystem, decompressing as it is read",
+	"<interface> <dev[:part]> <addr> <filename> [maxsize]\n"
+	"    - read the gzip, lzma, lz4 or zstd compressed kernel in 'filename'\n"
+	"      (raw, legacy image or FIT with external data) and decompress it\n"
+	"      to 'addr' while it is being read"
+);
@@ -8,8 +8,10 @@
 #include <dm/device.h>
 #include <dm/uclass.h>
 #include <net.h>
+#include <net/sink.h>
 #include <linux/compat.h>
 #include <linux/ethtool.h>
+#include <linux/math64.h>
 
 static int do_net_list(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 {
@@ -26,6 +28,22 @@ static int do_net_list(struct cmd_tbl *cmdtp, int flag, int argc, char *const ar
 	return CMD_RET_SUCCESS;
 }
 
+static int do_net_rx_stats(void)
+{
+	const struct net_rx_stats *st = &net_rx_stats;
+	uint per_byte = 0;
+
+	if (st->bytes)
+		per_byte = div64_u64(st->copied * 100, st->bytes);
+
+	printf("  rx_packets: %llu\n", st->packets);
+	printf("  rx_bytes: %llu\n", st->bytes);
+	printf("  rx_copied: %llu (%u.%02u per byte received)\n", st->copied,
+	       per_byte / 100, per_byte % 100);
+
+	return CMD_RET_SUCCESS;
+}
+
 static int do_net_stats(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 {
 	int nstats, err, i, off;
@@ -33,8 +51,11 @@ static int do_net_stats(struct cmd_tbl *cmdtp, int flag, int argc, char *const a
 	u64 *values;
 	u8 *strings;
 
-	if (argc < 2)
-		return CMD_RET_USAGE;
+	if (argc < 2) {
+		if (!IS_ENABLED(CONFIG_NET_LEGACY))
+			return CMD_RET_USAGE;
+		return do_net_rx_stats();
+	}
 
 	err = uclass_get_device_by_name(UCLASS_ETH, argv[1], &dev);
 	if (err) {
@@ -78,9 +99,39 @@ err_free_strings:
 	return CMD_RET_FAILURE;
 }
 
+#if IS_ENABLED(CONFIG_NET_SINK)
+static int do_net_sink(struct cmd_tbl *cmdtp, int flag, int argc,
+		       char *const argv[])
+{
+	int ret;
+
+	if (argc == 1) {
+		net_sink_show();
+		return CMD_RET_SUCCESS;
+	}
+	if (argc == 2) {
+		if (strcmp(argv[1], "off"))
+			return CMD_RET_USAGE;
+		net_sink_disarm();
+		return CMD_RET_SUCCESS;
+	}
+
+	ret = net_sink_arm(argv[1], argv[2], argc > 3 ? argv[3] : NULL);
+	if (ret == -EINVAL) {
+		printf("Invalid SHA-256 digest\n");
+		return CMD_RET_FAILURE;
+	}
+
+	return ret ? CMD_RET_FAILURE : CMD_RET_SUCCESS;
+}
+#endif
+
 static struct cmd_tbl cmd_net[] = {
 	U_BOOT_CMD_MKENT(list, 1, 0, do_net_list, "", ""),
 	U_BOOT_CMD_MKENT(stats, 2, 0, do_net_stats, "", ""),
+#if IS_ENABLED(CONFIG_NET_SINK)
+	U_BOOT_CMD_MKENT(sink, 4, 0, do_net_sink, "", ""),
+#endif
 };
 
 static int do_net(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
@@ -101,6 +152,13 @@ static int do_net(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 	return cp->cmd(cmdtp, flag, argc, argv);
 }
 
-U_BOOT_CMD(net, 3, 1, do_net, "NET sub-system",
+U_BOOT_CMD(net, 5, 1, do_net, "NET sub-system",
 	   "list - list available devices\n"
-	   "net stats <device> - dump statistics for specified device\n");
+	   "net stats [<device>] - dump statistics for specified device, or\n"
+	   "    receive statistics for the last network operation\n"
+#if IS_ENABLED(CONFIG_NET_SINK)
+	   "net sink <interface> <dev[:part]> [<sha256>] - write the next\n"
+	   "    download to a block device, checking its digest if given\n"
+	   "net sink [off] - show or cancel where the next download goes\n"
+#endif
+	   );
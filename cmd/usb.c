@@ -16,9 +16,12 @@
 #include <console.h>
 #include <dm.h>
 #include <dm/uclass-internal.h>
+#include <mapmem.h>
 #include <memalign.h>
+#include <time.h>
 #include <asm/byteorder.h>
 #include <asm/unaligned.h>
+#include <div64.h>
 #include <part.h>
 #include <usb.h>
 
@@ -596,6 +599,40 @@ static void usb_show_info(struct usb_device *udev)
 }
 #endif
 
+#ifdef CONFIG_USB_STORAGE
+static int usb_bench(char *const argv[])
+{
+	phys_addr_t paddr = hextoul(argv[2], NULL);
+	lbaint_t blk = hextoul(argv[3], NULL);
+	ulong cnt = hextoul(argv[4], NULL);
+	struct blk_desc *desc;
+	ulong start, elapsed, n;
+	u64 len;
+	void *vaddr;
+
+	if (blk_get_desc(UCLASS_USB, usb_stor_curr_dev, &desc))
+		return CMD_RET_FAILURE;
+	len = (u64)desc->blksz * cnt;
+	vaddr = map_sysmem(paddr, len);
+	start = timer_get_us();
+	n = blk_dread(desc, blk, cnt, vaddr);
+	elapsed = max(timer_get_us() - start, 1UL);
+	unmap_sysmem(vaddr);
+	if (n != cnt) {
+		printf("%ld blocks read: ERROR\n", n);
+		return CMD_RET_FAILURE;
+	}
+
+	printf("%lu blocks of %lu bytes read in %lu ms, %lukiB/s\n", cnt,
+	       desc->blksz, elapsed / 1000,
+	       (ulong)(lldiv(len * 1000000, elapsed) >> 10));
+	printf("up to %u blocks per command\n",
+	       usb_stor_get_max_xfer_blk(desc));
+
+	return CMD_RET_SUCCESS;
+}
+#endif
+
 /******************************************************************************
  * usb command intepreter
  */
@@ -686,6 +723,11 @@ static int do_usb(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 #ifdef CONFIG_USB_STORAGE
 	if (strncmp(argv[1], "stor", 4) == 0)
 		return usb_stor_info();
+	if (strcmp(argv[1], "bench") == 0) {
+		if (argc != 5)
+			return CMD_RET_USAGE;
+		return usb_bench(argv);
+	}
 
 	return blk_common_cmd(argc, argv, UCLASS_USB, &usb_stor_curr_dev);
 #else
@@ -712,7 +754,9 @@ U_BOOT_CMD(
 	"usb read addr blk# cnt - read `cnt' blocks starting at block `blk#'\n"
 	"    to memory address `addr'\n"
 	"usb write addr blk# cnt - write `cnt' blocks starting at block `blk#'\n"
-	"    from memory address `addr'"
+	"    from memory address `addr'\n"
+	"usb bench addr blk# cnt - read `cnt' blocks like `usb read' and show\n"
+	"    the transfer rate"
 #endif /* CONFIG_USB_STORAGE */
 );
 
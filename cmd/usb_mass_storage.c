@@ -9,28 +9,90 @@
 #include <blk.h>
 #include <command.h>
 #include <console.h>
+#include <display_options.h>
+#include <div64.h>
 #include <errno.h>
 #include <g_dnl.h>
 #include <malloc.h>
 #include <part.h>
+#include <time.h>
 #include <usb.h>
 #include <usb_mass_storage.h>
 #include <watchdog.h>
 #include <linux/delay.h>
 #include <linux/printk.h>
 
+/**
+ * struct ums_stats - what the host transferred, reported at exit
+ *
+ * @bytes_read: Number of bytes read from the storage
+ * @bytes_written: Number of bytes written to the storage
+ * @accesses: Number of storage accesses
+ * @busy_us: Time spent accessing the storage
+ * @elapsed_us: Time from the start of the first access to the end of the last
+ * @last_us: Timer value at the end of the last access
+ */
+struct ums_stats {
+	u64 bytes_read;
+	u64 bytes_written;
+	ulong accesses;
+	u64 busy_us;
+	u64 elapsed_us;
+	ulong last_us;
+};
+
+static struct ums_stats ums_stats;
+
+static void ums_account(u64 *bytes, ulong start_us, int blks, ulong blksz)
+{
+	struct ums_stats *st = &ums_stats;
+	ulong now = timer_get_us();
+
+	if (st->accesses++)
+		st->elapsed_us += now - st->last_us;
+	else
+		st->elapsed_us = now - start_us;
+	st->last_us = now;
+	st->busy_us += now - start_us;
+	if (blks > 0)
+		*bytes += (u64)blks * blksz;
+}
+
+static void ums_show_stats(void)
+{
+	struct ums_stats *st = &ums_stats;
+	u64 elapsed = max_t(u64, st->elapsed_us, 1);
+	u64 speed;
+
+	if (!st->accesses)
+		return;
+
+	speed = lldiv((st->bytes_read + st->bytes_written) * 1000000, elapsed);
+	printf("UMS: ");
+	print_size(st->bytes_read, " read, ");
+	print_size(st->bytes_written, " written in ");
+	printf("%llu ms, %lukiB/s, storage busy %llu%%\n",
+	       lldiv(elapsed, 1000), (unsigned long)(speed >> 10),
+	       lldiv(st->busy_us * 100, elapsed));
+}
+
 static int ums_read_sector(struct ums *ums_dev,
 			   ulong start, lbaint_t blkcnt, void *buf)
 {
 	struct blk_desc *block_dev = &ums_dev->block_dev;
 	lbaint_t blkstart = start + ums_dev->start_sector;
+	ulong start_us;
 	int ret;
 
 	ret = blk_dselect_hwpart(block_dev, ums_dev->hwpart);
 	if (ret && ret != -ENOSYS)
 		return ret;
 
-	return blk_dread(block_dev, blkstart, blkcnt, buf);
+	start_us = timer_get_us();
+	ret = blk_dread(block_dev, blkstart, blkcnt, buf);
+	ums_account(&ums_stats.bytes_read, start_us, ret, block_dev->blksz);
+
+	return ret;
 }
 
 static int ums_write_sector(struct ums *ums_dev,
@@ -38,13 +100,18 @@ static int ums_write_sector(struct ums *ums_dev,
 {
 	struct blk_desc *block_dev = &ums_dev->block_dev;
 	lbaint_t blkstart = start + ums_dev->start_sector;
+	ulong start_us;
 	int ret;
 
 	ret = blk_dselect_hwpart(block_dev, ums_dev->hwpart);
 	if (ret && ret != -ENOSYS)
 		return ret;
 
-	return blk_dwrite(block_dev, blkstart, blkcnt, buf);
+	start_us = timer_get_us();
+	ret = blk_dwrite(block_dev, blkstart, blkcnt, buf);
+	ums_account(&ums_stats.bytes_written, start_us, ret, block_dev->blksz);
+
+	return ret;
 }
 
 static struct ums *ums;
@@ -78,6 +145,7 @@ static int ums_init(const char *devtype, const char *devnums_part_str)
 
 	t = s;
 	ums_count = 0;
+	memset(&ums_stats, '\0', sizeof(ums_stats));
 
 	for (;;) {
 		devnum_part_str = strsep(&t, ",");
@@ -254,6 +322,7 @@ static int do_usb_mass_storage(struct cmd_tbl *cmdtp, int flag,
 	}
 
 cleanup_register:
+	ums_show_stats();
 	g_dnl_unregister();
 cleanup_board:
 	udc_device_put(udc);
@@ -38,6 +38,7 @@ int run_usb_dnl_gadget(int usbctrl_index, char *usb_dnl_gadget)
 		ret = CMD_RET_FAILURE;
 		goto err_detach;
 	}
+	dfu_set_write_queue(true);
 
 #ifdef CONFIG_DFU_TIMEOUT
 	unsigned long start_time = get_timer(0);
@@ -105,8 +106,11 @@ int run_usb_dnl_gadget(int usbctrl_index, char *usb_dnl_gadget)
 
 		schedule();
 		dm_usb_gadget_handle_interrupts(udc);
+		/* write to the medium while the host sends the next blocks */
+		dfu_write_pending();
 	}
 exit:
+	dfu_set_write_queue(false);
 	g_dnl_unregister();
 err_detach:
 	udc_device_put(udc);
@@ -73,6 +73,12 @@ static int usb_max_devs; /* number of highest available usb device */
 static struct blk_desc usb_dev_desc[USB_MAX_STOR_DEV];
 #endif
 
+#ifdef CONFIG_USB_STORAGE_SS_MAX_XFER_BLK
+#define USB_STOR_SS_MAX_XFER_BLK	CONFIG_USB_STORAGE_SS_MAX_XFER_BLK
+#else
+#define USB_STOR_SS_MAX_XFER_BLK	240
+#endif
+
 struct us_data;
 typedef int (*trans_cmnd)(struct scsi_cmd *cb, struct us_data *data);
 typedef int (*trans_reset)(struct us_data *data);
@@ -100,6 +106,7 @@ struct us_data {
 	trans_reset	transport_reset;	/* reset routine */
 	trans_cmnd	transport;		/* transport routine */
 	unsigned short	max_xfer_blk;		/* maximum transfer blocks */
+	size_t		max_xfer_size;		/* HCD's maximum transfer bytes */
 	bool		cmd12;			/* use 12-byte commands (RBC/UFI) */
 };
 
@@ -971,19 +978,50 @@ static void usb_stor_set_max_xfer_blk(struct usb_device *udev,
 	 * Windows 7 limiting transfers to 128 sectors for both USB2 and USB3
 	 * and Apple Mac OS X 10.11 limiting transfers to 256 sectors for USB2
 	 * and 2048 for USB3 devices.
+	 *
+	 * SuperSpeed devices are recent enough not to have this problem and
+	 * need larger transfers to get anywhere near their bandwidth, so
+	 * follow Mac OS X for them.
 	 */
 	unsigned short blk = 240;
+	size_t size = SIZE_MAX;
 
-#if CONFIG_IS_ENABLED(DM_USB)
-	size_t size;
-	int ret;
+	if (udev->speed >= USB_SPEED_SUPER)
+		blk = USB_STOR_SS_MAX_XFER_BLK;
 
-	ret = usb_get_max_xfer_size(udev, (size_t *)&size);
-	if ((ret >= 0) && (size < blk * 512))
-		blk = size / 512;
+#if CONFIG_IS_ENABLED(DM_USB)
+	if (usb_get_max_xfer_size(udev, &size) < 0)
+		size = SIZE_MAX;
 #endif
 
 	us->max_xfer_blk = blk;
+	us->max_xfer_size = size;
+}
+
+/*
+ * Get the maximum number of blocks in one transfer. The limit of the HCD is
+ * in bytes, so it depends on the block size, which can differ between LUNs.
+ */
+static unsigned short usb_stor_max_blks(struct us_data *us, ulong blksz)
+{
+	size_t blks = us->max_xfer_size / blksz;
+
+	return clamp_t(size_t, blks, 1, us->max_xfer_blk);
+}
+
+unsigned int usb_stor_get_max_xfer_blk(struct blk_desc *desc)
+{
+	struct usb_device *udev;
+
+#if CONFIG_IS_ENABLED(BLK)
+	udev = dev_get_parent_priv(dev_get_parent(desc->bdev));
+#else
+	udev = usb_dev_desc[desc->devnum].priv;
+#endif
+	if (!udev || !udev->privptr)
+		return 0;
+
+	return usb_stor_max_blks(udev->privptr, desc->blksz);
 }
 
 static int usb_inquiry(struct scsi_cmd *srb, struct us_data *ss)
@@ -1146,7 +1184,7 @@ static unsigned long usb_stor_read(struct blk_desc *block_dev, lbaint_t blknr,
 {
 	lbaint_t start, blks;
 	uintptr_t buf_addr;
-	unsigned short smallblks;
+	unsigned short smallblks, max_blks;
 	struct usb_device *udev;
 	struct us_data *ss;
 	int retry;
@@ -1171,6 +1209,7 @@ static unsigned long usb_stor_read(struct blk_desc *block_dev, lbaint_t blknr,
 	}
 #endif
 	ss = (struct us_data *)udev->privptr;
+	max_blks = usb_stor_max_blks(ss, block_dev->blksz);
 
 	usb_disable_asynch(1); /* asynch transfer not allowed */
 	usb_lock_async(udev, 1);
@@ -1186,12 +1225,12 @@ static unsigned long usb_stor_read(struct blk_desc *block_dev, lbaint_t blknr,
 		/* XXX need some comment here */
 		retry = 2;
 		srb->pdata = (unsigned char *)buf_addr;
-		if (blks > ss->max_xfer_blk)
-			smallblks = ss->max_xfer_blk;
+		if (blks > max_blks)
+			smallblks = max_blks;
 		else
 			smallblks = (unsigned short) blks;
 retry_it:
-		if (smallblks == ss->max_xfer_blk)
+		if (smallblks == max_blks)
 			usb_show_progress();
 		srb->datalen = block_dev->blksz * smallblks;
 		srb->pdata = (unsigned char *)buf_addr;
@@ -1214,7 +1253,7 @@ retry_it:
 
 	usb_lock_async(udev, 0);
 	usb_disable_asynch(0); /* asynch transfer allowed */
-	if (blkcnt >= ss->max_xfer_blk)
+	if (blkcnt >= max_blks)
 		debug("\n");
 	return blkcnt;
 }
@@ -1229,7 +1268,7 @@ static unsigned long usb_stor_write(struct blk_desc *block_dev, lbaint_t blknr,
 {
 	lbaint_t start, blks;
 	uintptr_t buf_addr;
-	unsigned short smallblks;
+	unsigned short smallblks, max_blks;
 	struct usb_device *udev;
 	struct us_data *ss;
 	int retry;
@@ -1255,6 +1294,7 @@ static unsigned long usb_stor_write(struct blk_desc *block_dev, lbaint_t blknr,
 	}
 #endif
 	ss = (struct us_data *)udev->privptr;
+	max_blks = usb_stor_max_blks(ss, block_dev->blksz);
 
 	usb_disable_asynch(1); /* asynch transfer not allowed */
 	usb_lock_async(udev, 1);
@@ -1273,12 +1313,12 @@ static unsigned long usb_stor_write(struct blk_desc *block_dev, lbaint_t blknr,
 		 */
 		retry = 2;
 		srb->pdata = (unsigned char *)buf_addr;
-		if (blks > ss->max_xfer_blk)
-			smallblks = ss->max_xfer_blk;
+		if (blks > max_blks)
+			smallblks = max_blks;
 		else
 			smallblks = (unsigned short) blks;
 retry_it:
-		if (smallblks == ss->max_xfer_blk)
+		if (smallblks == max_blks)
 			usb_show_progress();
 		srb->datalen = block_dev->blksz * smallblks;
 		srb->pdata = (unsigned char *)buf_addr;
@@ -1301,7 +1341,7 @@ retry_it:
 
 	usb_lock_async(udev, 0);
 	usb_disable_asynch(0); /* asynch transfer allowed */
-	if (blkcnt >= ss->max_xfer_blk)
+	if (blkcnt >= max_blks)
 		debug("\n");
 	return blkcnt;
 
@@ -8,6 +8,7 @@
 #include <command.h>
 #include <env.h>
 #include <errno.h>
+#include <fs.h>
 #include <log.h>
 #include <malloc.h>
 #include <part.h>
@@ -281,7 +282,8 @@ void dev_print(struct blk_desc *desc)
 	}
 }
 
-void part_init(struct blk_desc *desc)
+/* Find the partition table again, when the medium itself has not changed */
+static void part_rescan(struct blk_desc *desc)
 {
 	struct part_driver *drv =
 		ll_entry_start(struct part_driver, part_driver);
@@ -289,6 +291,7 @@ void part_init(struct blk_desc *desc)
 	struct part_driver *entry;
 
 	blkcache_invalidate(desc->uclass_id, desc->devnum);
+	blk_readahead_invalidate(desc);
 
 	if (desc->part_type != PART_TYPE_UNKNOWN) {
 		for (entry = drv; entry != drv + n_ents; entry++) {
@@ -310,6 +313,13 @@ void part_init(struct blk_desc *desc)
 	}
 }
 
+void part_init(struct blk_desc *desc)
+{
+	/* the medium may have changed under a filesystem kept mounted */
+	fs_cache_invalidate(desc);
+	part_rescan(desc);
+}
+
 static void print_part_header(const char *type, struct blk_desc *desc)
 {
 #if CONFIG_IS_ENABLED(MAC_PARTITION) || \
@@ -439,10 +449,11 @@ int blk_get_device_by_str(const char *ifname, const char *dev_hwpart_str,
 		/*
 		 * Updates the partition table for the specified hw partition.
 		 * Always should be done, otherwise hw partition 0 will return
-		 * stale data after displaying a non-zero hw partition.
+		 * stale data after displaying a non-zero hw partition. The
+		 * medium is the same, so a mounted filesystem can be kept.
 		 */
 		if ((*desc)->uclass_id == UCLASS_MMC)
-			part_init(*desc);
+			part_rescan(*desc);
 	}
 
 cleanup:
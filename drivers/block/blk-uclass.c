@@ -8,8 +8,10 @@
 
 #include <blk.h>
 #include <dm.h>
+#include <fs.h>
 #include <log.h>
 #include <malloc.h>
+#include <memalign.h>
 #include <part.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
@@ -321,6 +323,7 @@ int blk_show_device(enum uclass_id uclass_id, int devnum)
 
 int blk_select_hwpart(struct udevice *dev, int hwpart)
 {
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
 	const struct blk_ops *ops = blk_get_ops(dev);
 
 	if (!ops)
@@ -328,6 +331,10 @@ int blk_select_hwpart(struct udevice *dev, int hwpart)
 	if (!ops->select_hwpart)
 		return 0;
 
+	blk_readahead_invalidate(desc);
+	if (hwpart != desc->hwpart)
+		fs_cache_invalidate(desc);
+
 	return ops->select_hwpart(dev, hwpart);
 }
 
@@ -429,19 +436,13 @@ static int blk_buffer_aligned(struct bounce_buffer *state)
 	return 1;	/* Default, any buffer is OK */
 }
 
-long blk_read(struct udevice *dev, lbaint_t start, lbaint_t blkcnt, void *buf)
+static long blk_read_dev(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
+			 void *buf)
 {
 	struct blk_desc *desc = dev_get_uclass_plat(dev);
 	const struct blk_ops *ops = blk_get_ops(dev);
 	ulong blks_read;
 
-	if (!ops->read)
-		return -ENOSYS;
-
-	if (blkcache_read(desc->uclass_id, desc->devnum,
-			  start, blkcnt, desc->blksz, buf))
-		return blkcnt;
-
 	if (IS_ENABLED(CONFIG_BOUNCE_BUFFER) && desc->bb) {
 		struct blk_bounce_buffer bbstate = { .dev = dev };
 		int ret;
@@ -460,6 +461,143 @@ long blk_read(struct udevice *dev, lbaint_t start, lbaint_t blkcnt, void *buf)
 		blks_read = ops->read(dev, start, blkcnt, buf);
 	}
 
+	return blks_read;
+}
+
+#if CONFIG_IS_ENABLED(BLK_READAHEAD)
+/**
+ * struct blk_readahead - read-ahead state of a block device
+ *
+ * This is the uclass-private data of each block device.
+ *
+ * @next: Block following the previous read, to detect sequential access
+ * @start: First block held in @buf
+ * @count: Number of valid blocks in @buf, 0 if the window is empty
+ * @buf: Read-ahead window of CONFIG_BLK_READAHEAD_SIZE bytes, allocated on
+ *	first use
+ * @stats: Read-ahead statistics
+ */
+struct blk_readahead {
+	lbaint_t next;
+	lbaint_t start;
+	lbaint_t count;
+	void *buf;
+	struct blk_readahead_stats stats;
+};
+
+/*
+ * Read blocks, serving them from the read-ahead window where possible. Once a
+ * read follows on from the previous one, a whole window is read from the
+ * device with a single request and later reads are copied out of it, so the
+ * device sees a few large transfers instead of many small ones.
+ */
+static long blk_read_ahead(struct udevice *dev, lbaint_t start,
+			   lbaint_t blkcnt, void *buf)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	struct blk_readahead *ra = dev_get_uclass_priv(dev);
+	lbaint_t window = CONFIG_BLK_READAHEAD_SIZE / desc->blksz;
+	bool sequential = start == ra->next;
+	lbaint_t done = 0, count;
+	long ret;
+
+	ra->next = start + blkcnt;
+
+	if (ra->count && start >= ra->start && start < ra->start + ra->count) {
+		count = min(blkcnt, ra->start + ra->count - start);
+		memcpy(buf, ra->buf + (start - ra->start) * desc->blksz,
+		       count * desc->blksz);
+		ra->stats.used += count;
+		done = count;
+		start += count;
+		blkcnt -= count;
+		buf += count * desc->blksz;
+		if (!blkcnt)
+			return done;
+	}
+
+	if (desc->lba && start + window > desc->lba)
+		window = desc->lba > start ? desc->lba - start : 0;
+	if (!sequential || blkcnt >= window)
+		goto direct;
+
+	if (!ra->buf) {
+		ra->buf = memalign(ARCH_DMA_MINALIGN, CONFIG_BLK_READAHEAD_SIZE);
+		if (!ra->buf)
+			goto direct;
+	}
+
+	ra->count = 0;
+	ret = blk_read_dev(dev, start, window, ra->buf);
+	if (ret < 0 || (lbaint_t)ret < blkcnt) {
+		log_debug("read-ahead of " LBAFU " blocks at " LBAF " failed\n",
+			  window, start);
+		goto direct;
+	}
+	ra->start = start;
+	ra->count = ret;
+	ra->stats.windows++;
+	ra->stats.fetched += ret - blkcnt;
+	memcpy(buf, ra->buf, blkcnt * desc->blksz);
+
+	return done + blkcnt;
+
+direct:
+	ret = blk_read_dev(dev, start, blkcnt, buf);
+	if (ret < 0)
+		return done ? done : ret;
+
+	return done + ret;
+}
+
+void blk_readahead_invalidate(struct blk_desc *desc)
+{
+	struct blk_readahead *ra;
+
+	if (!desc->bdev || !device_active(desc->bdev))
+		return;
+
+	ra = dev_get_uclass_priv(desc->bdev);
+	ra->count = 0;
+	ra->next = 0;
+}
+
+int blk_readahead_stats(struct udevice *dev, struct blk_readahead_stats *stats,
+			bool reset)
+{
+	struct blk_readahead *ra;
+
+	if (!device_active(dev))
+		return -EAGAIN;
+
+	ra = dev_get_uclass_priv(dev);
+	*stats = ra->stats;
+	if (reset)
+		memset(&ra->stats, '\0', sizeof(ra->stats));
+
+	return 0;
+}
+#endif /* BLK_READAHEAD */
+
+long blk_read(struct udevice *dev, lbaint_t start, lbaint_t blkcnt, void *buf)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	const struct blk_ops *ops = blk_get_ops(dev);
+	long blks_read;
+
+	if (!ops->read)
+		return -ENOSYS;
+
+	if (blkcache_read(desc->uclass_id, desc->devnum,
+			  start, blkcnt, desc->blksz, buf))
+		return blkcnt;
+
+#if CONFIG_IS_ENABLED(BLK_READAHEAD)
+	blks_read = blk_read_ahead(dev, start, blkcnt, buf);
+#else
+	blks_read = blk_read_dev(dev, start, blkcnt, buf);
+#endif
+
 	if (blks_read == blkcnt)
 		blkcache_fill(desc->uclass_id, desc->devnum, start, blkcnt,
 			      desc->blksz, buf);
@@ -477,7 +615,8 @@ long blk_write(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
 	if (!ops->write)
 		return -ENOSYS;
 
-	blkcache_invalidate(desc->uclass_id, desc->devnum);
+	blk_readahead_invalidate(desc);
+	fs_cache_invalidate(desc);
 
 	if (IS_ENABLED(CONFIG_BOUNCE_BUFFER) && desc->bb) {
 		struct blk_bounce_buffer bbstate = { .dev = dev };
@@ -498,6 +637,13 @@ long blk_write(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
 		blks_written = ops->write(dev, start, blkcnt, buf);
 	}
 
+	/* write through, so that cached blocks stay valid */
+	if (blks_written == blkcnt)
+		blkcache_write(desc->uclass_id, desc->devnum, start, blkcnt,
+			       desc->blksz, buf);
+	else
+		blkcache_invalidate(desc->uclass_id, desc->devnum);
+
 	return blks_written;
 }
 
@@ -510,6 +656,8 @@ long blk_erase(struct udevice *dev, lbaint_t start, lbaint_t blkcnt)
 		return -ENOSYS;
 
 	blkcache_invalidate(desc->uclass_id, desc->devnum);
+	blk_readahead_invalidate(desc);
+	fs_cache_invalidate(desc);
 
 	return ops->erase(dev, start, blkcnt);
 }
@@ -841,9 +989,27 @@ static int blk_post_probe(struct udevice *dev)
 	return 0;
 }
 
+static int blk_pre_remove(struct udevice *dev)
+{
+#if CONFIG_IS_ENABLED(BLK_READAHEAD)
+	struct blk_readahead *ra = dev_get_uclass_priv(dev);
+
+	free(ra->buf);
+	ra->buf = NULL;
+	ra->count = 0;
+#endif
+	fs_cache_invalidate(dev_get_uclass_plat(dev));
+
+	return 0;
+}
+
 UCLASS_DRIVER(blk) = {
 	.id		= UCLASS_BLK,
 	.name		= "blk",
 	.post_probe	= blk_post_probe,
+	.pre_remove	= blk_pre_remove,
+#if CONFIG_IS_ENABLED(BLK_READAHEAD)
+	.per_device_auto	= sizeof(struct blk_readahead),
+#endif
 	.per_device_plat_auto	= sizeof(struct blk_desc),
 };
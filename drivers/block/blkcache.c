@@ -10,65 +10,264 @@
 #include <part.h>
 #include <asm/global_data.h>
 #include <linux/ctype.h>
+#include <linux/err.h>
 #include <linux/list.h>
+#include <linux/log2.h>
 
-struct block_cache_node {
+/* Smallest block size used to size the set array */
+#define BLKCACHE_MIN_BLKSZ	512
+
+/**
+ * struct block_cache_dev - per-device accounting of the block cache
+ *
+ * @lh: entry in the block_cache_devs list
+ * @iftype: uclass ID of the device
+ * @devnum: device number within that uclass
+ * @entries: number of blocks cached for this device
+ * @bytes: number of bytes cached for this device
+ * @hits: number of reads satisfied from the cache
+ * @misses: number of reads passed on to the device
+ */
+struct block_cache_dev {
 	struct list_head lh;
 	int iftype;
 	int devnum;
+	unsigned entries;
+	ulong bytes;
+	unsigned hits;
+	unsigned misses;
+};
+
+/**
+ * struct block_cache_node - a single cached block
+ *
+ * @lh: entry in the list for its set, in MRU order
+ * @dev: device this block belongs to
+ * @start: block number
+ * @blksz: size of the block in bytes
+ * @cache: block data
+ */
+struct block_cache_node {
+	struct list_head lh;
+	struct block_cache_dev *dev;
 	lbaint_t start;
-	lbaint_t blkcnt;
 	unsigned long blksz;
-	char *cache;
+	char cache[];
 };
 
-static LIST_HEAD(block_cache);
+static LIST_HEAD(block_cache_devs);
+
+/* Array of _stats.sets lists, each holding up to _stats.ways nodes */
+static struct list_head *block_cache;
 
 static struct block_cache_stats _stats = {
-	.max_blocks_per_entry = 8,
-	.max_entries = 32
+	.max_bytes = CONFIG_BLOCK_CACHE_SIZE,
+	.ways = CONFIG_BLOCK_CACHE_WAYS,
+	.max_blocks = 32,
 };
 
-static struct block_cache_node *cache_find(int iftype, int devnum,
-					   lbaint_t start, lbaint_t blkcnt,
-					   unsigned long blksz)
+static uint cache_set(struct block_cache_dev *dev, lbaint_t start)
+{
+	u64 key;
+
+	if (_stats.sets < 2)
+		return 0;
+
+	key = (u64)start ^ ((u64)dev->devnum << 40) ^ ((u64)dev->iftype << 52);
+
+	/* Fibonacci hashing, so that adjacent blocks land in different sets */
+	return (key * 0x61c8864680b583ebULL) >> (64 - ilog2(_stats.sets));
+}
+
+static uint cache_sets(void)
+{
+	ulong sets;
+
+	if (!_stats.max_bytes || !_stats.ways)
+		return 0;
+	sets = max(_stats.max_bytes / (_stats.ways * BLKCACHE_MIN_BLKSZ), 1UL);
+
+	return rounddown_pow_of_two(sets);
+}
+
+static int cache_setup(void)
+{
+	uint i;
+
+	if (block_cache)
+		return 0;
+
+	_stats.sets = cache_sets();
+	if (!_stats.sets)
+		return -ENOSPC;
+	block_cache = malloc(_stats.sets * sizeof(*block_cache));
+	if (!block_cache)
+		return -ENOMEM;
+	for (i = 0; i < _stats.sets; i++)
+		INIT_LIST_HEAD(&block_cache[i]);
+
+	return 0;
+}
+
+static struct block_cache_dev *cache_get_dev(int iftype, int devnum,
+					     bool create)
 {
+	struct block_cache_dev *dev;
+
+	list_for_each_entry(dev, &block_cache_devs, lh)
+		if (dev->iftype == iftype && dev->devnum == devnum)
+			return dev;
+	if (!create)
+		return NULL;
+
+	dev = calloc(1, sizeof(*dev));
+	if (!dev)
+		return NULL;
+	dev->iftype = iftype;
+	dev->devnum = devnum;
+	list_add_tail(&dev->lh, &block_cache_devs);
+
+	return dev;
+}
+
+static struct block_cache_node *cache_find(struct block_cache_dev *dev,
+					   lbaint_t start, unsigned long blksz)
+{
+	struct list_head *set = &block_cache[cache_set(dev, start)];
 	struct block_cache_node *node;
 
-	list_for_each_entry(node, &block_cache, lh)
-		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum) &&
-		    (node->blksz == blksz) &&
-		    (node->start <= start) &&
-		    (node->start + node->blkcnt >= start + blkcnt)) {
-			if (block_cache.next != &node->lh) {
+	list_for_each_entry(node, set, lh)
+		if (node->dev == dev && node->start == start &&
+		    node->blksz == blksz) {
+			if (set->next != &node->lh) {
 				/* maintain MRU ordering */
 				list_del(&node->lh);
-				list_add(&node->lh, &block_cache);
+				list_add(&node->lh, set);
 			}
 			return node;
 		}
-	return 0;
+
+	return NULL;
+}
+
+static void cache_remove(struct block_cache_node *node)
+{
+	list_del(&node->lh);
+	node->dev->entries--;
+	node->dev->bytes -= node->blksz;
+	_stats.entries--;
+	_stats.bytes -= node->blksz;
+}
+
+/*
+ * Pick a node to evict from @set so that a block of @blksz for @dev fits,
+ * honouring the associativity, the capacity and the per-device limit. The
+ * LRU node of the set is chosen, restricted to @dev's nodes when @dev is over
+ * its share. Returns NULL if the set is not full and nothing needs evicting,
+ * or ERR_PTR(-ENOSPC) if room cannot be made in this set.
+ */
+static struct block_cache_node *cache_victim(struct list_head *set,
+					     struct block_cache_dev *dev,
+					     unsigned long blksz)
+{
+	struct block_cache_node *node;
+	bool dev_full;
+	uint count = 0;
+
+	list_for_each_entry(node, set, lh)
+		count++;
+
+	dev_full = _stats.max_dev_bytes &&
+		   dev->bytes + blksz > _stats.max_dev_bytes;
+	if (count < _stats.ways && !dev_full &&
+	    _stats.bytes + blksz <= _stats.max_bytes)
+		return NULL;
+
+	list_for_each_entry_reverse(node, set, lh)
+		if (!dev_full || node->dev == dev)
+			return node;
+
+	return ERR_PTR(-ENOSPC);
+}
+
+static void cache_insert(struct block_cache_dev *dev, lbaint_t start,
+			 unsigned long blksz, const void *buffer)
+{
+	struct list_head *set = &block_cache[cache_set(dev, start)];
+	struct block_cache_node *node, *spare = NULL;
+
+	node = cache_find(dev, start, blksz);
+	if (node) {
+		memcpy(node->cache, buffer, blksz);
+		return;
+	}
+
+	while ((node = cache_victim(set, dev, blksz))) {
+		if (IS_ERR(node)) {
+			free(spare);
+			return;
+		}
+		debug("drop: start " LBAF "\n", node->start);
+		cache_remove(node);
+		_stats.evictions++;
+		if (!spare && node->blksz == blksz)
+			spare = node;
+		else
+			free(node);
+	}
+
+	node = spare;
+	if (!node) {
+		node = malloc(sizeof(*node) + blksz);
+		if (!node)
+			return;
+	}
+
+	node->dev = dev;
+	node->start = start;
+	node->blksz = blksz;
+	memcpy(node->cache, buffer, blksz);
+	list_add(&node->lh, set);
+	dev->entries++;
+	dev->bytes += blksz;
+	_stats.entries++;
+	_stats.bytes += blksz;
 }
 
 int blkcache_read(int iftype, int devnum,
 		  lbaint_t start, lbaint_t blkcnt,
 		  unsigned long blksz, void *buffer)
 {
-	struct block_cache_node *node = cache_find(iftype, devnum, start,
-						   blkcnt, blksz);
-	if (node) {
-		const char *src = node->cache + (start - node->start) * blksz;
-		memcpy(buffer, src, blksz * blkcnt);
-		debug("hit: start " LBAF ", count " LBAFU "\n",
-		      start, blkcnt);
-		++_stats.hits;
-		return 1;
+	struct block_cache_dev *dev = NULL;
+	struct block_cache_node *node;
+	lbaint_t i;
+
+	if (!block_cache || blkcnt > _stats.max_blocks)
+		goto miss;
+
+	dev = cache_get_dev(iftype, devnum, true);
+	if (!dev)
+		goto miss;
+
+	for (i = 0; i < blkcnt; i++) {
+		node = cache_find(dev, start + i, blksz);
+		if (!node)
+			goto miss;
+		memcpy(buffer + i * blksz, node->cache, blksz);
 	}
 
+	debug("hit: start " LBAF ", count " LBAFU "\n",
+	      start, blkcnt);
+	++_stats.hits;
+	++dev->hits;
+	return 1;
+
+miss:
 	debug("miss: start " LBAF ", count " LBAFU "\n",
 	      start, blkcnt);
 	++_stats.misses;
+	if (dev)
+		++dev->misses;
 	return 0;
 }
 
@@ -76,95 +275,131 @@ void blkcache_fill(int iftype, int devnum,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer)
 {
-	lbaint_t bytes;
-	struct block_cache_node *node;
+	struct block_cache_dev *dev;
+	lbaint_t i;
 
 	/* don't cache big stuff */
-	if (blkcnt > _stats.max_blocks_per_entry)
+	if (blkcnt > _stats.max_blocks)
 		return;
 
-	if (_stats.max_entries == 0)
+	if (cache_setup())
 		return;
 
-	bytes = blksz * blkcnt;
-	if (_stats.max_entries <= _stats.entries) {
-		/* pop LRU */
-		node = (struct block_cache_node *)block_cache.prev;
-		list_del(&node->lh);
-		_stats.entries--;
-		debug("drop: start " LBAF ", count " LBAFU "\n",
-		      node->start, node->blkcnt);
-		if (node->blkcnt * node->blksz < bytes) {
-			free(node->cache);
-			node->cache = 0;
-		}
-	} else {
-		node = malloc(sizeof(*node));
-		if (!node)
-			return;
-		node->cache = 0;
-	}
-
-	if (!node->cache) {
-		node->cache = malloc(bytes);
-		if (!node->cache) {
-			free(node);
-			return;
-		}
-	}
+	dev = cache_get_dev(iftype, devnum, true);
+	if (!dev)
+		return;
 
 	debug("fill: start " LBAF ", count " LBAFU "\n",
 	      start, blkcnt);
 
-	node->iftype = iftype;
-	node->devnum = devnum;
-	node->start = start;
-	node->blkcnt = blkcnt;
-	node->blksz = blksz;
-	memcpy(node->cache, buffer, bytes);
-	list_add(&node->lh, &block_cache);
-	_stats.entries++;
+	for (i = 0; i < blkcnt; i++)
+		cache_insert(dev, start + i, blksz, buffer + i * blksz);
 }
 
-void blkcache_invalidate(int iftype, int devnum)
+void blkcache_write(int iftype, int devnum,
+		    lbaint_t start, lbaint_t blkcnt,
+		    unsigned long blksz, void const *buffer)
 {
-	struct list_head *entry, *n;
+	struct block_cache_dev *dev;
 	struct block_cache_node *node;
+	lbaint_t i;
+
+	dev = cache_get_dev(iftype, devnum, false);
+	if (!block_cache || !dev || !dev->entries)
+		return;
+
+	for (i = 0; i < blkcnt; i++) {
+		node = cache_find(dev, start + i, blksz);
+		if (node) {
+			memcpy(node->cache, buffer + i * blksz, blksz);
+			_stats.writes++;
+		}
+	}
+}
+
+void blkcache_invalidate(int iftype, int devnum)
+{
+	struct block_cache_node *node, *n;
+	struct block_cache_dev *dev, *dn;
+	uint i;
 
-	list_for_each_safe(entry, n, &block_cache) {
-		node = (struct block_cache_node *)entry;
+	for (i = 0; block_cache && i < _stats.sets; i++) {
+		list_for_each_entry_safe(node, n, &block_cache[i], lh) {
+			if (iftype == -1 ||
+			    (node->dev->iftype == iftype &&
+			     node->dev->devnum == devnum)) {
+				cache_remove(node);
+				free(node);
+			}
+		}
+	}
+
+	list_for_each_entry_safe(dev, dn, &block_cache_devs, lh) {
 		if (iftype == -1 ||
-		    (node->iftype == iftype && node->devnum == devnum)) {
-			list_del(entry);
-			free(node->cache);
-			free(node);
-			--_stats.entries;
+		    (dev->iftype == iftype && dev->devnum == devnum)) {
+			list_del(&dev->lh);
+			free(dev);
 		}
 	}
 }
 
-void blkcache_configure(unsigned blocks, unsigned entries)
+void blkcache_configure(ulong max_bytes, unsigned ways, unsigned max_blocks,
+			ulong max_dev_bytes)
 {
-	/* invalidate cache if there is a change */
-	if ((blocks != _stats.max_blocks_per_entry) ||
-	    (entries != _stats.max_entries))
-		blkcache_invalidate(-1, 0);
+	/* drop the cache if its geometry changes */
+	if (max_bytes != _stats.max_bytes || ways != _stats.ways)
+		blkcache_free();
 
-	_stats.max_blocks_per_entry = blocks;
-	_stats.max_entries = entries;
+	_stats.max_bytes = max_bytes;
+	_stats.ways = ways;
+	_stats.max_blocks = max_blocks;
+	_stats.max_dev_bytes = max_dev_bytes;
 
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.evictions = 0;
+	_stats.writes = 0;
 }
 
 void blkcache_stats(struct block_cache_stats *stats)
 {
 	memcpy(stats, &_stats, sizeof(*stats));
+	if (!block_cache)
+		stats->sets = cache_sets();
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.evictions = 0;
+	_stats.writes = 0;
+}
+
+int blkcache_dev_stats(int idx, struct block_cache_dev_stats *stats,
+		       bool reset)
+{
+	struct block_cache_dev *dev;
+
+	list_for_each_entry(dev, &block_cache_devs, lh) {
+		if (idx--)
+			continue;
+		stats->iftype = dev->iftype;
+		stats->devnum = dev->devnum;
+		stats->entries = dev->entries;
+		stats->bytes = dev->bytes;
+		stats->hits = dev->hits;
+		stats->misses = dev->misses;
+		if (reset) {
+			dev->hits = 0;
+			dev->misses = 0;
+		}
+		return 0;
+	}
+
+	return -ENOENT;
 }
 
 void blkcache_free(void)
 {
 	blkcache_invalidate(-1, 0);
+	free(block_cache);
+	block_cache = NULL;
+	_stats.sets = 0;
 }
@@ -26,6 +26,7 @@
 #include <dm/pinctrl.h>
 #include <dm/platdata.h>
 #include <dm/read.h>
+#include <dm/root.h>
 #include <dm/uclass.h>
 #include <dm/uclass-internal.h>
 #include <dm/util.h>
@@ -56,6 +57,10 @@ static int device_bind_common(struct udevice *parent, const struct driver *drv,
 	if (!name)
 		return -EINVAL;
 
+	/*
+	 * This binds any nodes of the uclass which were left until first use
+	 * (CONFIG_DM_LAZY_BIND), so that devices stay in devicetree order
+	 */
 	ret = uclass_get(drv->id, &uc);
 	if (ret) {
 		dm_warn("Missing uclass for driver %s\n", drv->name);
@@ -902,6 +907,8 @@ static struct udevice *_device_find_global_by_ofnode(struct udevice *parent,
 int device_find_global_by_ofnode(ofnode ofnode, struct udevice **devp)
 {
 	*devp = _device_find_global_by_ofnode(gd->dm_root, ofnode);
+	if (!*devp && dm_lazy_bind_ofnode(ofnode))
+		*devp = _device_find_global_by_ofnode(gd->dm_root, ofnode);
 
 	return *devp ? 0 : -ENOENT;
 }
@@ -911,6 +918,8 @@ int device_get_global_by_ofnode(ofnode ofnode, struct udevice **devp)
 	struct udevice *dev;
 
 	dev = _device_find_global_by_ofnode(gd->dm_root, ofnode);
+	if (!dev && dm_lazy_bind_ofnode(ofnode))
+		dev = _device_find_global_by_ofnode(gd->dm_root, ofnode);
 	return device_get_device_tail(dev, dev ? 0 : -ENOENT, devp);
 }
 
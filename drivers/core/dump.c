@@ -7,6 +7,7 @@
 #include <malloc.h>
 #include <mapmem.h>
 #include <sort.h>
+#include <dm/of_index.h>
 #include <dm/root.h>
 #include <dm/util.h>
 #include <dm/uclass-internal.h>
@@ -296,6 +297,13 @@ void dm_dump_mem(struct dm_stats *stats)
 	printf("Memory: device %x:%x, device names %x, uclass %x:%x\n",
 	       stats->dev_count, stats->dev_size, stats->dev_name_size,
 	       stats->uc_count, stats->uc_size);
+	if (stats->lazy_count) {
+		int unbound = stats->lazy_count - stats->lazy_bound;
+
+		printf("Lazy: nodes %x, bound %x, size %x, device saving %x\n",
+		       stats->lazy_count, stats->lazy_bound, stats->lazy_size,
+		       unbound * (int)sizeof(struct udevice));
+	}
 	printf("\n");
 	printf("%-15s  %5s  %5s  %5s  %5s  %5s\n", "Attached type", "Count",
 	       "Size", "Cur", "Tags", "Save");
@@ -356,3 +364,33 @@ void dm_dump_mem(struct dm_stats *stats)
 	printf("Drop device name (not SRAM): %x (%d)\n", stats->dev_name_size,
 	       stats->dev_name_size);
 }
+
+#if CONFIG_IS_ENABLED(OF_INDEX)
+void dm_dump_of_index(void)
+{
+	static const char *const lookup_name[OF_LOOKUP_COUNT] = {
+		"phandle", "compat", "path",
+	};
+	struct of_index_info info;
+	int i;
+
+	of_index_get_info(&info);
+	if (info.tree)
+		printf("Index: %s tree, %d nodes, %lx bytes, built %u time(s)\n",
+		       info.live ? "live" : "flat", info.nodes, info.size,
+		       info.builds);
+	else
+		printf("Index: not built, built %u time(s)\n", info.builds);
+	printf("\n");
+	printf("%-10s  %8s  %8s  %10s\n", "Lookup", "Calls", "Indexed",
+	       "Time (us)");
+	printf("%-10s  %8s  %8s  %10s\n", "----------", "--------",
+	       "--------", "----------");
+	for (i = 0; i < OF_LOOKUP_COUNT; i++) {
+		struct of_lookup_stats *stats = &info.lookup[i];
+
+		printf("%-10s  %8u  %8u  %10lu\n", lookup_name[i],
+		       stats->calls, stats->indexed, stats->us);
+	}
+}
+#endif
@@ -0,0 +1,197 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Binding devicetree devices when they are first used
+ *
+ * With a large devicetree, binding a device for every node when driver model
+ * starts takes time and memory, even though only a few devices are used before
+ * the OS boots. In lazy mode, leaf nodes below the root are only recorded when
+ * driver model scans the tree. They are bound when their uclass is first
+ * looked at, or when their node is looked up.
+ */
+
+#define LOG_CATEGORY LOGC_DM
+
+#include <alist.h>
+#include <bootstage.h>
+#include <log.h>
+#include <malloc.h>
+#include <asm/global_data.h>
+#include <dm/device.h>
+#include <dm/lists.h>
+#include <dm/root.h>
+#include <dm/uclass-id.h>
+#include <dm/util.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+/**
+ * struct dm_lazy_node - a node which is not bound yet
+ *
+ * @node: Devicetree node
+ * @id: Uclass of the driver which matches the node
+ * @bound: true if the node has been bound
+ */
+struct dm_lazy_node {
+	ofnode node;
+	u16 id;
+	bool bound;
+};
+
+/**
+ * struct dm_lazy - nodes recorded for binding when first used
+ *
+ * @nodes: Nodes recorded, in devicetree order (struct dm_lazy_node)
+ * @bound: Number of nodes which have been bound
+ * @pre_reloc_only: true if the nodes were scanned before relocation
+ * @depth: Number of uclasses being bound, since binding a device may bind
+ *	another uclass
+ * @pending: true for each uclass with nodes which are not bound yet
+ */
+struct dm_lazy {
+	struct alist nodes;
+	uint bound;
+	bool pre_reloc_only;
+	uint depth;
+	bool pending[UCLASS_COUNT];
+};
+
+int dm_lazy_init(void)
+{
+	struct dm_lazy *lazy;
+
+	lazy = calloc(1, sizeof(*lazy));
+	if (!lazy)
+		return log_msg_ret("laz", -ENOMEM);
+	if (!alist_init_struct(&lazy->nodes, struct dm_lazy_node)) {
+		free(lazy);
+		return log_msg_ret("lal", -ENOMEM);
+	}
+	gd->dm_lazy = lazy;
+
+	return 0;
+}
+
+void dm_lazy_uninit(void)
+{
+	struct dm_lazy *lazy = gd->dm_lazy;
+
+	if (lazy) {
+		alist_uninit(&lazy->nodes);
+		free(lazy);
+		gd->dm_lazy = NULL;
+	}
+}
+
+int dm_lazy_add(ofnode node, bool pre_reloc_only)
+{
+	struct dm_lazy *lazy = gd->dm_lazy;
+	struct dm_lazy_node entry;
+	struct driver *drv;
+	int ret;
+
+	if (!lazy)
+		return 0;
+
+	/* a node with subnodes may be a bus, whose children must be bound */
+	if (ofnode_valid(ofnode_first_subnode(node)))
+		return 0;
+
+	ret = lists_find_fdt_driver(node, pre_reloc_only, &drv);
+	if (ret == -ENOENT)
+		return 1;	/* nothing to bind */
+	if (ret)
+		return 0;	/* let lists_bind_fdt() report it */
+	if (drv->flags & DM_FLAG_PROBE_AFTER_BIND)
+		return 0;
+
+	entry.node = node;
+	entry.id = drv->id;
+	entry.bound = false;
+	if (!alist_add(&lazy->nodes, entry))
+		return log_msg_ret("lad", -ENOMEM);
+	lazy->pending[drv->id] = true;
+	lazy->pre_reloc_only = pre_reloc_only;
+	log_debug("Deferring '%s' (%s)\n", ofnode_get_name(node), drv->name);
+
+	return 1;
+}
+
+/* Bind all pending nodes in uclass @id, in devicetree order */
+static int dm_lazy_bind(struct dm_lazy *lazy, enum uclass_id id)
+{
+	struct dm_lazy_node *entry;
+	int ret = 0, err;
+
+	/*
+	 * Clear this first, so that binding a device in the uclass does not
+	 * bind the uclass again. The drivers' bind() methods may still use
+	 * other uclasses, which are bound as usual.
+	 */
+	lazy->pending[id] = false;
+	if (!lazy->depth++)
+		bootstage_start(BOOTSTAGE_ID_ACCUM_DM_LAZY, "dm_lazy");
+	alist_for_each(entry, &lazy->nodes) {
+		if (entry->bound || entry->id != id)
+			continue;
+		entry->bound = true;
+		lazy->bound++;
+		log_debug("Binding '%s'\n", ofnode_get_name(entry->node));
+		err = lists_bind_fdt(gd->dm_root, entry->node, NULL, NULL,
+				     lazy->pre_reloc_only);
+		if (err && !ret) {
+			dm_warn("%s: ret=%d\n", ofnode_get_name(entry->node),
+				err);
+			ret = err;
+		}
+	}
+	if (!--lazy->depth)
+		bootstage_accum(BOOTSTAGE_ID_ACCUM_DM_LAZY);
+
+	return ret;
+}
+
+int dm_lazy_bind_uclass(enum uclass_id id)
+{
+	struct dm_lazy *lazy = gd->dm_lazy;
+
+	if (!lazy || id < 0 || id >= UCLASS_COUNT || !lazy->pending[id])
+		return 0;
+
+	return dm_lazy_bind(lazy, id);
+}
+
+int dm_lazy_bind_ofnode(ofnode node)
+{
+	struct dm_lazy *lazy = gd->dm_lazy;
+	const struct dm_lazy_node *entry;
+
+	if (!lazy || lazy->bound == lazy->nodes.count)
+		return 0;
+
+	alist_for_each(entry, &lazy->nodes) {
+		if (!entry->bound && lazy->pending[entry->id] &&
+		    ofnode_equal(entry->node, node)) {
+			/*
+			 * Bind the whole uclass so that its devices stay in
+			 * devicetree order and are numbered as usual
+			 */
+			dm_lazy_bind(lazy, entry->id);
+
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+void dm_lazy_get_stats(struct dm_stats *stats)
+{
+	struct dm_lazy *lazy = gd->dm_lazy;
+
+	if (!lazy)
+		return;
+	stats->lazy_count = lazy->nodes.count;
+	stats->lazy_bound = lazy->bound;
+	stats->lazy_size = sizeof(*lazy) +
+		lazy->nodes.alloc * sizeof(struct dm_lazy_node);
+}
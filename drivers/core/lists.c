@@ -287,4 +287,36 @@ int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
 
 	return 0;
 }
+
+int lists_find_fdt_driver(ofnode node, bool pre_reloc_only,
+			  struct driver **drvp)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	const int n_ents = ll_entry_count(struct driver, driver);
+	const char *compat_list, *compat;
+	const struct udevice_id *id;
+	struct driver *entry;
+	int compat_length, i;
+
+	compat_list = ofnode_get_property(node, "compatible", &compat_length);
+	if (!compat_list)
+		return compat_length == -FDT_ERR_NOTFOUND ? -ENOENT : -EINVAL;
+
+	for (i = 0; i < compat_length; i += strlen(compat) + 1) {
+		compat = compat_list + i;
+		for (entry = driver; entry != driver + n_ents; entry++) {
+			if (driver_check_compatible(entry->of_match, &id,
+						    compat))
+				continue;
+			if (pre_reloc_only && !ofnode_pre_reloc(node) &&
+			    !(entry->flags & DM_FLAG_PRE_RELOC))
+				return -ENOENT;
+			*drvp = entry;
+
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
 #endif
@@ -25,6 +25,7 @@
 #include <linux/bug.h>
 #include <linux/libfdt.h>
 #include <dm/of_access.h>
+#include <dm/of_index.h>
 #include <dm/util.h>
 #include <linux/ctype.h>
 #include <linux/err.h>
@@ -343,16 +344,14 @@ static struct device_node *__of_find_node_by_path(struct device_node *parent,
 #define for_each_property_of_node(dn, pp) \
 	for (pp = dn->properties; pp != NULL; pp = pp->next)
 
-struct device_node *of_find_node_opts_by_path(struct device_node *root,
-					      const char *path,
-					      const char **opts)
+static struct device_node *of_walk_node_by_path(struct device_node *root,
+						const char *path,
+						const char **opts)
 {
 	struct device_node *np = NULL;
 	struct property *pp;
 	const char *separator = strchr(path, ':');
 
-	if (!root)
-		root = gd->of_root;
 	if (opts)
 		*opts = separator ? separator + 1 : NULL;
 
@@ -404,10 +403,51 @@ struct device_node *of_find_node_opts_by_path(struct device_node *root,
 	return np;
 }
 
+struct device_node *of_find_node_opts_by_path(struct device_node *root,
+					      const char *path,
+					      const char **opts)
+{
+	struct device_node *np;
+	ofnode node;
+	ulong start;
+	int ret;
+
+	if (!root)
+		root = gd->of_root;
+	start = of_lookup_start();
+	ret = of_index_path(root, true, path, &node);
+	if (ret != -EAGAIN) {
+		np = ret ? NULL : node.np;
+		if (opts)
+			*opts = NULL;
+	} else {
+		np = of_walk_node_by_path(root, path, opts);
+	}
+	if (root == gd->of_root)
+		of_lookup_done(OF_LOOKUP_PATH, start, ret != -EAGAIN);
+
+	return np;
+}
+
 struct device_node *of_find_compatible_node(struct device_node *from,
 		const char *type, const char *compatible)
 {
 	struct device_node *np;
+	ofnode node, prev = { .np = from };
+	ulong start;
+	int ret;
+
+	if (!type) {
+		start = of_lookup_start();
+		ret = of_index_compat(gd->of_root, true, prev, compatible,
+				      &node);
+		of_lookup_done(OF_LOOKUP_COMPAT, start, ret != -EAGAIN);
+		if (ret != -EAGAIN) {
+			np = ret ? NULL : node.np;
+			of_node_put(from);
+			return of_node_get(np);
+		}
+	}
 
 	for_each_of_allnodes_from(from, np)
 		if (of_device_is_compatible(np, compatible, type, NULL) &&
@@ -449,13 +489,24 @@ struct device_node *of_find_node_by_phandle(struct device_node *root,
 					    phandle handle)
 {
 	struct device_node *np;
+	ofnode node;
+	ulong start;
+	int ret;
 
 	if (!handle)
 		return NULL;
 
-	for_each_of_allnodes_from(root, np)
-		if (np->phandle == handle)
-			break;
+	start = of_lookup_start();
+	ret = of_index_phandle(root ? root : gd->of_root, true, handle, &node);
+	if (ret != -EAGAIN) {
+		np = ret ? NULL : node.np;
+	} else {
+		for_each_of_allnodes_from(root, np)
+			if (np->phandle == handle)
+				break;
+	}
+	if (!root || root == gd->of_root)
+		of_lookup_done(OF_LOOKUP_PHANDLE, start, ret != -EAGAIN);
 	(void)of_node_get(np);
 
 	return np;
@@ -1014,6 +1065,17 @@ struct device_node *of_get_stdout(void)
 	return of_stdout;
 }
 
+/* Drop the index if a change to @np affects lookups in the control tree */
+static void of_tree_changed(const struct device_node *np)
+{
+	if (!CONFIG_IS_ENABLED(OF_INDEX))
+		return;
+	while (np->parent)
+		np = np->parent;
+	if (np == gd_of_root())
+		of_index_invalidate();
+}
+
 int of_write_prop(struct device_node *np, const char *propname, int len,
 		  const void *value)
 {
@@ -1029,6 +1091,8 @@ int of_write_prop(struct device_node *np, const char *propname, int len,
 			/* Property exists -> change value */
 			pp->value = (void *)value;
 			pp->length = len;
+			if (!strcmp(propname, "compatible"))
+				of_tree_changed(np);
 			return 0;
 		}
 		pp_last = pp;
@@ -1053,6 +1117,8 @@ int of_write_prop(struct device_node *np, const char *propname, int len,
 		pp_last->next = new;
 	else
 		np->properties = new;
+	if (!strcmp(propname, "compatible"))
+		of_tree_changed(np);
 
 	return 0;
 }
@@ -1114,6 +1180,7 @@ int of_add_subnode(struct device_node *parent, const char *name, int len,
 	if (!parent->child)
 		parent->child = new;
 	new->parent = parent;
+	of_tree_changed(parent);
 
 	*childp = new;
 
@@ -1144,6 +1211,8 @@ int of_remove_property(struct device_node *np, struct property *prop)
 	mutex_lock(&of_mutex);
 
 	rc = __of_remove_property(np, prop);
+	if (!rc && !strcmp(prop->name, "compatible"))
+		of_tree_changed(np);
 
 	mutex_unlock(&of_mutex);
 
@@ -1171,6 +1240,7 @@ int of_remove_node(struct device_node *to_remove)
 		prev->sibling = np->sibling;
 	else
 		parent->child = np->sibling;
+	of_tree_changed(parent);
 
 	/*
 	 * don't free it, since if this is an unflattened tree, all the memory
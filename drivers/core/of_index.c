@@ -0,0 +1,643 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Index of the control devicetree, to speed up node lookups
+ *
+ * Looking up a node by phandle, compatible string or path normally walks the
+ * tree. The index holds a hash table for each of these, mapping the phandle or
+ * the hash of the string to the nodes which have it, so most lookups only
+ * need to check one or two nodes.
+ */
+
+#define LOG_CATEGORY	LOGC_DT
+
+#include <log.h>
+#include <malloc.h>
+#include <time.h>
+#include <asm/global_data.h>
+#include <dm/of_access.h>
+#include <dm/of_index.h>
+#include <linux/libfdt.h>
+#include <linux/log2.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+enum {
+	/* Marks an unused slot in a table */
+	OF_INDEX_EMPTY		= U32_MAX,
+
+	/* FNV-1a hash */
+	OF_HASH_INIT		= 0x811c9dc5,
+	OF_HASH_PRIME		= 0x01000193,
+
+	/* Deepest flat-tree node that can be indexed */
+	OF_INDEX_MAX_DEPTH	= 32,
+};
+
+/**
+ * struct of_index_entry - an entry in a table of the index
+ *
+ * @key: Phandle, or hash of the compatible string or path
+ * @ref: Node number in a live tree, offset in a flat tree, or OF_INDEX_EMPTY
+ */
+struct of_index_entry {
+	u32 key;
+	u32 ref;
+};
+
+/**
+ * struct of_index_table - an open-addressing hash table
+ *
+ * Entries with the same key are found in the order they were added, which is
+ * the order of the nodes in the tree.
+ *
+ * @slot: Array of 1 << @bits entries
+ * @bits: Number of bits in a slot number
+ */
+struct of_index_table {
+	struct of_index_entry *slot;
+	uint bits;
+};
+
+/**
+ * struct of_index - index of the control devicetree
+ *
+ * This is allocated the first time it is needed and again once the full
+ * malloc() is available, since the early memory may be reused.
+ *
+ * @full_malloc: true if this was allocated with the full malloc()
+ * @failed: true if building the tables failed, so they are not tried again
+ *	until the index is invalidated
+ * @filled: true if the tables were built with this allocation of the state
+ * @builds: Number of times the tables were built
+ * @lookup: Lookup statistics (CONFIG_DM_STATS)
+ * @tree: Tree the tables were built for (root node or FDT), NULL if none
+ * @live: true if @tree is a live tree
+ * @count: Number of nodes in @tree
+ * @struct_size: Size of the FDT structure block, to spot changes
+ * @strings_size: Size of the FDT strings block, to spot changes
+ * @nodes: Nodes of a live tree, indexed by node number
+ * @parent: Offset of the parent of the node in each slot of the path table,
+ *	for a flat tree
+ * @table: Table for each type of lookup
+ * @buf: Memory holding @nodes and the tables
+ * @size: Size of @buf in bytes
+ */
+struct of_index {
+	bool full_malloc;
+	bool failed;
+	bool filled;
+	uint builds;
+	struct of_lookup_stats lookup[OF_LOOKUP_COUNT];
+	const void *tree;
+	bool live;
+	int count;
+	u32 struct_size;
+	u32 strings_size;
+	struct device_node **nodes;
+	u32 *parent;
+	struct of_index_table table[OF_LOOKUP_COUNT];
+	void *buf;
+	ulong size;
+};
+
+static u32 of_hash(u32 hash, const char *str, int len)
+{
+	while (len--) {
+		hash ^= (u8)*str++;
+		hash *= OF_HASH_PRIME;
+	}
+
+	return hash;
+}
+
+static uint table_slot(const struct of_index_table *tbl, u32 key)
+{
+	/* Fibonacci hashing, since phandles are sequential */
+	return (key * 0x9e3779b9) >> (32 - tbl->bits);
+}
+
+static uint table_next(const struct of_index_table *tbl, uint slot)
+{
+	return (slot + 1) & ((1U << tbl->bits) - 1);
+}
+
+/* Add an entry to a table, returning its slot number */
+static uint table_add(struct of_index_table *tbl, u32 key, u32 ref)
+{
+	uint slot;
+
+	for (slot = table_slot(tbl, key); tbl->slot[slot].ref != OF_INDEX_EMPTY;
+	     slot = table_next(tbl, slot))
+		;
+	tbl->slot[slot].key = key;
+	tbl->slot[slot].ref = ref;
+
+	return slot;
+}
+
+/*
+ * Add the compatible strings in @prop, or count them if @idx is NULL. Returns
+ * the number of strings
+ */
+static int add_compat(struct of_index *idx, const char *prop, int len, u32 ref)
+{
+	const char *end = prop + len;
+	int count = 0;
+
+	for (; prop && prop < end; prop += strlen(prop) + 1, count++) {
+		if (idx)
+			table_add(&idx->table[OF_LOOKUP_COMPAT],
+				  of_hash(OF_HASH_INIT, prop, strlen(prop)),
+				  ref);
+	}
+
+	return count;
+}
+
+/*
+ * Add the nodes of a live tree to the tables, or count the entries needed if
+ * @idx is NULL. Nodes are numbered in the order of of_find_all_nodes().
+ * Returns the number of nodes
+ */
+static int scan_live(struct of_index *idx, struct device_node *root,
+		     uint *count)
+{
+	struct device_node *np;
+	const char *compat;
+	int len;
+	u32 ref;
+
+	for (np = root, ref = 0; np; np = of_find_all_nodes(np), ref++) {
+		compat = of_get_property(np, "compatible", &len);
+		if (!idx) {
+			count[OF_LOOKUP_PATH]++;
+			count[OF_LOOKUP_PHANDLE] += np->phandle != 0;
+			count[OF_LOOKUP_COMPAT] += add_compat(NULL, compat, len,
+							      ref);
+			continue;
+		}
+		idx->nodes[ref] = np;
+		table_add(&idx->table[OF_LOOKUP_PATH],
+			  of_hash(OF_HASH_INIT, np->full_name,
+				  strlen(np->full_name)), ref);
+		if (np->phandle)
+			table_add(&idx->table[OF_LOOKUP_PHANDLE], np->phandle,
+				  ref);
+		add_compat(idx, compat, len, ref);
+	}
+
+	return ref;
+}
+
+/*
+ * Add the nodes of a flat tree to the tables, or count the entries needed if
+ * @idx is NULL. Returns the number of nodes, or -ve on error
+ */
+static int scan_flat(struct of_index *idx, const void *blob, uint *count)
+{
+	int parent[OF_INDEX_MAX_DEPTH];
+	u32 hash[OF_INDEX_MAX_DEPTH];
+	int shadow = OF_INDEX_MAX_DEPTH;
+	int offset, depth = 0;
+	const char *name;
+	uint phandle, slot;
+	int nodes = 0;
+	int len;
+
+	for (offset = 0; offset >= 0 && depth >= 0;
+	     offset = fdt_next_node(blob, offset, &depth)) {
+		if (depth >= OF_INDEX_MAX_DEPTH)
+			return -E2BIG;
+		parent[depth] = offset;
+		name = fdt_get_name(blob, offset, &len);
+		nodes++;
+		if (!depth) {
+			hash[0] = of_hash(OF_HASH_INIT, "/", 1);
+		} else {
+			/* the root's path is "/", but it is not a prefix */
+			hash[depth] = depth > 1 ? hash[depth - 1] : OF_HASH_INIT;
+			hash[depth] = of_hash(of_hash(hash[depth], "/", 1),
+					      name, len);
+		}
+
+		/*
+		 * libfdt lets a path leave out the unit address, so "/a" finds
+		 * "a@1" if that comes before "a". Leave out "a" and the nodes
+		 * below it, so that lookups of their paths walk the tree.
+		 */
+		if (depth <= shadow)
+			shadow = OF_INDEX_MAX_DEPTH;
+		if (depth && shadow == OF_INDEX_MAX_DEPTH &&
+		    !memchr(name, '@', len) &&
+		    fdt_subnode_offset_namelen(blob, parent[depth - 1], name,
+					       len) != offset)
+			shadow = depth;
+
+		phandle = fdt_get_phandle(blob, offset);
+		name = fdt_getprop(blob, offset, "compatible", &len);
+		if (!idx) {
+			count[OF_LOOKUP_PATH] += depth < shadow;
+			count[OF_LOOKUP_PHANDLE] += phandle != 0;
+			count[OF_LOOKUP_COMPAT] += add_compat(NULL, name, len,
+							      offset);
+			continue;
+		}
+		if (depth < shadow) {
+			slot = table_add(&idx->table[OF_LOOKUP_PATH],
+					 hash[depth], offset);
+			idx->parent[slot] = depth ? parent[depth - 1] :
+				OF_INDEX_EMPTY;
+		}
+		if (phandle)
+			table_add(&idx->table[OF_LOOKUP_PHANDLE], phandle,
+				  offset);
+		add_compat(idx, name, len, offset);
+	}
+
+	return nodes;
+}
+
+static void of_index_drop(struct of_index *idx)
+{
+	free(idx->buf);
+	idx->buf = NULL;
+	idx->tree = NULL;
+}
+
+static int of_index_fill(struct of_index *idx, const void *tree, bool live)
+{
+	uint count[OF_LOOKUP_COUNT] = {};
+	struct of_index_table *tbl;
+	ulong size, slots;
+	int ret, nodes, i;
+	void *ptr;
+
+	/* the early malloc() cannot free memory, so only build once there */
+	if (!idx->full_malloc && idx->filled) {
+		ret = -ENOSPC;
+		goto err;
+	}
+
+	if (live)
+		nodes = scan_live(NULL, (struct device_node *)tree, count);
+	else
+		nodes = scan_flat(NULL, tree, count);
+	if (nodes < 0) {
+		ret = nodes;
+		goto err;
+	}
+
+	size = live ? nodes * sizeof(*idx->nodes) : 0;
+	for (i = 0; i < OF_LOOKUP_COUNT; i++) {
+		/* keep the tables no more than two-thirds full */
+		slots = roundup_pow_of_two(max(count[i] + count[i] / 2 + 1,
+					       2U));
+		idx->table[i].bits = ilog2(slots);
+		size += slots * sizeof(struct of_index_entry);
+	}
+	if (!live)
+		size += sizeof(u32) << idx->table[OF_LOOKUP_PATH].bits;
+	idx->buf = malloc(size);
+	if (!idx->buf) {
+		ret = -ENOMEM;
+		goto err;
+	}
+	memset(idx->buf, '\xff', size);
+
+	ptr = idx->buf;
+	if (live) {
+		idx->nodes = ptr;
+		ptr += nodes * sizeof(*idx->nodes);
+	}
+	for (i = 0; i < OF_LOOKUP_COUNT; i++) {
+		tbl = &idx->table[i];
+		tbl->slot = ptr;
+		ptr += sizeof(struct of_index_entry) << tbl->bits;
+	}
+	if (!live)
+		idx->parent = ptr;
+
+	if (live)
+		scan_live(idx, (struct device_node *)tree, NULL);
+	else
+		scan_flat(idx, tree, NULL);
+	idx->tree = tree;
+	idx->live = live;
+	idx->count = nodes;
+	idx->size = size;
+	if (!live) {
+		idx->struct_size = fdt_size_dt_struct(tree);
+		idx->strings_size = fdt_size_dt_strings(tree);
+	}
+	idx->filled = true;
+	idx->builds++;
+	log_debug("Indexed %d nodes in %lx bytes\n", idx->count, size);
+
+	return 0;
+
+err:
+	log_debug("Cannot index tree (err=%d)\n", ret);
+	idx->failed = true;
+
+	return ret;
+}
+
+/* Get the index state, moving it to the full malloc() once that is ready */
+static struct of_index *of_index_state(void)
+{
+	bool full_malloc = gd->flags & GD_FLG_FULL_MALLOC_INIT;
+	struct of_index *old = gd->of_index, *idx;
+
+	if (old && old->full_malloc == full_malloc)
+		return old;
+
+	/* the early index cannot be freed, but keep its statistics */
+	idx = calloc(1, sizeof(*idx));
+	if (!idx)
+		return NULL;
+	idx->full_malloc = full_malloc;
+	if (old) {
+		idx->builds = old->builds;
+		memcpy(idx->lookup, old->lookup, sizeof(idx->lookup));
+	}
+	gd->of_index = idx;
+
+	return idx;
+}
+
+/* Get the index for @tree, building it if needed */
+static struct of_index *of_index_get(const void *tree, bool live)
+{
+	struct of_index *idx;
+
+	if (!tree || tree != (live ? (void *)gd_of_root() : gd->fdt_blob))
+		return NULL;
+	/* don't swap between trees if the FDT is used with a live tree */
+	if (!live && gd_of_root())
+		return NULL;
+	idx = of_index_state();
+	if (!idx)
+		return NULL;
+
+	if (idx->tree == tree && idx->live == live) {
+		if (live || (fdt_size_dt_struct(tree) == idx->struct_size &&
+			     fdt_size_dt_strings(tree) == idx->strings_size))
+			return idx;
+		log_debug("FDT changed, rebuilding index\n");
+	}
+	if (idx->tree)
+		of_index_drop(idx);
+	if (idx->failed || of_index_fill(idx, tree, live))
+		return NULL;
+
+	return idx;
+}
+
+int of_index_build(const void *tree, bool live)
+{
+	struct of_index *idx;
+
+	idx = of_index_state();
+	if (!idx)
+		return -ENOMEM;
+	if (idx->tree)
+		of_index_drop(idx);
+	idx->failed = false;
+
+	return of_index_fill(idx, tree, live);
+}
+
+void of_index_invalidate(void)
+{
+	struct of_index *idx = gd->of_index;
+	bool full_malloc = gd->flags & GD_FLG_FULL_MALLOC_INIT;
+
+	/* an early index is replaced when next used */
+	if (!idx || idx->full_malloc != full_malloc)
+		return;
+	if (idx->tree)
+		of_index_drop(idx);
+	idx->failed = false;
+}
+
+static ofnode ref_to_node(const struct of_index *idx, u32 ref)
+{
+	ofnode node;
+
+	if (idx->live)
+		node.np = idx->nodes[ref];
+	else
+		node.of_offset = ref;
+
+	return node;
+}
+
+/* Find the node number of @np in a live tree, or -1 if not indexed */
+static int live_ref(const struct of_index *idx, const struct device_node *np)
+{
+	const struct of_index_table *tbl = &idx->table[OF_LOOKUP_PATH];
+	u32 key, ref;
+	uint slot;
+
+	key = of_hash(OF_HASH_INIT, np->full_name, strlen(np->full_name));
+	for (slot = table_slot(tbl, key);
+	     (ref = tbl->slot[slot].ref) != OF_INDEX_EMPTY;
+	     slot = table_next(tbl, slot)) {
+		if (tbl->slot[slot].key == key && idx->nodes[ref] == np)
+			return ref;
+	}
+
+	return -1;
+}
+
+int of_index_phandle(const void *tree, bool live, uint phandle, ofnode *nodep)
+{
+	const struct of_index_table *tbl;
+	struct of_index *idx;
+	uint slot, found;
+	u32 ref;
+
+	if (!phandle || phandle == -1U)
+		return -EAGAIN;
+	idx = of_index_get(tree, live);
+	if (!idx)
+		return -EAGAIN;
+
+	tbl = &idx->table[OF_LOOKUP_PHANDLE];
+	for (slot = table_slot(tbl, phandle);
+	     (ref = tbl->slot[slot].ref) != OF_INDEX_EMPTY;
+	     slot = table_next(tbl, slot)) {
+		if (tbl->slot[slot].key != phandle)
+			continue;
+		*nodep = ref_to_node(idx, ref);
+		found = live ? nodep->np->phandle : fdt_get_phandle(tree, ref);
+		if (found == phandle)
+			return 0;
+
+		/* the tree changed without the index being invalidated */
+		of_index_drop(idx);
+		return -EAGAIN;
+	}
+
+	return -ENOENT;
+}
+
+int of_index_compat(const void *tree, bool live, ofnode from,
+		    const char *compat, ofnode *nodep)
+{
+	const struct of_index_table *tbl;
+	struct of_index *idx;
+	int from_ref;
+	uint slot;
+	u32 key, ref;
+
+	idx = of_index_get(tree, live);
+	if (!idx)
+		return -EAGAIN;
+
+	if (live)
+		from_ref = from.np ? live_ref(idx, from.np) : -1;
+	else
+		from_ref = from.of_offset >= 0 ? from.of_offset : -1;
+	if (live && from.np && from_ref == -1)
+		return -EAGAIN;
+
+	/* node numbers and offsets both follow the order of the tree */
+	tbl = &idx->table[OF_LOOKUP_COMPAT];
+	key = of_hash(OF_HASH_INIT, compat, strlen(compat));
+	for (slot = table_slot(tbl, key);
+	     (ref = tbl->slot[slot].ref) != OF_INDEX_EMPTY;
+	     slot = table_next(tbl, slot)) {
+		if (tbl->slot[slot].key != key || (int)ref <= from_ref)
+			continue;
+		*nodep = ref_to_node(idx, ref);
+		if (live ? of_device_is_compatible(nodep->np, compat, NULL,
+						   NULL) :
+		    !fdt_node_check_compatible(tree, ref, compat))
+			return 0;
+	}
+
+	/*
+	 * A compatible string in the FDT may have been changed with libfdt
+	 * without changing its size, so let the caller walk the tree
+	 */
+	return live ? -ENOENT : -EAGAIN;
+}
+
+/*
+ * Check that the flat-tree node @ref in @slot of the path table has the path
+ * @path, @len bytes long. The hash only makes that likely, so compare each
+ * component, finding the parents through the path table.
+ */
+static bool flat_path_match(const struct of_index *idx, const void *blob,
+			    const char *path, int len, u32 ref, uint slot)
+{
+	const struct of_index_table *tbl = &idx->table[OF_LOOKUP_PATH];
+	const char *last, *name;
+	int name_len;
+	u32 key, up;
+
+	while (len > 1) {
+		for (last = path + len; last[-1] != '/'; last--)
+			;
+		name = fdt_get_name(blob, ref, &name_len);
+		if (!name || name_len != path + len - last ||
+		    memcmp(name, last, name_len))
+			return false;
+
+		up = idx->parent[slot];
+		len = last - 1 - path;
+		if (!len)
+			return !up;
+		key = of_hash(OF_HASH_INIT, path, len);
+		for (slot = table_slot(tbl, key);
+		     (ref = tbl->slot[slot].ref) != OF_INDEX_EMPTY;
+		     slot = table_next(tbl, slot)) {
+			if (tbl->slot[slot].key == key && ref == up)
+				break;
+		}
+		if (ref == OF_INDEX_EMPTY)
+			return false;
+	}
+
+	return !ref;
+}
+
+int of_index_path(const void *tree, bool live, const char *path,
+		  ofnode *nodep)
+{
+	const struct of_index_table *tbl;
+	struct of_index *idx;
+	uint slot;
+	u32 key, ref;
+	int len;
+
+	if (*path != '/' || strchr(path, ':'))
+		return -EAGAIN;
+	idx = of_index_get(tree, live);
+	if (!idx)
+		return -EAGAIN;
+
+	tbl = &idx->table[OF_LOOKUP_PATH];
+	len = strlen(path);
+	key = of_hash(OF_HASH_INIT, path, len);
+	for (slot = table_slot(tbl, key);
+	     (ref = tbl->slot[slot].ref) != OF_INDEX_EMPTY;
+	     slot = table_next(tbl, slot)) {
+		if (tbl->slot[slot].key != key)
+			continue;
+		*nodep = ref_to_node(idx, ref);
+		if (live) {
+			if (!strcmp(nodep->np->full_name, path))
+				return 0;
+			continue;
+		}
+		if (flat_path_match(idx, tree, path, len, ref, slot))
+			return 0;
+	}
+
+	/* libfdt may still find it without the unit address */
+	return live ? -ENOENT : -EAGAIN;
+}
+
+void of_index_get_info(struct of_index_info *info)
+{
+	struct of_index *idx = gd->of_index;
+
+	memset(info, '\0', sizeof(*info));
+	if (!idx)
+		return;
+	info->tree = idx->tree;
+	info->live = idx->live;
+	info->nodes = idx->tree ? idx->count : 0;
+	info->size = idx->tree ? idx->size : 0;
+	info->builds = idx->builds;
+	memcpy(info->lookup, idx->lookup, sizeof(info->lookup));
+}
+
+#if CONFIG_IS_ENABLED(DM_STATS)
+ulong of_lookup_start(void)
+{
+#ifdef CONFIG_TIMER
+	/* starting the timer looks up nodes too */
+	if (!gd->timer)
+		return 0;
+#endif
+	return timer_get_us();
+}
+
+void of_lookup_done(enum of_lookup_t type, ulong start, bool indexed)
+{
+	struct of_index *idx = gd->of_index;
+	struct of_lookup_stats *stats;
+
+	if (!idx)
+		return;
+	stats = &idx->lookup[type];
+	stats->calls++;
+	if (indexed)
+		stats->indexed++;
+	if (start)
+		stats->us += timer_get_us() - start;
+}
+#endif
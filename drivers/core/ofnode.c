@@ -15,6 +15,7 @@
 #include <linux/libfdt.h>
 #include <dm/of_access.h>
 #include <dm/of_addr.h>
+#include <dm/of_index.h>
 #include <dm/ofnode.h>
 #include <dm/util.h>
 #include <linux/err.h>
@@ -805,8 +806,8 @@ ofnode ofnode_get_by_phandle(uint phandle)
 	if (of_live_active())
 		node = np_to_ofnode(of_find_node_by_phandle(NULL, phandle));
 	else
-		node.of_offset = fdt_node_offset_by_phandle(gd->fdt_blob,
-							    phandle);
+		node.of_offset = fdtdec_node_offset_by_phandle(gd->fdt_blob,
+							       phandle);
 
 	return node;
 }
@@ -819,8 +820,8 @@ ofnode oftree_get_by_phandle(oftree tree, uint phandle)
 		node = np_to_ofnode(of_find_node_by_phandle(tree.np, phandle));
 	else
 		node = ofnode_from_tree_offset(tree,
-			fdt_node_offset_by_phandle(oftree_lookup_fdt(tree),
-						   phandle));
+			fdtdec_node_offset_by_phandle(oftree_lookup_fdt(tree),
+						      phandle));
 
 	return node;
 }
@@ -1137,12 +1138,34 @@ int oftree_count_phandle_with_args(oftree tree, ofnode node, const char *list_na
 				cell_count, -1, NULL);
 }
 
+/* Find the offset of a node by path, using the index for the control FDT */
+static int ofnode_path_offset(const void *fdt, const char *path)
+{
+	ofnode node;
+	ulong start;
+	int offset;
+	int ret;
+
+	start = of_lookup_start();
+	ret = of_index_path(fdt, false, path, &node);
+	if (!ret)
+		offset = node.of_offset;
+	else if (ret == -ENOENT)
+		offset = -FDT_ERR_NOTFOUND;
+	else
+		offset = fdt_path_offset(fdt, path);
+	if (fdt == gd->fdt_blob)
+		of_lookup_done(OF_LOOKUP_PATH, start, ret != -EAGAIN);
+
+	return offset;
+}
+
 ofnode ofnode_path(const char *path)
 {
 	if (of_live_active())
 		return np_to_ofnode(of_find_node_by_path(path));
 	else
-		return offset_to_ofnode(fdt_path_offset(gd->fdt_blob, path));
+		return offset_to_ofnode(ofnode_path_offset(gd->fdt_blob, path));
 }
 
 ofnode oftree_root(oftree tree)
@@ -1162,7 +1185,7 @@ ofnode oftree_path(oftree tree, const char *path)
 	} else if (*path != '/' && tree.fdt != gd->fdt_blob) {
 		return ofnode_null();  /* Aliases only on control FDT */
 	} else {
-		int offset = fdt_path_offset(tree.fdt, path);
+		int offset = ofnode_path_offset(tree.fdt, path);
 
 		return ofnode_from_tree_offset(tree, offset);
 	}
@@ -1763,6 +1786,31 @@ int ofnode_device_is_compatible(ofnode node, const char *compat)
 						  compat);
 }
 
+/*
+ * Find the offset of the next compatible node after @offset, using the index
+ * for the control FDT
+ */
+static int ofnode_compat_offset(const void *fdt, int offset,
+				const char *compat)
+{
+	ofnode node, from = { .of_offset = offset };
+	ulong start;
+	int ret;
+
+	start = of_lookup_start();
+	ret = of_index_compat(fdt, false, from, compat, &node);
+	if (!ret)
+		offset = node.of_offset;
+	else if (ret == -ENOENT)
+		offset = -FDT_ERR_NOTFOUND;
+	else
+		offset = fdt_node_offset_by_compatible(fdt, offset, compat);
+	if (fdt == gd->fdt_blob)
+		of_lookup_done(OF_LOOKUP_COMPAT, start, ret != -EAGAIN);
+
+	return offset;
+}
+
 ofnode ofnode_by_compatible(ofnode from, const char *compat)
 {
 	if (of_live_active()) {
@@ -1771,8 +1819,8 @@ ofnode ofnode_by_compatible(ofnode from, const char *compat)
 			compat));
 	} else {
 		return noffset_to_ofnode(from,
-			fdt_node_offset_by_compatible(ofnode_to_fdt(from),
-					ofnode_to_offset(from), compat));
+			ofnode_compat_offset(ofnode_to_fdt(from),
+					     ofnode_to_offset(from), compat));
 	}
 }
 
@@ -1810,11 +1858,17 @@ int ofnode_write_prop(ofnode node, const char *propname, const void *value,
 			free(newval);
 		return ret;
 	} else {
-		ret = fdt_setprop(ofnode_to_fdt(node), ofnode_to_offset(node),
-				  propname, value, len);
+		void *fdt = ofnode_to_fdt(node);
+
+		ret = fdt_setprop(fdt, ofnode_to_offset(node), propname, value,
+				  len);
 		if (ret)
 			return ret == -FDT_ERR_NOSPACE ? -ENOSPC : -EINVAL;
 
+		/* a new value of the same size does not move anything */
+		if (fdt == gd->fdt_blob && !strcmp(propname, "compatible"))
+			of_index_invalidate();
+
 		return 0;
 	}
 }
@@ -124,6 +124,10 @@ int dm_init(bool of_live)
 	}
 
 	INIT_LIST_HEAD((struct list_head *)&gd->dmtag_list);
+#if CONFIG_IS_ENABLED(DM_LAZY_BIND)
+	/* any list from before relocation is in the old malloc() area */
+	gd->dm_lazy = NULL;
+#endif
 
 	return 0;
 }
@@ -135,6 +139,7 @@ int dm_uninit(void)
 	device_remove(dm_root(), DM_REMOVE_NORMAL);
 	device_unbind(dm_root());
 	gd->dm_root = NULL;
+	dm_lazy_uninit();
 
 	return 0;
 }
@@ -210,6 +215,13 @@ static int dm_scan_fdt_node(struct udevice *parent, ofnode parent_node,
 			pr_debug("   - ignoring disabled device\n");
 			continue;
 		}
+		if (parent == gd->dm_root) {
+			err = dm_lazy_add(node, pre_reloc_only);
+			if (err > 0)
+				continue;
+			if (err)
+				return log_msg_ret("laz", err);
+		}
 		err = lists_bind_fdt(parent, node, NULL, NULL, pre_reloc_only);
 		if (err && !ret) {
 			ret = err;
@@ -376,6 +388,12 @@ int dm_init_and_scan(bool pre_reloc_only)
 		dm_warn("dm_init() failed: %d\n", ret);
 		return ret;
 	}
+	if (CONFIG_IS_ENABLED(DM_LAZY_BIND) &&
+	    ofnode_options_read_bool("dm-lazy-bind")) {
+		ret = dm_lazy_init();
+		if (ret)
+			return log_msg_ret("laz", ret);
+	}
 	if (!CONFIG_IS_ENABLED(OF_PLATDATA_INST)) {
 		ret = dm_scan(pre_reloc_only);
 		if (ret) {
@@ -447,10 +465,11 @@ void dm_get_mem(struct dm_stats *stats)
 	dev_collect_stats(stats, gd->dm_root);
 	uclass_collect_stats(stats);
 	dev_tag_collect_stats(stats);
+	dm_lazy_get_stats(stats);
 
 	stats->total_size = stats->dev_size + stats->uc_size +
 		stats->attach_size_total + stats->uc_attach_size +
-		stats->tag_size;
+		stats->tag_size + stats->lazy_size;
 }
 
 #if CONFIG_IS_ENABLED(ACPIGEN)
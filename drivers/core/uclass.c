@@ -17,6 +17,7 @@
 #include <dm/device-internal.h>
 #include <dm/lists.h>
 #include <dm/ofnode_graph.h>
+#include <dm/root.h>
 #include <dm/uclass.h>
 #include <dm/uclass-internal.h>
 #include <dm/util.h>
@@ -149,6 +150,8 @@ int uclass_get(enum uclass_id id, struct uclass **ucp)
 	/* Immediately fail if driver model is not set up */
 	if (!gd->uclass_root)
 		return -EDEADLK;
+	/* bind any devices which were left until first use */
+	dm_lazy_bind_uclass(id);
 	*ucp = NULL;
 	uc = uclass_find(id);
 	if (!uc) {
@@ -306,6 +309,7 @@ struct udevice *uclass_try_first_device(enum uclass_id id)
 {
 	struct uclass *uc;
 
+	dm_lazy_bind_uclass(id);
 	uc = uclass_find(id);
 	if (!uc || list_empty(&uc->dev_head))
 		return NULL;
@@ -10,11 +10,17 @@
 #include <dm.h>
 #include <errno.h>
 #include <log.h>
+#include <time.h>
+#include <watchdog.h>
+#include <asm/io.h>
 #include <dm/lists.h>
 #include <dm/root.h>
 #include <linux/err.h>
 #include <relocate.h>
 
+/* Time allowed for a job on another core before giving up on it */
+#define CPU_JOB_TIMEOUT_MS	10000
+
 int cpu_probe_all(void)
 {
 	int ret = uclass_probe_all(UCLASS_CPU);
@@ -112,6 +118,102 @@ int cpu_release_core(const struct udevice *dev, phys_addr_t addr)
 	return ops->release_core(dev, addr);
 }
 
+int cpu_run(struct udevice *dev, struct cpu_job *job)
+{
+	struct cpu_ops *ops = cpu_get_ops(dev);
+	int ret;
+
+	if (!ops->run)
+		return -ENOSYS;
+	if (cpu_is_current(dev) > 0)
+		return -EBUSY;
+
+	job->cpu = dev;
+	job->done = false;
+	mb();
+	ret = ops->run(dev, job);
+	if (ret)
+		job->cpu = NULL;
+
+	return ret;
+}
+
+void cpu_job_run(struct cpu_job *job)
+{
+	job->ret = job->func(job->arg);
+
+	/* make the result visible before saying that the job is done */
+	mb();
+	WRITE_ONCE(job->done, true);
+}
+
+int cpu_job_wait(struct cpu_job *job)
+{
+	ulong start = get_timer(0);
+
+	while (!READ_ONCE(job->done)) {
+		if (get_timer(start) > CPU_JOB_TIMEOUT_MS) {
+			log_err("Job on CPU %s timed out\n",
+				job->cpu ? job->cpu->name : "?");
+			return -ETIMEDOUT;
+		}
+		schedule();
+	}
+	mb();
+
+	return job->ret;
+}
+
+int cpu_job_cores(void)
+{
+	struct udevice *dev;
+	int count = 1;
+
+	uclass_foreach_dev_probe(UCLASS_CPU, dev) {
+		if (cpu_get_ops(dev)->run && cpu_is_current(dev) <= 0)
+			count++;
+	}
+
+	return count;
+}
+
+int cpu_run_jobs(struct cpu_job *jobs, int count)
+{
+	struct udevice *dev;
+	int i, next, ret;
+
+	if (!count)
+		return 0;
+	for (i = 0; i < count; i++) {
+		jobs[i].cpu = NULL;
+		jobs[i].done = false;
+	}
+
+	/* hand one job to each other core which can take one */
+	next = 1;
+	uclass_foreach_dev_probe(UCLASS_CPU, dev) {
+		if (next == count)
+			break;
+		if (!cpu_run(dev, &jobs[next]))
+			next++;
+	}
+
+	/* run the first job and any that are left over here */
+	cpu_job_run(&jobs[0]);
+	for (i = next; i < count; i++)
+		cpu_job_run(&jobs[i]);
+
+	ret = 0;
+	for (i = 0; i < count; i++) {
+		int err = cpu_job_wait(&jobs[i]);
+
+		if (err && !ret)
+			ret = err;
+	}
+
+	return ret;
+}
+
 U_BOOT_DRIVER(cpu_bus) = {
 	.name	= "cpu_bus",
 	.id	= UCLASS_SIMPLE_BUS,
@@ -49,6 +49,14 @@ static int cpu_sandbox_release_core(const struct udevice *dev, phys_addr_t addr)
 	return 0;
 }
 
+static int cpu_sandbox_run(const struct udevice *dev, struct cpu_job *job)
+{
+	/* sandbox has a single thread, so run the job straight away */
+	cpu_job_run(job);
+
+	return 0;
+}
+
 static int cpu_sandbox_is_current(struct udevice *dev)
 {
 	if (!strcmp(dev->name, cpu_current))
@@ -64,6 +72,7 @@ static const struct cpu_ops cpu_sandbox_ops = {
 	.get_vendor = cpu_sandbox_get_vendor,
 	.is_current = cpu_sandbox_is_current,
 	.release_core = cpu_sandbox_release_core,
+	.run = cpu_sandbox_run,
 };
 
 static int cpu_sandbox_bind(struct udevice *dev)
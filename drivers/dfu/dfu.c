@@ -6,6 +6,8 @@
  * author: Lukasz Majewski <l.majewski@samsung.com>
  */
 
+#include <display_options.h>
+#include <div64.h>
 #include <env.h>
 #include <errno.h>
 #include <log.h>
@@ -17,6 +19,13 @@
 #include <linux/list.h>
 #include <linux/compiler.h>
 #include <linux/printk.h>
+#include <time.h>
+
+#ifdef CONFIG_DFU_WRITE_BUFFERS
+#define DFU_WRITE_BUFFERS	CONFIG_DFU_WRITE_BUFFERS
+#else
+#define DFU_WRITE_BUFFERS	1
+#endif
 
 LIST_HEAD(dfu_list);
 static int dfu_alt_num;
@@ -199,10 +208,41 @@ static unsigned char *dfu_buf;
 static unsigned long dfu_buf_size;
 static enum dfu_device_type dfu_buf_device_type;
 
+/*
+ * Write queue: when enabled, a full buffer is queued instead of being written
+ * at once and the next one is filled, while the main loop writes the queued
+ * buffers with dfu_write_pending(). dfu_wbufs[0] is dfu_buf.
+ */
+static bool dfu_wq_enabled;
+static unsigned char *dfu_wbufs[DFU_WRITE_BUFFERS];
+static long dfu_wq_len[DFU_WRITE_BUFFERS];
+static int dfu_wq_fill;		/* buffer being filled */
+static int dfu_wq_head;		/* oldest queued buffer */
+static int dfu_wq_count;	/* number of queued buffers */
+static struct dfu_entity *dfu_wq_entity;
+static int dfu_wq_err;
+
+static void dfu_write_queue_reset(void)
+{
+	dfu_wq_fill = 0;
+	dfu_wq_head = 0;
+	dfu_wq_count = 0;
+	dfu_wq_entity = NULL;
+	dfu_wq_err = 0;
+}
+
 unsigned char *dfu_free_buf(void)
 {
+	int i;
+
+	for (i = 1; i < DFU_WRITE_BUFFERS; i++) {
+		free(dfu_wbufs[i]);
+		dfu_wbufs[i] = NULL;
+	}
+	dfu_write_queue_reset();
 	free(dfu_buf);
 	dfu_buf = NULL;
+	dfu_wbufs[0] = NULL;
 	return dfu_buf;
 }
 
@@ -237,10 +277,21 @@ unsigned char *dfu_get_buf(struct dfu_entity *dfu)
 		printf("%s: Could not memalign 0x%lx bytes\n",
 		       __func__, dfu_buf_size);
 
+	dfu_wbufs[0] = dfu_buf;
 	dfu_buf_device_type = dfu->dev_type;
 	return dfu_buf;
 }
 
+/* Get the next write buffer, NULL if there is none */
+static unsigned char *dfu_get_write_buf(int i)
+{
+	if (!dfu_wbufs[i])
+		dfu_wbufs[i] = memalign(CONFIG_SYS_CACHELINE_SIZE,
+					dfu_buf_size);
+
+	return dfu_wbufs[i];
+}
+
 static char *dfu_get_hash_algo(void)
 {
 	char *s;
@@ -258,26 +309,21 @@ static char *dfu_get_hash_algo(void)
 	return NULL;
 }
 
-static int dfu_write_buffer_drain(struct dfu_entity *dfu)
+static int dfu_write_medium_buf(struct dfu_entity *dfu, u8 *buf, long w_size)
 {
-	long w_size;
+	ulong start_us;
 	int ret;
 
-	/* flush size? */
-	w_size = dfu->i_buf - dfu->i_buf_start;
-	if (w_size == 0)
-		return 0;
-
 	if (dfu_hash_algo)
 		dfu_hash_algo->hash_update(dfu_hash_algo, &dfu->crc,
-					   dfu->i_buf_start, w_size, 0);
+					   buf, w_size, 0);
 
-	ret = dfu->write_medium(dfu, dfu->offset, dfu->i_buf_start, &w_size);
+	start_us = timer_get_us();
+	ret = dfu->write_medium(dfu, dfu->offset, buf, &w_size);
 	if (ret)
 		debug("%s: Write error!\n", __func__);
-
-	/* point back */
-	dfu->i_buf = dfu->i_buf_start;
+	dfu->stat_write_us += timer_get_us() - start_us;
+	dfu->stat_bytes += w_size;
 
 	/* update offset */
 	dfu->offset += w_size;
@@ -287,6 +333,105 @@ static int dfu_write_buffer_drain(struct dfu_entity *dfu)
 	return ret;
 }
 
+/* Write the oldest queued buffer */
+static int dfu_write_queued(void)
+{
+	struct dfu_entity *dfu = dfu_wq_entity;
+	int i = dfu_wq_head;
+	int ret;
+
+	dfu_wq_head = (i + 1) % DFU_WRITE_BUFFERS;
+	dfu_wq_count--;
+	ret = dfu_write_medium_buf(dfu, dfu_wbufs[i], dfu_wq_len[i]);
+	if (ret) {
+		/* drop the rest, the error is returned by the next write */
+		dfu_wq_err = ret;
+		dfu_wq_count = 0;
+	}
+
+	return ret;
+}
+
+void dfu_write_pending(void)
+{
+	if (dfu_wq_count && !dfu_wq_err)
+		dfu_write_queued();
+}
+
+void dfu_set_write_queue(bool enable)
+{
+	dfu_wq_enabled = enable && DFU_WRITE_BUFFERS > 1;
+}
+
+/* Queue the buffer being filled and move on to the next one */
+static int dfu_write_buffer_queue(struct dfu_entity *dfu, long w_size)
+{
+	int next = (dfu_wq_fill + 1) % DFU_WRITE_BUFFERS;
+	u8 *buf;
+	int ret;
+
+	/* make room by writing the oldest one */
+	if (dfu_wq_count == DFU_WRITE_BUFFERS - 1) {
+		ret = dfu_write_queued();
+		if (ret)
+			return ret;
+	}
+	buf = dfu_get_write_buf(next);
+	if (!buf)
+		return -ENOMEM;
+
+	dfu_wq_entity = dfu;
+	dfu_wq_len[dfu_wq_fill] = w_size;
+	dfu_wq_count++;
+	dfu_wq_fill = next;
+
+	dfu->i_buf_start = buf;
+	dfu->i_buf_end = buf + dfu_buf_size;
+	dfu->i_buf = buf;
+
+	return 0;
+}
+
+/*
+ * Write out the buffer being filled. With @queue, it may be queued instead,
+ * otherwise all queued buffers are written before it.
+ */
+static int dfu_write_buffer_drain(struct dfu_entity *dfu, bool queue)
+{
+	long w_size;
+	int ret;
+
+	if (dfu_wq_err)
+		return dfu_wq_err;
+
+	/* flush size? */
+	w_size = dfu->i_buf - dfu->i_buf_start;
+	if (w_size == 0 && !dfu_wq_count)
+		return 0;
+
+	if (queue && dfu_wq_enabled && w_size) {
+		ret = dfu_write_buffer_queue(dfu, w_size);
+		/* without memory for another buffer, write it now */
+		if (ret != -ENOMEM)
+			return ret;
+	}
+
+	while (dfu_wq_count) {
+		ret = dfu_write_queued();
+		if (ret)
+			return ret;
+	}
+	if (w_size == 0)
+		return 0;
+
+	ret = dfu_write_medium_buf(dfu, dfu->i_buf_start, w_size);
+
+	/* point back */
+	dfu->i_buf = dfu->i_buf_start;
+
+	return ret;
+}
+
 void dfu_transaction_cleanup(struct dfu_entity *dfu)
 {
 	/* clear everything */
@@ -299,6 +444,9 @@ void dfu_transaction_cleanup(struct dfu_entity *dfu)
 	dfu->r_left = 0;
 	dfu->b_left = 0;
 	dfu->bad_skip = 0;
+	dfu->stat_bytes = 0;
+	dfu->stat_write_us = 0;
+	dfu_write_queue_reset();
 
 	dfu->inited = 0;
 }
@@ -316,6 +464,7 @@ int dfu_transaction_initiate(struct dfu_entity *dfu, bool read)
 		return -ENOMEM;
 
 	dfu->i_buf_end = dfu->i_buf_start + dfu_get_buf_size();
+	dfu->stat_start = get_timer(0);
 
 	if (read) {
 		ret = dfu->get_medium_size(dfu, &dfu->r_left);
@@ -330,11 +479,25 @@ int dfu_transaction_initiate(struct dfu_entity *dfu, bool read)
 	return 0;
 }
 
+static void dfu_show_stats(struct dfu_entity *dfu)
+{
+	ulong elapsed = max(get_timer(dfu->stat_start), 1UL);
+
+	if (!dfu->stat_bytes)
+		return;
+
+	printf("%sDFU %s: ", dfu_hash_algo ? "" : "\n", dfu->name);
+	print_size(dfu->stat_bytes, " in ");
+	printf("%lu ms, %lukiB/s, writing %llu ms\n", elapsed,
+	       (ulong)(lldiv(dfu->stat_bytes * 1000, elapsed) >> 10),
+	       lldiv(dfu->stat_write_us, 1000));
+}
+
 int dfu_flush(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 {
 	int ret = 0;
 
-	ret = dfu_write_buffer_drain(dfu);
+	ret = dfu_write_buffer_drain(dfu, false);
 	if (ret)
 		return ret;
 
@@ -344,6 +507,7 @@ int dfu_flush(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 	if (dfu_hash_algo)
 		printf("\nDFU complete %s: 0x%08x\n", dfu_hash_algo->name,
 		       dfu->crc);
+	dfu_show_stats(dfu);
 
 	dfu_flush_callback(dfu);
 
@@ -364,6 +528,14 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 	if (ret < 0)
 		return ret;
 
+	/* a queued buffer could not be written */
+	if (dfu_wq_err) {
+		ret = dfu_wq_err;
+		dfu_transaction_cleanup(dfu);
+		dfu_error_callback(dfu, "DFU write error");
+		return ret;
+	}
+
 	if (dfu->i_blk_seq_num != blk_seq_num) {
 		printf("%s: Wrong sequence number! [%d] [%d]\n",
 		       __func__, dfu->i_blk_seq_num, blk_seq_num);
@@ -390,7 +562,7 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 
 	/* flush buffer if overflow */
 	if ((dfu->i_buf + size) > dfu->i_buf_end) {
-		ret = dfu_write_buffer_drain(dfu);
+		ret = dfu_write_buffer_drain(dfu, true);
 		if (ret) {
 			dfu_transaction_cleanup(dfu);
 			dfu_error_callback(dfu, "DFU write error");
@@ -412,7 +584,7 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 
 	/* if end or if buffer full flush */
 	if (size == 0 || (dfu->i_buf + size) > dfu->i_buf_end) {
-		ret = dfu_write_buffer_drain(dfu);
+		ret = dfu_write_buffer_drain(dfu, true);
 		if (ret) {
 			dfu_transaction_cleanup(dfu);
 			dfu_error_callback(dfu, "DFU write error");
@@ -327,3 +327,53 @@ void fastboot_block_flash_write(const char *part_name, void *download_buffer,
 					       download_buffer, download_bytes, response);
 	}
 }
+
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+static struct fb_block_sparse stream_priv;
+static struct sparse_storage stream_storage;
+static struct sparse_stream stream;
+
+int fastboot_block_stream_open(struct blk_desc *dev_desc,
+			       struct disk_partition *info,
+			       const char *part_name, char *response)
+{
+	stream_priv.dev_desc = dev_desc;
+
+	stream_storage.blksz = info->blksz;
+	stream_storage.start = info->start;
+	stream_storage.size = info->size;
+	stream_storage.write = fb_block_sparse_write;
+	stream_storage.reserve = fb_block_sparse_reserve;
+	stream_storage.mssg = fastboot_fail;
+	stream_storage.priv = &stream_priv;
+
+	if (sparse_stream_start(&stream, &stream_storage, part_name)) {
+		fastboot_fail("out of memory", response);
+		return -ENOMEM;
+	}
+	printf("Flashing '%s' while downloading\n", part_name);
+
+	return 0;
+}
+
+int fastboot_block_stream_write(const void *data, u32 len, char *response)
+{
+	int ret;
+
+	ret = sparse_stream_write(&stream, data, len, response);
+	if (ret)
+		sparse_stream_abort(&stream);
+
+	return ret;
+}
+
+int fastboot_block_stream_close(char *response)
+{
+	return sparse_stream_finish(&stream, response);
+}
+
+void fastboot_block_stream_abort(void)
+{
+	sparse_stream_abort(&stream);
+}
+#endif
@@ -32,6 +32,30 @@ static u32 fastboot_bytes_received;
  */
 static u32 fastboot_bytes_expected;
 
+/**
+ * fastboot_stream_part - partition which downloads are written to as they
+ * arrive, or empty to keep them in the download buffer
+ */
+static char fastboot_stream_part[FASTBOOT_COMMAND_LEN];
+
+/**
+ * fastboot_streaming - true while a download is being written to
+ * fastboot_stream_part
+ */
+static bool fastboot_streaming;
+
+/**
+ * fastboot_stream_err - result of writing the last download to
+ * fastboot_stream_part, -ENODATA if there is none to flash
+ */
+static int fastboot_stream_err = -ENODATA;
+
+/**
+ * fastboot_stream_response - response explaining why writing the download
+ * failed, sent once the download is complete
+ */
+static char fastboot_stream_response[FASTBOOT_RESPONSE_LEN];
+
 static void okay(char *, char *);
 static void getvar(char *, char *);
 static void download(char *, char *);
@@ -45,6 +69,7 @@ static void oem_partconf(char *, char *);
 static void oem_bootbus(char *, char *);
 static void oem_console(char *, char *);
 static void oem_board(char *, char *);
+static void oem_stream(char *, char *);
 static void run_ucmd(char *, char *);
 static void run_acmd(char *, char *);
 
@@ -120,6 +145,10 @@ static const struct {
 		.command = "oem board",
 		.dispatch = CONFIG_IS_ENABLED(FASTBOOT_OEM_BOARD, (oem_board), (NULL))
 	},
+	[FASTBOOT_COMMAND_OEM_STREAM] = {
+		.command = "oem stream",
+		.dispatch = CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM, (oem_stream), (NULL))
+	},
 	[FASTBOOT_COMMAND_UCMD] = {
 		.command = "UCmd",
 		.dispatch = CONFIG_IS_ENABLED(FASTBOOT_UUU_SUPPORT, (run_ucmd), (NULL))
@@ -221,6 +250,66 @@ static void getvar(char *cmd_parameter, char *response)
 	fastboot_getvar(cmd_parameter, response);
 }
 
+u32 fastboot_max_download_size(void)
+{
+	if (CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM) && *fastboot_stream_part)
+		return U32_MAX;
+
+	return fastboot_buf_size;
+}
+
+/**
+ * fastboot_stream_get_part() - Look up the partition to write downloads to
+ *
+ * @part_name: Named partition to lookup
+ * @dev_desc: Pointer to returned blk_desc pointer
+ * @info: Pointer to returned struct disk_partition
+ * @response: Pointer to fastboot response buffer
+ * Return: Partition number, or -ve on error
+ */
+static int fastboot_stream_get_part(const char *part_name,
+				    struct blk_desc **dev_desc,
+				    struct disk_partition *info,
+				    char *response)
+{
+	if (IS_ENABLED(CONFIG_FASTBOOT_FLASH_BLOCK))
+		return fastboot_block_get_part_info(part_name, dev_desc, info,
+						    response);
+
+	return fastboot_mmc_get_part_info(part_name, dev_desc, info, response);
+}
+
+/**
+ * fastboot_stream_open() - Start writing a download to fastboot_stream_part
+ *
+ * @response: Pointer to fastboot response buffer
+ * Return: 0 on success, -ve on error
+ */
+static int fastboot_stream_open(char *response)
+{
+	struct disk_partition info;
+	struct blk_desc *dev_desc;
+	int ret;
+
+	if (fastboot_streaming)
+		fastboot_block_stream_abort();
+	fastboot_streaming = false;
+	fastboot_stream_err = -ENODATA;
+
+	ret = fastboot_stream_get_part(fastboot_stream_part, &dev_desc, &info,
+				       response);
+	if (ret < 0)
+		return ret;
+	ret = fastboot_block_stream_open(dev_desc, &info, fastboot_stream_part,
+					 response);
+	if (ret)
+		return ret;
+	fastboot_streaming = true;
+	fastboot_stream_err = 0;
+
+	return 0;
+}
+
 /**
  * fastboot_download() - Start a download transfer from the client
  *
@@ -247,7 +336,13 @@ static void download(char *cmd_parameter, char *response)
 	 *
 	 * where cmd_parameter is an 8 digit hexadecimal number
 	 */
-	if (fastboot_bytes_expected > fastboot_buf_size) {
+	if (CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM) && *fastboot_stream_part) {
+		if (fastboot_stream_open(response))
+			return;
+		printf("Starting download of %d bytes\n",
+		       fastboot_bytes_expected);
+		fastboot_response("DATA", response, "%s", cmd_parameter);
+	} else if (fastboot_bytes_expected > fastboot_buf_size) {
 		fastboot_fail(cmd_parameter, response);
 	} else {
 		printf("Starting download of %d bytes\n",
@@ -273,9 +368,10 @@ u32 fastboot_data_remaining(void)
  * @fastboot_data_len: Length of received fastboot data
  * @response: Pointer to fastboot response buffer
  *
- * Copies image data from fastboot_data to fastboot_buf_addr. Writes to
- * response. fastboot_bytes_received is updated to indicate the number
- * of bytes that have been transferred.
+ * Copies image data from fastboot_data to fastboot_buf_addr, or writes it to
+ * the partition given by "oem stream". Writes to response.
+ * fastboot_bytes_received is updated to indicate the number of bytes that
+ * have been transferred.
  *
  * On completion sets image_size and ${filesize} to the total size of the
  * downloaded image.
@@ -294,9 +390,18 @@ void fastboot_data_download(const void *fastboot_data,
 			      response);
 		return;
 	}
-	/* Download data to fastboot_buf_addr */
-	memcpy(fastboot_buf_addr + fastboot_bytes_received,
-	       fastboot_data, fastboot_data_len);
+	if (fastboot_streaming) {
+		/* a failure is reported once the download is complete */
+		if (!fastboot_stream_err)
+			fastboot_stream_err =
+				fastboot_block_stream_write(fastboot_data,
+							    fastboot_data_len,
+							    fastboot_stream_response);
+	} else {
+		/* Download data to fastboot_buf_addr */
+		memcpy(fastboot_buf_addr + fastboot_bytes_received,
+		       fastboot_data, fastboot_data_len);
+	}
 
 	pre_dot_num = fastboot_bytes_received / BYTES_PER_DOT;
 	fastboot_bytes_received += fastboot_data_len;
@@ -324,6 +429,17 @@ void fastboot_data_complete(char *response)
 	printf("\ndownloading of %d bytes finished\n", fastboot_bytes_received);
 	image_size = fastboot_bytes_received;
 	env_set_hex("filesize", image_size);
+	if (fastboot_streaming) {
+		/* nothing was left in the download buffer */
+		image_size = 0;
+		fastboot_streaming = false;
+		if (!fastboot_stream_err)
+			fastboot_stream_err =
+				fastboot_block_stream_close(fastboot_stream_response);
+		if (fastboot_stream_err)
+			strlcpy(response, fastboot_stream_response,
+				FASTBOOT_RESPONSE_LEN);
+	}
 	fastboot_bytes_expected = 0;
 	fastboot_bytes_received = 0;
 }
@@ -339,6 +455,20 @@ void fastboot_data_complete(char *response)
  */
 static void __maybe_unused flash(char *cmd_parameter, char *response)
 {
+	if (CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM) && *fastboot_stream_part) {
+		/* the image was written while it was downloaded */
+		if (!cmd_parameter || strcmp(cmd_parameter, fastboot_stream_part))
+			fastboot_response("FAIL", response,
+					  "downloads go to '%s'",
+					  fastboot_stream_part);
+		else if (fastboot_stream_err)
+			fastboot_fail("no image written", response);
+		else
+			fastboot_okay(NULL, response);
+		fastboot_stream_err = -ENODATA;
+		return;
+	}
+
 	if (IS_ENABLED(CONFIG_FASTBOOT_FLASH_BLOCK))
 		fastboot_block_flash_write(cmd_parameter, fastboot_buf_addr,
 					   image_size, response);
@@ -589,3 +719,38 @@ static void __maybe_unused oem_board(char *cmd_parameter, char *response)
 {
 	fastboot_oem_board(cmd_parameter, (void *)fastboot_buf_addr, image_size, response);
 }
+
+/**
+ * oem_stream() - Execute the OEM stream command
+ *
+ * Downloads are written to the partition named by the parameter as they
+ * arrive, until the command is sent without a parameter.
+ *
+ * @cmd_parameter: Pointer to command parameter
+ * @response: Pointer to fastboot response buffer
+ */
+static void __maybe_unused oem_stream(char *cmd_parameter, char *response)
+{
+	struct disk_partition info;
+	struct blk_desc *dev_desc;
+
+	if (fastboot_streaming)
+		fastboot_block_stream_abort();
+	fastboot_streaming = false;
+	fastboot_stream_err = -ENODATA;
+
+	if (!cmd_parameter || !*cmd_parameter) {
+		*fastboot_stream_part = '\0';
+		fastboot_okay(NULL, response);
+		return;
+	}
+
+	if (fastboot_stream_get_part(cmd_parameter, &dev_desc, &info,
+				     response) < 0) {
+		*fastboot_stream_part = '\0';
+		return;
+	}
+	strlcpy(fastboot_stream_part, cmd_parameter,
+		sizeof(fastboot_stream_part));
+	fastboot_okay(NULL, response);
+}
@@ -17,12 +17,11 @@
 #include <linux/compat.h>
 #include "nvme.h"
 
-#define NVME_Q_DEPTH		2
 #define NVME_AQ_DEPTH		2
 #define NVME_SQ_SIZE(depth)	(depth * sizeof(struct nvme_command))
 #define NVME_CQ_SIZE(depth)	(depth * sizeof(struct nvme_completion))
-#define NVME_CQ_ALLOCATION	ALIGN(NVME_CQ_SIZE(NVME_Q_DEPTH), \
-				      ARCH_DMA_MINALIGN)
+#define NVME_CQ_ALLOCATION(depth)	ALIGN(NVME_CQ_SIZE(depth), \
+					      ARCH_DMA_MINALIGN)
 #define ADMIN_TIMEOUT		60
 #define IO_TIMEOUT		30
 #define MAX_PRP_POOL		512
@@ -61,8 +60,21 @@ static int nvme_wait_csts(struct nvme_dev *dev, u32 mask, u32 val)
 	return -ETIME;
 }
 
-static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
-			   int total_len, u64 dma_addr)
+/**
+ * nvme_setup_prps() - set up the PRP entries for a transfer
+ *
+ * Each command in flight needs its own PRP list, so @prps is one of the
+ * per-command lists in dev->prp_lists. It is grown if it is too small.
+ *
+ * @dev:	NVMe device
+ * @prps:	PRP list to use for this command
+ * @prp2:	Returns the value for the PRP2 field of the command
+ * @total_len:	Length of the transfer in bytes
+ * @dma_addr:	Bus address of the buffer
+ * Return: 0 if OK, -ENOMEM if the PRP list could not be allocated
+ */
+static int nvme_setup_prps(struct nvme_dev *dev, struct nvme_prp_list *prps,
+			   u64 *prp2, int total_len, u64 dma_addr)
 {
 	u32 page_size = dev->page_size;
 	int offset = dma_addr & (page_size - 1);
@@ -90,23 +102,22 @@ static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
 	nprps = DIV_ROUND_UP(length, page_size);
 	num_pages = DIV_ROUND_UP(nprps - 1, prps_per_page - 1);
 
-	if (nprps > dev->prp_entry_num) {
-		free(dev->prp_pool);
+	if (nprps > prps->entry_num) {
+		free(prps->pool);
 		/*
 		 * Always increase in increments of pages.  It doesn't waste
 		 * much memory and reduces the number of allocations.
 		 */
-		dev->prp_pool = memalign(page_size, num_pages * page_size);
-		if (!dev->prp_pool) {
+		prps->pool = memalign(page_size, num_pages * page_size);
+		if (!prps->pool) {
 			printf("Error: malloc prp_pool fail\n");
+			prps->entry_num = 0;
 			return -ENOMEM;
 		}
-		dev->prp_pool_dma = dev_phys_to_bus(dev->udev,
-						    (uintptr_t)dev->prp_pool);
-		dev->prp_entry_num = num_pages * (prps_per_page - 1) + 1;
+		prps->entry_num = num_pages * (prps_per_page - 1) + 1;
 	}
 
-	prp_pool = dev->prp_pool;
+	prp_pool = prps->pool;
 	i = 0;
 	while (nprps) {
 		if ((i == (prps_per_page - 1)) && nprps > 1) {
@@ -121,9 +132,9 @@ static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
 		dma_addr += page_size;
 		nprps--;
 	}
-	*prp2 = dev->prp_pool_dma;
+	*prp2 = dev_phys_to_bus(dev->udev, (uintptr_t)prps->pool);
 
-	flush_dcache_range((ulong)dev->prp_pool, (ulong)dev->prp_pool +
+	flush_dcache_range((ulong)prps->pool, (ulong)prps->pool +
 			   num_pages * page_size);
 
 	return 0;
@@ -148,13 +159,28 @@ static u16 nvme_read_completion_status(struct nvme_queue *nvmeq, u16 index)
 	 * as the cache line should never become dirty.
 	 */
 	ulong start = (ulong)&nvmeq->cqes[0];
-	ulong stop = start + NVME_CQ_ALLOCATION;
+	ulong stop = start + NVME_CQ_ALLOCATION(nvmeq->q_depth);
 
 	invalidate_dcache_range(start, stop);
 
 	return readw(&(nvmeq->cqes[index].status));
 }
 
+/**
+ * nvme_write_cmd() - copy a command into a queue at its tail
+ *
+ * @nvmeq:	The queue to use
+ * @cmd:	The command to copy
+ */
+static void nvme_write_cmd(struct nvme_queue *nvmeq, struct nvme_command *cmd)
+{
+	u16 tail = nvmeq->sq_tail;
+
+	memcpy(&nvmeq->sq_cmds[tail], cmd, sizeof(*cmd));
+	flush_dcache_range((ulong)&nvmeq->sq_cmds[tail],
+			   (ulong)&nvmeq->sq_cmds[tail] + sizeof(*cmd));
+}
+
 /**
  * nvme_submit_cmd() - copy a command into a queue and ring the doorbell
  *
@@ -166,9 +192,7 @@ static void nvme_submit_cmd(struct nvme_queue *nvmeq, struct nvme_command *cmd)
 	struct nvme_ops *ops;
 	u16 tail = nvmeq->sq_tail;
 
-	memcpy(&nvmeq->sq_cmds[tail], cmd, sizeof(*cmd));
-	flush_dcache_range((ulong)&nvmeq->sq_cmds[tail],
-			   (ulong)&nvmeq->sq_cmds[tail] + sizeof(*cmd));
+	nvme_write_cmd(nvmeq, cmd);
 
 	ops = (struct nvme_ops *)nvmeq->dev->udev->driver->ops;
 	if (ops && ops->submit_cmd) {
@@ -243,6 +267,91 @@ static int nvme_submit_sync_cmd(struct nvme_queue *nvmeq,
 	return status;
 }
 
+/**
+ * nvme_submit_cmds() - submit a batch of commands and wait for them all
+ *
+ * The commands are copied into the queue back-to-back and the doorbell is
+ * rung once for the whole batch. The completions are then reaped together,
+ * in whatever order the controller finishes the commands, and the
+ * completion queue head doorbell is written once at the end.
+ *
+ * Controllers with their own submit_cmd() operation get the commands one at
+ * a time.
+ *
+ * @nvmeq:	The queue to use, which must have room for @count commands
+ * @cmds:	The commands to send
+ * @count:	Number of commands
+ * @timeout:	Timeout for the whole batch
+ * Return: number of leading commands in @cmds which completed successfully,
+ * or -ETIMEDOUT
+ */
+static int nvme_submit_cmds(struct nvme_queue *nvmeq, struct nvme_command *cmds,
+			    int count, unsigned timeout)
+{
+	struct nvme_ops *ops;
+	u16 head = nvmeq->cq_head;
+	u16 phase = nvmeq->cq_phase;
+	ulong timeout_us = timeout * 100000;
+	ulong start_time;
+	int i, ok = count;
+	u16 status, id;
+
+	ops = (struct nvme_ops *)nvmeq->dev->udev->driver->ops;
+	if (ops && ops->submit_cmd) {
+		for (i = 0; i < count; i++) {
+			if (nvme_submit_sync_cmd(nvmeq, &cmds[i], NULL,
+						 timeout))
+				return i;
+		}
+
+		return count;
+	}
+
+	for (i = 0; i < count; i++) {
+		/* the batch is drained before the next, so IDs can repeat */
+		cmds[i].common.command_id = cpu_to_le16(i);
+		nvme_write_cmd(nvmeq, &cmds[i]);
+		if (++nvmeq->sq_tail == nvmeq->q_depth)
+			nvmeq->sq_tail = 0;
+	}
+	writel(nvmeq->sq_tail, nvmeq->q_db);
+
+	start_time = timer_get_us();
+	for (i = 0; i < count;) {
+		status = nvme_read_completion_status(nvmeq, head);
+		if ((status & 0x01) != phase) {
+			if (timeout_us > 0 && (timer_get_us() - start_time)
+			    >= timeout_us) {
+				pr_warn("nvme: %d of %d cmds timed out\n",
+					count - i, count);
+				ok = -ETIMEDOUT;
+				break;
+			}
+			continue;
+		}
+
+		status >>= 1;
+		if (status) {
+			id = le16_to_cpu(readw(&nvmeq->cqes[head].command_id));
+			printf("ERROR: status = %x, cmd = %d, head = %d\n",
+			       status, id, head);
+			ok = min_t(int, ok, id);
+		}
+
+		if (++head == nvmeq->q_depth) {
+			head = 0;
+			phase = !phase;
+		}
+		i++;
+	}
+
+	writel(head, nvmeq->q_db + nvmeq->dev->db_stride);
+	nvmeq->cq_head = head;
+	nvmeq->cq_phase = phase;
+
+	return ok;
+}
+
 static int nvme_submit_admin_cmd(struct nvme_dev *dev, struct nvme_command *cmd,
 				 u32 *result)
 {
@@ -259,7 +368,7 @@ static struct nvme_queue *nvme_alloc_queue(struct nvme_dev *dev,
 		return NULL;
 	memset(nvmeq, 0, sizeof(*nvmeq));
 
-	nvmeq->cqes = (void *)memalign(4096, NVME_CQ_ALLOCATION);
+	nvmeq->cqes = (void *)memalign(4096, NVME_CQ_ALLOCATION(depth));
 	if (!nvmeq->cqes)
 		goto free_nvmeq;
 	nvmeq->cq_dma_addr = dev_phys_to_bus(dev->udev,
@@ -369,7 +478,8 @@ static void nvme_init_queue(struct nvme_queue *nvmeq, u16 qid)
 	nvmeq->q_db = &dev->dbs[qid * 2 * dev->db_stride];
 	memset((void *)nvmeq->cqes, 0, NVME_CQ_SIZE(nvmeq->q_depth));
 	flush_dcache_range((ulong)nvmeq->cqes,
-			   (ulong)nvmeq->cqes + NVME_CQ_ALLOCATION);
+			   (ulong)nvmeq->cqes +
+			   NVME_CQ_ALLOCATION(nvmeq->q_depth));
 	dev->online_queues++;
 }
 
@@ -744,53 +854,65 @@ static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
 {
 	struct nvme_ns *ns = dev_get_priv(udev);
 	struct nvme_dev *dev = ns->dev;
-	struct nvme_command c;
+	struct nvme_command *c;
 	struct blk_desc *desc = dev_get_uclass_plat(udev);
-	int status;
+	int count, done;
 	u64 prp2;
 	u64 total_len = blkcnt << desc->log2blksz;
 	u64 temp_len = total_len;
+	u64 batch_len;
 	uintptr_t dma_addr = dev_phys_to_bus(udev, (uintptr_t)buffer);
 
 	u64 slba = blknr;
 	u16 lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
+	u64 max_len = (u64)lbas << ns->lba_shift;
 	u64 total_lbas = blkcnt;
+	bool err = false;
 
 	flush_dcache_range((unsigned long)buffer,
 			   (unsigned long)buffer + total_len);
 
-	c.rw.opcode = read ? nvme_cmd_read : nvme_cmd_write;
-	c.rw.flags = 0;
-	c.rw.nsid = cpu_to_le32(ns->ns_id);
-	c.rw.control = 0;
-	c.rw.dsmgmt = 0;
-	c.rw.reftag = 0;
-	c.rw.apptag = 0;
-	c.rw.appmask = 0;
-	c.rw.metadata = 0;
-
-	while (total_lbas) {
-		if (total_lbas < lbas) {
-			lbas = (u16)total_lbas;
-			total_lbas = 0;
-		} else {
-			total_lbas -= lbas;
+	while (total_lbas && !err) {
+		/* Split off as many commands as the queue can take at once */
+		batch_len = 0;
+		for (count = 0; total_lbas && count < dev->batch_size;
+		     count++) {
+			if (total_lbas < lbas) {
+				lbas = (u16)total_lbas;
+				total_lbas = 0;
+			} else {
+				total_lbas -= lbas;
+			}
+
+			if (nvme_setup_prps(dev, &dev->prp_lists[count], &prp2,
+					    lbas << ns->lba_shift, dma_addr)) {
+				err = true;
+				break;
+			}
+
+			c = &dev->batch_cmds[count];
+			memset(c, '\0', sizeof(*c));
+			c->rw.opcode = read ? nvme_cmd_read : nvme_cmd_write;
+			c->rw.nsid = cpu_to_le32(ns->ns_id);
+			c->rw.slba = cpu_to_le64(slba);
+			c->rw.length = cpu_to_le16(lbas - 1);
+			c->rw.prp1 = cpu_to_le64(dma_addr);
+			c->rw.prp2 = cpu_to_le64(prp2);
+			slba += lbas;
+			dma_addr += lbas << ns->lba_shift;
+			batch_len += (u32)lbas << ns->lba_shift;
 		}
+		if (!count)
+			break;
 
-		if (nvme_setup_prps(dev, &prp2,
-				    lbas << ns->lba_shift, dma_addr))
-			return -EIO;
-		c.rw.slba = cpu_to_le64(slba);
-		slba += lbas;
-		c.rw.length = cpu_to_le16(lbas - 1);
-		c.rw.prp1 = cpu_to_le64(dma_addr);
-		c.rw.prp2 = cpu_to_le64(prp2);
-		status = nvme_submit_sync_cmd(dev->queues[NVME_IO_Q],
-				&c, NULL, IO_TIMEOUT);
-		if (status)
+		done = nvme_submit_cmds(dev->queues[NVME_IO_Q],
+					dev->batch_cmds, count, IO_TIMEOUT);
+		if (done < 0)
+			break;
+		/* only the last command of the transfer can be short */
+		temp_len -= done == count ? batch_len : done * max_len;
+		if (done < count)
 			break;
-		temp_len -= (u32)lbas << ns->lba_shift;
-		dma_addr += lbas << ns->lba_shift;
 	}
 
 	if (read)
@@ -825,10 +947,42 @@ U_BOOT_DRIVER(nvme_blk) = {
 	.priv_auto	= sizeof(struct nvme_ns),
 };
 
+static void nvme_free_batch(struct nvme_dev *dev)
+{
+	int i;
+
+	for (i = 0; dev->prp_lists && i < dev->batch_size; i++)
+		free(dev->prp_lists[i].pool);
+	free(dev->prp_lists);
+	dev->prp_lists = NULL;
+	free(dev->batch_cmds);
+	dev->batch_cmds = NULL;
+}
+
+static int nvme_alloc_batch(struct nvme_dev *dev)
+{
+	int i;
+
+	dev->batch_cmds = calloc(dev->batch_size, sizeof(struct nvme_command));
+	dev->prp_lists = calloc(dev->batch_size, sizeof(struct nvme_prp_list));
+	if (!dev->batch_cmds || !dev->prp_lists)
+		return -ENOMEM;
+
+	for (i = 0; i < dev->batch_size; i++) {
+		dev->prp_lists[i].pool = memalign(dev->page_size, MAX_PRP_POOL);
+		if (!dev->prp_lists[i].pool)
+			return -ENOMEM;
+		dev->prp_lists[i].entry_num = MAX_PRP_POOL >> 3;
+	}
+
+	return 0;
+}
+
 int nvme_init(struct udevice *udev)
 {
 	struct nvme_dev *ndev = dev_get_priv(udev);
 	struct nvme_id_ns *id;
+	struct nvme_ops *ops;
 	int ret;
 
 	ndev->udev = udev;
@@ -848,7 +1002,8 @@ int nvme_init(struct udevice *udev)
 	memset(ndev->queues, 0, NVME_Q_NUM * sizeof(struct nvme_queue *));
 
 	ndev->cap = nvme_readq(&ndev->bar->cap);
-	ndev->q_depth = min_t(int, NVME_CAP_MQES(ndev->cap) + 1, NVME_Q_DEPTH);
+	ndev->q_depth = min_t(int, NVME_CAP_MQES(ndev->cap) + 1,
+			      CONFIG_NVME_QUEUE_DEPTH);
 	ndev->db_stride = 1 << NVME_CAP_STRIDE(ndev->cap);
 	ndev->dbs = ((void __iomem *)ndev->bar) + 4096;
 
@@ -858,17 +1013,20 @@ int nvme_init(struct udevice *udev)
 		goto free_queue;
 	}
 
+	/*
+	 * A queue of depth n can hold n - 1 commands. Controllers with their
+	 * own submission method get one command at a time.
+	 */
+	ops = (struct nvme_ops *)udev->driver->ops;
+	ndev->batch_size = ops && ops->submit_cmd ? 1 : ndev->q_depth - 1;
+
 	/* Allocate after the page size is known */
-	ndev->prp_pool = memalign(ndev->page_size, MAX_PRP_POOL);
-	if (!ndev->prp_pool) {
-		ret = -ENOMEM;
+	ret = nvme_alloc_batch(ndev);
+	if (ret) {
 		printf("Error: %s: Out of memory!\n", udev->name);
-		goto free_queue;
+		goto free_prp_pool;
 	}
 
-	ndev->prp_pool_dma = dev_phys_to_bus(udev, (uintptr_t)ndev->prp_pool);
-	ndev->prp_entry_num = MAX_PRP_POOL >> 3;
-
 	ret = nvme_setup_io_queues(ndev);
 	if (ret) {
 		log_debug("Unable to setup I/O queues(err=%dE)\n", ret);
@@ -928,7 +1086,7 @@ int nvme_init(struct udevice *udev)
 free_id:
 	free(id);
 free_prp_pool:
-	free((void *)ndev->prp_pool);
+	nvme_free_batch(ndev);
 free_queue:
 	free((void *)ndev->queues);
 free_nvme:
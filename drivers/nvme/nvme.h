@@ -594,6 +594,15 @@ enum {
 	NVME_CSTS_SHST_MASK	= 3 << 2,
 };
 
+/*
+ * A PRP list for one command. Each command of a batch needs its own list,
+ * since they are all in flight at the same time.
+ */
+struct nvme_prp_list {
+	u64 *pool;
+	u32 entry_num;
+};
+
 /* Represents an NVM Express device. Each nvme_dev is a PCI function. */
 struct nvme_dev {
 	struct udevice *udev;
@@ -618,9 +627,9 @@ struct nvme_dev {
 	u32 stripe_size;
 	u32 page_size;
 	u8 vwc;
-	u64 *prp_pool;
-	uintptr_t prp_pool_dma;
-	u32 prp_entry_num;
+	struct nvme_prp_list *prp_lists;
+	struct nvme_command *batch_cmds;
+	int batch_size;
 	u32 nn;
 };
 
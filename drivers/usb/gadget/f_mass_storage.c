@@ -689,6 +689,22 @@ static int sleep_thread(struct fsg_common *common)
 
 /*-------------------------------------------------------------------------*/
 
+/* Pieces of a command's data are not made smaller than this */
+#define FSG_MIN_PIECE	((u32)32768)
+
+/*
+ * Split the data of a command over the buffers, so that the USB transfer
+ * of one piece overlaps with the storage access for the next even when the
+ * command fits in a single buffer.
+ */
+static u32 fsg_piece_len(u32 data_size)
+{
+	u32 piece = ALIGN(DIV_ROUND_UP(data_size, FSG_NUM_BUFFERS),
+			  PAGE_CACHE_SIZE);
+
+	return min(max(piece, FSG_MIN_PIECE), FSG_BUFLEN);
+}
+
 static int do_read(struct fsg_common *common)
 {
 	struct fsg_lun		*curlun = &common->luns[common->lun];
@@ -699,6 +715,7 @@ static int do_read(struct fsg_common *common)
 	loff_t			file_offset;
 	unsigned int		amount;
 	unsigned int		partial_page;
+	u32			piece;
 	ssize_t			nread;
 
 	/* Get the starting Logical Block Address and check that it's
@@ -727,18 +744,19 @@ static int do_read(struct fsg_common *common)
 	if (unlikely(amount_left == 0)) {
 		return -EIO;		/* No default reply */
 	}
+	piece = fsg_piece_len(amount_left);
 
 	for (;;) {
 
 		/* Figure out how much we need to read:
 		 * Try to read the remaining amount.
-		 * But don't read more than the buffer size.
+		 * But don't read more than a piece.
 		 * And don't try to read past the end of the file.
 		 * Finally, if we're not at a page boundary, don't read past
 		 *	the next page.
 		 * If this means reading 0 then we were asked to read past
 		 *	the end of file. */
-		amount = min(amount_left, FSG_BUFLEN);
+		amount = min(amount_left, piece);
 		partial_page = file_offset & (PAGE_CACHE_SIZE - 1);
 		if (partial_page > 0)
 			amount = min(amount, (unsigned int) PAGE_CACHE_SIZE -
@@ -827,6 +845,7 @@ static int do_write(struct fsg_common *common)
 	loff_t			usb_offset, file_offset;
 	unsigned int		amount;
 	unsigned int		partial_page;
+	u32			piece;
 	ssize_t			nwritten;
 	int			rc;
 
@@ -861,6 +880,7 @@ static int do_write(struct fsg_common *common)
 	file_offset = usb_offset = ((loff_t)lba) << curlun->blkbits;
 	amount_left_to_req = common->data_size_from_cmnd;
 	amount_left_to_write = common->data_size_from_cmnd;
+	piece = fsg_piece_len(amount_left_to_req);
 
 	while (amount_left_to_write > 0) {
 
@@ -870,14 +890,14 @@ static int do_write(struct fsg_common *common)
 
 			/* Figure out how much we want to get:
 			 * Try to get the remaining amount.
-			 * But don't get more than the buffer size.
+			 * But don't get more than a piece.
 			 * And don't try to go past the end of the file.
 			 * If we're not at a page boundary,
 			 *	don't go past the next page.
 			 * If this means getting 0, then we were asked
 			 *	to write past the end of file.
 			 * Finally, round down to a block boundary. */
-			amount = min(amount_left_to_req, FSG_BUFLEN);
+			amount = min(amount_left_to_req, piece);
 			partial_page = usb_offset & (PAGE_CACHE_SIZE - 1);
 			if (partial_page > 0)
 				amount = min(amount,
@@ -24,6 +24,7 @@
 
 #include <blk.h>
 #include <config.h>
+#include <fs.h>
 #include <fs_internal.h>
 #include <ext4fs.h>
 #include <ext_common.h>
@@ -38,6 +39,9 @@ static struct disk_partition *part_info;
 void ext4fs_set_blk_dev(struct blk_desc *rbdd, struct disk_partition *info)
 {
 	assert(rbdd->blksz == (1 << rbdd->log2blksz));
+	/* a filesystem kept mounted by the fs layer is replaced */
+	fs_cache_invalidate(NULL);
+	ext4fs_free_extent_runs();
 	ext4fs_blk_desc = rbdd;
 	get_fs()->dev_desc = rbdd;
 	part_info = info;
@@ -1999,6 +1999,172 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 	return blknr;
 }
 
+/* Deepest extent tree allowed, as in Linux */
+#define EXT4_EXT_MAX_DEPTH	5
+/* Longest initialised extent, longer ones are unwritten */
+#define EXT4_EXT_INIT_MAX_LEN	(1 << 15)
+
+/*
+ * Extent runs of the inode last read, so that reading a file in several
+ * parts, or reading the same directory again, does not decode its extent
+ * tree each time. The copy of the tree root catches an inode which has been
+ * written since.
+ */
+static struct {
+	int ino;
+	char root[sizeof(((struct ext2_inode *)0)->b)];
+	struct ext4_extent_run *run;
+	int count;
+	int max;
+} ext4fs_runs;
+
+static int ext4fs_add_extent_run(const struct ext4_extent *extent)
+{
+	struct ext4_extent_run *run;
+	uint len = le16_to_cpu(extent->ee_len);
+	bool uninit = false;
+	u32 lblk = le32_to_cpu(extent->ee_block);
+
+	if (len > EXT4_EXT_INIT_MAX_LEN) {
+		len -= EXT4_EXT_INIT_MAX_LEN;
+		uninit = true;
+	}
+	if (!len)
+		return 0;
+
+	/* The tree must give the extents in order, without overlaps */
+	if (ext4fs_runs.count) {
+		run = &ext4fs_runs.run[ext4fs_runs.count - 1];
+		if (lblk < run->lblk + run->len)
+			return -EINVAL;
+	}
+
+	if (ext4fs_runs.count == ext4fs_runs.max) {
+		int max = ext4fs_runs.max ? ext4fs_runs.max * 2 : 16;
+
+		run = realloc(ext4fs_runs.run, max * sizeof(*run));
+		if (!run)
+			return -ENOMEM;
+		ext4fs_runs.run = run;
+		ext4fs_runs.max = max;
+	}
+
+	run = &ext4fs_runs.run[ext4fs_runs.count++];
+	run->lblk = lblk;
+	run->len = len;
+	run->pblk = le16_to_cpu(extent->ee_start_hi);
+	run->pblk = (run->pblk << 32) + le32_to_cpu(extent->ee_start_lo);
+	run->uninit = uninit;
+
+	return 0;
+}
+
+static int ext4fs_walk_extents(struct ext4_extent_header *ext_block,
+			       int size, int depth)
+{
+	int entries = le16_to_cpu(ext_block->eh_entries);
+	int blksz = EXT2_BLOCK_SIZE(ext4fs_root);
+	int log2_blksz = LOG2_BLOCK_SIZE(ext4fs_root)
+		- get_fs()->dev_desc->log2blksz;
+	struct ext4_extent_idx *index;
+	unsigned long long block;
+	char *buf;
+	int i, ret = 0;
+
+	if (le16_to_cpu(ext_block->eh_magic) != EXT4_EXT_MAGIC ||
+	    le16_to_cpu(ext_block->eh_depth) != depth ||
+	    sizeof(*ext_block) + entries * sizeof(struct ext4_extent) > size)
+		return -EINVAL;
+
+	if (!depth) {
+		struct ext4_extent *extent;
+
+		extent = (struct ext4_extent *)(ext_block + 1);
+		for (i = 0; i < entries; i++) {
+			ret = ext4fs_add_extent_run(&extent[i]);
+			if (ret)
+				return ret;
+		}
+
+		return 0;
+	}
+
+	buf = memalign(ARCH_DMA_MINALIGN, blksz);
+	if (!buf)
+		return -ENOMEM;
+
+	index = (struct ext4_extent_idx *)(ext_block + 1);
+	for (i = 0; i < entries; i++) {
+		block = le16_to_cpu(index[i].ei_leaf_hi);
+		block = (block << 32) + le32_to_cpu(index[i].ei_leaf_lo);
+		if (!ext4fs_devread((lbaint_t)block << log2_blksz, 0, blksz,
+				    buf)) {
+			ret = -EIO;
+			break;
+		}
+		ret = ext4fs_walk_extents((struct ext4_extent_header *)buf,
+					  blksz, depth - 1);
+		if (ret)
+			break;
+	}
+	free(buf);
+
+	return ret;
+}
+
+/**
+ * ext4fs_get_extent_runs() - Get the extents of an inode
+ *
+ * The leaves of the extent tree are read once into a list of runs, sorted by
+ * file block, which is kept until the inode changes or the filesystem is
+ * closed. It is not kept while the filesystem is being written.
+ *
+ * @node:	inode using extents
+ * @runsp:	returns the runs, which must not be freed
+ * Return:	number of runs, or -ve on error
+ */
+int ext4fs_get_extent_runs(struct ext2fs_node *node,
+			   struct ext4_extent_run **runsp)
+{
+	struct ext2_inode *inode = &node->inode;
+	struct ext4_extent_header *ext_block;
+	int ret;
+
+	if (ext4fs_runs.ino && ext4fs_runs.ino == node->ino &&
+	    !memcmp(ext4fs_runs.root, &inode->b, sizeof(inode->b))) {
+		*runsp = ext4fs_runs.run;
+		return ext4fs_runs.count;
+	}
+
+	ext4fs_runs.ino = 0;
+	ext4fs_runs.count = 0;
+
+	ext_block = (struct ext4_extent_header *)inode->b.blocks.dir_blocks;
+	if (le16_to_cpu(ext_block->eh_depth) > EXT4_EXT_MAX_DEPTH)
+		return -EINVAL;
+	ret = ext4fs_walk_extents(ext_block, sizeof(inode->b),
+				  le16_to_cpu(ext_block->eh_depth));
+	if (ret) {
+		ext4fs_free_extent_runs();
+		return ret;
+	}
+
+	/* While the filesystem is written, a tree can change below its root */
+	if (!get_fs()->sb) {
+		ext4fs_runs.ino = node->ino;
+		memcpy(ext4fs_runs.root, &inode->b, sizeof(inode->b));
+	}
+	*runsp = ext4fs_runs.run;
+
+	return ext4fs_runs.count;
+}
+
+void ext4fs_free_extent_runs(void)
+{
+	free(ext4fs_runs.run);
+	memset(&ext4fs_runs, '\0', sizeof(ext4fs_runs));
+}
+
 /**
  * ext4fs_reinit_global() - Reinitialize values of ext4 write implementation's
  *			    global pointers
@@ -2013,6 +2179,7 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock,
  */
 void ext4fs_reinit_global(void)
 {
+	ext4fs_free_extent_runs();
 	if (ext4fs_indir1_block != NULL) {
 		free(ext4fs_indir1_block);
 		ext4fs_indir1_block = NULL;
@@ -2046,6 +2213,66 @@ void ext4fs_close(void)
 	ext4fs_reinit_global();
 }
 
+/**
+ * ext4fs_dirent_node() - Get the node of a directory entry
+ *
+ * @dir:	directory holding the entry
+ * @dirent:	directory entry
+ * @fnode:	returns the node, which the caller must free
+ * @ftype:	returns the type of the file, FILETYPE_...
+ * Return:	1 on success, 0 on error
+ */
+int ext4fs_dirent_node(struct ext2fs_node *dir, struct ext2_dirent *dirent,
+		       struct ext2fs_node **fnode, int *ftype)
+{
+	struct ext2fs_node *fdiro;
+	int type = FILETYPE_UNKNOWN;
+	int status;
+
+	fdiro = zalloc(sizeof(struct ext2fs_node));
+	if (!fdiro)
+		return 0;
+
+	fdiro->data = dir->data;
+	fdiro->ino = le32_to_cpu(dirent->inode);
+
+	if (dirent->filetype != FILETYPE_UNKNOWN) {
+		fdiro->inode_read = 0;
+
+		if (dirent->filetype == FILETYPE_DIRECTORY)
+			type = FILETYPE_DIRECTORY;
+		else if (dirent->filetype == FILETYPE_SYMLINK)
+			type = FILETYPE_SYMLINK;
+		else if (dirent->filetype == FILETYPE_REG)
+			type = FILETYPE_REG;
+	} else {
+		status = ext4fs_read_inode(dir->data,
+					   le32_to_cpu(dirent->inode),
+					   &fdiro->inode);
+		if (status == 0) {
+			free(fdiro);
+			return 0;
+		}
+		fdiro->inode_read = 1;
+
+		if ((le16_to_cpu(fdiro->inode.mode) &
+		     FILETYPE_INO_MASK) == FILETYPE_INO_DIRECTORY) {
+			type = FILETYPE_DIRECTORY;
+		} else if ((le16_to_cpu(fdiro->inode.mode) &
+			    FILETYPE_INO_MASK) == FILETYPE_INO_SYMLINK) {
+			type = FILETYPE_SYMLINK;
+		} else if ((le16_to_cpu(fdiro->inode.mode) &
+			    FILETYPE_INO_MASK) == FILETYPE_INO_REG) {
+			type = FILETYPE_REG;
+		}
+	}
+
+	*fnode = fdiro;
+	*ftype = type;
+
+	return 1;
+}
+
 int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
 				struct ext2fs_node **fnode, int *ftype)
 {
@@ -2062,6 +2289,18 @@ int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
 		if (status == 0)
 			return 0;
 	}
+
+	/*
+	 * Look a name up by the hash tree index, if the directory has one.
+	 * "." and ".." are only in the first block, outside the index.
+	 */
+	if (name && fnode && ftype && strcmp(name, ".") && strcmp(name, "..") &&
+	    (le32_to_cpu(dir->inode.flags) & EXT4_INDEX_FL)) {
+		status = ext4fs_htree_find(dir, name, fnode, ftype);
+		if (status >= 0)
+			return status;
+	}
+
 	/* Search the file.  */
 	while (fpos < le32_to_cpu(dir->inode.size)) {
 		struct ext2_dirent dirent;
@@ -2080,7 +2319,7 @@ int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
 		if (dirent.namelen != 0) {
 			char filename[dirent.namelen + 1];
 			struct ext2fs_node *fdiro;
-			int type = FILETYPE_UNKNOWN;
+			int type;
 
 			status = ext4fs_read_file(dir,
 						  fpos +
@@ -2090,49 +2329,12 @@ int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
 			if (status < 0)
 				return 0;
 
-			fdiro = zalloc(sizeof(struct ext2fs_node));
-			if (!fdiro)
+			status = ext4fs_dirent_node(dir, &dirent, &fdiro,
+						    &type);
+			if (status == 0)
 				return 0;
 
-			fdiro->data = dir->data;
-			fdiro->ino = le32_to_cpu(dirent.inode);
-
 			filename[dirent.namelen] = '\0';
-
-			if (dirent.filetype != FILETYPE_UNKNOWN) {
-				fdiro->inode_read = 0;
-
-				if (dirent.filetype == FILETYPE_DIRECTORY)
-					type = FILETYPE_DIRECTORY;
-				else if (dirent.filetype == FILETYPE_SYMLINK)
-					type = FILETYPE_SYMLINK;
-				else if (dirent.filetype == FILETYPE_REG)
-					type = FILETYPE_REG;
-			} else {
-				status = ext4fs_read_inode(dir->data,
-							   le32_to_cpu
-							   (dirent.inode),
-							   &fdiro->inode);
-				if (status == 0) {
-					free(fdiro);
-					return 0;
-				}
-				fdiro->inode_read = 1;
-
-				if ((le16_to_cpu(fdiro->inode.mode) &
-				     FILETYPE_INO_MASK) ==
-				    FILETYPE_INO_DIRECTORY) {
-					type = FILETYPE_DIRECTORY;
-				} else if ((le16_to_cpu(fdiro->inode.mode)
-					    & FILETYPE_INO_MASK) ==
-					   FILETYPE_INO_SYMLINK) {
-					type = FILETYPE_SYMLINK;
-				} else if ((le16_to_cpu(fdiro->inode.mode)
-					    & FILETYPE_INO_MASK) ==
-					   FILETYPE_INO_REG) {
-					type = FILETYPE_REG;
-				}
-			}
 #ifdef DEBUG
 			printf("iterate >%s<\n", filename);
 #endif /* of DEBUG */
@@ -2319,7 +2521,11 @@ int ext4fs_open(const char *filename, loff_t *len)
 	if (ext4fs_root == NULL)
 		return -1;
 
-	ext4fs_file = NULL;
+	/* the filesystem may have been left mounted with a file open */
+	if (ext4fs_file) {
+		ext4fs_free_node(ext4fs_file, &ext4fs_root->diropen);
+		ext4fs_file = NULL;
+	}
 	status = ext4fs_find_file(filename, &ext4fs_root->diropen, &fdiro,
 				  FILETYPE_REG);
 	if (status == 0)
@@ -47,6 +47,21 @@ static inline void *zalloc(size_t size)
 	return kzalloc(size, 0);
 }
 
+/**
+ * struct ext4_extent_run - extent of a file, decoded from its extent tree
+ *
+ * @lblk:	first file block
+ * @len:	number of blocks
+ * @pblk:	first filesystem block on the device
+ * @uninit:	blocks are allocated but not written, so they read as zeroes
+ */
+struct ext4_extent_run {
+	u32 lblk;
+	u32 len;
+	u64 pblk;
+	bool uninit;
+};
+
 int ext4fs_read_inode(struct ext2_data *data, int ino,
 		      struct ext2_inode *inode);
 int ext4fs_read_file(struct ext2fs_node *node, loff_t pos, loff_t len,
@@ -57,6 +72,22 @@ int ext4fs_find_file1(const char *currpath, struct ext2fs_node *currroot,
 		      struct ext2fs_node **currfound, int *foundtype);
 int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
 			struct ext2fs_node **fnode, int *ftype);
+int ext4fs_dirent_node(struct ext2fs_node *dir, struct ext2_dirent *dirent,
+		       struct ext2fs_node **fnode, int *ftype);
+int ext4fs_get_extent_runs(struct ext2fs_node *node,
+			   struct ext4_extent_run **runsp);
+void ext4fs_free_extent_runs(void);
+
+#if IS_ENABLED(CONFIG_EXT4_HTREE)
+int ext4fs_htree_find(struct ext2fs_node *dir, const char *name,
+		      struct ext2fs_node **fnode, int *ftype);
+#else
+static inline int ext4fs_htree_find(struct ext2fs_node *dir, const char *name,
+				    struct ext2fs_node **fnode, int *ftype)
+{
+	return -ENOSYS;
+}
+#endif
 
 #if defined(CONFIG_EXT4_WRITE)
 uint32_t ext4fs_div_roundup(uint32_t size, uint32_t n);
@@ -0,0 +1,471 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Look up names in ext4 directories by their hash tree index
+ *
+ * The directory hash functions are taken from Linux fs/ext4/hash.c:
+ * Copyright (C) 2002 by Theodore Ts'o
+ */
+
+#include <ext_common.h>
+#include <ext4fs.h>
+#include <log.h>
+#include <malloc.h>
+#include <memalign.h>
+#include <linux/bitops.h>
+#include "ext4_common.h"
+
+/* Hash versions in the root of the index */
+#define DX_HASH_LEGACY			0
+#define DX_HASH_HALF_MD4		1
+#define DX_HASH_TEA			2
+#define DX_HASH_LEGACY_UNSIGNED		3
+#define DX_HASH_HALF_MD4_UNSIGNED	4
+#define DX_HASH_TEA_UNSIGNED		5
+
+/* Superblock flag: the hashes of this filesystem use unsigned chars */
+#define EXT2_FLAGS_UNSIGNED_HASH	0x0002
+
+#define EXT4_HTREE_EOF_32BIT		0x7fffffff
+/* Most levels of the index, with the largedir feature */
+#define EXT4_HTREE_LEVEL		3
+
+struct dx_entry {
+	__le32 hash;
+	__le32 block;
+};
+
+/* Overlays the hash of the first entry of each index block */
+struct dx_countlimit {
+	__le16 limit;
+	__le16 count;
+};
+
+struct dx_root_info {
+	__le32 reserved_zero;
+	u8 hash_version;
+	u8 info_length;
+	u8 indirect_levels;
+	u8 unused_flags;
+};
+
+/* The index root follows the '.' and '..' entries in the first block */
+#define DX_ROOT_INFO_OFFSET		24
+/* Other index blocks start with an empty entry covering the block */
+#define DX_NODE_OFFSET			8
+
+/**
+ * struct dx_frame - position in one level of the index
+ *
+ * @buf:	index block
+ * @entries:	entries of the index block
+ * @count:	number of entries
+ * @at:		entry followed down to the next level
+ */
+struct dx_frame {
+	char *buf;
+	struct dx_entry *entries;
+	int count;
+	int at;
+};
+
+static u32 dx_hack_hash_unsigned(const char *name, int len)
+{
+	u32 hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+	const unsigned char *ucp = (const unsigned char *)name;
+
+	while (len--) {
+		hash = hash1 + (hash0 ^ (((int)*ucp++) * 7152373));
+
+		if (hash & 0x80000000)
+			hash -= 0x7fffffff;
+		hash1 = hash0;
+		hash0 = hash;
+	}
+	return hash0 << 1;
+}
+
+static u32 dx_hack_hash_signed(const char *name, int len)
+{
+	u32 hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+	const signed char *scp = (const signed char *)name;
+
+	while (len--) {
+		hash = hash1 + (hash0 ^ (((int)*scp++) * 7152373));
+
+		if (hash & 0x80000000)
+			hash -= 0x7fffffff;
+		hash1 = hash0;
+		hash0 = hash;
+	}
+	return hash0 << 1;
+}
+
+static void str2hashbuf(const char *msg, int len, u32 *buf, int num,
+			bool is_unsigned)
+{
+	const unsigned char *ucp = (const unsigned char *)msg;
+	const signed char *scp = (const signed char *)msg;
+	u32 pad, val;
+	int i;
+
+	pad = (u32)len | ((u32)len << 8);
+	pad |= pad << 16;
+
+	val = pad;
+	if (len > num * 4)
+		len = num * 4;
+	for (i = 0; i < len; i++) {
+		if (is_unsigned)
+			val = ((int)ucp[i]) + (val << 8);
+		else
+			val = ((int)scp[i]) + (val << 8);
+		if ((i % 4) == 3) {
+			*buf++ = val;
+			val = pad;
+			num--;
+		}
+	}
+	if (--num >= 0)
+		*buf++ = val;
+	while (--num >= 0)
+		*buf++ = pad;
+}
+
+#define F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define H(x, y, z) ((x) ^ (y) ^ (z))
+
+#define MD4_ROUND(f, a, b, c, d, x, s)	\
+	(a += f(b, c, d) + x, a = rol32(a, s))
+#define K1 0
+#define K2 013240474631UL
+#define K3 015666365641UL
+
+/* Basic cut-down MD4 transform */
+static void half_md4_transform(u32 buf[4], const u32 in[8])
+{
+	u32 a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+	/* Round 1 */
+	MD4_ROUND(F, a, b, c, d, in[0] + K1,  3);
+	MD4_ROUND(F, d, a, b, c, in[1] + K1,  7);
+	MD4_ROUND(F, c, d, a, b, in[2] + K1, 11);
+	MD4_ROUND(F, b, c, d, a, in[3] + K1, 19);
+	MD4_ROUND(F, a, b, c, d, in[4] + K1,  3);
+	MD4_ROUND(F, d, a, b, c, in[5] + K1,  7);
+	MD4_ROUND(F, c, d, a, b, in[6] + K1, 11);
+	MD4_ROUND(F, b, c, d, a, in[7] + K1, 19);
+
+	/* Round 2 */
+	MD4_ROUND(G, a, b, c, d, in[1] + K2,  3);
+	MD4_ROUND(G, d, a, b, c, in[3] + K2,  5);
+	MD4_ROUND(G, c, d, a, b, in[5] + K2,  9);
+	MD4_ROUND(G, b, c, d, a, in[7] + K2, 13);
+	MD4_ROUND(G, a, b, c, d, in[0] + K2,  3);
+	MD4_ROUND(G, d, a, b, c, in[2] + K2,  5);
+	MD4_ROUND(G, c, d, a, b, in[4] + K2,  9);
+	MD4_ROUND(G, b, c, d, a, in[6] + K2, 13);
+
+	/* Round 3 */
+	MD4_ROUND(H, a, b, c, d, in[3] + K3,  3);
+	MD4_ROUND(H, d, a, b, c, in[7] + K3,  9);
+	MD4_ROUND(H, c, d, a, b, in[2] + K3, 11);
+	MD4_ROUND(H, b, c, d, a, in[6] + K3, 15);
+	MD4_ROUND(H, a, b, c, d, in[1] + K3,  3);
+	MD4_ROUND(H, d, a, b, c, in[5] + K3,  9);
+	MD4_ROUND(H, c, d, a, b, in[0] + K3, 11);
+	MD4_ROUND(H, b, c, d, a, in[4] + K3, 15);
+
+	buf[0] += a;
+	buf[1] += b;
+	buf[2] += c;
+	buf[3] += d;
+}
+
+#undef MD4_ROUND
+#undef K1
+#undef K2
+#undef K3
+#undef F
+#undef G
+#undef H
+
+/* The old legendary 128 bit TEA transform */
+static void tea_transform(u32 buf[4], const u32 in[])
+{
+	u32 sum = 0;
+	u32 b0 = buf[0], b1 = buf[1];
+	u32 a = in[0], b = in[1], c = in[2], d = in[3];
+	int n = 16;
+
+	do {
+		sum += 0x9e3779b9;
+		b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+		b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+	} while (--n);
+
+	buf[0] += b0;
+	buf[1] += b1;
+}
+
+/**
+ * ext4fs_dirhash() - Work out the hash of a name, as kept in the index
+ *
+ * @name:	name to hash
+ * @len:	length of the name
+ * @version:	hash version, DX_HASH_...
+ * @seed:	hash seed from the superblock
+ * @hashp:	returns the hash
+ * Return:	0 on success, -EINVAL if the hash version is not known
+ */
+static int ext4fs_dirhash(const char *name, int len, int version,
+			  const __le32 seed[4], u32 *hashp)
+{
+	u32 buf[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+	bool is_unsigned = false;
+	const char *p;
+	u32 in[8];
+	u32 hash;
+	int i;
+
+	/* A seed of zeroes means the default one */
+	if (seed[0] || seed[1] || seed[2] || seed[3]) {
+		for (i = 0; i < 4; i++)
+			buf[i] = le32_to_cpu(seed[i]);
+	}
+
+	switch (version) {
+	case DX_HASH_LEGACY_UNSIGNED:
+		hash = dx_hack_hash_unsigned(name, len);
+		break;
+	case DX_HASH_LEGACY:
+		hash = dx_hack_hash_signed(name, len);
+		break;
+	case DX_HASH_HALF_MD4_UNSIGNED:
+		is_unsigned = true;
+		fallthrough;
+	case DX_HASH_HALF_MD4:
+		for (p = name; len > 0; len -= 32, p += 32) {
+			str2hashbuf(p, len, in, 8, is_unsigned);
+			half_md4_transform(buf, in);
+		}
+		hash = buf[1];
+		break;
+	case DX_HASH_TEA_UNSIGNED:
+		is_unsigned = true;
+		fallthrough;
+	case DX_HASH_TEA:
+		for (p = name; len > 0; len -= 16, p += 16) {
+			str2hashbuf(p, len, in, 4, is_unsigned);
+			tea_transform(buf, in);
+		}
+		hash = buf[0];
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	hash &= ~1;
+	if (hash == (EXT4_HTREE_EOF_32BIT << 1))
+		hash = (EXT4_HTREE_EOF_32BIT - 1) << 1;
+	*hashp = hash;
+
+	return 0;
+}
+
+/*
+ * Read an index block and check its entries, which start at @offset. The
+ * hash of the first entry holds the number of entries instead.
+ */
+static int dx_read_frame(struct ext2fs_node *dir, u32 block, int offset,
+			 struct dx_frame *frame)
+{
+	int blksz = EXT2_BLOCK_SIZE(dir->data);
+	struct dx_countlimit *countlimit;
+	loff_t actread;
+	int limit;
+
+	if (ext4fs_read_file(dir, (loff_t)block * blksz, blksz, frame->buf,
+			     &actread) || actread != blksz)
+		return -EIO;
+
+	frame->entries = (struct dx_entry *)(frame->buf + offset);
+	countlimit = (struct dx_countlimit *)frame->entries;
+	limit = le16_to_cpu(countlimit->limit);
+	frame->count = le16_to_cpu(countlimit->count);
+	if (!frame->count || frame->count > limit ||
+	    limit > (blksz - offset) / sizeof(struct dx_entry))
+		return -EINVAL;
+
+	return 0;
+}
+
+/* Find the last entry of an index block whose hash is not above @hash */
+static void dx_search(struct dx_frame *frame, u32 hash)
+{
+	int lo = 1, hi = frame->count - 1;
+
+	while (lo <= hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if (le32_to_cpu(frame->entries[mid].hash) > hash)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+	frame->at = lo - 1;
+}
+
+static u32 dx_block(struct dx_frame *frame)
+{
+	return le32_to_cpu(frame->entries[frame->at].block) & 0x0fffffff;
+}
+
+/*
+ * Look for @name in a leaf block of the directory. Returns 1 if found, 0 if
+ * not, or -ve on error.
+ */
+static int dx_search_leaf(struct ext2fs_node *dir, u32 block, char *buf,
+			  const char *name, struct ext2fs_node **fnode,
+			  int *ftype)
+{
+	int blksz = EXT2_BLOCK_SIZE(dir->data);
+	int namelen = strlen(name);
+	struct ext2_dirent *dirent;
+	loff_t actread;
+	int pos, len;
+
+	if (ext4fs_read_file(dir, (loff_t)block * blksz, blksz, buf,
+			     &actread) || actread != blksz)
+		return -EIO;
+
+	for (pos = 0; pos + sizeof(*dirent) <= blksz; pos += len) {
+		dirent = (struct ext2_dirent *)(buf + pos);
+		len = le16_to_cpu(dirent->direntlen);
+		if (len < sizeof(*dirent) || pos + len > blksz ||
+		    sizeof(*dirent) + dirent->namelen > len)
+			return -EINVAL;
+
+		if (dirent->inode && dirent->namelen == namelen &&
+		    !memcmp(dirent + 1, name, namelen)) {
+			if (!ext4fs_dirent_node(dir, dirent, fnode, ftype))
+				return -EIO;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * ext4fs_htree_find() - Look a name up in a directory by its index
+ *
+ * The index is followed down from its root to the leaf block which holds
+ * the names with the same hash as @name. When the names with a hash are
+ * split over several leaf blocks, the following ones are searched too.
+ *
+ * @dir:	directory with an index (EXT4_INDEX_FL)
+ * @name:	name to look up
+ * @fnode:	returns the node of the file, if found
+ * @ftype:	returns the type of the file, if found
+ * Return:	1 if found, 0 if not, or -ve if the index cannot be used, so
+ *		that the directory must be searched in full
+ */
+int ext4fs_htree_find(struct ext2fs_node *dir, const char *name,
+		      struct ext2fs_node **fnode, int *ftype)
+{
+	struct dx_frame frames[EXT4_HTREE_LEVEL];
+	struct ext2_sblock *sblock = &dir->data->sblock;
+	int blksz = EXT2_BLOCK_SIZE(dir->data);
+	struct dx_root_info *info;
+	int levels, level, version;
+	char *leaf;
+	u32 hash;
+	int ret;
+
+	memset(frames, '\0', sizeof(frames));
+	leaf = memalign(ARCH_DMA_MINALIGN, blksz);
+	frames[0].buf = memalign(ARCH_DMA_MINALIGN, blksz);
+	if (!leaf || !frames[0].buf) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	/* The root follows the '.' and '..' entries in the first block */
+	ret = dx_read_frame(dir, 0, DX_ROOT_INFO_OFFSET + sizeof(*info),
+			    &frames[0]);
+	if (ret)
+		goto out;
+	info = (struct dx_root_info *)(frames[0].buf + DX_ROOT_INFO_OFFSET);
+	levels = info->indirect_levels + 1;
+	if (info->reserved_zero || info->info_length != sizeof(*info) ||
+	    levels > EXT4_HTREE_LEVEL) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	version = info->hash_version;
+	if (version <= DX_HASH_TEA &&
+	    (le32_to_cpu(sblock->flags) & EXT2_FLAGS_UNSIGNED_HASH))
+		version += DX_HASH_LEGACY_UNSIGNED;
+	ret = ext4fs_dirhash(name, strlen(name), version, sblock->hash_seed,
+			     &hash);
+	if (ret) {
+		log_debug("unsupported hash version %d\n", version);
+		goto out;
+	}
+
+	for (level = 1; level < levels; level++) {
+		frames[level].buf = memalign(ARCH_DMA_MINALIGN, blksz);
+		if (!frames[level].buf) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	/* Go down to the leaf which holds the hash */
+	for (level = 0; level < levels - 1; level++) {
+		dx_search(&frames[level], hash);
+		ret = dx_read_frame(dir, dx_block(&frames[level]),
+				    DX_NODE_OFFSET, &frames[level + 1]);
+		if (ret)
+			goto out;
+	}
+	dx_search(&frames[level], hash);
+
+	while (1) {
+		ret = dx_search_leaf(dir, dx_block(&frames[level]), leaf, name,
+				     fnode, ftype);
+		if (ret)
+			goto out;
+
+		/*
+		 * Move on to the next leaf if it carries on with the same
+		 * hash, which is shown by the lowest bit of its hash
+		 */
+		while (++frames[level].at == frames[level].count) {
+			if (!level)
+				goto out;
+			level--;
+		}
+		if ((le32_to_cpu(frames[level].entries[frames[level].at].hash) &
+		     ~1) != hash)
+			goto out;
+
+		/* Take the first entry of each level below */
+		for (; level < levels - 1; level++) {
+			ret = dx_read_frame(dir, dx_block(&frames[level]),
+					    DX_NODE_OFFSET, &frames[level + 1]);
+			if (ret)
+				goto out;
+			frames[level + 1].at = 0;
+		}
+	}
+
+out:
+	for (level = 0; level < EXT4_HTREE_LEVEL; level++)
+		free(frames[level].buf);
+	free(leaf);
+
+	return ret;
+}
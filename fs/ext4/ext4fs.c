@@ -29,8 +29,12 @@
 #include <part.h>
 #include <rtc.h>
 #include <u-boot/uuid.h>
+#include <linux/sizes.h>
 #include "ext4_common.h"
 
+/* Largest part of a run read from the device at once */
+#define EXT4_READ_CHUNK		SZ_1G
+
 int ext4fs_symlinknest;
 struct ext_filesystem ext_fs;
 
@@ -63,6 +67,81 @@ void ext4fs_free_node(struct ext2fs_node *node, struct ext2fs_node *currroot)
 		free(node);
 }
 
+/*
+ * Read part of a file which uses extents, one run at a time: the blocks of a
+ * run are read from the device straight into the buffer, at most
+ * EXT4_READ_CHUNK bytes at a time. Holes and unwritten extents read as
+ * zeroes. Returns -EIO if the device cannot be read, or another -ve error if
+ * the extent tree cannot be decoded, which the caller handles by reading the
+ * file block by block.
+ */
+static int ext4fs_read_extents(struct ext2fs_node *node, loff_t pos,
+			       loff_t len, char *buf)
+{
+	struct ext_filesystem *fs = get_fs();
+	int log2blksz = fs->dev_desc->log2blksz;
+	int log2_fs_blocksize = LOG2_BLOCK_SIZE(node->data);
+	struct ext4_extent_run *run;
+	loff_t end = pos + len;
+	int count, i, hi;
+
+	count = ext4fs_get_extent_runs(node, &run);
+	if (count < 0)
+		return count;
+
+	/* Find the first run which ends after pos */
+	i = 0;
+	hi = count;
+	while (i < hi) {
+		int mid = (i + hi) / 2;
+
+		if (((loff_t)run[mid].lblk + run[mid].len) <<
+		    log2_fs_blocksize <= pos)
+			i = mid + 1;
+		else
+			hi = mid;
+	}
+
+	while (pos < end) {
+		loff_t start = end, stop = end;
+		loff_t n;
+
+		if (i < count) {
+			start = (loff_t)run[i].lblk << log2_fs_blocksize;
+			stop = ((loff_t)run[i].lblk + run[i].len) <<
+				log2_fs_blocksize;
+		}
+
+		if (pos < start) {
+			/* Hole before the run */
+			n = min(start, end) - pos;
+			memset(buf, 0, n);
+		} else {
+			n = min(min(stop, end) - pos, (loff_t)EXT4_READ_CHUNK);
+			if (run[i].uninit) {
+				memset(buf, 0, n);
+			} else {
+				loff_t off = pos - start;
+				lbaint_t sector;
+
+				sector = ((lbaint_t)run[i].pblk <<
+					  (log2_fs_blocksize - log2blksz)) +
+					 (off >> log2blksz);
+				if (!ext4fs_devread(sector,
+						    off & (fs->dev_desc->blksz - 1),
+						    n, buf))
+					return -EIO;
+			}
+			if (pos + n == stop)
+				i++;
+		}
+		buf += n;
+		pos += n;
+	}
+
+	return 0;
+}
+
 /*
  * Taken from openmoko-kernel mailing list: By Andy green
  * Optimized read file API : collects and defers contiguous sector
@@ -99,6 +178,18 @@ int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 		return -1;
 	}
 
+	if (le32_to_cpu(node->inode.flags) & EXT4_EXTENTS_FL) {
+		int ret = ext4fs_read_extents(node, pos, len, buf);
+
+		if (!ret || ret == -EIO) {
+			ext_cache_fini(&cache);
+			if (ret)
+				return -1;
+			*actread = len;
+			return 0;
+		}
+	}
+
 	blockcnt = lldiv(((len + pos) + blocksize - 1), blocksize);
 
 	for (i = lldiv(pos, blocksize); i < blockcnt; i++) {
@@ -201,10 +201,160 @@ static int disk_read(__u32 block, __u32 nr_blocks, void *buf)
 }
 #endif /* CONFIG_FS_FAT_HANDLE_SECTOR_SIZE_MISMATCH */
 
+#if CONFIG_IS_ENABLED(FS_FAT_CACHE)
+/* Sectors of the FAT read into the cache at a time */
+#define FAT_CACHE_CHUNK		64
+
+/*
+ * Copy of the FAT of the current filesystem, read a chunk at a time as its
+ * entries are looked up. It is only set up if the FAT is not larger than
+ * CONFIG_FS_FAT_CACHE_SIZE, otherwise 'buf' is NULL.
+ */
+static struct {
+	__u8	*buf;
+	__u8	*loaded;	/* Set for each chunk read */
+	__u32	fatlength;
+	__u16	fat_sect;
+	__u16	sect_size;
+} fat_cache;
+
+static void fat_cache_drop(void)
+{
+	free(fat_cache.buf);
+	free(fat_cache.loaded);
+	memset(&fat_cache, '\0', sizeof(fat_cache));
+}
+
+static bool fat_cache_setup(fsdata *mydata)
+{
+	ulong size = (ulong)mydata->fatlength * mydata->sect_size;
+
+	if (fat_cache.fatlength == mydata->fatlength &&
+	    fat_cache.fat_sect == mydata->fat_sect &&
+	    fat_cache.sect_size == mydata->sect_size)
+		return fat_cache.buf;
+
+	fat_cache_drop();
+	fat_cache.fatlength = mydata->fatlength;
+	fat_cache.fat_sect = mydata->fat_sect;
+	fat_cache.sect_size = mydata->sect_size;
+	if (!size || size > CONFIG_FS_FAT_CACHE_SIZE)
+		return false;
+
+	fat_cache.buf = malloc_cache_aligned(size);
+	fat_cache.loaded = calloc(DIV_ROUND_UP(mydata->fatlength,
+					       FAT_CACHE_CHUNK), 1);
+	if (!fat_cache.buf || !fat_cache.loaded) {
+		free(fat_cache.buf);
+		free(fat_cache.loaded);
+		fat_cache.buf = NULL;
+		fat_cache.loaded = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Get the bytes holding the entry at index 'entry' from the copy of the FAT,
+ * reading them if needed. Returns NULL if the FAT is not cached.
+ */
+static __u8 *fat_cache_entry(fsdata *mydata, __u32 entry)
+{
+	__u32 offset, last, chunk;
+
+	if (!fat_cache_setup(mydata))
+		return NULL;
+
+	switch (mydata->fatsize) {
+	case 32:
+		offset = entry * 4;
+		last = offset + 3;
+		break;
+	case 16:
+		offset = entry * 2;
+		last = offset + 1;
+		break;
+	default:
+		/* An entry of FAT12 may span two sectors */
+		offset = (entry * 3) / 2;
+		last = offset + 1;
+		break;
+	}
+	if (last >= mydata->fatlength * mydata->sect_size)
+		return NULL;
+
+	for (chunk = offset / mydata->sect_size / FAT_CACHE_CHUNK;
+	     chunk <= last / mydata->sect_size / FAT_CACHE_CHUNK; chunk++) {
+		__u32 sect = chunk * FAT_CACHE_CHUNK;
+		__u32 count = min(mydata->fatlength - sect,
+				  (__u32)FAT_CACHE_CHUNK);
+
+		if (fat_cache.loaded[chunk])
+			continue;
+		if (disk_read(mydata->fat_sect + sect, count,
+			      fat_cache.buf + sect * mydata->sect_size) != count)
+			return NULL;
+		fat_cache.loaded[chunk] = 1;
+	}
+
+	return fat_cache.buf + offset;
+}
+#else
+static inline void fat_cache_drop(void)
+{
+}
+#endif
+
+/*
+ * Runs of consecutive clusters of the file read last, in file order, so that
+ * reading a file in parts does not follow its cluster chain from the start
+ * each time
+ */
+struct fat_run {
+	__u32	clust;
+	__u32	count;
+};
+
+static struct {
+	__u32	start;		/* First cluster of the file, 0 if none */
+	__u32	nclust;		/* Number of clusters in the runs */
+	int	count;
+	int	max;
+	struct fat_run *run;
+} fat_runs;
+
+static void fat_runs_drop(void)
+{
+	free(fat_runs.run);
+	memset(&fat_runs, '\0', sizeof(fat_runs));
+}
+
+/*
+ * The FAT sectors from 'sect' on were written from 'buf': keep the cached
+ * FAT up to date and drop the runs, as cluster chains may have changed.
+ */
+static void __maybe_unused fat_written(fsdata *mydata, __u32 sect,
+				       __u32 count, __u8 *buf)
+{
+#if CONFIG_IS_ENABLED(FS_FAT_CACHE)
+	if (fat_cache.buf && fat_cache.fatlength == mydata->fatlength &&
+	    fat_cache.fat_sect == mydata->fat_sect &&
+	    fat_cache.sect_size == mydata->sect_size)
+		memcpy(fat_cache.buf + sect * mydata->sect_size, buf,
+		       count * mydata->sect_size);
+#endif
+	fat_runs_drop();
+}
+
 int fat_set_blk_dev(struct blk_desc *dev_desc, struct disk_partition *info)
 {
 	ALLOC_CACHE_ALIGN_BUFFER(unsigned char, buffer, dev_desc->blksz);
 
+	/* a filesystem kept mounted by the fs layer is replaced */
+	fs_cache_invalidate(NULL);
+	fat_cache_drop();
+	fat_runs_drop();
 	cur_dev = dev_desc;
 	cur_part_info = *info;
 
@@ -307,6 +457,7 @@ static __u32 get_fatent(fsdata *mydata, __u32 entry)
 	__u32 bufnum;
 	__u32 offset, off8;
 	__u32 ret = 0x00;
+	__u8 *ent = NULL;
 
 	if (CHECK_CLUST(entry, mydata->fatsize)) {
 		log_err("Invalid FAT entry: %#08x\n", entry);
@@ -335,8 +486,14 @@ static __u32 get_fatent(fsdata *mydata, __u32 entry)
 	debug("FAT%d: entry: 0x%08x = %d, offset: 0x%04x = %d\n",
 	       mydata->fatsize, entry, entry, offset, offset);
 
+#if CONFIG_IS_ENABLED(FS_FAT_CACHE)
+	/* Use the copy of the FAT, unless the entry is in the FAT buffer */
+	if (bufnum != mydata->fatbufnum)
+		ent = fat_cache_entry(mydata, entry);
+#endif
+
 	/* Read a new block of FAT entries into the cache. */
-	if (bufnum != mydata->fatbufnum) {
+	if (!ent && bufnum != mydata->fatbufnum) {
 		__u32 getsize = FATBUFBLOCKS;
 		__u8 *bufptr = mydata->fatbuf;
 		__u32 fatlength = mydata->fatlength;
@@ -364,20 +521,34 @@ static __u32 get_fatent(fsdata *mydata, __u32 entry)
 		mydata->fatbufnum = bufnum;
 	}
 
+	if (!ent) {
+		switch (mydata->fatsize) {
+		case 32:
+			ent = mydata->fatbuf + offset * 4;
+			break;
+		case 16:
+			ent = mydata->fatbuf + offset * 2;
+			break;
+		case 12:
+			off8 = (offset * 3) / 2;
+			ent = mydata->fatbuf + off8;
+			break;
+		}
+	}
+
 	/* Get the actual entry from the table */
 	switch (mydata->fatsize) {
 	case 32:
-		ret = FAT2CPU32(((__u32 *) mydata->fatbuf)[offset]);
+		ret = FAT2CPU32(*(__u32 *)ent);
 		break;
 	case 16:
-		ret = FAT2CPU16(((__u16 *) mydata->fatbuf)[offset]);
+		ret = FAT2CPU16(*(__u16 *)ent);
 		break;
 	case 12:
-		off8 = (offset * 3) / 2;
-		/* fatbut + off8 may be unaligned, read in byte granularity */
-		ret = mydata->fatbuf[off8] + (mydata->fatbuf[off8 + 1] << 8);
+		/* ent may be unaligned, read in byte granularity */
+		ret = ent[0] + (ent[1] << 8);
 
-		if (offset & 0x1)
+		if (entry & 0x1)
 			ret >>= 4;
 		ret &= 0xfff;
 	}
@@ -387,69 +558,149 @@ static __u32 get_fatent(fsdata *mydata, __u32 entry)
 	return ret;
 }
 
+/* Largest bounce buffer for reading into a misaligned buffer, in sectors */
+#define FAT_BOUNCE_SECTS	128
+
 /*
- * Read at most 'size' bytes from the specified cluster into 'buffer'.
+ * Read 'size' bytes, from 'offset' bytes into the sectors starting at 'sect',
+ * into 'buffer'. Whole sectors are read straight into 'buffer' if it is
+ * aligned, otherwise through a bounce buffer.
  * Return 0 on success, -1 otherwise.
  */
-static int
-get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
+static int fat_read_bytes(fsdata *mydata, __u32 sect, __u32 offset,
+			  __u8 *buffer, __u32 size)
 {
-	__u32 startsect;
+	ALLOC_CACHE_ALIGN_BUFFER(__u8, tmpbuf, mydata->sect_size);
+	__u32 skip = offset % mydata->sect_size;
+	__u32 count, n;
+	__u8 *bounce;
 	int ret;
 
-	if (clustnum > 0) {
-		startsect = clust_to_sect(mydata, clustnum);
-	} else {
-		startsect = mydata->rootdir_sect;
-	}
-
-	debug("gc - clustnum: %d, startsect: %d\n", clustnum, startsect);
+	sect += offset / mydata->sect_size;
+	debug("read - sect: %d, offset: %d, size: %d\n", sect, skip, size);
 
-	if ((unsigned long)buffer & (ARCH_DMA_MINALIGN - 1)) {
-		ALLOC_CACHE_ALIGN_BUFFER(__u8, tmpbuf, mydata->sect_size);
+	/* Part of the first sector */
+	if (skip) {
+		n = min(size, (__u32)mydata->sect_size - skip);
+		ret = disk_read(sect++, 1, tmpbuf);
+		if (ret != 1) {
+			debug("Error reading data (got %d)\n", ret);
+			return -1;
+		}
+		memcpy(buffer, tmpbuf + skip, n);
+		buffer += n;
+		size -= n;
+	}
 
+	count = size / mydata->sect_size;
+	if (count && !((unsigned long)buffer & (ARCH_DMA_MINALIGN - 1))) {
+		ret = disk_read(sect, count, buffer);
+		if (ret != count) {
+			debug("Error reading data (got %d)\n", ret);
+			return -1;
+		}
+		sect += count;
+		buffer += count * mydata->sect_size;
+		size -= count * mydata->sect_size;
+	} else if (count) {
 		debug("FAT: Misaligned buffer address (%p)\n", buffer);
 
-		while (size >= mydata->sect_size) {
-			ret = disk_read(startsect++, 1, tmpbuf);
-			if (ret != 1) {
+		n = min(count, (__u32)FAT_BOUNCE_SECTS);
+		bounce = malloc_cache_aligned(n * mydata->sect_size);
+		if (!bounce) {
+			bounce = tmpbuf;
+			n = 1;
+		}
+		while (count) {
+			n = min(n, count);
+			ret = disk_read(sect, n, bounce);
+			if (ret != n) {
 				debug("Error reading data (got %d)\n", ret);
+				if (bounce != tmpbuf)
+					free(bounce);
 				return -1;
 			}
-
-			memcpy(buffer, tmpbuf, mydata->sect_size);
-			buffer += mydata->sect_size;
-			size -= mydata->sect_size;
+			memcpy(buffer, bounce, n * mydata->sect_size);
+			sect += n;
+			count -= n;
+			buffer += n * mydata->sect_size;
+			size -= n * mydata->sect_size;
 		}
-	} else if (size >= mydata->sect_size) {
-		__u32 bytes_read;
-		__u32 sect_count = size / mydata->sect_size;
-
-		ret = disk_read(startsect, sect_count, buffer);
-		if (ret != sect_count) {
-			debug("Error reading data (got %d)\n", ret);
-			return -1;
-		}
-		bytes_read = sect_count * mydata->sect_size;
-		startsect += sect_count;
-		buffer += bytes_read;
-		size -= bytes_read;
+		if (bounce != tmpbuf)
+			free(bounce);
 	}
-	if (size) {
-		ALLOC_CACHE_ALIGN_BUFFER(__u8, tmpbuf, mydata->sect_size);
 
-		ret = disk_read(startsect, 1, tmpbuf);
+	/* Part of the last sector */
+	if (size) {
+		ret = disk_read(sect, 1, tmpbuf);
 		if (ret != 1) {
 			debug("Error reading data (got %d)\n", ret);
 			return -1;
 		}
-
 		memcpy(buffer, tmpbuf, size);
 	}
 
 	return 0;
 }
 
+/*
+ * Make sure that the runs of the file starting at cluster 'start' hold at
+ * least 'nclust' clusters, following its chain from where they end.
+ * Return 0 on success, -EINVAL if the chain is broken, -ENOMEM if the runs
+ * cannot be stored.
+ */
+static int fat_get_runs(fsdata *mydata, __u32 start, __u32 nclust)
+{
+	struct fat_run *run;
+	__u32 clust;
+
+	if (fat_runs.start != start) {
+		fat_runs_drop();
+		fat_runs.start = start;
+	}
+	if (fat_runs.nclust >= nclust)
+		return 0;
+
+	if (fat_runs.count) {
+		run = &fat_runs.run[fat_runs.count - 1];
+		clust = get_fatent(mydata, run->clust + run->count - 1);
+	} else {
+		clust = start;
+	}
+
+	while (1) {
+		if (CHECK_CLUST(clust, mydata->fatsize)) {
+			debug("curclust: 0x%x\n", clust);
+			fat_runs_drop();
+			return -EINVAL;
+		}
+
+		run = fat_runs.count ? &fat_runs.run[fat_runs.count - 1] : NULL;
+		if (run && run->clust + run->count == clust) {
+			run->count++;
+		} else {
+			if (fat_runs.count == fat_runs.max) {
+				int max = fat_runs.max ? fat_runs.max * 2 : 16;
+
+				run = realloc(fat_runs.run, max * sizeof(*run));
+				if (!run) {
+					fat_runs_drop();
+					return -ENOMEM;
+				}
+				fat_runs.run = run;
+				fat_runs.max = max;
+			}
+			run = &fat_runs.run[fat_runs.count++];
+			run->clust = clust;
+			run->count = 1;
+		}
+
+		if (++fat_runs.nclust == nclust)
+			return 0;
+		clust = get_fatent(mydata, clust);
+	}
+}
+
 /**
  * get_contents() - read from file
  *
@@ -457,6 +708,9 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
  * into 'buffer'. Update the number of bytes read in *gotsize or return -1 on
  * fatal errors.
  *
+ * The clusters of the file are gathered into runs of consecutive clusters,
+ * each of which is read at once.
+ *
  * @mydata:	file system description
  * @dentprt:	directory entry pointer
  * @pos:	position from where to read
@@ -468,120 +722,57 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 			__u8 *buffer, loff_t maxsize, loff_t *gotsize)
 {
-	loff_t filesize = FAT2CPU32(dentptr->size);
-	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
-	__u32 curclust = START(dentptr);
-	__u32 endclust, newclust;
-	loff_t actsize;
+	__u32 filesize = FAT2CPU32(dentptr->size);
+	__u32 bytesperclust = mydata->clust_size * mydata->sect_size;
+	__u32 runpos, runend, end, n;
+	int i, ret;
 
 	*gotsize = 0;
-	debug("Filesize: %llu bytes\n", filesize);
+	debug("Filesize: %u bytes\n", filesize);
 
 	if (pos >= filesize) {
 		debug("Read position past EOF: %llu\n", pos);
 		return 0;
 	}
 
+	end = filesize;
 	if (maxsize > 0 && filesize > pos + maxsize)
-		filesize = pos + maxsize;
-
-	debug("%llu bytes\n", filesize);
-
-	actsize = bytesperclust;
-
-	/* go to cluster at pos */
-	while (actsize <= pos) {
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-		actsize += bytesperclust;
-	}
-
-	/* actsize > pos */
-	actsize -= bytesperclust;
-	filesize -= actsize;
-	pos -= actsize;
-
-	/* align to beginning of next cluster if any */
-	if (pos) {
-		__u8 *tmp_buffer;
+		end = pos + maxsize;
 
-		actsize = min(filesize, (loff_t)bytesperclust);
-		tmp_buffer = malloc_cache_aligned(actsize);
-		if (!tmp_buffer) {
-			debug("Error: allocating buffer\n");
-			return -1;
-		}
-
-		if (get_cluster(mydata, curclust, tmp_buffer, actsize) != 0) {
-			printf("Error reading cluster\n");
-			free(tmp_buffer);
-			return -1;
-		}
-		filesize -= actsize;
-		actsize -= pos;
-		memcpy(buffer, tmp_buffer + pos, actsize);
-		free(tmp_buffer);
-		*gotsize += actsize;
-		if (!filesize)
-			return 0;
-		buffer += actsize;
+	debug("%u bytes\n", end);
 
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
+	ret = fat_get_runs(mydata, START(dentptr), end / bytesperclust +
+			   !!(end % bytesperclust));
+	if (ret == -ENOMEM) {
+		debug("Error: allocating memory\n");
+		return -1;
+	} else if (ret) {
+		printf("Invalid FAT entry\n");
+		return -1;
 	}
 
-	actsize = bytesperclust;
-	endclust = curclust;
-
-	do {
-		/* search for consecutive clusters */
-		while (actsize < filesize) {
-			newclust = get_fatent(mydata, endclust);
-			if ((newclust - 1) != endclust)
-				goto getit;
-			if (CHECK_CLUST(newclust, mydata->fatsize)) {
-				debug("curclust: 0x%x\n", newclust);
-				printf("Invalid FAT entry\n");
+	runpos = 0;
+	for (i = 0; i < fat_runs.count && pos < end; i++) {
+		struct fat_run *run = &fat_runs.run[i];
+
+		runend = runpos + min((u64)run->count * bytesperclust,
+				      (u64)filesize - runpos);
+		if (pos < runend) {
+			n = min(runend, end) - pos;
+			if (fat_read_bytes(mydata,
+					   clust_to_sect(mydata, run->clust),
+					   pos - runpos, buffer, n)) {
+				printf("Error reading cluster\n");
 				return -1;
 			}
-			endclust = newclust;
-			actsize += bytesperclust;
+			buffer += n;
+			pos += n;
+			*gotsize += n;
 		}
+		runpos = runend;
+	}
 
-		/* get remaining bytes */
-		actsize = filesize;
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		*gotsize += actsize;
-		return 0;
-getit:
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		*gotsize += (int)actsize;
-		filesize -= actsize;
-		buffer += actsize;
-
-		curclust = get_fatent(mydata, endclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-		actsize = bytesperclust;
-		endclust = curclust;
-	} while (1);
+	return 0;
 }
 
 /*
@@ -1569,6 +1760,8 @@ void fat_closedir(struct fs_dir_stream *dirs)
 
 void fat_close(void)
 {
+	fat_cache_drop();
+	fat_runs_drop();
 }
 
 int fat_uuid(char *uuid_str)
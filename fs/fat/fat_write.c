@@ -241,6 +241,7 @@ static int flush_dirty_fat_buffer(fsdata *mydata)
 		debug("error: writing FAT blocks\n");
 		return -1;
 	}
+	fat_written(mydata, mydata->fatbufnum * FATBUFBLOCKS, getsize, bufptr);
 
 	if (mydata->fats == 2) {
 		/* Update corresponding second FAT blocks */
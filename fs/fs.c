@@ -37,6 +37,7 @@ static struct blk_desc *fs_dev_desc;
 static int fs_dev_part;
 static struct disk_partition fs_partition;
 static int fs_type = FS_TYPE_ANY;
+static bool fs_kept_open;
 
 void fs_set_type(int type)
 {
@@ -159,6 +160,13 @@ struct fstype_info {
 	 * filesystem.
 	 */
 	bool null_dev_desc_ok;
+	/*
+	 * Can the filesystem be left mounted by fs_close(), so that the next
+	 * access to the same partition does not need to probe it again? The
+	 * driver must then cope with being used again without a new probe.
+	 * See CONFIG_FS_MOUNT_CACHE.
+	 */
+	bool keep_mounted;
 	int (*probe)(struct blk_desc *fs_dev_desc,
 		     struct disk_partition *fs_partition);
 	int (*ls)(const char *dirname);
@@ -196,6 +204,7 @@ static struct fstype_info fstypes[] = {
 		.fstype = FS_TYPE_FAT,
 		.name = "fat",
 		.null_dev_desc_ok = false,
+		.keep_mounted = true,
 		.probe = fat_set_blk_dev,
 		.close = fat_close,
 		.ls = fs_ls_generic,
@@ -229,6 +238,7 @@ static struct fstype_info fstypes[] = {
 		.fstype = FS_TYPE_EXT,
 		.name = "ext4",
 		.null_dev_desc_ok = false,
+		.keep_mounted = true,
 		.probe = ext4fs_probe,
 		.close = ext4fs_close,
 		.ls = fs_ls_generic,
@@ -340,6 +350,7 @@ static struct fstype_info fstypes[] = {
 		.fstype = FS_TYPE_SQUASHFS,
 		.name = "squashfs",
 		.null_dev_desc_ok = false,
+		.keep_mounted = true,
 		.probe = sqfs_probe,
 		.opendir = sqfs_opendir,
 		.readdir = sqfs_readdir,
@@ -492,6 +503,127 @@ static struct fstype_info *fs_lookup_null_dev_info(const char *ifname,
 	return NULL;
 }
 
+/**
+ * struct fs_mount - filesystem kept mounted between accesses
+ *
+ * The filesystem drivers keep the state of a mounted filesystem in globals,
+ * so at most one filesystem is mounted at a time: either the one in use,
+ * between fs_set_blk_dev() and fs_close(), or the one kept mounted after it.
+ *
+ * @desc: Block device of the filesystem
+ * @hwpart: Hardware partition which was selected on @desc
+ * @part: Partition number
+ * @start: First block of the partition, to notice a new partition table
+ * @size: Number of blocks in the partition
+ * @fstype: Filesystem type (FS_TYPE_...)
+ * @valid: true if the filesystem is kept mounted and not in use
+ * @active: true if the filesystem in use can be kept mounted when closed
+ * @dirty: true if the device was written while the filesystem was in use,
+ *	so it must be closed
+ * @off: true if no filesystem is to be kept mounted
+ * @stats: Cache statistics
+ */
+static struct fs_mount {
+	struct blk_desc *desc;
+	int hwpart;
+	int part;
+	lbaint_t start;
+	lbaint_t size;
+	int fstype;
+	bool valid;
+	bool active;
+	bool dirty;
+	bool off;
+	struct fs_cache_stats stats;
+} fs_mount;
+
+/* Close the filesystem kept mounted */
+static void fs_mount_drop(void)
+{
+	if (fs_mount.active)
+		fs_close();
+	if (!fs_mount.valid)
+		return;
+	fs_mount.valid = false;
+	fs_get_info(fs_mount.fstype)->close();
+}
+
+/*
+ * Use the filesystem kept mounted if it is on the partition which has just
+ * been looked up, otherwise close it before another filesystem is probed.
+ */
+static bool fs_mount_lookup(int part, int fstype)
+{
+	if (!CONFIG_IS_ENABLED(FS_MOUNT_CACHE))
+		return false;
+
+	if (fs_mount.active)
+		fs_close();
+	if (fs_mount.valid && fs_mount.desc == fs_dev_desc &&
+	    fs_mount.hwpart == fs_dev_desc->hwpart && fs_mount.part == part &&
+	    fs_mount.start == fs_partition.start &&
+	    fs_mount.size == fs_partition.size &&
+	    (fstype == FS_TYPE_ANY || fstype == fs_mount.fstype)) {
+		fs_mount.valid = false;
+		fs_mount.active = true;
+		fs_mount.dirty = false;
+		fs_mount.stats.hits++;
+		fs_type = fs_mount.fstype;
+		fs_dev_part = part;
+		return true;
+	}
+	fs_mount_drop();
+	fs_mount.stats.misses++;
+
+	return false;
+}
+
+/* Note that the filesystem just probed may be kept mounted when closed */
+static void fs_mount_start(struct fstype_info *info)
+{
+	if (!CONFIG_IS_ENABLED(FS_MOUNT_CACHE) || !info->keep_mounted ||
+	    !fs_dev_desc || fs_mount.off)
+		return;
+
+	fs_mount.desc = fs_dev_desc;
+	fs_mount.hwpart = fs_dev_desc->hwpart;
+	fs_mount.part = fs_dev_part;
+	fs_mount.start = fs_partition.start;
+	fs_mount.size = fs_partition.size;
+	fs_mount.fstype = info->fstype;
+	fs_mount.active = true;
+	fs_mount.dirty = false;
+}
+
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+void fs_cache_invalidate(struct blk_desc *desc)
+{
+	if (desc && desc != fs_mount.desc)
+		return;
+	if (fs_mount.active)
+		fs_mount.dirty = true;
+	if (fs_mount.valid) {
+		fs_mount.stats.invalidations++;
+		fs_mount_drop();
+	}
+}
+
+void fs_cache_enable(bool enable)
+{
+	fs_mount.off = !enable;
+	if (!enable)
+		fs_cache_invalidate(NULL);
+}
+
+void fs_cache_get_stats(struct fs_cache_stats *stats)
+{
+	*stats = fs_mount.stats;
+	stats->desc = fs_mount.valid ? fs_mount.desc : NULL;
+	stats->part = fs_mount.part;
+	stats->fstype_name = fs_get_info(fs_mount.fstype)->name;
+}
+#endif
+
 int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 {
 	struct fstype_info *info;
@@ -499,6 +631,7 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 
 	info = fs_lookup_null_dev_info(ifname, fstype);
 	if (info) {
+		fs_mount_drop();
 		fs_dev_desc = NULL;
 		memset(&fs_partition, 0, sizeof(fs_partition));
 		if (!info->probe(NULL, &fs_partition)) {
@@ -512,6 +645,8 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 						    &fs_partition, 1);
 	if (part < 0)
 		return -1;
+	if (fs_dev_desc && fs_mount_lookup(part, fstype))
+		return 0;
 
 	for (i = 0, info = fstypes; i < ARRAY_SIZE(fstypes); i++, info++) {
 		if (fstype != FS_TYPE_ANY && info->fstype != FS_TYPE_ANY &&
@@ -524,6 +659,7 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 		if (!info->probe(fs_dev_desc, &fs_partition)) {
 			fs_type = info->fstype;
 			fs_dev_part = part;
+			fs_mount_start(info);
 			return 0;
 		}
 	}
@@ -544,11 +680,14 @@ int fs_set_blk_dev_with_part(struct blk_desc *desc, int part)
 	if (ret)
 		return ret;
 	fs_dev_desc = desc;
+	if (fs_mount_lookup(part, FS_TYPE_ANY))
+		return 0;
 
 	for (i = 0, info = fstypes; i < ARRAY_SIZE(fstypes); i++, info++) {
 		if (!info->probe(fs_dev_desc, &fs_partition)) {
 			fs_type = info->fstype;
 			fs_dev_part = part;
+			fs_mount_start(info);
 			return 0;
 		}
 	}
@@ -560,11 +699,34 @@ void fs_close(void)
 {
 	struct fstype_info *info = fs_get_info(fs_type);
 
-	info->close();
+	if (fs_kept_open)
+		return;
+	if (fs_mount.active && !fs_mount.dirty) {
+		fs_mount.valid = true;
+	} else {
+		if (fs_mount.active)
+			fs_mount.stats.invalidations++;
+		info->close();
+	}
+	fs_mount.active = false;
 
 	fs_type = FS_TYPE_ANY;
 }
 
+void fs_keep_open(bool keep)
+{
+	fs_kept_open = keep;
+	if (!keep && fs_type != FS_TYPE_ANY)
+		fs_close();
+}
+
+/* Close the filesystem after changing it, rather than keeping it mounted */
+static void fs_close_written(void)
+{
+	fs_mount.dirty = true;
+	fs_close();
+}
+
 int fs_uuid(char *uuid_str)
 {
 	struct fstype_info *info = fs_get_info(fs_type);
@@ -699,7 +861,7 @@ int fs_write(const char *filename, ulong addr, loff_t offset, loff_t len,
 		log_err("** Unable to write file %s **\n", filename);
 		ret = -1;
 	}
-	fs_close();
+	fs_close_written();
 
 	return ret;
 }
@@ -764,7 +926,7 @@ int fs_unlink(const char *filename)
 
 	ret = info->unlink(filename);
 
-	fs_close();
+	fs_close_written();
 
 	return ret;
 }
@@ -777,7 +939,7 @@ int fs_mkdir(const char *dirname)
 
 	ret = info->mkdir(dirname);
 
-	fs_close();
+	fs_close_written();
 
 	return ret;
 }
@@ -793,7 +955,7 @@ int fs_ln(const char *fname, const char *target)
 		log_err("** Unable to create link %s -> %s **\n", fname, target);
 		ret = -1;
 	}
-	fs_close();
+	fs_close_written();
 
 	return ret;
 }
@@ -809,7 +971,7 @@ int fs_rename(const char *old_path, const char *new_path)
 		log_debug("Unable to rename %s -> %s\n", old_path, new_path);
 		ret = -1;
 	}
-	fs_close();
+	fs_close_written();
 
 	return ret;
 }
@@ -930,13 +930,172 @@ out:
 	return metablks_count;
 }
 
+/* Drop a reference to the tables, freeing them if it was the last one */
+static void sqfs_put_tables(struct squashfs_tables *tables)
+{
+	if (!tables || --tables->refcount)
+		return;
+
+	free(tables->inode_table);
+	free(tables->dir_table);
+	free(tables->pos_list);
+	free(tables);
+}
+
+/*
+ * Decompress the inode and directory tables, unless this has already been
+ * done since the filesystem was probed. They are kept until sqfs_close(), so
+ * that looking up several paths does not decompress them each time.
+ */
+static int sqfs_read_tables(void)
+{
+	struct squashfs_tables *tables;
+	int ret;
+
+	if (ctxt.tables)
+		return 0;
+
+	tables = calloc(1, sizeof(*tables));
+	if (!tables)
+		return -ENOMEM;
+
+	ret = sqfs_read_inode_table(&tables->inode_table);
+	if (ret) {
+		free(tables);
+		return ret;
+	}
+
+	tables->metablks_count = sqfs_read_directory_table(&tables->dir_table,
+							   &tables->pos_list);
+	if (tables->metablks_count < 1) {
+		free(tables->inode_table);
+		free(tables);
+		return -EINVAL;
+	}
+	tables->refcount = 1;
+	ctxt.tables = tables;
+
+	return 0;
+}
+
+/**
+ * struct sqfs_cached_block - decompressed data or fragment block
+ *
+ * @start: Position of the block in the filesystem, in bytes
+ * @data: Decompressed contents, NULL if the entry is not in use
+ * @len: Number of bytes in @data
+ * @last_use: Value of sqfs_block_use when the block was last used
+ */
+struct sqfs_cached_block {
+	u64 start;
+	void *data;
+	unsigned long len;
+	ulong last_use;
+};
+
+static struct sqfs_cached_block sqfs_blocks[CONFIG_SQUASHFS_CACHE_BLOCKS];
+static ulong sqfs_block_use;
+
+/*
+ * Get the contents of the data or fragment block at byte @start, whose size
+ * as recorded in the inode or fragment table is @size. The block is taken from
+ * the cache if it is there, otherwise it is read and decompressed into the
+ * least recently used entry. The contents remain valid until the next call.
+ */
+static int sqfs_get_block(u64 start, u32 size, void **datap,
+			  unsigned long *lenp)
+{
+	u32 block_size = get_unaligned_le32(&ctxt.sblk->block_size);
+	u64 blk, table_size, table_offset, n_blks;
+	struct sqfs_cached_block *cb, *lru;
+	unsigned char *buf;
+	size_t buf_size;
+	int i, ret;
+
+	lru = &sqfs_blocks[0];
+	for (i = 0; i < ARRAY_SIZE(sqfs_blocks); i++) {
+		cb = &sqfs_blocks[i];
+		if (cb->data && cb->start == start) {
+			cb->last_use = ++sqfs_block_use;
+			*datap = cb->data;
+			*lenp = cb->len;
+			return 0;
+		}
+		if (lru->data && (!cb->data || cb->last_use < lru->last_use))
+			lru = cb;
+	}
+
+	table_size = SQFS_BLOCK_SIZE(size);
+	blk = lldiv(start, ctxt.cur_dev->blksz);
+	table_offset = start - (blk * ctxt.cur_dev->blksz);
+	n_blks = DIV_ROUND_UP(table_size + table_offset, ctxt.cur_dev->blksz);
+
+	if (table_size > block_size ||
+	    __builtin_mul_overflow(n_blks, ctxt.cur_dev->blksz, &buf_size))
+		return -EINVAL;
+
+	buf = malloc_cache_aligned(buf_size);
+	if (!buf)
+		return -ENOMEM;
+
+	if (sqfs_disk_read(blk, n_blks, buf) < 0) {
+		ret = -EIO;
+		goto out;
+	}
+
+	if (!lru->data) {
+		lru->data = malloc(block_size);
+		if (!lru->data) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	if (SQFS_COMPRESSED_BLOCK(size)) {
+		lru->len = block_size;
+		ret = sqfs_decompress(&ctxt, lru->data, &lru->len,
+				      buf + table_offset, table_size);
+	} else {
+		memcpy(lru->data, buf + table_offset, table_size);
+		lru->len = table_size;
+		ret = 0;
+	}
+	if (ret) {
+		free(lru->data);
+		lru->data = NULL;
+		goto out;
+	}
+
+	lru->start = start;
+	lru->last_use = ++sqfs_block_use;
+	*datap = lru->data;
+	*lenp = lru->len;
+
+out:
+	free(buf);
+
+	return ret;
+}
+
+/* Drop the tables and blocks kept for the filesystem */
+static void sqfs_drop_caches(void)
+{
+	int i;
+
+	sqfs_put_tables(ctxt.tables);
+	ctxt.tables = NULL;
+
+	for (i = 0; i < ARRAY_SIZE(sqfs_blocks); i++) {
+		free(sqfs_blocks[i].data);
+		sqfs_blocks[i].data = NULL;
+	}
+}
+
 static int sqfs_opendir_nest(const char *filename, struct fs_dir_stream **dirsp)
 {
-	unsigned char *inode_table = NULL, *dir_table = NULL;
-	int j, token_count = 0, ret = 0, metablks_count;
+	int j, token_count = 0, ret = 0;
 	struct squashfs_dir_stream *dirs;
 	char **token_list = NULL, *path = NULL;
-	u32 *pos_list = NULL;
 
 	dirs = calloc(1, sizeof(*dirs));
 	if (!dirs)
@@ -948,19 +1107,14 @@ static int sqfs_opendir_nest(const char *filename, struct fs_dir_stream **dirsp)
 	dirs->table = NULL;
 	dirs->inode_table = NULL;
 	dirs->dir_table = NULL;
+	dirs->tables = NULL;
 
-	ret = sqfs_read_inode_table(&inode_table);
+	ret = sqfs_read_tables();
 	if (ret) {
 		ret = -EINVAL;
 		goto out;
 	}
 
-	metablks_count = sqfs_read_directory_table(&dir_table, &pos_list);
-	if (metablks_count < 1) {
-		ret = -EINVAL;
-		goto out;
-	}
-
 	/* Tokenize filename */
 	token_count = sqfs_count_tokens(filename);
 	if (token_count < 0) {
@@ -988,10 +1142,11 @@ static int sqfs_opendir_nest(const char *filename, struct fs_dir_stream **dirsp)
 	 * ldir's (extended directory) size is greater than dir, so it works as
 	 * a general solution for the malloc size, since 'i' is a union.
 	 */
-	dirs->inode_table = inode_table;
-	dirs->dir_table = dir_table;
-	ret = sqfs_search_dir(dirs, token_list, token_count, pos_list,
-			      metablks_count);
+	dirs->inode_table = ctxt.tables->inode_table;
+	dirs->dir_table = ctxt.tables->dir_table;
+	ret = sqfs_search_dir(dirs, token_list, token_count,
+			      ctxt.tables->pos_list,
+			      ctxt.tables->metablks_count);
 	if (ret)
 		goto out;
 
@@ -1009,6 +1164,9 @@ static int sqfs_opendir_nest(const char *filename, struct fs_dir_stream **dirsp)
 	dirs->entry = NULL;
 	dirs->table += SQFS_DIR_HEADER_SIZE;
 
+	/* the stream may be read after the filesystem is closed */
+	dirs->tables = ctxt.tables;
+	dirs->tables->refcount++;
 	*dirsp = (struct fs_dir_stream *)dirs;
 
 out:
@@ -1017,12 +1175,9 @@ out:
 			free(token_list[j]);
 		free(token_list);
 	}
-	free(pos_list);
 	free(path);
-	if (ret) {
-		free(inode_table);
+	if (ret)
 		free(dirs);
-	}
 
 	return ret;
 }
@@ -1161,6 +1316,7 @@ int sqfs_probe(struct blk_desc *fs_dev_desc, struct disk_partition *fs_partition
 	struct squashfs_super_block *sblk;
 	int ret;
 
+	sqfs_drop_caches();
 	ctxt.cur_dev = fs_dev_desc;
 	ctxt.cur_part_info = *fs_partition;
 
@@ -1388,9 +1544,9 @@ static int sqfs_get_lregfile_info(struct squashfs_lreg_inode *lreg,
 static int sqfs_read_nest(const char *filename, void *buf, loff_t offset,
 			  loff_t len, loff_t *actread)
 {
-	char *dir = NULL, *fragment_block, *datablock = NULL;
-	char *fragment = NULL, *file = NULL, *resolved, *data;
+	char *dir = NULL, *file = NULL, *resolved, *data;
 	u64 start, n_blks, table_size, data_offset, table_offset, sparse_size;
+	u64 size;
 	int ret, j, i_number, datablk_count = 0;
 	struct squashfs_super_block *sblk = ctxt.sblk;
 	struct squashfs_fragment_block_entry frag_entry;
@@ -1404,7 +1560,7 @@ static int sqfs_read_nest(const char *filename, void *buf, loff_t offset,
 	unsigned long dest_len;
 	struct fs_dirent *dent;
 	unsigned char *ipos;
-	size_t buf_size;
+	void *block;
 
 	*actread = 0;
 
@@ -1490,9 +1646,8 @@ static int sqfs_read_nest(const char *filename, void *buf, loff_t offset,
 		symlink = (struct squashfs_symlink_inode *)ipos;
 		resolved = sqfs_resolve_symlink(symlink, filename);
 		/*
-		 * Free the parent directory resources before recursing so that
-		 * the recursive call can allocate its own inode and directory
-		 * tables without exhausting the heap.
+		 * Free the parent directory resources before recursing. The
+		 * inode and directory tables are kept for the recursive call.
 		 */
 		free(dirs->entry);
 		dirs->entry = NULL;
@@ -1525,33 +1680,37 @@ static int sqfs_read_nest(const char *filename, void *buf, loff_t offset,
 		len = finfo.size;
 	}
 
-	if (datablk_count) {
-		data_offset = finfo.start;
-		datablock = malloc(get_unaligned_le32(&sblk->block_size));
-		if (!datablock) {
-			ret = -ENOMEM;
-			goto out;
-		}
-	}
-
+	data_offset = finfo.start;
 	for (j = 0; j < datablk_count; j++) {
 		char *data_buffer;
 
-		start = lldiv(data_offset, ctxt.cur_dev->blksz);
 		table_size = SQFS_BLOCK_SIZE(finfo.blk_sizes[j]);
-		table_offset = data_offset - (start * ctxt.cur_dev->blksz);
-		n_blks = DIV_ROUND_UP(table_size + table_offset,
-				      ctxt.cur_dev->blksz);
 
-		/* Don't load any data for sparse blocks */
+		/* Load the data */
 		if (finfo.blk_sizes[j] == 0) {
-			n_blks = 0;
-			table_offset = 0;
-			data_buffer = NULL;
-			data = NULL;
+			/* This is a sparse block, don't load any data */
+			sparse_size = get_unaligned_le32(&sblk->block_size);
+			if ((*actread + sparse_size) > len)
+				sparse_size = len - *actread;
+			memset(buf + *actread, 0, sparse_size);
+			*actread += sparse_size;
+		} else if (SQFS_COMPRESSED_BLOCK(finfo.blk_sizes[j])) {
+			ret = sqfs_get_block(data_offset, finfo.blk_sizes[j],
+					     &block, &dest_len);
+			if (ret)
+				goto out;
+
+			if ((*actread + dest_len) > len)
+				dest_len = len - *actread;
+			memcpy(buf + *actread, block, dest_len);
+			*actread += dest_len;
 		} else {
-			data_buffer = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
+			start = lldiv(data_offset, ctxt.cur_dev->blksz);
+			table_offset = data_offset - (start * ctxt.cur_dev->blksz);
+			n_blks = DIV_ROUND_UP(table_size + table_offset,
+					      ctxt.cur_dev->blksz);
 
+			data_buffer = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
 			if (!data_buffer) {
 				ret = -ENOMEM;
 				goto out;
@@ -1565,40 +1724,20 @@ static int sqfs_read_nest(const char *filename, void *buf, loff_t offset,
 				 * image with mksquashfs's -b <block_size> option.
 				 */
 				printf("Error: too many data blocks to be read.\n");
+				free(data_buffer);
 				goto out;
 			}
 
 			data = data_buffer + table_offset;
-		}
-
-		/* Load the data */
-		if (finfo.blk_sizes[j] == 0) {
-			/* This is a sparse block */
-			sparse_size = get_unaligned_le32(&sblk->block_size);
-			if ((*actread + sparse_size) > len)
-				sparse_size = len - *actread;
-			memset(buf + *actread, 0, sparse_size);
-			*actread += sparse_size;
-		} else if (SQFS_COMPRESSED_BLOCK(finfo.blk_sizes[j])) {
-			dest_len = get_unaligned_le32(&sblk->block_size);
-			ret = sqfs_decompress(&ctxt, datablock, &dest_len,
-					      data, table_size);
-			if (ret)
-				goto out;
-
-			if ((*actread + dest_len) > len)
-				dest_len = len - *actread;
-			memcpy(buf + *actread, datablock, dest_len);
-			*actread += dest_len;
-		} else {
-			if ((*actread + table_size) > len)
-				table_size = len - *actread;
-			memcpy(buf + *actread, data, table_size);
-			*actread += table_size;
+			size = table_size;
+			if ((*actread + size) > len)
+				size = len - *actread;
+			memcpy(buf + *actread, data, size);
+			*actread += size;
+			free(data_buffer);
 		}
 
 		data_offset += table_size;
-		free(data_buffer);
 		if (*actread >= len)
 			break;
 	}
@@ -1611,61 +1750,27 @@ static int sqfs_read_nest(const char *filename, void *buf, loff_t offset,
 		goto out;
 	}
 
-	start = lldiv(frag_entry.start, ctxt.cur_dev->blksz);
-	table_size = SQFS_BLOCK_SIZE(frag_entry.size);
-	table_offset = frag_entry.start - (start * ctxt.cur_dev->blksz);
-	n_blks = DIV_ROUND_UP(table_size + table_offset, ctxt.cur_dev->blksz);
-
-	if (__builtin_mul_overflow(n_blks, ctxt.cur_dev->blksz, &buf_size)) {
-		ret = -EINVAL;
+	/*
+	 * Small files share fragment blocks, so the block is often still in
+	 * the cache from reading another file.
+	 */
+	ret = sqfs_get_block(frag_entry.start, frag_entry.size, &block,
+			     &dest_len);
+	if (ret)
 		goto out;
-	}
 
-	fragment = malloc_cache_aligned(buf_size);
-
-	if (!fragment) {
-		ret = -ENOMEM;
+	if (finfo.offset > dest_len ||
+	    finfo.size - *actread > dest_len - finfo.offset) {
+		ret = -EINVAL;
 		goto out;
 	}
 
-	ret = sqfs_disk_read(start, n_blks, fragment);
-	if (ret < 0)
-		goto out;
-
-	/* File compressed and fragmented */
-	if (finfo.frag && finfo.comp) {
-		dest_len = get_unaligned_le32(&sblk->block_size);
-		fragment_block = malloc(dest_len);
-		if (!fragment_block) {
-			ret = -ENOMEM;
-			goto out;
-		}
-
-		ret = sqfs_decompress(&ctxt, fragment_block, &dest_len,
-				      (void *)fragment  + table_offset,
-				      frag_entry.size);
-		if (ret) {
-			free(fragment_block);
-			goto out;
-		}
-
-		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
-		*actread = finfo.size;
-
-		free(fragment_block);
-
-	} else if (finfo.frag && !finfo.comp) {
-		fragment_block = (void *)fragment + table_offset;
-
-		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
-		*actread = finfo.size;
-	}
+	memcpy(buf + *actread, block + finfo.offset, finfo.size - *actread);
+	*actread = finfo.size;
 
 	ret = 0;
 
 out:
-	free(fragment);
-	free(datablock);
 	free(file);
 	free(dir);
 	free(finfo.blk_sizes);
@@ -1835,6 +1940,7 @@ int sqfs_size(const char *filename, loff_t *size)
 
 void sqfs_close(void)
 {
+	sqfs_drop_caches();
 	sqfs_decompressor_cleanup(&ctxt);
 	free(ctxt.sblk);
 	ctxt.sblk = NULL;
@@ -1849,8 +1955,7 @@ void sqfs_closedir(struct fs_dir_stream *dirs)
 		return;
 
 	sqfs_dirs = (struct squashfs_dir_stream *)dirs;
-	free(sqfs_dirs->inode_table);
-	free(sqfs_dirs->dir_table);
+	sqfs_put_tables(sqfs_dirs->tables);
 	free(sqfs_dirs->dir_header);
 	free(sqfs_dirs);
 }
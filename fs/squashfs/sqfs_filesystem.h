@@ -71,10 +71,26 @@ struct squashfs_super_block {
 	__le64 export_table_start;
 };
 
+/*
+ * Decompressed inode and directory tables, and the position of each metadata
+ * block of the directory table. They are shared by the mounted filesystem and
+ * the directory streams opened on it, which each hold a reference, so that a
+ * directory stream can still be read after the filesystem is closed.
+ */
+struct squashfs_tables {
+	unsigned char *inode_table;
+	unsigned char *dir_table;
+	u32 *pos_list;
+	int metablks_count;
+	int refcount;
+};
+
 struct squashfs_ctxt {
 	struct disk_partition cur_part_info;
 	struct blk_desc *cur_dev;
 	struct squashfs_super_block *sblk;
+	/* Tables, read on first use and kept until sqfs_close() */
+	struct squashfs_tables *tables;
 #if IS_ENABLED(CONFIG_ZSTD)
 	void *zstd_workspace;
 #endif
@@ -272,10 +288,12 @@ struct squashfs_dir_stream {
 	struct squashfs_ldir_inode i_ldir;
 	/*
 	 * References to the tables' beginnings. They are assigned in
-	 * sqfs_opendir() and freed in sqfs_closedir().
+	 * sqfs_opendir() and kept by a reference to 'tables', which is
+	 * dropped in sqfs_closedir().
 	 */
 	unsigned char *inode_table;
 	unsigned char *dir_table;
+	struct squashfs_tables *tables;
 };
 
 struct squashfs_file_info {
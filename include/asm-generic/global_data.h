@@ -29,7 +29,9 @@
 #include <asm-offsets.h>
 
 struct acpi_ctx;
+struct dm_lazy;
 struct driver_rt;
+struct of_index;
 struct upl;
 
 typedef struct global_data gd_t;
@@ -265,6 +267,13 @@ struct global_data {
 	 */
 	void *dm_priv_base;
 # endif
+# if CONFIG_IS_ENABLED(DM_LAZY_BIND)
+	/**
+	 * @dm_lazy: devicetree nodes recorded for binding on first use, or
+	 * NULL if all devices are bound when driver model is scanned
+	 */
+	struct dm_lazy *dm_lazy;
+# endif
 #endif
 #ifdef CONFIG_TIMER
 	/**
@@ -278,6 +287,12 @@ struct global_data {
 	 */
 	struct device_node *of_root;
 #endif
+#if CONFIG_IS_ENABLED(OF_INDEX)
+	/**
+	 * @of_index: index of the control devicetree, see dm/of_index.h
+	 */
+	struct of_index *of_index;
+#endif
 #if CONFIG_IS_ENABLED(MULTI_DTB_FIT)
 	/**
 	 * @multi_dtb_fit: pointer to uncompressed multi-dtb FIT image
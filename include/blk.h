@@ -10,6 +10,7 @@
 #include <bouncebuf.h>
 #include <dm/uclass-id.h>
 #include <efi.h>
+#include <linux/errno.h>
 
 #ifdef CONFIG_SYS_64BIT_LBA
 typedef uint64_t lbaint_t;
@@ -140,6 +141,24 @@ void blkcache_fill(int iftype, int dev,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer);
 
+/**
+ * blkcache_write() - update cached blocks after a write to a block device
+ *
+ * Blocks in the range which are present in the cache are updated with the
+ * data written, so that the cache stays coherent without being discarded.
+ * Blocks which are not cached are not added.
+ *
+ * @param iftype - uclass_id_x for type of device
+ * @param dev - device index of particular type
+ * @param start - starting block number
+ * @param blkcnt - number of blocks written
+ * @param blksz - size in bytes of each block
+ * @param buffer - buffer containing the data written
+ */
+void blkcache_write(int iftype, int dev,
+		    lbaint_t start, lbaint_t blkcnt,
+		    unsigned long blksz, void const *buffer);
+
 /**
  * blkcache_invalidate() - discard the cache for a set of blocks
  * because of a write or device (re)initialization.
@@ -152,10 +171,16 @@ void blkcache_invalidate(int iftype, int dev);
 /**
  * blkcache_configure() - configure block cache
  *
- * @param blocks - maximum blocks per entry
- * @param entries - maximum entries in cache
+ * The cache is discarded if its capacity or associativity changes.
+ *
+ * @param max_bytes - capacity of the cache in bytes, 0 to disable it
+ * @param ways - maximum number of blocks in each set of the cache
+ * @param max_blocks - largest read, in blocks, which is added to the cache
+ * @param max_dev_bytes - maximum bytes which a single device may use, 0 for
+ *	no limit
  */
-void blkcache_configure(unsigned blocks, unsigned entries);
+void blkcache_configure(ulong max_bytes, unsigned ways, unsigned max_blocks,
+			ulong max_dev_bytes);
 
 /*
  * statistics of the block cache
@@ -163,9 +188,27 @@ void blkcache_configure(unsigned blocks, unsigned entries);
 struct block_cache_stats {
 	unsigned hits;
 	unsigned misses;
+	unsigned evictions;
+	unsigned writes; /* cached blocks updated by writes */
 	unsigned entries; /* current entry count */
-	unsigned max_blocks_per_entry;
-	unsigned max_entries;
+	ulong bytes; /* current size of cached data */
+	ulong max_bytes;
+	ulong max_dev_bytes;
+	unsigned max_blocks;
+	unsigned ways;
+	unsigned sets;
+};
+
+/*
+ * per-device statistics of the block cache
+ */
+struct block_cache_dev_stats {
+	int iftype;
+	int devnum;
+	unsigned entries;
+	ulong bytes;
+	unsigned hits;
+	unsigned misses;
 };
 
 /**
@@ -175,6 +218,17 @@ struct block_cache_stats {
  */
 void blkcache_stats(struct block_cache_stats *stats);
 
+/**
+ * blkcache_dev_stats() - return statistics for a device using the cache
+ *
+ * @param idx - index of the device, starting at 0
+ * @param stats - statistics are copied here
+ * @param reset - true to reset the hit and miss counters of the device
+ * Return: 0 if OK, -ENOENT if there is no device with that index
+ */
+int blkcache_dev_stats(int idx, struct block_cache_dev_stats *stats,
+		       bool reset);
+
 /** blkcache_free() - free all memory allocated to the block cache */
 void blkcache_free(void);
 
@@ -191,6 +245,10 @@ static inline void blkcache_fill(int iftype, int dev,
 				 lbaint_t start, lbaint_t blkcnt,
 				 unsigned long blksz, void const *buffer) {}
 
+static inline void blkcache_write(int iftype, int dev,
+				  lbaint_t start, lbaint_t blkcnt,
+				  unsigned long blksz, void const *buffer) {}
+
 static inline void blkcache_invalidate(int iftype, int dev) {}
 
 static inline void blkcache_free(void) {}
@@ -307,6 +365,51 @@ unsigned long blk_derase(struct blk_desc *block_dev, lbaint_t start,
 long blk_read(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
 	      void *buffer);
 
+/**
+ * struct blk_readahead_stats - read-ahead statistics of a block device
+ *
+ * @windows: Number of read-ahead windows read from the device
+ * @fetched: Number of blocks read ahead of the caller
+ * @used: Number of read-ahead blocks which were later returned to the caller
+ */
+struct blk_readahead_stats {
+	ulong windows;
+	ulong fetched;
+	ulong used;
+};
+
+#if CONFIG_IS_ENABLED(BLK_READAHEAD)
+/**
+ * blk_readahead_invalidate() - discard the read-ahead window of a device
+ *
+ * This must be called when the contents of the device may have changed
+ * other than through blk_write(), e.g. when the media is reinitialised.
+ *
+ * @desc: Block device descriptor
+ */
+void blk_readahead_invalidate(struct blk_desc *desc);
+
+/**
+ * blk_readahead_stats() - get read-ahead statistics of a device
+ *
+ * @dev: Block device
+ * @stats: Returns the statistics
+ * @reset: true to reset the statistics after reading them
+ * Return: 0 if OK, -EAGAIN if the device is not active
+ */
+int blk_readahead_stats(struct udevice *dev, struct blk_readahead_stats *stats,
+			bool reset);
+#else
+static inline void blk_readahead_invalidate(struct blk_desc *desc) {}
+
+static inline int blk_readahead_stats(struct udevice *dev,
+				      struct blk_readahead_stats *stats,
+				      bool reset)
+{
+	return -ENOSYS;
+}
+#endif
+
 /**
  * blk_write() - Write to a block device
  *
@@ -548,8 +651,16 @@ static inline ulong blk_dread(struct blk_desc *block_dev, lbaint_t start,
 static inline ulong blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 			       lbaint_t blkcnt, const void *buffer)
 {
-	blkcache_invalidate(block_dev->uclass_id, block_dev->devnum);
-	return block_dev->block_write(block_dev, start, blkcnt, buffer);
+	ulong blks_written;
+
+	blks_written = block_dev->block_write(block_dev, start, blkcnt, buffer);
+	if (blks_written == blkcnt)
+		blkcache_write(block_dev->uclass_id, block_dev->devnum,
+			       start, blkcnt, block_dev->blksz, buffer);
+	else
+		blkcache_invalidate(block_dev->uclass_id, block_dev->devnum);
+
+	return blks_written;
 }
 
 static inline ulong blk_derase(struct blk_desc *block_dev, lbaint_t start,
@@ -56,6 +56,27 @@ struct cpu_info {
 	uint address_width;
 };
 
+/**
+ * struct cpu_job - a function to run on a CPU core
+ *
+ * The function runs with U-Boot's memory map, but must not use devices, the
+ * console, malloc() or anything else which is not safe to use from more than
+ * one core at a time.
+ *
+ * @func:	Function to run
+ * @arg:	Argument to pass to @func
+ * @ret:	Return value of @func
+ * @cpu:	CPU the job was started on, or NULL if it ran on the current CPU
+ * @done:	Set once @func has returned
+ */
+struct cpu_job {
+	int (*func)(void *arg);
+	void *arg;
+	int ret;
+	struct udevice *cpu;
+	bool done;
+};
+
 struct cpu_ops {
 	/**
 	 * get_desc() - Get a description string for a CPU
@@ -111,6 +132,18 @@ struct cpu_ops {
 	 * @return 0 if OK, -ve on error
 	 */
 	int (*release_core)(const struct udevice *dev, phys_addr_t addr);
+
+	/**
+	 * run() - Start running a job on a CPU core
+	 *
+	 * The core must call cpu_job_run() on @job and then wait for more
+	 * work. This is never called for the current CPU.
+	 *
+	 * @dev:	Device to run the job on (UCLASS_CPU)
+	 * @job:	Job to run
+	 * @return 0 if OK, -ve on error
+	 */
+	int (*run)(const struct udevice *dev, struct cpu_job *job);
 };
 
 #define cpu_get_ops(dev)        ((struct cpu_ops *)(dev)->driver->ops)
@@ -180,6 +213,65 @@ struct udevice *cpu_get_current_dev(void);
  */
 int cpu_release_core(const struct udevice *dev, phys_addr_t addr);
 
+/**
+ * cpu_run() - Start running a job on another CPU core
+ *
+ * This returns as soon as the job has started. Use cpu_job_wait() to wait for
+ * it to finish.
+ *
+ * @dev:	Device to run the job on (UCLASS_CPU)
+ * @job:	Job to run
+ * Return: 0 if OK, -EBUSY if @dev is the current CPU, -ENOSYS if the CPU
+ *	cannot run jobs, other -ve on error
+ */
+int cpu_run(struct udevice *dev, struct cpu_job *job);
+
+/**
+ * cpu_job_run() - Run a job on the current CPU core
+ *
+ * This is called by CPU drivers on the core that was asked to run @job. It
+ * calls the function and marks the job as done.
+ *
+ * @job:	Job to run
+ */
+void cpu_job_run(struct cpu_job *job);
+
+/**
+ * cpu_job_wait() - Wait for a job to finish
+ *
+ * @job:	Job to wait for
+ * Return: return value of the job's function, or -ETIMEDOUT
+ */
+int cpu_job_wait(struct cpu_job *job);
+
+/**
+ * cpu_job_cores() - Count the CPU cores which can run jobs
+ *
+ * Return: number of cores that cpu_run_jobs() can use, including the current
+ *	one, so at least 1
+ */
+int cpu_job_cores(void);
+
+/**
+ * cpu_run_jobs() - Run a set of jobs across the available CPU cores
+ *
+ * The first job runs on the current CPU. Each of the others is started on
+ * another core that can run jobs, as long as there is one; any left over run
+ * on the current CPU once the first is done. Put the longest job first for
+ * the best balance.
+ *
+ * If there are no other cores that can run jobs, all jobs run on the current
+ * CPU, one after the other.
+ *
+ * If a job times out, its core may still be running it, so @jobs and anything
+ * the jobs use must then not be freed or reused; -ETIMEDOUT is returned.
+ *
+ * @jobs:	Jobs to run
+ * @count:	Number of jobs
+ * Return: 0 if all jobs returned 0, else the first error
+ */
+int cpu_run_jobs(struct cpu_job *jobs, int count);
+
 /**
  * cpu_phys_address_size() - Get the physical-address size for the CPU
  *
@@ -170,6 +170,11 @@ struct dfu_entity {
 
 	u32 bad_skip;	/* for nand use */
 
+	/* statistics of the current transfer */
+	u64 stat_bytes;
+	u64 stat_write_us;
+	ulong stat_start;
+
 	unsigned int inited:1;
 };
 
@@ -312,6 +317,25 @@ int dfu_init_env_entities(char *interface, char *devstr);
 unsigned char *dfu_get_buf(struct dfu_entity *dfu);
 unsigned char *dfu_free_buf(void);
 unsigned long dfu_get_buf_size(void);
+
+/**
+ * dfu_set_write_queue() - queue full buffers instead of writing them at once
+ *
+ * With CONFIG_DFU_WRITE_BUFFERS > 1, dfu_write() moves on to the next buffer
+ * when one is full, leaving it to be written by dfu_write_pending(). It only
+ * writes itself when all buffers are full. The caller must not reuse the
+ * buffer returned by dfu_get_buf() while the queue is enabled.
+ *
+ * @enable:	true to queue full buffers
+ */
+void dfu_set_write_queue(bool enable);
+
+/**
+ * dfu_write_pending() - write the oldest queued buffer, if any
+ *
+ * An error is returned by the next call to dfu_write() or dfu_flush().
+ */
+void dfu_write_pending(void);
 bool dfu_usb_get_reset(void);
 
 #ifdef CONFIG_DFU_TIMEOUT
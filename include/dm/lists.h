@@ -64,6 +64,23 @@ int lists_bind_drivers(struct udevice *parent, bool pre_reloc_only);
 int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
 		   struct driver *drv, bool pre_reloc_only);
 
+/**
+ * lists_find_fdt_driver() - find the driver that would be bound to a node
+ *
+ * This matches drivers against the node in the same way as lists_bind_fdt(),
+ * but does not bind anything. Note that the driver may still refuse to bind,
+ * in which case lists_bind_fdt() tries the next match.
+ *
+ * @node: device tree node to check
+ * @pre_reloc_only: If true, only match nodes with special devicetree
+ * properties, or drivers with the DM_FLAG_PRE_RELOC flag
+ * @drvp: returns the driver found
+ * Return: 0 if found, -ENOENT if no device would be bound for this node,
+ * -EINVAL if the device tree is invalid
+ */
+int lists_find_fdt_driver(ofnode node, bool pre_reloc_only,
+			  struct driver **drvp);
+
 /**
  * device_bind_driver() - bind a device to a driver
  *
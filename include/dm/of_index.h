@@ -0,0 +1,202 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Index of the control devicetree, to speed up node lookups
+ */
+
+#ifndef _DM_OF_INDEX_H
+#define _DM_OF_INDEX_H
+
+#include <dm/ofnode_decl.h>
+#include <linux/errno.h>
+#include <linux/types.h>
+
+struct device_node;
+
+/**
+ * enum of_lookup_t - types of node lookup which can use the index
+ *
+ * @OF_LOOKUP_PHANDLE: Find a node by its phandle
+ * @OF_LOOKUP_COMPAT: Find the next node with a compatible string
+ * @OF_LOOKUP_PATH: Find a node by its full path
+ * @OF_LOOKUP_COUNT: Number of lookup types
+ */
+enum of_lookup_t {
+	OF_LOOKUP_PHANDLE,
+	OF_LOOKUP_COMPAT,
+	OF_LOOKUP_PATH,
+
+	OF_LOOKUP_COUNT,
+};
+
+/**
+ * struct of_lookup_stats - statistics for one type of lookup
+ *
+ * @calls: Number of lookups made in the control tree
+ * @indexed: Number of those which were answered by the index, without
+ *	walking the tree
+ * @us: Time spent in the lookups, in microseconds. This is only counted once
+ *	the timer is running
+ */
+struct of_lookup_stats {
+	uint calls;
+	uint indexed;
+	ulong us;
+};
+
+/**
+ * struct of_index_info - information about the index
+ *
+ * @tree: Tree the index was built for (root node or FDT), or NULL if none
+ * @live: true if @tree is a live tree
+ * @nodes: Number of nodes in the index
+ * @size: Number of bytes used by the index
+ * @builds: Number of times the index was built
+ * @lookup: Statistics for each type of lookup
+ */
+struct of_index_info {
+	const void *tree;
+	bool live;
+	int nodes;
+	ulong size;
+	uint builds;
+	struct of_lookup_stats lookup[OF_LOOKUP_COUNT];
+};
+
+#if CONFIG_IS_ENABLED(OF_INDEX)
+/**
+ * of_index_build() - Build the index for a tree
+ *
+ * This is only useful for the control tree, i.e. @tree must be gd->of_root or
+ * gd->fdt_blob. It is called when the live tree is created. Otherwise the
+ * index is built the first time it is needed.
+ *
+ * @tree: Root node of the live tree, or the FDT
+ * @live: true if @tree is a live tree
+ * Return: 0 if OK, -ENOMEM if out of memory
+ */
+int of_index_build(const void *tree, bool live);
+
+/**
+ * of_index_invalidate() - Drop the index after the control tree has changed
+ *
+ * This must be called when nodes are added to or removed from the control
+ * tree, or a compatible string changes. The ofnode and of_access functions
+ * do this automatically. Code which changes the control FDT with libfdt
+ * directly only needs to call this if the sizes of the FDT do not change,
+ * since that is checked on each lookup.
+ *
+ * The index is built again the next time it is needed.
+ */
+void of_index_invalidate(void);
+
+/**
+ * of_index_phandle() - Look up a node by phandle
+ *
+ * @tree: Root node of the live tree, or the FDT
+ * @live: true if @tree is a live tree
+ * @phandle: Phandle to find
+ * @nodep: Returns the node: its node pointer for a live tree, else its offset
+ * Return: 0 if found, -ENOENT if there is no such node, -EAGAIN if the
+ *	index cannot answer, so the tree must be walked
+ */
+int of_index_phandle(const void *tree, bool live, uint phandle, ofnode *nodep);
+
+/**
+ * of_index_compat() - Look up the next node with a compatible string
+ *
+ * @tree: Root node of the live tree, or the FDT
+ * @live: true if @tree is a live tree
+ * @from: Node to start after (see of_index_phandle() for the format), or
+ *	ofnode_null() to start at the root
+ * @compat: Compatible string to find
+ * @nodep: Returns the node (see of_index_phandle() for the format)
+ * Return: 0 if found, -ENOENT if there is no such node in a live tree,
+ *	-EAGAIN if the index cannot answer, so the tree must be walked. A miss
+ *	in an FDT gives -EAGAIN, since libfdt can change a compatible string in
+ *	place without the index noticing.
+ */
+int of_index_compat(const void *tree, bool live, ofnode from,
+		    const char *compat, ofnode *nodep);
+
+/**
+ * of_index_path() - Look up a node by its full path
+ *
+ * Aliases and options (after ':') are not supported. With a flat tree,
+ * libfdt also allows the unit address to be omitted, so a miss is never
+ * final there.
+ *
+ * @tree: Root node of the live tree, or the FDT
+ * @live: true if @tree is a live tree
+ * @path: Full path of the node
+ * @nodep: Returns the node (see of_index_phandle() for the format)
+ * Return: 0 if found, -ENOENT if there is no such node, -EAGAIN if the
+ *	index cannot answer, so the tree must be walked
+ */
+int of_index_path(const void *tree, bool live, const char *path,
+		  ofnode *nodep);
+
+/**
+ * of_index_get_info() - Get information about the index
+ *
+ * @info: Returns the information
+ */
+void of_index_get_info(struct of_index_info *info);
+#else
+static inline int of_index_build(const void *tree, bool live)
+{
+	return 0;
+}
+
+static inline void of_index_invalidate(void) {}
+
+static inline int of_index_phandle(const void *tree, bool live, uint phandle,
+				   ofnode *nodep)
+{
+	return -EAGAIN;
+}
+
+static inline int of_index_compat(const void *tree, bool live, ofnode from,
+				  const char *compat, ofnode *nodep)
+{
+	return -EAGAIN;
+}
+
+static inline int of_index_path(const void *tree, bool live, const char *path,
+				ofnode *nodep)
+{
+	return -EAGAIN;
+}
+
+static inline void of_index_get_info(struct of_index_info *info)
+{
+	*info = (struct of_index_info){};
+}
+#endif
+
+#if CONFIG_IS_ENABLED(OF_INDEX) && CONFIG_IS_ENABLED(DM_STATS)
+/**
+ * of_lookup_start() - Note the start of a lookup
+ *
+ * Return: Time to pass to of_lookup_done()
+ */
+ulong of_lookup_start(void);
+
+/**
+ * of_lookup_done() - Record a lookup in the control tree
+ *
+ * @type: Type of lookup
+ * @start: Value returned by of_lookup_start()
+ * @indexed: true if the index answered the lookup
+ */
+void of_lookup_done(enum of_lookup_t type, ulong start, bool indexed);
+#else
+static inline ulong of_lookup_start(void)
+{
+	return 0;
+}
+
+static inline void of_lookup_done(enum of_lookup_t type, ulong start,
+				  bool indexed) {}
+#endif
+
+#endif
@@ -9,7 +9,10 @@
 #ifndef _DM_ROOT_H_
 #define _DM_ROOT_H_
 
+#include <dm/ofnode_decl.h>
 #include <dm/tag.h>
+#include <dm/uclass-id.h>
+#include <linux/errno.h>
 
 struct udevice;
 
@@ -34,6 +37,10 @@ extern struct list_head uclass_head;
  * @attach_size_total: Total number of bytes of attached data
  * @attach_count: Number of devices with attached, for each type
  * @attach_size: Total number of bytes of attached data, for each type
+ * @lazy_count: Number of devicetree nodes recorded for binding on first use
+ *	(CONFIG_DM_LAZY_BIND)
+ * @lazy_bound: Number of those nodes which have been bound
+ * @lazy_size: Bytes used to record the nodes
  */
 struct dm_stats {
 	int total_size;
@@ -50,6 +57,9 @@ struct dm_stats {
 	int attach_size_total;
 	int attach_count[DM_TAG_ATTACH_COUNT];
 	int attach_size[DM_TAG_ATTACH_COUNT];
+	int lazy_count;
+	int lazy_bound;
+	int lazy_size;
 };
 
 /**
@@ -211,4 +221,90 @@ void dm_get_stats(int *device_countp, int *uclass_countp);
  */
 void dm_get_mem(struct dm_stats *stats);
 
+#if CONFIG_IS_ENABLED(DM_LAZY_BIND)
+/**
+ * dm_lazy_init() - Bind devicetree devices when they are first used
+ *
+ * After this is called, leaf nodes below the root of the devicetree (and the
+ * other nodes scanned by dm_extended_scan()) are recorded by the scan instead
+ * of being bound. They are bound when their uclass is first used, or their
+ * node is looked up with device_find_global_by_ofnode().
+ *
+ * This is called by dm_init_and_scan() if the 'dm-lazy-bind' property is
+ * present in /options/u-boot in the control devicetree.
+ *
+ * Return: 0 if OK, -ENOMEM if out of memory
+ */
+int dm_lazy_init(void);
+
+/**
+ * dm_lazy_uninit() - Stop binding devices on first use
+ *
+ * This frees the nodes recorded by dm_lazy_init(), without binding them
+ */
+void dm_lazy_uninit(void);
+
+/**
+ * dm_lazy_add() - Record a node to be bound when first used
+ *
+ * @node: Node to record, which is a subnode of a node scanned by
+ *	dm_extended_scan()
+ * @pre_reloc_only: If true, only nodes with special devicetree properties, or
+ *	drivers with the DM_FLAG_PRE_RELOC flag, are considered
+ * Return: 1 if the node was dealt with (recorded, or has nothing to bind),
+ *	0 if it must be bound now, -ENOMEM if out of memory
+ */
+int dm_lazy_add(ofnode node, bool pre_reloc_only);
+
+/**
+ * dm_lazy_bind_uclass() - Bind the recorded nodes of a uclass
+ *
+ * @id: Uclass ID
+ * Return: 0 if OK, -ve if a device failed to bind
+ */
+int dm_lazy_bind_uclass(enum uclass_id id);
+
+/**
+ * dm_lazy_bind_ofnode() - Bind a recorded node
+ *
+ * This binds the node along with the other recorded nodes in its uclass, so
+ * that the devices in the uclass stay in devicetree order
+ *
+ * @node: Node to bind
+ * Return: 1 if the node was bound, 0 if it was not recorded
+ */
+int dm_lazy_bind_ofnode(ofnode node);
+
+/**
+ * dm_lazy_get_stats() - Add stats on recorded nodes
+ *
+ * @stats: Place to put the information
+ */
+void dm_lazy_get_stats(struct dm_stats *stats);
+#else
+static inline int dm_lazy_init(void)
+{
+	return -ENOSYS;
+}
+
+static inline void dm_lazy_uninit(void) {}
+
+static inline int dm_lazy_add(ofnode node, bool pre_reloc_only)
+{
+	return 0;
+}
+
+static inline int dm_lazy_bind_uclass(enum uclass_id id)
+{
+	return 0;
+}
+
+static inline int dm_lazy_bind_ofnode(ofnode node)
+{
+	return 0;
+}
+
+static inline void dm_lazy_get_stats(struct dm_stats *stats) {}
+#endif
+
 #endif
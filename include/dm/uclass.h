@@ -156,6 +156,9 @@ void *uclass_get_priv(const struct uclass *uc);
  * the number of uclasses. This function allows looking up a uclass by its
  * ID.
  *
+ * With CONFIG_DM_LAZY_BIND, this binds any devices in the uclass which were
+ * left until first use.
+ *
  * @key: ID to look up
  * @ucp: Returns pointer to uclass (there is only one per ID)
  * Return:
@@ -58,6 +58,14 @@ void dm_dump_static_driver_info(void);
  */
 void dm_dump_mem(struct dm_stats *stats);
 
+/**
+ * dm_dump_of_index() - Dump stats on devicetree lookups and the index
+ *
+ * This shows the state of the index of the control devicetree and how many
+ * lookups of each type were made, and how many used the index
+ */
+void dm_dump_of_index(void);
+
 #if CONFIG_IS_ENABLED(OF_PLATDATA_INST) && CONFIG_IS_ENABLED(READ_ONLY)
 void *dm_priv_to_rw(void *priv);
 #else
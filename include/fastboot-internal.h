@@ -13,6 +13,14 @@ extern void *fastboot_buf_addr;
  */
 extern u32 fastboot_buf_size;
 
+/**
+ * fastboot_max_download_size() - Get the largest download which is accepted
+ *
+ * Return: Size of the download buffer, or more if downloads are written to a
+ *	partition as they arrive
+ */
+u32 fastboot_max_download_size(void);
+
 /**
  * fastboot_progress_callback - callback executed during long operations
  */
@@ -102,4 +102,46 @@ void fastboot_block_write_sparse_image(struct blk_desc *dev_desc, struct disk_pa
 void fastboot_block_flash_write(const char *part_name, void *download_buffer,
 				u32 download_bytes, char *response);
 
+/**
+ * fastboot_block_stream_open() - Start writing a download as it arrives
+ *
+ * The download may be a sparse image, or a raw image which is written from
+ * the start of the partition.
+ *
+ * @dev_desc: Block device to write to
+ * @info: Partition to write to
+ * @part_name: Name of the partition, which must stay valid until the stream
+ *	is closed
+ * @response: Pointer to fastboot response buffer
+ * Return: 0 on success, -ve on error
+ */
+int fastboot_block_stream_open(struct blk_desc *dev_desc,
+			       struct disk_partition *info,
+			       const char *part_name, char *response);
+
+/**
+ * fastboot_block_stream_write() - Write the next part of the download
+ *
+ * On error, the stream is ended.
+ *
+ * @data: Next part of the download
+ * @len: Number of bytes in @data
+ * @response: Pointer to fastboot response buffer, set on error
+ * Return: 0 on success, -ve on error
+ */
+int fastboot_block_stream_write(const void *data, u32 len, char *response);
+
+/**
+ * fastboot_block_stream_close() - Finish writing the download
+ *
+ * @response: Pointer to fastboot response buffer, set on error
+ * Return: 0 on success, -ve on error
+ */
+int fastboot_block_stream_close(char *response);
+
+/**
+ * fastboot_block_stream_abort() - Stop writing the download
+ */
+void fastboot_block_stream_abort(void);
+
 #endif // _FB_BLOCK_H_
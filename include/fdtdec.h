@@ -699,6 +699,18 @@ int fdtdec_get_chosen_node(const void *blob, const char *name);
  */
 const char *fdtdec_get_compatible(enum fdt_compat_id id);
 
+/**
+ * fdtdec_node_offset_by_phandle() - Find the node with a given phandle
+ *
+ * This is the same as fdt_node_offset_by_phandle() but uses the index of the
+ * control FDT, if enabled (CONFIG_OF_INDEX).
+ *
+ * @blob:	FDT blob
+ * @phandle:	phandle to find
+ * Return: node offset if found, -ve FDT_ERR_... error code on error
+ */
+int fdtdec_node_offset_by_phandle(const void *blob, uint phandle);
+
 /* Look up a phandle and follow it to its node. Then return the offset
  * of that node.
  *
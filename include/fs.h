@@ -91,6 +91,72 @@ int fs_set_blk_dev_with_part(struct blk_desc *desc, int part);
  */
 void fs_close(void);
 
+/**
+ * fs_keep_open() - Keep the filesystem in use open across several accesses
+ *
+ * While set, the file functions which implicitly call fs_close() leave the
+ * filesystem set by fs_set_blk_dev() open, so that a file can be read in parts
+ * without finding and probing the filesystem again for each one. No other
+ * filesystem may be selected until this is cleared.
+ *
+ * @keep: true to keep the filesystem open, false to close it
+ */
+void fs_keep_open(bool keep);
+
+/**
+ * struct fs_cache_stats - statistics of the filesystem mount cache
+ *
+ * @desc: Block device of the filesystem kept mounted, NULL if none
+ * @part: Partition of the filesystem kept mounted
+ * @fstype_name: Type of the filesystem kept mounted
+ * @hits: Number of accesses which found the filesystem still mounted
+ * @misses: Number of accesses which had to probe the filesystem
+ * @invalidations: Number of times a mounted filesystem was closed because
+ *	its device was written or removed
+ */
+struct fs_cache_stats {
+	struct blk_desc *desc;
+	int part;
+	const char *fstype_name;
+	ulong hits;
+	ulong misses;
+	ulong invalidations;
+};
+
+/**
+ * fs_cache_get_stats() - Get the statistics of the filesystem mount cache
+ *
+ * @stats: Returns the statistics
+ */
+void fs_cache_get_stats(struct fs_cache_stats *stats);
+
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+/**
+ * fs_cache_invalidate() - Close a filesystem kept mounted on a block device
+ *
+ * With CONFIG_FS_MOUNT_CACHE, fs_close() leaves the filesystem mounted so that
+ * the next access to the same partition does not need to probe it again. This
+ * must be called when the block device is written other than through the
+ * filesystem, when its medium may have changed, or when it is removed.
+ *
+ * @desc: Block device, or NULL for any
+ */
+void fs_cache_invalidate(struct blk_desc *desc);
+
+/**
+ * fs_cache_enable() - Allow or stop keeping filesystems mounted
+ *
+ * When disabled, the filesystem kept mounted is closed and each access probes
+ * the filesystem again, as without CONFIG_FS_MOUNT_CACHE.
+ *
+ * @enable: true to keep filesystems mounted, false to close them after each
+ *	access
+ */
+void fs_cache_enable(bool enable);
+#else
+static inline void fs_cache_invalidate(struct blk_desc *desc) {}
+#endif
+
 /**
  * fs_get_type() - Get type of current filesystem
  *
@@ -42,3 +42,116 @@ static inline int is_sparse_image(void *buf)
 
 int write_sparse_image(struct sparse_storage *info, const char *part_name,
 		       void *data, char *response);
+
+/**
+ * enum sparse_stream_state - what a sparse image stream expects next
+ *
+ * @SPARSE_STREAM_FILE_HDR: Collecting the file header
+ * @SPARSE_STREAM_CHUNK_HDR: Collecting a chunk header
+ * @SPARSE_STREAM_FILL: Collecting the value of a fill chunk
+ * @SPARSE_STREAM_DATA: Writing the data of a raw chunk
+ * @SPARSE_STREAM_RAW: Writing an image which is not sparse
+ * @SPARSE_STREAM_DONE: All chunks have been written
+ */
+enum sparse_stream_state {
+	SPARSE_STREAM_FILE_HDR,
+	SPARSE_STREAM_CHUNK_HDR,
+	SPARSE_STREAM_FILL,
+	SPARSE_STREAM_DATA,
+	SPARSE_STREAM_RAW,
+	SPARSE_STREAM_DONE,
+};
+
+/**
+ * struct sparse_stream - an image being written as it arrives
+ *
+ * An image which is not sparse is written as it is.
+ *
+ * @info: Storage to write to
+ * @part_name: Name of the partition, for messages
+ * @state: What is expected next
+ * @hdr: Header or fill value being collected
+ * @want: Number of bytes of @hdr to collect
+ * @have: Number of bytes of @hdr collected so far
+ * @file: File header of the sparse image
+ * @chunk: Header of the current chunk
+ * @chunks: Number of chunk headers handled
+ * @skip: Number of bytes to skip before going on
+ * @left: Number of bytes of the current raw chunk still to come
+ * @blk: Next block to write
+ * @total_blocks: Number of blocks of the sparse image handled
+ * @bytes_written: Number of bytes written to the storage
+ * @buf: Bounce buffer, aligned for DMA
+ * @buf_size: Size of @buf, a multiple of the block size
+ * @fill: Number of bytes in @buf
+ */
+struct sparse_stream {
+	struct sparse_storage *info;
+	const char *part_name;
+	enum sparse_stream_state state;
+	union {
+		sparse_header_t file;
+		chunk_header_t chunk;
+		uint32_t fill;
+		u8 bytes[sizeof(sparse_header_t)];
+	} hdr;
+	uint want;
+	uint have;
+	sparse_header_t file;
+	chunk_header_t chunk;
+	uint chunks;
+	u64 skip;
+	u64 left;
+	lbaint_t blk;
+	uint32_t total_blocks;
+	u64 bytes_written;
+	void *buf;
+	ulong buf_size;
+	ulong fill;
+};
+
+/**
+ * sparse_stream_start() - Start writing an image as it arrives
+ *
+ * This allows an image to be written while it is being received, without
+ * holding all of it in memory. Whether it is a sparse image is decided from
+ * its first bytes.
+ *
+ * @ss: Stream to set up
+ * @info: Storage to write to, which must stay valid until the stream ends
+ * @part_name: Name of the partition, for messages
+ * Return: 0 if OK, -ENOMEM if out of memory
+ */
+int sparse_stream_start(struct sparse_stream *ss, struct sparse_storage *info,
+			const char *part_name);
+
+/**
+ * sparse_stream_write() - Write the next part of an image
+ *
+ * @ss: Stream to write to
+ * @data: Next part of the image
+ * @len: Number of bytes in @data
+ * @response: Returns the reason for a failure, via the storage's mssg()
+ * Return: 0 if OK, -ve on error, after which the stream must be aborted
+ */
+int sparse_stream_write(struct sparse_stream *ss, const void *data,
+			size_t len, char *response);
+
+/**
+ * sparse_stream_finish() - Finish writing an image
+ *
+ * This writes the end of an image which is not sparse, or checks that all
+ * the blocks of a sparse image were written. The stream is ended either way.
+ *
+ * @ss: Stream to finish
+ * @response: Returns the reason for a failure, via the storage's mssg()
+ * Return: 0 if OK, -ve on error
+ */
+int sparse_stream_finish(struct sparse_stream *ss, char *response);
+
+/**
+ * sparse_stream_abort() - End a stream without finishing the image
+ *
+ * @ss: Stream to end
+ */
+void sparse_stream_abort(struct sparse_stream *ss);
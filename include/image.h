@@ -1092,6 +1092,52 @@ int image_decomp(int comp, ulong load, ulong image_start, int type,
 		 void *load_buf, void *image_buf, ulong image_len,
 		 uint unc_len, ulong *load_end);
 
+/**
+ * struct image_stream - source of an image that is decompressed as it is read
+ *
+ * @read:	Read @len bytes at @offset in the source into @buf. Return the
+ *		number of bytes read, or -ve on error
+ * @priv:	Private data for @read
+ * @offset:	Offset of the compressed data in the source
+ * @size:	Size of the compressed data in bytes
+ * @window:	Number of bytes to read from the source at a time
+ * @algo:	Hash algorithm to run over the compressed data, or NULL for none
+ * @digest:	Returns the hash of the compressed data, if @algo is set. A crc32
+ *		is stored big-endian, as in FIT hash nodes
+ * @read_us:	Returns the time spent in @read, in microseconds
+ * @decomp_us:	Returns the time spent decompressing, in microseconds
+ */
+struct image_stream {
+	long (*read)(struct image_stream *strm, void *buf, ulong offset,
+		     ulong len);
+	void *priv;
+	ulong offset;
+	ulong size;
+	ulong window;
+	struct hash_algo *algo;
+	uint8_t digest[HASH_MAX_DIGEST_SIZE];
+	ulong read_us;
+	ulong decomp_us;
+};
+
+/**
+ * image_decomp_stream() - decompress an image while reading it
+ *
+ * This reads the compressed data a window at a time and feeds each window to
+ * the decompressor before reading the next one, so the compressed image never
+ * needs to be held in memory as a whole.
+ *
+ * @strm:	Source of the compressed data
+ * @comp:	Compression algorithm that is used (IH_COMP_...)
+ * @load_buf:	Place to decompress to
+ * @unc_len:	Available space for decompression
+ * @load_len:	Returns the number of bytes decompressed
+ * Return: 0 if OK, -ENOSYS if @comp is not supported, -ENOBUFS if the
+ *	uncompressed data does not fit in @unc_len, other -ve on error
+ */
+int image_decomp_stream(struct image_stream *strm, int comp, void *load_buf,
+			ulong unc_len, ulong *load_len);
+
 /**
  * Set up properties in the FDT
  *
@@ -136,6 +136,38 @@ static inline void net_set_state(enum net_loop_state state)
 extern int		net_restart_wrap;	/* Tried all network devices */
 #if CONFIG_IS_ENABLED(NET)
 extern uchar		*net_rx_packets[PKTBUFSRX]; /* Receive packets */
+
+/**
+ * struct net_rx_stats - receive statistics for the last network operation
+ *
+ * Ethernet drivers hand each received frame to the stack in place (see
+ * &struct eth_ops), so the only copy a file transfer should need is the one
+ * which stores its payload at the load address. Comparing @copied with @bytes
+ * shows whether anything else copies the data.
+ *
+ * @packets: Number of frames received (legacy network stack only)
+ * @bytes: Number of bytes received, including the Ethernet headers (legacy
+ *	network stack only)
+ * @copied: Number of bytes copied out of received frames by the stack, i.e.
+ *	payload stored by a file transfer and reassembled IP fragments
+ */
+struct net_rx_stats {
+	u64 packets;
+	u64 bytes;
+	u64 copied;
+};
+
+extern struct net_rx_stats net_rx_stats;
+
+/**
+ * net_rx_copied() - Note that the stack copied data out of a received frame
+ *
+ * @len: Number of bytes copied
+ */
+static inline void net_rx_copied(uint len)
+{
+	net_rx_stats.copied += len;
+}
 #endif
 extern const u8		net_bcast_ethaddr[ARP_HLEN];	/* Ethernet broadcast address */
 extern struct in_addr	net_ip;		/* Our    IP addr (0 = unknown) */
@@ -283,7 +315,10 @@ enum eth_recv_flags {
  *	 called if supplied
  * free_pkt: Give the driver an opportunity to manage its packet buffer memory
  *	     when the network stack is finished processing it. This will only be
- *	     called when no error was returned from recv - optional
+ *	     called when no error was returned from recv - optional. A driver
+ *	     with a DMA receive ring can return the DMA buffer itself from recv
+ *	     and give it back to the hardware here, so that the packet is never
+ *	     copied before the protocol stores its payload
  * stop: Stop the hardware from looking for packets - may be called even if
  *	 state == PASSIVE
  * mcast: Join or leave a multicast group (for TFTP) - optional
@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Writing a download straight to a block device
+ */
+
+#ifndef __NET_SINK_H__
+#define __NET_SINK_H__
+
+#include <linux/errno.h>
+#include <linux/types.h>
+
+/*
+ * The sink is armed by the 'net sink' command. The next TFTP or HTTP download
+ * is then written to the block device as it arrives, instead of to memory,
+ * and its SHA-256 digest is worked out on the way. The sink is disarmed when
+ * that download finishes, whether or not it succeeds.
+ */
+
+#if IS_ENABLED(CONFIG_NET_SINK)
+/**
+ * net_sink_arm() - Arm the sink for the next download
+ *
+ * @ifname: Interface of the block device, e.g. "mmc"
+ * @dev_part: Device and optional partition, e.g. "0:1". Without a partition,
+ *	the whole device is written
+ * @digest: SHA-256 digest which the download must have, as a hex string, or
+ *	NULL to not check it
+ * Return: 0 if OK, -ENODEV if there is no such device or partition, -EINVAL
+ *	if @digest is not valid
+ */
+int net_sink_arm(const char *ifname, const char *dev_part, const char *digest);
+
+/**
+ * net_sink_disarm() - Disarm the sink, if it is not in use
+ */
+void net_sink_disarm(void);
+
+/**
+ * net_sink_show() - Show where the next download will be written
+ */
+void net_sink_show(void);
+
+/**
+ * net_sink_start() - Start writing a download to the sink, if it is armed
+ *
+ * Return: 0 if OK or not armed, -ENOMEM if out of memory
+ */
+int net_sink_start(void);
+
+/**
+ * net_sink_active() - Check if the download is being written to the sink
+ *
+ * Return: true if net_sink_write() must be used to store the download
+ */
+bool net_sink_active(void);
+
+/**
+ * net_sink_size() - Get the number of bytes of the download received
+ *
+ * Return: Number of bytes passed to net_sink_write(), without gaps
+ */
+ulong net_sink_size(void);
+
+/**
+ * net_sink_write() - Write part of the download
+ *
+ * The download must be written in order. Data before net_sink_size() has
+ * been written already, so is skipped.
+ *
+ * @offset: Offset of @buf in the download
+ * @buf: Data to write
+ * @len: Number of bytes to write
+ * Return: 0 if OK, -EAGAIN if @offset is after net_sink_size(), so the data
+ *	before it is missing, -ENOSPC if the download does not fit, -EIO if the
+ *	device could not be written
+ */
+int net_sink_write(ulong offset, const void *buf, ulong len);
+
+/**
+ * net_sink_finish() - Finish writing the download and check its digest
+ *
+ * If @ok is false, the sink is just closed.
+ *
+ * @ok: true if the whole download has been received
+ * Return: 0 if OK, -EIO if the device could not be written, -EILSEQ if the
+ *	digest does not match
+ */
+int net_sink_finish(bool ok);
+#else
+static inline int net_sink_start(void)
+{
+	return 0;
+}
+
+static inline bool net_sink_active(void)
+{
+	return false;
+}
+
+static inline ulong net_sink_size(void)
+{
+	return 0;
+}
+
+static inline int net_sink_write(ulong offset, const void *buf, ulong len)
+{
+	return -ENOSYS;
+}
+
+static inline int net_sink_finish(bool ok)
+{
+	return 0;
+}
+#endif
+
+#endif /* __NET_SINK_H__ */
@@ -86,7 +86,6 @@ struct ip_tcp_hdr {
 #define TCP_OPT_LEN_8	0x08
 #define TCP_OPT_LEN_A	0x0a		/* Timestamp Length		*/
 #define TCP_MSS		1460		/* Max segment size		*/
-#define TCP_SCALE	0x01		/* Scale			*/
 
 /**
  * struct tcp_mss - TCP option structure for MSS (Max segment size)
@@ -357,7 +356,12 @@ enum tcp_status {
  * @loc_timestamp:	Local timestamp
  * @rmt_timestamp:	Remote timestamp
  *
+ * @loc_win_scale:	Local window scale factor: the shift applied to the
+ *			  window we advertise. It is offered in our SYN and
+ *			  dropped to 0 if the remote end does not agree
  * @rmt_win_scale:	Remote window scale factor
+ * @win_scale_ok:	Non-zero if the remote end sent a window scale option
+ *			  in its SYN
  *
  * @lost:		Used for SACK
  *
@@ -419,7 +423,9 @@ struct tcp_stream {
 	u32		rmt_timestamp;
 
 	/* TCP window scale */
+	u8		loc_win_scale;
 	u8		rmt_win_scale;
+	u8		win_scale_ok;
 
 	/* TCP sliding window control used to request re-TX */
 	struct tcp_sack_v lost;
@@ -30,6 +30,34 @@ typedef struct {
 
 extern const uint8_t sha512_der_prefix[];
 
+#if !CONFIG_IS_ENABLED(MBEDTLS_LIB_CRYPTO)
+/**
+ * sha512_process() - Process whole blocks of input
+ *
+ * This is used for both SHA-384 and SHA-512. The generic version is weak, so
+ * that an architecture can provide an accelerated one.
+ *
+ * @ctx: Context to update
+ * @data: Input data, @blocks * SHA512_BLOCK_SIZE bytes long
+ * @blocks: Number of blocks to process
+ */
+void sha512_process(sha512_context *ctx, const unsigned char *data,
+		    unsigned int blocks);
+
+/**
+ * sha512_process_generic() - Process whole blocks of input in C
+ *
+ * This is the portable implementation of sha512_process(), also available
+ * when an accelerated one is in use.
+ *
+ * @ctx: Context to update
+ * @data: Input data, @blocks * SHA512_BLOCK_SIZE bytes long
+ * @blocks: Number of blocks to process
+ */
+void sha512_process_generic(sha512_context *ctx, const unsigned char *data,
+			    unsigned int blocks);
+#endif
+
 void sha512_starts(sha512_context * ctx);
 void sha512_update(sha512_context *ctx, const uint8_t *input, uint32_t length);
 void sha512_finish(sha512_context * ctx, uint8_t digest[SHA512_SUM_LEN]);
@@ -232,6 +232,15 @@ int board_usb_cleanup(int index, enum usb_init_type init);
 int usb_stor_scan(int mode);
 int usb_stor_info(void);
 
+/**
+ * usb_stor_get_max_xfer_blk() - Get the maximum blocks in one transfer
+ *
+ * @desc: USB storage block device
+ * Return: largest number of blocks read or written with one command, 0 if
+ *	the device is not a USB storage device
+ */
+unsigned int usb_stor_get_max_xfer_blk(struct blk_desc *desc);
+
 #endif
 
 #ifdef CONFIG_USB_HOST_ETHER
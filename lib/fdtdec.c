@@ -32,6 +32,7 @@
 #include <asm/sections.h>
 #include <dm/ofnode.h>
 #include <dm/of_extra.h>
+#include <dm/of_index.h>
 #include <linux/ctype.h>
 #include <linux/lzo.h>
 #include <linux/ioport.h>
@@ -654,6 +655,27 @@ int fdtdec_check_fdt(void)
 	return 0;
 }
 
+int fdtdec_node_offset_by_phandle(const void *blob, uint phandle)
+{
+	ofnode node;
+	ulong start;
+	int offset;
+	int ret;
+
+	start = of_lookup_start();
+	ret = of_index_phandle(blob, false, phandle, &node);
+	if (!ret)
+		offset = node.of_offset;
+	else if (ret == -ENOENT)
+		offset = -FDT_ERR_NOTFOUND;
+	else
+		offset = fdt_node_offset_by_phandle(blob, phandle);
+	if (blob == gd->fdt_blob)
+		of_lookup_done(OF_LOOKUP_PHANDLE, start, ret != -EAGAIN);
+
+	return offset;
+}
+
 int fdtdec_lookup_phandle(const void *blob, int node, const char *prop_name)
 {
 	const u32 *phandle;
@@ -664,7 +686,7 @@ int fdtdec_lookup_phandle(const void *blob, int node, const char *prop_name)
 	if (!phandle)
 		return -FDT_ERR_NOTFOUND;
 
-	lookup = fdt_node_offset_by_phandle(blob, fdt32_to_cpu(*phandle));
+	lookup = fdtdec_node_offset_by_phandle(blob, fdt32_to_cpu(*phandle));
 	return lookup;
 }
 
@@ -813,8 +835,8 @@ int fdtdec_parse_phandle_with_args(const void *blob, int src_node,
 			 * below.
 			 */
 			if (cells_name || cur_index == index) {
-				node = fdt_node_offset_by_phandle(blob,
-								  phandle);
+				node = fdtdec_node_offset_by_phandle(blob,
+								     phandle);
 				if (node < 0) {
 					debug("%s: could not find phandle\n",
 					      fdt_get_name(blob, src_node,
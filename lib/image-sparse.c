@@ -106,6 +106,54 @@ write_fail:
 	return -1;
 }
 
+static lbaint_t write_sparse_chunk_fill(struct sparse_storage *info,
+					lbaint_t blk, lbaint_t blkcnt,
+					uint32_t fill_val, char *response)
+{
+	int fill_buf_num_blks = CONFIG_IMAGE_SPARSE_FILLBUF_SIZE / info->blksz;
+	lbaint_t blks, start = blk;
+	uint32_t *fill_buf;
+	int i, j;
+
+	if (blk + blkcnt > info->start + info->size) {
+		printf("%s: Request would exceed partition size!\n", __func__);
+		info->mssg("Request would exceed partition size!", response);
+		return -1;
+	}
+
+	fill_buf = (uint32_t *)memalign(ARCH_DMA_MINALIGN,
+					ROUNDUP(info->blksz * fill_buf_num_blks,
+						ARCH_DMA_MINALIGN));
+	if (!fill_buf) {
+		info->mssg("Malloc failed for: CHUNK_TYPE_FILL", response);
+		return -1;
+	}
+
+	for (i = 0; i < (info->blksz * fill_buf_num_blks / sizeof(fill_val));
+	     i++)
+		fill_buf[i] = fill_val;
+
+	for (i = 0; i < blkcnt;) {
+		j = blkcnt - i;
+		if (j > fill_buf_num_blks)
+			j = fill_buf_num_blks;
+		blks = info->write(info, blk, j, fill_buf);
+		/* blks might be > j (eg. NAND bad-blocks) */
+		if (blks < j) {
+			printf("%s: %s " LBAFU " [%d]\n", __func__,
+			       "Write failed, block #", blk, j);
+			info->mssg("flash write failure", response);
+			free(fill_buf);
+			return -1;
+		}
+		blk += blks;
+		i += j;
+	}
+	free(fill_buf);
+
+	return blk - start;
+}
+
 int write_sparse_image(struct sparse_storage *info,
 		       const char *part_name, void *data, char *response)
 {
@@ -116,16 +164,10 @@ int write_sparse_image(struct sparse_storage *info,
 	unsigned int chunk;
 	unsigned int offset;
 	uint64_t chunk_data_sz;
-	uint32_t *fill_buf = NULL;
 	uint32_t fill_val;
 	sparse_header_t *sparse_header;
 	chunk_header_t *chunk_header;
 	uint32_t total_blocks = 0;
-	int fill_buf_num_blks;
-	int i;
-	int j;
-
-	fill_buf_num_blks = CONFIG_IMAGE_SPARSE_FILLBUF_SIZE / info->blksz;
 
 	/* Read and skip over sparse image header */
 	sparse_header = (sparse_header_t *)data;
@@ -227,58 +269,18 @@ int write_sparse_image(struct sparse_storage *info,
 				return -1;
 			}
 
-			fill_buf = (uint32_t *)
-				   memalign(ARCH_DMA_MINALIGN,
-					    ROUNDUP(
-						info->blksz * fill_buf_num_blks,
-						ARCH_DMA_MINALIGN));
-			if (!fill_buf) {
-				info->mssg("Malloc failed for: CHUNK_TYPE_FILL",
-					   response);
-				return -1;
-			}
-
 			fill_val = *(uint32_t *)data;
 			data = (char *)data + sizeof(uint32_t);
 
-			for (i = 0;
-			     i < (info->blksz * fill_buf_num_blks /
-				  sizeof(fill_val));
-			     i++)
-				fill_buf[i] = fill_val;
-
-			if (blk + blkcnt > info->start + info->size) {
-				printf(
-				    "%s: Request would exceed partition size!\n",
-				    __func__);
-				info->mssg("Request would exceed partition size!",
-					   response);
+			blks = write_sparse_chunk_fill(info, blk, blkcnt,
+						       fill_val, response);
+			if (IS_ERR_VALUE(blks))
 				return -1;
-			}
 
-			for (i = 0; i < blkcnt;) {
-				j = blkcnt - i;
-				if (j > fill_buf_num_blks)
-					j = fill_buf_num_blks;
-				blks = info->write(info, blk, j, fill_buf);
-				/* blks might be > j (eg. NAND bad-blocks) */
-				if (blks < j) {
-					printf("%s: %s " LBAFU " [%d]\n",
-					       __func__,
-					       "Write failed, block #",
-					       blk, j);
-					info->mssg("flash write failure",
-						   response);
-					free(fill_buf);
-					return -1;
-				}
-				blk += blks;
-				i += j;
-			}
+			blk += blks;
 			bytes_written += ((u64)blkcnt) * info->blksz;
 			total_blocks += DIV_ROUND_UP_ULL(chunk_data_sz,
 							 sparse_header->blk_sz);
-			free(fill_buf);
 			break;
 
 		case CHUNK_TYPE_DONT_CARE:
@@ -316,3 +318,293 @@ int write_sparse_image(struct sparse_storage *info,
 
 	return 0;
 }
+
+static int sparse_stream_next_chunk(struct sparse_stream *ss)
+{
+	if (ss->chunks == ss->file.total_chunks) {
+		ss->state = SPARSE_STREAM_DONE;
+	} else {
+		ss->state = SPARSE_STREAM_CHUNK_HDR;
+		ss->want = sizeof(chunk_header_t);
+	}
+
+	return 0;
+}
+
+/* Write the bounce buffer, padding the last block with zeroes */
+static int sparse_stream_flush(struct sparse_stream *ss, char *response)
+{
+	struct sparse_storage *info = ss->info;
+	lbaint_t blkcnt = DIV_ROUND_UP(ss->fill, info->blksz);
+	lbaint_t blks;
+
+	if (!blkcnt)
+		return 0;
+	if (ss->blk + blkcnt > info->start + info->size) {
+		printf("%s: Request would exceed partition size!\n", __func__);
+		info->mssg("Request would exceed partition size!", response);
+		return -EFBIG;
+	}
+
+	memset(ss->buf + ss->fill, '\0', blkcnt * info->blksz - ss->fill);
+	blks = info->write(info, ss->blk, blkcnt, ss->buf);
+	/* blks might be > blkcnt (eg. NAND bad-blocks) */
+	if (IS_ERR_VALUE(blks) || blks < blkcnt) {
+		printf("%s: Write failed, block #" LBAFU " [" LBAFU "]\n",
+		       __func__, ss->blk, blkcnt);
+		info->mssg("flash write failure", response);
+		return -EIO;
+	}
+	ss->blk += blks;
+	ss->bytes_written += (u64)blkcnt * info->blksz;
+	ss->fill = 0;
+
+	return 0;
+}
+
+/* Handle a header, or the value of a fill chunk, once it has been collected */
+static int sparse_stream_header(struct sparse_stream *ss, char *response)
+{
+	struct sparse_storage *info = ss->info;
+	chunk_header_t *chunk = &ss->chunk;
+	uint64_t chunk_data_sz;
+	lbaint_t blkcnt, blks;
+	uint32_t offset;
+
+	switch (ss->state) {
+	case SPARSE_STREAM_FILE_HDR:
+		if (!is_sparse_image(&ss->hdr.file)) {
+			/* write it as it is */
+			puts("Flashing Raw Image\n");
+			memcpy(ss->buf, ss->hdr.bytes, ss->want);
+			ss->fill = ss->want;
+			ss->state = SPARSE_STREAM_RAW;
+			return 0;
+		}
+		ss->file = ss->hdr.file;
+		div_u64_rem(ss->file.blk_sz, info->blksz, &offset);
+		if (offset || ss->file.file_hdr_sz < sizeof(sparse_header_t) ||
+		    ss->file.chunk_hdr_sz < sizeof(chunk_header_t)) {
+			printf("%s: Sparse image block size issue [%u]\n",
+			       __func__, ss->file.blk_sz);
+			info->mssg("sparse image block size issue", response);
+			return -EINVAL;
+		}
+		ss->skip = ss->file.file_hdr_sz - sizeof(sparse_header_t);
+		puts("Flashing Sparse Image\n");
+
+		return sparse_stream_next_chunk(ss);
+
+	case SPARSE_STREAM_CHUNK_HDR:
+		*chunk = ss->hdr.chunk;
+		ss->chunks++;
+		ss->skip = ss->file.chunk_hdr_sz - sizeof(chunk_header_t);
+		chunk_data_sz = (u64)ss->file.blk_sz * chunk->chunk_sz;
+		blkcnt = DIV_ROUND_UP_ULL(chunk_data_sz, info->blksz);
+
+		switch (chunk->chunk_type) {
+		case CHUNK_TYPE_RAW:
+			if (chunk->total_sz !=
+			    ss->file.chunk_hdr_sz + chunk_data_sz) {
+				info->mssg("Bogus chunk size for chunk type Raw",
+					   response);
+				return -EINVAL;
+			}
+			if (ss->blk + blkcnt > info->start + info->size) {
+				printf("%s: Request would exceed partition size!\n",
+				       __func__);
+				info->mssg("Request would exceed partition size!",
+					   response);
+				return -EFBIG;
+			}
+			ss->left = chunk_data_sz;
+			ss->state = SPARSE_STREAM_DATA;
+			if (!ss->left)
+				return sparse_stream_next_chunk(ss);
+			return 0;
+
+		case CHUNK_TYPE_FILL:
+			if (chunk->total_sz !=
+			    ss->file.chunk_hdr_sz + sizeof(uint32_t)) {
+				info->mssg("Bogus chunk size for chunk type FILL",
+					   response);
+				return -EINVAL;
+			}
+			ss->state = SPARSE_STREAM_FILL;
+			ss->want = sizeof(uint32_t);
+			return 0;
+
+		case CHUNK_TYPE_DONT_CARE:
+			ss->blk += info->reserve(info, ss->blk, blkcnt);
+			ss->total_blocks += chunk->chunk_sz;
+			return sparse_stream_next_chunk(ss);
+
+		case CHUNK_TYPE_CRC32:
+			if (chunk->total_sz !=
+			    ss->file.chunk_hdr_sz + sizeof(uint32_t)) {
+				info->mssg("Bogus chunk size for chunk type CRC32",
+					   response);
+				return -EINVAL;
+			}
+			ss->skip += sizeof(uint32_t);
+			ss->total_blocks += chunk->chunk_sz;
+			return sparse_stream_next_chunk(ss);
+
+		default:
+			printf("%s: Unknown chunk type: %x\n", __func__,
+			       chunk->chunk_type);
+			info->mssg("Unknown chunk type", response);
+			return -EINVAL;
+		}
+
+	case SPARSE_STREAM_FILL:
+		chunk_data_sz = (u64)ss->file.blk_sz * chunk->chunk_sz;
+		blkcnt = DIV_ROUND_UP_ULL(chunk_data_sz, info->blksz);
+		blks = write_sparse_chunk_fill(info, ss->blk, blkcnt,
+					       ss->hdr.fill, response);
+		if (IS_ERR_VALUE(blks))
+			return -EIO;
+		ss->blk += blks;
+		ss->bytes_written += (u64)blkcnt * info->blksz;
+		ss->total_blocks += DIV_ROUND_UP_ULL(chunk_data_sz,
+						     ss->file.blk_sz);
+		return sparse_stream_next_chunk(ss);
+
+	default:
+		return -EINVAL;
+	}
+}
+
+int sparse_stream_start(struct sparse_stream *ss, struct sparse_storage *info,
+			const char *part_name)
+{
+	memset(ss, '\0', sizeof(*ss));
+	if (!info->mssg)
+		info->mssg = default_log;
+	ss->info = info;
+	ss->part_name = part_name;
+	ss->buf_size = max_t(ulong, rounddown(CONFIG_IMAGE_SPARSE_FILLBUF_SIZE,
+					      info->blksz), info->blksz);
+	ss->buf = memalign(ARCH_DMA_MINALIGN,
+			   ROUNDUP(ss->buf_size, ARCH_DMA_MINALIGN));
+	if (!ss->buf)
+		return -ENOMEM;
+	ss->blk = info->start;
+	ss->state = SPARSE_STREAM_FILE_HDR;
+	ss->want = sizeof(sparse_header_t);
+
+	return 0;
+}
+
+int sparse_stream_write(struct sparse_stream *ss, const void *data,
+			size_t len, char *response)
+{
+	size_t n;
+	int ret;
+
+	while (len) {
+		if (ss->skip) {
+			n = min_t(u64, len, ss->skip);
+			ss->skip -= n;
+			data += n;
+			len -= n;
+			continue;
+		}
+
+		switch (ss->state) {
+		case SPARSE_STREAM_FILE_HDR:
+		case SPARSE_STREAM_CHUNK_HDR:
+		case SPARSE_STREAM_FILL:
+			n = min_t(size_t, len, ss->want - ss->have);
+			memcpy(ss->hdr.bytes + ss->have, data, n);
+			ss->have += n;
+			data += n;
+			len -= n;
+			if (ss->have < ss->want)
+				break;
+			ss->have = 0;
+			ret = sparse_stream_header(ss, response);
+			if (ret)
+				return ret;
+			break;
+
+		case SPARSE_STREAM_DATA:
+		case SPARSE_STREAM_RAW:
+			n = min_t(size_t, len, ss->buf_size - ss->fill);
+			if (ss->state == SPARSE_STREAM_DATA)
+				n = min_t(u64, n, ss->left);
+			memcpy(ss->buf + ss->fill, data, n);
+			ss->fill += n;
+			data += n;
+			len -= n;
+			if (ss->state == SPARSE_STREAM_RAW) {
+				if (ss->fill == ss->buf_size) {
+					ret = sparse_stream_flush(ss, response);
+					if (ret)
+						return ret;
+				}
+				break;
+			}
+
+			/* the data of a chunk is a whole number of blocks */
+			ss->left -= n;
+			if (ss->fill == ss->buf_size || !ss->left) {
+				ret = sparse_stream_flush(ss, response);
+				if (ret)
+					return ret;
+			}
+			if (!ss->left) {
+				ss->total_blocks += ss->chunk.chunk_sz;
+				sparse_stream_next_chunk(ss);
+			}
+			break;
+
+		default:
+			/* ignore anything after the last chunk */
+			return 0;
+		}
+	}
+
+	return 0;
+}
+
+int sparse_stream_finish(struct sparse_stream *ss, char *response)
+{
+	int ret = 0;
+
+	switch (ss->state) {
+	case SPARSE_STREAM_FILE_HDR:
+		/* an image too short to be sparse */
+		puts("Flashing Raw Image\n");
+		memcpy(ss->buf, ss->hdr.bytes, ss->have);
+		ss->fill = ss->have;
+		fallthrough;
+	case SPARSE_STREAM_RAW:
+		ret = sparse_stream_flush(ss, response);
+		break;
+	case SPARSE_STREAM_DONE:
+		debug("Wrote %d blocks, expected to write %d blocks\n",
+		      ss->total_blocks, ss->file.total_blks);
+		if (ss->total_blocks != ss->file.total_blks) {
+			ss->info->mssg("sparse image write failure", response);
+			ret = -EIO;
+		}
+		break;
+	default:
+		ss->info->mssg("sparse image is incomplete", response);
+		ret = -EIO;
+		break;
+	}
+	sparse_stream_abort(ss);
+	if (!ret)
+		printf("........ wrote %llu bytes to '%s'\n", ss->bytes_written,
+		       ss->part_name);
+
+	return ret;
+}
+
+void sparse_stream_abort(struct sparse_stream *ss)
+{
+	free(ss->buf);
+	ss->buf = NULL;
+}
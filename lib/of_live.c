@@ -17,6 +17,7 @@
 #include <of_live.h>
 #include <malloc.h>
 #include <dm/of_access.h>
+#include <dm/of_index.h>
 #include <linux/err.h>
 #include <linux/sizes.h>
 
@@ -335,6 +336,9 @@ int of_live_build(const void *fdt_blob, struct device_node **rootp)
 		debug("Failed to scan live tree aliases: err=%d\n", ret);
 		return ret;
 	}
+	/* not fatal, since lookups can still walk the tree */
+	if (CONFIG_IS_ENABLED(OF_INDEX) && of_index_build(*rootp, true))
+		log_debug("Cannot index live tree\n");
 	debug("%s: stop\n", __func__);
 
 	if (CONFIG_IS_ENABLED(EVENT)) {
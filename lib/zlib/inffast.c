@@ -12,6 +12,35 @@
 
 #ifndef ASMINF
 
+#if CONFIG_IS_ENABLED(ZLIB_CHUNK_COPY)
+/*
+ * U-Boot: copy matches that are at least INFLATE_CHUNK bytes back in chunks
+ * of that size. This writes up to INFLATE_CHUNK - 1 bytes past the end of the
+ * match, so the caller must check that there is room in the output buffer.
+ */
+#ifdef CONFIG_ARM64
+#define INFLATE_CHUNK	16
+
+/* Advanced SIMD version, in arch/arm/lib/inflate-copy-arm64.S */
+void inflate_chunk_copy(unsigned char *out, const unsigned char *from,
+			unsigned len);
+#else
+#define INFLATE_CHUNK	8
+
+static inline void inflate_chunk_copy(unsigned char *out,
+				      const unsigned char *from, unsigned len)
+{
+	unsigned char *last = out + len;
+
+	do {
+		put_unaligned(get_unaligned((u64 *)from), (u64 *)out);
+		out += INFLATE_CHUNK;
+		from += INFLATE_CHUNK;
+	} while (out < last);
+}
+#endif
+#endif
+
 /*
    Decode literal, length, and distance codes and write out the resulting
    literal and match bytes until either not enough input or output is
@@ -240,6 +269,14 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
 		    unsigned long loops;
 
                     from = out - dist;          /* copy direct from output */
+#ifdef INFLATE_CHUNK
+		    if (dist >= INFLATE_CHUNK &&
+			len + INFLATE_CHUNK - 1 <= (unsigned)(end - out) + 257) {
+			inflate_chunk_copy(out, from, len);
+			out += len;
+			continue;
+		    }
+#endif
                     /* minimum length is three */
 		    /* Align out addr */
 		    if (!((long)(out - 1) & 1)) {
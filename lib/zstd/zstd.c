@@ -6,18 +6,237 @@
 #define LOG_CATEGORY	LOGC_BOOT
 
 #include <abuf.h>
+#include <cpu.h>
 #include <log.h>
 #include <malloc.h>
 #include <linux/errno.h>
 #include <linux/zstd.h>
 
+/**
+ * struct zstd_frame - a data frame of a multi-frame zstd stream
+ *
+ * @src: Compressed frame
+ * @src_len: Size of the compressed frame in bytes
+ * @dst: Where the frame is decompressed to
+ * @dst_len: Decompressed size of the frame, from its header
+ */
+struct zstd_frame {
+	const void *src;
+	size_t src_len;
+	void *dst;
+	size_t dst_len;
+};
+
+/**
+ * struct zstd_worker - decompresses every @step'th frame, from @first
+ *
+ * @frames: All data frames
+ * @count: Number of data frames
+ * @first: First frame to decompress
+ * @step: Number of workers
+ * @workspace: Decompression context workspace, owned by this worker
+ * @wsize: Size of @workspace in bytes
+ * @err: zstd error code of the first frame which failed, if any
+ */
+struct zstd_worker {
+	struct zstd_frame *frames;
+	int count;
+	int first;
+	int step;
+	void *workspace;
+	size_t wsize;
+	int err;
+};
+
+/*
+ * Walk the frames at the start of @src, stopping at the end or at the first
+ * thing which is not a frame. Returns the number of data frames found, or -ve
+ * if there are none. @lenp is set to the number of bytes used by the frames
+ * and @sizep to their total decompressed size, or to
+ * ZSTD_CONTENTSIZE_UNKNOWN if any of the frames does not record it. If @frames
+ * is not NULL, the data frames are recorded there, placed one after the other
+ * from @dst.
+ */
+static int zstd_scan_frames(const void *src, size_t size,
+			    struct zstd_frame *frames, void *dst,
+			    size_t *lenp, u64 *sizep)
+{
+	zstd_frame_header hdr;
+	size_t len, used = 0;
+	u64 total = 0;
+	int count = 0;
+
+	while (used < size) {
+		len = zstd_find_frame_compressed_size(src + used, size - used);
+		if (zstd_is_error(len)) {
+			if (!used) {
+				log_err("%s: failed to detect compressed size: %d\n",
+					__func__, zstd_get_error_code(len));
+				return -EINVAL;
+			}
+			/* junk at the end, which zstd_decompress_dctx() can't handle */
+			break;
+		}
+		if (zstd_get_frame_header(&hdr, src + used, size - used))
+			break;
+		if (hdr.frameType != ZSTD_skippableFrame) {
+			if (hdr.frameContentSize == ZSTD_CONTENTSIZE_UNKNOWN ||
+			    total == ZSTD_CONTENTSIZE_UNKNOWN)
+				total = ZSTD_CONTENTSIZE_UNKNOWN;
+			else
+				total += hdr.frameContentSize;
+			if (frames) {
+				frames[count].src = src + used;
+				frames[count].src_len = len;
+				frames[count].dst = dst;
+				frames[count].dst_len = hdr.frameContentSize;
+				dst += hdr.frameContentSize;
+			}
+			count++;
+		}
+		used += len;
+	}
+	if (!count)
+		return -EINVAL;
+	*lenp = used;
+	*sizep = total;
+
+	return count;
+}
+
+/* Runs on any core: no malloc(), no console */
+static int zstd_decompress_frames(void *arg)
+{
+	struct zstd_worker *wrk = arg;
+	struct zstd_frame *frame;
+	zstd_dctx *ctx;
+	size_t len;
+	int i;
+
+	ctx = zstd_init_dctx(wrk->workspace, wrk->wsize);
+	if (!ctx)
+		return -EPERM;
+
+	for (i = wrk->first; i < wrk->count; i += wrk->step) {
+		frame = &wrk->frames[i];
+		len = zstd_decompress_dctx(ctx, frame->dst, frame->dst_len,
+					   frame->src, frame->src_len);
+		if (zstd_is_error(len)) {
+			wrk->err = zstd_get_error_code(len);
+			return -EINVAL;
+		}
+		if (len != frame->dst_len)
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+ * Decompress the @count data frames in @in on up to one core per frame, each
+ * core with its own context. Returns the decompressed size, -EAGAIN if there
+ * is only one core to use, or other -ve on error. If a core times out, it may
+ * still be writing to @out and using the frames and its workspace, so as with
+ * cpu_run_jobs() these are not freed and -ETIMEDOUT is returned
+ */
+static int zstd_decompress_parallel(struct abuf *in, struct abuf *out,
+				    int count)
+{
+	struct zstd_worker *workers;
+	struct zstd_frame *frames;
+	struct cpu_job *jobs;
+	size_t wsize, len;
+	int nworkers, i;
+	u64 size;
+	int ret;
+
+	nworkers = min(count, cpu_job_cores());
+	if (nworkers < 2)
+		return -EAGAIN;
+
+	wsize = zstd_dctx_workspace_bound();
+	frames = calloc(count, sizeof(*frames));
+	workers = calloc(nworkers, sizeof(*workers));
+	jobs = calloc(nworkers, sizeof(*jobs));
+	if (!frames || !workers || !jobs) {
+		ret = -ENOMEM;
+		goto do_free;
+	}
+	for (i = 0; i < nworkers; i++) {
+		workers[i].workspace = malloc(wsize);
+		if (!workers[i].workspace) {
+			ret = -ENOMEM;
+			goto do_free;
+		}
+		workers[i].wsize = wsize;
+		workers[i].frames = frames;
+		workers[i].count = count;
+		workers[i].first = i;
+		workers[i].step = nworkers;
+		jobs[i].func = zstd_decompress_frames;
+		jobs[i].arg = &workers[i];
+	}
+	zstd_scan_frames(abuf_data(in), abuf_size(in), frames,
+			 abuf_data(out), &len, &size);
+
+	cpu_run_jobs(jobs, nworkers);
+	for (i = 0; i < nworkers; i++) {
+		if (!jobs[i].done) {
+			/* a core may still be using these, so leave them be */
+			log_err("%s: timed out, not freeing buffers\n",
+				__func__);
+			return -ETIMEDOUT;
+		}
+	}
+	ret = size;
+	for (i = 0; i < nworkers; i++) {
+		if (jobs[i].ret) {
+			log_err("%s: failed to decompress: %d\n", __func__,
+				workers[i].err);
+			ret = -EINVAL;
+			break;
+		}
+	}
+
+do_free:
+	for (i = 0; workers && i < nworkers; i++)
+		free(workers[i].workspace);
+	free(jobs);
+	free(workers);
+	free(frames);
+
+	return ret;
+}
+
 int zstd_decompress(struct abuf *in, struct abuf *out)
 {
 	zstd_dctx *ctx;
 	size_t wsize, len;
 	void *workspace;
+	u64 size;
 	int ret;
 
+	/*
+	 * Find out how large the frames actually are, there may be junk at
+	 * the end that zstd_decompress_dctx() can't handle.
+	 */
+	ret = zstd_scan_frames(abuf_data(in), abuf_size(in), NULL, NULL, &len,
+			       &size);
+	if (ret < 0)
+		return ret;
+
+	/*
+	 * Frames of known size can be decompressed independently. The size is
+	 * returned as an int, which it must fit
+	 */
+	if (CONFIG_IS_ENABLED(ZSTD_PARALLEL) && ret > 1 &&
+	    size != ZSTD_CONTENTSIZE_UNKNOWN && size <= abuf_size(out) &&
+	    size <= INT_MAX) {
+		ret = zstd_decompress_parallel(in, out, ret);
+		if (ret != -EAGAIN)
+			return ret;
+	}
+
 	wsize = zstd_dctx_workspace_bound();
 	workspace = malloc(wsize);
 	if (!workspace) {
@@ -33,18 +252,6 @@ int zstd_decompress(struct abuf *in, struct abuf *out)
 		goto do_free;
 	}
 
-	/*
-	 * Find out how large the frame actually is, there may be junk at
-	 * the end of the frame that zstd_decompress_dctx() can't handle.
-	 */
-	len = zstd_find_frame_compressed_size(abuf_data(in), abuf_size(in));
-	if (zstd_is_error(len)) {
-		log_err("%s: failed to detect compressed size: %d\n", __func__,
-			zstd_get_error_code(len));
-		ret = -EINVAL;
-		goto do_free;
-	}
-
 	len = zstd_decompress_dctx(ctx, abuf_data(out), abuf_size(out),
 				   abuf_data(in), len);
 	if (zstd_is_error(len)) {
@@ -3,6 +3,7 @@
  * Copyright (C) 2023 The Android Open Source Project
  */
 
+#include <errno.h>
 #include <fastboot.h>
 #include <net.h>
 #include <net/fastboot_tcp.h>
@@ -13,71 +14,166 @@
 static const unsigned short handshake_length = 4;
 static const uchar *handshake = "FB01";
 
-static char rxbuf[sizeof(u64) + FASTBOOT_COMMAND_LEN + 1];
+static char rxbuf[FASTBOOT_COMMAND_LEN + 1];
 static char txbuf[sizeof(u64) + FASTBOOT_RESPONSE_LEN + 1];
 
+/**
+ * enum fastboot_tcp_state - what the next bytes from the client are
+ *
+ * @FASTBOOT_TCP_HANDSHAKE: protocol version, "FB01"
+ * @FASTBOOT_TCP_HEADER: big-endian length of the next message
+ * @FASTBOOT_TCP_COMMAND: command
+ * @FASTBOOT_TCP_DATA: data of a download, passed on as it arrives
+ */
+enum fastboot_tcp_state {
+	FASTBOOT_TCP_HANDSHAKE,
+	FASTBOOT_TCP_HEADER,
+	FASTBOOT_TCP_COMMAND,
+	FASTBOOT_TCP_DATA,
+};
+
+static enum fastboot_tcp_state rx_state;
+/* bytes wanted in rxbuf for the current state, and bytes already there */
+static u32 rx_want, rx_have;
+/* bytes left of the download data in the current message */
+static u64 msg_left;
+/* bytes of the stream handled so far */
 static u32 data_read;
 static u32 tx_last_offs, tx_last_len;
+/* only one client is served at a time */
+static bool connected;
 
-static void tcp_stream_on_rcv_nxt_update(struct tcp_stream *tcp, u32 rx_bytes)
+static void fastboot_tcp_respond(void)
 {
-	u64	cmd_size;
 	__be64	len_be;
-	char	saved;
-	int	fastboot_command_id, len;
+	int	len;
+
+	len = strlen(txbuf + sizeof(u64));
+	len_be = __cpu_to_be64(len);
+	memcpy(txbuf, &len_be, sizeof(u64));
+
+	tx_last_offs += tx_last_len;
+	tx_last_len = len + sizeof(u64);
+}
+
+static void fastboot_tcp_set_state(enum fastboot_tcp_state state, u32 want)
+{
+	rx_state = state;
+	rx_want = want;
+	rx_have = 0;
+}
+
+/*
+ * Handle a complete handshake, header or command in rxbuf
+ *
+ * Return: 0 if OK, -ve if the client does not follow the protocol
+ */
+static int fastboot_tcp_handle(void)
+{
+	int	fastboot_command_id;
+	u64	size;
 
-	if (!data_read && rx_bytes >= handshake_length) {
+	switch (rx_state) {
+	case FASTBOOT_TCP_HANDSHAKE:
 		if (memcmp(rxbuf, handshake, handshake_length)) {
 			printf("fastboot: bad handshake\n");
-			tcp_stream_close(tcp);
-			return;
+			return -EPROTO;
 		}
-
 		tx_last_offs = 0;
 		tx_last_len = handshake_length;
 		memcpy(txbuf, handshake, handshake_length);
-
-		data_read += handshake_length;
-		rx_bytes -= handshake_length;
-		if (rx_bytes > 0)
-			memmove(rxbuf, rxbuf + handshake_length, rx_bytes);
-		return;
+		fastboot_tcp_set_state(FASTBOOT_TCP_HEADER, sizeof(u64));
+		break;
+	case FASTBOOT_TCP_HEADER:
+		memcpy(&size, rxbuf, sizeof(u64));
+		size = __be64_to_cpu(size);
+		if (fastboot_data_remaining()) {
+			if (size > fastboot_data_remaining()) {
+				printf("fastboot: too much data\n");
+				return -EPROTO;
+			}
+			msg_left = size;
+			fastboot_tcp_set_state(FASTBOOT_TCP_DATA, 0);
+			break;
+		}
+		if (size > FASTBOOT_COMMAND_LEN) {
+			printf("fastboot: command too long\n");
+			return -EPROTO;
+		}
+		fastboot_tcp_set_state(FASTBOOT_TCP_COMMAND, size);
+		break;
+	case FASTBOOT_TCP_COMMAND:
+		rxbuf[rx_have] = '\0';
+		fastboot_command_id = fastboot_handle_command(rxbuf,
+							      txbuf + sizeof(u64));
+		fastboot_handle_boot(fastboot_command_id,
+				     strncmp("OKAY", txbuf + sizeof(u64), 4) != 0);
+		fastboot_tcp_respond();
+		fastboot_tcp_set_state(FASTBOOT_TCP_HEADER, sizeof(u64));
+		break;
+	default:
+		break;
 	}
 
-	if (rx_bytes < sizeof(u64))
-		return;
-
-	memcpy(&cmd_size, rxbuf, sizeof(u64));
-	cmd_size = __be64_to_cpu(cmd_size);
-	if (rx_bytes < sizeof(u64) + cmd_size)
-		return;
-
-	saved = rxbuf[sizeof(u64) + cmd_size];
-	rxbuf[sizeof(u64) + cmd_size] = '\0';
-	fastboot_command_id = fastboot_handle_command(rxbuf + sizeof(u64),
-						      txbuf + sizeof(u64));
-	fastboot_handle_boot(fastboot_command_id,
-			     strncmp("OKAY", txbuf + sizeof(u64), 4) != 0);
-	rxbuf[sizeof(u64) + cmd_size] = saved;
-
-	len = strlen(txbuf + sizeof(u64));
-	len_be = __cpu_to_be64(len);
-	memcpy(txbuf, &len_be, sizeof(u64));
+	return 0;
+}
 
-	tx_last_offs += tx_last_len;
-	tx_last_len = len + sizeof(u64);
+/*
+ * Handle the next bytes of the stream. Download data is passed on without
+ * being copied, everything else is collected in rxbuf.
+ */
+static int fastboot_tcp_recv(const uchar *buf, u32 len)
+{
+	u32	n;
+	int	ret;
+
+	while (len || (rx_state != FASTBOOT_TCP_DATA && rx_have == rx_want)) {
+		if (rx_state == FASTBOOT_TCP_DATA) {
+			n = min_t(u64, len, msg_left);
+			if (n)
+				fastboot_data_download(buf, n,
+						       txbuf + sizeof(u64));
+			msg_left -= n;
+			if (!fastboot_data_remaining()) {
+				fastboot_data_complete(txbuf + sizeof(u64));
+				fastboot_tcp_respond();
+			}
+			if (!msg_left)
+				fastboot_tcp_set_state(FASTBOOT_TCP_HEADER,
+						       sizeof(u64));
+		} else {
+			n = min(len, rx_want - rx_have);
+			memcpy(rxbuf + rx_have, buf, n);
+			rx_have += n;
+			if (rx_have == rx_want) {
+				ret = fastboot_tcp_handle();
+				if (ret)
+					return ret;
+			}
+		}
+		buf += n;
+		len -= n;
+		data_read += n;
+	}
 
-	data_read += sizeof(u64) + cmd_size;
-	rx_bytes -= sizeof(u64) + cmd_size;
-	if (rx_bytes > 0)
-		memmove(rxbuf, rxbuf + sizeof(u64) + cmd_size, rx_bytes);
+	return 0;
 }
 
 static int tcp_stream_rx(struct tcp_stream *tcp, u32 rx_offs, void *buf, int len)
 {
-	memcpy(rxbuf + rx_offs - data_read, buf, len);
+	u32 skip;
+	int ret;
+
+	/* the stream is handled in order, data after a gap is sent again */
+	if (rx_offs > data_read)
+		return 0;
+	skip = data_read - rx_offs;
+	if (skip >= len)
+		return len;
+
+	ret = fastboot_tcp_recv(buf + skip, len - skip);
 
-	return len;
+	return ret ? ret : len;
 }
 
 static int tcp_stream_tx(struct tcp_stream *tcp, u32 tx_offs, void *buf, int maxlen)
@@ -92,16 +188,23 @@ static int tcp_stream_tx(struct tcp_stream *tcp, u32 tx_offs, void *buf, int max
 	return maxlen;
 }
 
+static void tcp_stream_on_closed(struct tcp_stream *tcp)
+{
+	connected = false;
+}
+
 static int tcp_stream_on_create(struct tcp_stream *tcp)
 {
-	if (tcp->lport != FASTBOOT_TCP_PORT)
+	if (tcp->lport != FASTBOOT_TCP_PORT || connected)
 		return 0;
 
+	connected = true;
+	fastboot_tcp_set_state(FASTBOOT_TCP_HANDSHAKE, handshake_length);
 	data_read = 0;
 	tx_last_offs = 0;
 	tx_last_len = 0;
 
-	tcp->on_rcv_nxt_update = tcp_stream_on_rcv_nxt_update;
+	tcp->on_closed = tcp_stream_on_closed;
 	tcp->rx = tcp_stream_rx;
 	tcp->tx = tcp_stream_tx;
 
@@ -111,6 +214,7 @@ static int tcp_stream_on_create(struct tcp_stream *tcp)
 void fastboot_tcp_start_server(void)
 {
 	memset(net_server_ethaddr, 0, 6);
+	connected = false;
 	tcp_stream_set_on_create_handler(tcp_stream_on_create);
 
 	printf("Using %s device\n", eth_get_name());
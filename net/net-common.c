@@ -17,6 +17,8 @@ u32 net_boot_file_size;
 /* Boot file size in blocks as reported by the DHCP server */
 u32 net_boot_file_expected_size_in_blocks;
 uchar *net_rx_packets[PKTBUFSRX];
+/* Receive statistics for the last network operation */
+struct net_rx_stats net_rx_stats;
 
 void copy_filename(char *dst, const char *src, int size)
 {
@@ -99,6 +99,7 @@
 #if defined(CONFIG_CMD_PCAP)
 #include <net/pcap.h>
 #endif
+#include <net/sink.h>
 #include <net/tcp.h>
 #include <net/tftp.h>
 #include <net/udp.h>
@@ -418,6 +419,7 @@ int net_loop(enum proto_t protocol)
 {
 	int ret = -EINVAL;
 	enum net_loop_state prev_net_state = net_state;
+	bool sink;
 
 #if defined(CONFIG_CMD_PING)
 	if (protocol != PING)
@@ -440,6 +442,7 @@ int net_loop(enum proto_t protocol)
 
 	bootstage_mark_name(BOOTSTAGE_ID_ETH_START, "eth_start");
 	net_init();
+	memset(&net_rx_stats, '\0', sizeof(net_rx_stats));
 	if (eth_is_on_demand_init()) {
 		eth_halt();
 		eth_set_current();
@@ -483,6 +486,13 @@ restart:
 	case 0:
 		net_dev_exists = 1;
 		net_boot_file_size = 0;
+		if ((protocol == TFTPGET || protocol == WGET) &&
+		    net_sink_start()) {
+			puts("Cannot write to the block device\n");
+			eth_halt();
+			net_set_state(prev_net_state);
+			return -ENOMEM;
+		}
 		switch (protocol) {
 #ifdef CONFIG_CMD_TFTPBOOT
 		case TFTPGET:
@@ -679,11 +689,20 @@ restart:
 
 		case NETLOOP_SUCCESS:
 			net_cleanup_loop();
+			sink = net_sink_active();
+			if (sink && net_sink_finish(true)) {
+				eth_halt();
+				eth_set_last_protocol(BOOTP);
+				ret = -EIO;
+				goto done;
+			}
 			if (net_boot_file_size > 0) {
 				printf("Bytes transferred = %u (%x hex)\n",
 				       net_boot_file_size, net_boot_file_size);
 				env_set_hex("filesize", net_boot_file_size);
-				env_set_hex("fileaddr", image_load_addr);
+				/* nothing was loaded into memory */
+				if (!sink)
+					env_set_hex("fileaddr", image_load_addr);
 			}
 			if (protocol != NETCONS && protocol != NCSI)
 				eth_halt();
@@ -710,6 +729,8 @@ restart:
 	}
 
 done:
+	/* if the download failed, the device is left partly written */
+	net_sink_finish(false);
 #ifdef CONFIG_USB_KEYBOARD
 	net_busy_flag = 0;
 #endif
@@ -1102,6 +1123,7 @@ static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 
 	/* finally copy this fragment and possibly return whole packet */
 	memcpy((uchar *)thisfrag, indata + IP_HDR_SIZE, len);
+	net_rx_copied(len);
 	if (!done)
 		return NULL;
 
@@ -1195,6 +1217,8 @@ void net_process_received_packet(uchar *in_packet, int len)
 #endif
 	net_rx_packet = in_packet;
 	net_rx_packet_len = len;
+	net_rx_stats.packets++;
+	net_rx_stats.bytes += len;
 	et = (struct ethernet_hdr *)in_packet;
 
 	/* too small packet? */
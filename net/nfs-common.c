@@ -39,6 +39,7 @@
 #ifdef CONFIG_SYS_DIRECT_FLASH_NFS
 #include <flash.h>
 #endif
+#include <env.h>
 #include <image.h>
 #include <log.h>
 #include <net.h>
@@ -52,6 +53,24 @@ static unsigned int dirfh3_length; /* (variable) length of dirfh when NFSv3 */
 static char filefh[NFS3_FHSIZE]; /* NFSv2 / NFSv3 file handle */
 static unsigned int filefh3_length;	/* (variable) length of filefh when NFSv3 */
 
+/*
+ * READ requests which are in flight. Each reply is stored straight into the
+ * load buffer at the offset of its request, so replies may arrive in any
+ * order.
+ */
+struct nfs_read_slot {
+	unsigned long id;	/* RPC id of the request, 0 if the slot is free */
+	unsigned int offset;
+	unsigned int len;
+};
+
+static struct nfs_read_slot nfs_read_slots[NFS_READ_WINDOW_MAX];
+static int nfs_read_window;	/* number of slots in use */
+static unsigned int nfs_read_size;	/* size of each READ request */
+static unsigned int nfs_read_next;	/* offset of the next READ request */
+static bool nfs_read_eof;		/* true once the end of file is seen */
+static unsigned int nfs_read_total;	/* bytes received so far */
+
 enum net_loop_state nfs_download_state;
 char *nfs_filename;
 char *nfs_path;
@@ -63,8 +82,6 @@ int nfs_our_port;
 int nfs_state;
 int nfs_timeout_count;
 unsigned long rpc_id;
-int nfs_offset = -1;
-int nfs_len;
 
 const ulong nfs_timeout = CONFIG_NFS_TIMEOUT;
 
@@ -98,6 +115,7 @@ static inline int store_block(uchar *src, unsigned int offset, unsigned int len)
 
 		memcpy(ptr, src, len);
 		unmap_sysmem(ptr);
+		net_rx_copied(len);
 	}
 
 	if (net_boot_file_size < (offset + len))
@@ -409,12 +427,82 @@ static void nfs_read_req(int offset, int readlen)
 	rpc_req(PROG_NFS, NFS_READ, data, len);
 }
 
+/**************************************************************************
+ * NFS_FSINFO - Get the server's limits (NFSv3 only)
+ **************************************************************************
+ */
+static void nfs_fsinfo_req(void)
+{
+	u32 data[1024];
+	u32 *p;
+	int len;
+
+	p = &data[0];
+	p = rpc_add_credentials(p);
+
+	*p++ = htonl(filefh3_length);
+	memcpy(p, filefh, filefh3_length);
+	p += (filefh3_length / 4);
+
+	len = (uint32_t *)p - (uint32_t *)&data[0];
+
+	rpc_req(PROG_NFS, NFS3PROC_FSINFO, data, len);
+}
+
+static void nfs_read_send(struct nfs_read_slot *slot)
+{
+	nfs_read_req(slot->offset, slot->len);
+	slot->id = rpc_id;
+}
+
+/* Request the next part of the file using @slot, or free it at the end */
+static void nfs_read_fill(struct nfs_read_slot *slot)
+{
+	slot->id = 0;
+	if (nfs_read_eof)
+		return;
+
+	slot->offset = nfs_read_next;
+	slot->len = nfs_read_size;
+	nfs_read_next += nfs_read_size;
+	nfs_read_send(slot);
+}
+
+static bool nfs_read_busy(void)
+{
+	int i;
+
+	for (i = 0; i < nfs_read_window; i++) {
+		if (nfs_read_slots[i].id)
+			return true;
+	}
+
+	return false;
+}
+
+/* Send the first window of READ requests */
+static void nfs_read_start(void)
+{
+	int i;
+
+	nfs_read_window = env_get_ulong("nfswindowsize", 10, NFS_READ_WINDOW);
+	nfs_read_window = clamp(nfs_read_window, 1, NFS_READ_WINDOW_MAX);
+	nfs_read_next = 0;
+	nfs_read_eof = false;
+	nfs_read_total = 0;
+
+	for (i = 0; i < nfs_read_window; i++)
+		nfs_read_fill(&nfs_read_slots[i]);
+}
+
 /**************************************************************************
  * RPC request dispatcher
  **************************************************************************
  */
 void nfs_send(void)
 {
+	int i;
+
 	switch (nfs_state) {
 	case STATE_PRCLOOKUP_PROG_MOUNT_REQ:
 		if (choosen_nfs_version != NFS_V3)
@@ -438,11 +526,17 @@ void nfs_send(void)
 		nfs_lookup_req(nfs_filename);
 		break;
 	case STATE_READ_REQ:
-		nfs_read_req(nfs_offset, nfs_len);
+		for (i = 0; i < nfs_read_window; i++) {
+			if (nfs_read_slots[i].id)
+				nfs_read_send(&nfs_read_slots[i]);
+		}
 		break;
 	case STATE_READLINK_REQ:
 		nfs_readlink_req();
 		break;
+	case STATE_FSINFO_REQ:
+		nfs_fsinfo_req();
+		break;
 	}
 }
 
@@ -639,6 +733,38 @@ static int nfs3_get_attributes_offset(uint32_t *data)
 	return 1;
 }
 
+static int nfs_fsinfo_reply(uchar *pkt, unsigned int len)
+{
+	struct rpc_t rpc_pkt;
+	unsigned int rtmax;
+	int nfsv3_data_offset;
+
+	memcpy(&rpc_pkt.u.data[0], pkt, len);
+
+	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
+		return -NFS_RPC_ERR;
+	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
+		return -NFS_RPC_DROP;
+
+	if (rpc_pkt.u.reply.rstatus  ||
+	    rpc_pkt.u.reply.verifier ||
+	    rpc_pkt.u.reply.astatus  ||
+	    rpc_pkt.u.reply.data[0])
+		return -1;
+
+	nfsv3_data_offset = nfs3_get_attributes_offset(rpc_pkt.u.reply.data);
+	if ((uchar *)&rpc_pkt.u.reply.data[2 + nfsv3_data_offset] -
+	    (uchar *)&rpc_pkt > len)
+		return -1;
+
+	rtmax = ntohl(rpc_pkt.u.reply.data[1 + nfsv3_data_offset]);
+	debug("NFS server rtmax %u\n", rtmax);
+	if (rtmax && rtmax < nfs_read_size)
+		nfs_read_size = rtmax;
+
+	return 0;
+}
+
 static int nfs_readlink_reply(uchar *pkt, unsigned int len)
 {
 	struct rpc_t rpc_pkt;
@@ -697,18 +823,44 @@ static int nfs_readlink_reply(uchar *pkt, unsigned int len)
 	return 0;
 }
 
-static int nfs_read_reply(uchar *pkt, unsigned int len)
+static void nfs_read_progress(unsigned int rlen)
+{
+	const unsigned int step = NFS_READ_SIZE / 2 * 10;
+	unsigned int hashes = DIV_ROUND_UP(nfs_read_total, step);
+
+	nfs_read_total += rlen;
+	for (; hashes < DIV_ROUND_UP(nfs_read_total, step); hashes++) {
+		if (hashes && !(hashes % HASHES_PER_LINE))
+			puts("\n\t ");
+		putc('#');
+	}
+}
+
+static int nfs_read_reply(uchar *pkt, unsigned int len,
+			  struct nfs_read_slot **slotp, bool *eofp)
 {
 	struct rpc_t rpc_pkt;
+	struct nfs_read_slot *slot = NULL;
+	unsigned int hdr_len, data_off;
+	unsigned long id;
+	u32 *data_ptr;
 	int rlen;
-	uchar *data_ptr;
+	int i;
 
-	memcpy(&rpc_pkt.u.data[0], pkt, sizeof(rpc_pkt.u.reply));
+	/* Only copy the header, since the data is stored straight from pkt */
+	hdr_len = min_t(unsigned int, len, sizeof(rpc_pkt) - NFS_READ_SIZE);
+	if (hdr_len < (uchar *)&rpc_pkt.u.reply.data[1] - (uchar *)&rpc_pkt)
+		return -NFS_RPC_DROP;
+	memcpy(&rpc_pkt.u.data[0], pkt, hdr_len);
 
-	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
-		return -NFS_RPC_ERR;
-	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
+	id = ntohl(rpc_pkt.u.reply.id);
+	for (i = 0; i < nfs_read_window; i++) {
+		if (nfs_read_slots[i].id == id)
+			slot = &nfs_read_slots[i];
+	}
+	if (!slot)
 		return -NFS_RPC_DROP;
+	*slotp = slot;
 
 	if (rpc_pkt.u.reply.rstatus  ||
 	    rpc_pkt.u.reply.verifier ||
@@ -721,40 +873,41 @@ static int nfs_read_reply(uchar *pkt, unsigned int len)
 		return -ntohl(rpc_pkt.u.reply.data[0]);
 	}
 
-	if (nfs_offset != 0 && !((nfs_offset) %
-			(NFS_READ_SIZE / 2 * 10 * HASHES_PER_LINE)))
-		puts("\n\t ");
-	if (!(nfs_offset % ((NFS_READ_SIZE / 2) * 10)))
-		putc('#');
-
 	if (choosen_nfs_version != NFS_V3) {
 		rlen = ntohl(rpc_pkt.u.reply.data[18]);
-		data_ptr = (uchar *)&rpc_pkt.u.reply.data[19];
+		data_ptr = &rpc_pkt.u.reply.data[19];
+		*eofp = false;
 	} else {  /* NFS_V3 */
 		int nfsv3_data_offset =
 			nfs3_get_attributes_offset(rpc_pkt.u.reply.data);
 
 		/* count value */
 		rlen = ntohl(rpc_pkt.u.reply.data[1 + nfsv3_data_offset]);
+		*eofp = rpc_pkt.u.reply.data[2 + nfsv3_data_offset];
 		/* Skip unused values :
 		 *	EOF:		32 bits value,
 		 *	data_size:	32 bits value,
 		 */
-		data_ptr = (uchar *)
-			&rpc_pkt.u.reply.data[4 + nfsv3_data_offset];
+		data_ptr = &rpc_pkt.u.reply.data[4 + nfsv3_data_offset];
 	}
 
-	if (((uchar *)&rpc_pkt.u.reply.data[0] - (uchar *)&rpc_pkt + rlen) > len)
+	data_off = (uchar *)data_ptr - (uchar *)&rpc_pkt;
+	if (data_off > hdr_len || rlen < 0 || rlen > slot->len ||
+	    data_off + rlen > len)
 		return -9999;
 
-	if (store_block(data_ptr, nfs_offset, rlen))
+	/* a read past the end of the file must not change its size */
+	if (rlen && store_block(pkt + data_off, slot->offset, rlen))
 		return -9999;
+	nfs_read_progress(rlen);
 
 	return rlen;
 }
 
 void nfs_pkt_recv(uchar *pkt, unsigned int len)
 {
+	struct nfs_read_slot *slot;
+	bool eof;
 	int rlen;
 	int reply;
 
@@ -822,13 +975,26 @@ void nfs_pkt_recv(uchar *pkt, unsigned int len)
 			nfs_state = STATE_PRCLOOKUP_PROG_MOUNT_REQ;
 			nfs_send();
 		} else {
-			nfs_state = STATE_READ_REQ;
-			nfs_offset = 0;
-			nfs_len = NFS_READ_SIZE;
-			nfs_send();
+			nfs_read_size = NFS_READ_SIZE;
+			if (choosen_nfs_version == NFS_V3) {
+				nfs_state = STATE_FSINFO_REQ;
+				nfs_send();
+			} else {
+				nfs_state = STATE_READ_REQ;
+				nfs_read_start();
+			}
 		}
 		break;
 
+	case STATE_FSINFO_REQ:
+		reply = nfs_fsinfo_reply(pkt, len);
+		if (reply == -NFS_RPC_DROP)
+			break;
+		/* If this fails, just use the default read size */
+		nfs_state = STATE_READ_REQ;
+		nfs_read_start();
+		break;
+
 	case STATE_READLINK_REQ:
 		reply = nfs_readlink_reply(pkt, len);
 		if (reply == -NFS_RPC_DROP) {
@@ -848,22 +1014,31 @@ void nfs_pkt_recv(uchar *pkt, unsigned int len)
 		break;
 
 	case STATE_READ_REQ:
-		rlen = nfs_read_reply(pkt, len);
+		rlen = nfs_read_reply(pkt, len, &slot, &eof);
 		if (rlen == -NFS_RPC_DROP)
 			break;
 		nfs_refresh_timeout();
-		if (rlen > 0) {
-			nfs_offset += rlen;
+		if (rlen > 0 && rlen < slot->len && !eof) {
+			/* short read: ask for the rest */
+			slot->offset += rlen;
+			slot->len -= rlen;
+			nfs_read_send(slot);
+		} else if (rlen >= 0) {
+			if (!rlen || eof)
+				nfs_read_eof = true;
+			nfs_read_fill(slot);
+			/* wait for the rest of the window */
+			if (nfs_read_busy())
+				break;
+			nfs_download_state = NETLOOP_SUCCESS;
+			nfs_state = STATE_UMOUNT_REQ;
 			nfs_send();
 		} else if ((rlen == -NFSERR_ISDIR) || (rlen == -NFSERR_INVAL)) {
 			/* symbolic link */
 			nfs_state = STATE_READLINK_REQ;
 			nfs_send();
 		} else {
-			if (!rlen)
-				nfs_download_state = NETLOOP_SUCCESS;
-			if (rlen < 0)
-				debug("NFS READ error (%d)\n", rlen);
+			debug("NFS READ error (%d)\n", rlen);
 			nfs_state = STATE_UMOUNT_REQ;
 			nfs_send();
 		}
@@ -54,8 +54,6 @@ extern int nfs_server_port;
 extern int nfs_our_port;
 extern int nfs_timeout_count;
 extern unsigned long rpc_id;
-extern int nfs_offset;
-extern int nfs_len;
 
 extern const ulong nfs_timeout;
 
@@ -67,14 +65,28 @@ extern int nfs_state;
 #define STATE_LOOKUP_REQ		5
 #define STATE_READ_REQ			6
 #define STATE_READLINK_REQ		7
+#define STATE_FSINFO_REQ		8
 
 /*
  * Block size used for NFS read accesses.  A RPC reply packet (including  all
  * headers) must fit within a single Ethernet frame to avoid fragmentation.
  * However, if CONFIG_IP_DEFRAG is set, a bigger value could be used.  In any
- * case, most NFS servers are optimized for a power of 2.
+ * case, most NFS servers are optimized for a power of 2.  With NFSv3 the
+ * size is also limited to the server's maximum (rtmax).
  */
+#ifdef CONFIG_NFS_READ_SIZE
+#define NFS_READ_SIZE	CONFIG_NFS_READ_SIZE
+#else
 #define NFS_READ_SIZE	1024	/* biggest power of two that fits Ether frame */
+#endif
+
+/* Number of READ requests sent before waiting for a reply */
+#ifdef CONFIG_NFS_READ_WINDOW
+#define NFS_READ_WINDOW	CONFIG_NFS_READ_WINDOW
+#else
+#define NFS_READ_WINDOW	1
+#endif
+#define NFS_READ_WINDOW_MAX	16
 #define NFS_MAX_ATTRS	26
 
 struct rpc_t {
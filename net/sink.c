@@ -0,0 +1,252 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Writing a download straight to a block device
+ *
+ * An image being provisioned may be larger than the memory available to load
+ * it into. Instead the download is collected in a bounce buffer, which is
+ * written to the device each time it fills up. The digest is worked out as
+ * each chunk is written, so the image does not need to be read back.
+ */
+
+#include <blk.h>
+#include <hash.h>
+#include <hexdump.h>
+#include <memalign.h>
+#include <net.h>
+#include <part.h>
+#include <net/sink.h>
+#include <u-boot/sha256.h>
+
+/**
+ * struct net_sink - where the next download is written
+ *
+ * @desc: Block device to write to
+ * @start: First block to write
+ * @blocks: Number of blocks available
+ * @name: Name of the device and partition, for messages
+ * @armed: true if the next download is to be written to the device
+ * @active: true while a download is being written to the device
+ * @check: true to check the digest of the download
+ * @digest: Digest which the download must have, if @check is true
+ * @algo: Hash algorithm for the digest
+ * @ctx: Context for progressive hashing, or NULL if none
+ * @buf: Bounce buffer, with space for an extra block after @buf_size
+ * @buf_size: Size of the bounce buffer, a multiple of the block size
+ * @fill: Number of bytes in the bounce buffer
+ * @written: Number of bytes written to the device before those in the buffer
+ */
+struct net_sink {
+	struct blk_desc *desc;
+	lbaint_t start;
+	lbaint_t blocks;
+	char name[32];
+	bool armed;
+	bool active;
+	bool check;
+	u8 digest[SHA256_SUM_LEN];
+	struct hash_algo *algo;
+	void *ctx;
+	u8 *buf;
+	ulong buf_size;
+	ulong fill;
+	ulong written;
+};
+
+static struct net_sink sink;
+
+int net_sink_arm(const char *ifname, const char *dev_part, const char *digest)
+{
+	struct disk_partition info;
+	u8 value[SHA256_SUM_LEN];
+	struct blk_desc *desc;
+
+	if (digest && (strlen(digest) != SHA256_SUM_LEN * 2 ||
+		       hex2bin(value, digest, SHA256_SUM_LEN)))
+		return -EINVAL;
+	if (blk_get_device_part_str(ifname, dev_part, &desc, &info, 1) < 0)
+		return -ENODEV;
+
+	sink.desc = desc;
+	sink.start = info.start;
+	sink.blocks = info.size;
+	snprintf(sink.name, sizeof(sink.name), "%s %s", ifname, dev_part);
+	sink.check = digest;
+	if (digest)
+		memcpy(sink.digest, value, SHA256_SUM_LEN);
+	sink.armed = true;
+
+	return 0;
+}
+
+void net_sink_disarm(void)
+{
+	if (!sink.active)
+		sink.armed = false;
+}
+
+void net_sink_show(void)
+{
+	if (!sink.armed) {
+		printf("Downloads are written to memory\n");
+		return;
+	}
+	printf("Next download is written to %s, %s\n", sink.name,
+	       sink.check ? "SHA-256 digest checked" : "SHA-256 digest shown");
+}
+
+int net_sink_start(void)
+{
+	ulong blksz;
+	int ret;
+
+	if (!sink.armed || sink.active)
+		return 0;
+
+	blksz = sink.desc->blksz;
+	sink.buf_size = max(rounddown(CONFIG_NET_SINK_BUF_SIZE, blksz), blksz);
+	sink.buf = malloc_cache_aligned(sink.buf_size + blksz);
+	if (!sink.buf)
+		return -ENOMEM;
+	ret = hash_progressive_lookup_algo("sha256", &sink.algo);
+	if (!ret)
+		ret = sink.algo->hash_init(sink.algo, &sink.ctx);
+	if (ret) {
+		free(sink.buf);
+		return ret;
+	}
+	sink.fill = 0;
+	sink.written = 0;
+	sink.active = true;
+	printf("Writing to %s\n", sink.name);
+
+	return 0;
+}
+
+bool net_sink_active(void)
+{
+	return sink.active;
+}
+
+ulong net_sink_size(void)
+{
+	return sink.written + sink.fill;
+}
+
+/*
+ * Write the bounce buffer to the device. At the end, the last block may only
+ * be partly filled, so the rest of it is read from the device first.
+ */
+static int sink_flush(bool last)
+{
+	ulong blksz = sink.desc->blksz;
+	lbaint_t blk = sink.start + sink.written / blksz;
+	lbaint_t count = sink.fill / blksz;
+	ulong tail = sink.fill % blksz;
+	u8 *extra = sink.buf + sink.buf_size;
+	int ret;
+
+	ret = sink.algo->hash_update(sink.algo, sink.ctx, sink.buf, sink.fill,
+				     last);
+	if (ret) {
+		/* the context is freed on error */
+		sink.ctx = NULL;
+		return -EIO;
+	}
+
+	if (tail) {
+		if (blk_dread(sink.desc, blk + count, 1, extra) != 1)
+			goto err;
+		memcpy(sink.buf + sink.fill, extra + tail, blksz - tail);
+		count++;
+	}
+	if (count && blk_dwrite(sink.desc, blk, count, sink.buf) != count)
+		goto err;
+	sink.written += sink.fill;
+	sink.fill = 0;
+
+	return 0;
+
+err:
+	printf("\nError writing to %s\n", sink.name);
+	return -EIO;
+}
+
+int net_sink_write(ulong offset, const void *buf, ulong len)
+{
+	ulong size = net_sink_size();
+	ulong skip, n;
+	int ret;
+
+	if (offset > size)
+		return -EAGAIN;
+	skip = size - offset;
+	if (skip >= len)
+		return 0;
+	buf += skip;
+	len -= skip;
+	if ((u64)size + len > (u64)sink.blocks * sink.desc->blksz) {
+		printf("\nImage too large for %s\n", sink.name);
+		return -ENOSPC;
+	}
+
+	while (len) {
+		n = min(len, sink.buf_size - sink.fill);
+		memcpy(sink.buf + sink.fill, buf, n);
+		net_rx_copied(n);
+		sink.fill += n;
+		buf += n;
+		len -= n;
+		if (sink.fill == sink.buf_size) {
+			ret = sink_flush(false);
+			if (ret)
+				return ret;
+		}
+	}
+
+	return 0;
+}
+
+static void sink_show_digest(const char *label, const u8 *digest)
+{
+	int i;
+
+	printf("%s", label);
+	for (i = 0; i < SHA256_SUM_LEN; i++)
+		printf("%02x", digest[i]);
+	printf("\n");
+}
+
+int net_sink_finish(bool ok)
+{
+	u8 digest[HASH_MAX_DIGEST_SIZE];
+	int ret = 0;
+
+	if (!sink.active)
+		return 0;
+
+	if (ok)
+		ret = sink_flush(true);
+	if (sink.ctx &&
+	    sink.algo->hash_finish(sink.algo, sink.ctx, digest, sizeof(digest)))
+		ret = ret ?: -EIO;
+	sink.ctx = NULL;
+	free(sink.buf);
+	sink.buf = NULL;
+	sink.active = false;
+	sink.armed = false;
+	if (!ok || ret)
+		return ret;
+
+	printf("Written %lu bytes to %s\n", sink.written, sink.name);
+	sink_show_digest("sha256 ==> ", digest);
+	if (sink.check) {
+		if (memcmp(digest, sink.digest, SHA256_SUM_LEN)) {
+			sink_show_digest("Digest mismatch, expected ",
+					 sink.digest);
+			return -EILSEQ;
+		}
+		printf("Digest OK\n");
+	}
+
+	return 0;
+}
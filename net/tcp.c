@@ -36,16 +36,20 @@
 #define TCP_SEND_RETRY		3
 #define TCP_SEND_TIMEOUT	2000UL
 #define TCP_RX_INACTIVE_TIMEOUT	30000UL
-#if PKTBUFSRX != 0
+#if defined(CONFIG_TCP_RCV_WINDOW) && CONFIG_TCP_RCV_WINDOW
+  #define TCP_RCV_WND_SIZE	CONFIG_TCP_RCV_WINDOW
+#elif PKTBUFSRX != 0
   #define TCP_RCV_WND_SIZE	(PKTBUFSRX * TCP_MSS)
 #else
   #define TCP_RCV_WND_SIZE	(4 * TCP_MSS)
 #endif
+/* Largest shift allowed by RFC 7323 */
+#define TCP_SCALE_MAX		14
 
 #define TCP_PACKET_OK		0
 #define TCP_PACKET_DROP		1
 
-static struct tcp_stream tcp_stream;
+static struct tcp_stream tcp_streams[CONFIG_PROT_TCP_STREAMS];
 
 static int (*tcp_stream_on_create)(struct tcp_stream *tcp);
 
@@ -146,6 +150,20 @@ void tcp_stream_restart_rx_timer(struct tcp_stream *tcp)
 	tcp->time_last_rx = get_timer(0);
 }
 
+/*
+ * Get the window scale needed to advertise the whole receive window in the
+ * 16-bit window field
+ */
+static u8 tcp_rcv_wnd_scale(u32 rcv_wnd)
+{
+	u8 scale = 0;
+
+	while (scale < TCP_SCALE_MAX && (rcv_wnd >> scale) > 0xffff)
+		scale++;
+
+	return scale;
+}
+
 static void tcp_stream_init(struct tcp_stream *tcp,
 			    struct in_addr rhost, u16 rport, u16 lport)
 {
@@ -156,6 +174,7 @@ static void tcp_stream_init(struct tcp_stream *tcp,
 	tcp->state = TCP_CLOSED;
 	tcp->lost.len = TCP_OPT_LEN_2;
 	tcp->rcv_wnd = TCP_RCV_WND_SIZE;
+	tcp->loc_win_scale = tcp_rcv_wnd_scale(tcp->rcv_wnd);
 	tcp->max_retry_count = TCP_SEND_RETRY;
 	tcp->initial_timeout = TCP_SEND_TIMEOUT;
 	tcp->rx_inactiv_timeout = TCP_RX_INACTIVE_TIMEOUT;
@@ -172,17 +191,20 @@ static void tcp_stream_destroy(struct tcp_stream *tcp)
 void tcp_init(void)
 {
 	static int initialized;
-	struct tcp_stream *tcp = &tcp_stream;
+	struct tcp_stream *tcp;
 
 	tcp_stream_on_create = NULL;
 	if (!initialized) {
 		initialized = 1;
-		memset(tcp, 0, sizeof(struct tcp_stream));
+		memset(tcp_streams, 0, sizeof(tcp_streams));
 	}
 
-	tcp_stream_set_state(tcp, TCP_CLOSED);
-	tcp_stream_set_status(tcp, TCP_ERR_RST);
-	tcp_stream_destroy(tcp);
+	for (tcp = tcp_streams; tcp < tcp_streams + ARRAY_SIZE(tcp_streams);
+	     tcp++) {
+		tcp_stream_set_state(tcp, TCP_CLOSED);
+		tcp_stream_set_status(tcp, TCP_ERR_RST);
+		tcp_stream_destroy(tcp);
+	}
 }
 
 void tcp_stream_set_on_create_handler(int (*on_create)(struct tcp_stream *))
@@ -193,10 +215,17 @@ void tcp_stream_set_on_create_handler(int (*on_create)(struct tcp_stream *))
 static struct tcp_stream *tcp_stream_add(struct in_addr rhost,
 					 u16 rport, u16 lport)
 {
-	struct tcp_stream *tcp = &tcp_stream;
+	struct tcp_stream *tcp;
 
-	if (!tcp_stream_on_create ||
-	    tcp->state != TCP_CLOSED)
+	if (!tcp_stream_on_create)
+		return NULL;
+
+	for (tcp = tcp_streams; tcp < tcp_streams + ARRAY_SIZE(tcp_streams);
+	     tcp++) {
+		if (tcp->state == TCP_CLOSED)
+			break;
+	}
+	if (tcp == tcp_streams + ARRAY_SIZE(tcp_streams))
 		return NULL;
 
 	tcp_stream_init(tcp, rhost, rport, lport);
@@ -206,14 +235,29 @@ static struct tcp_stream *tcp_stream_add(struct in_addr rhost,
 	return tcp;
 }
 
+static struct tcp_stream *tcp_stream_find(struct in_addr rhost,
+					  u16 rport, u16 lport)
+{
+	struct tcp_stream *tcp;
+
+	for (tcp = tcp_streams; tcp < tcp_streams + ARRAY_SIZE(tcp_streams);
+	     tcp++) {
+		if (tcp->rhost.s_addr == rhost.s_addr &&
+		    tcp->rport == rport &&
+		    tcp->lport == lport)
+			return tcp;
+	}
+
+	return NULL;
+}
+
 struct tcp_stream *tcp_stream_get(int is_new, struct in_addr rhost,
 				  u16 rport, u16 lport)
 {
-	struct tcp_stream *tcp = &tcp_stream;
+	struct tcp_stream *tcp;
 
-	if (tcp->rhost.s_addr == rhost.s_addr &&
-	    tcp->rport == rport &&
-	    tcp->lport == lport)
+	tcp = tcp_stream_find(rhost, rport, lport);
+	if (tcp)
 		return tcp;
 
 	return is_new ? tcp_stream_add(rhost, rport, lport) : NULL;
@@ -434,8 +478,9 @@ void tcp_streams_poll(void)
 	struct tcp_stream	*tcp;
 
 	time = get_timer(0);
-	tcp = &tcp_stream;
-	tcp_stream_poll(tcp, time);
+	for (tcp = tcp_streams; tcp < tcp_streams + ARRAY_SIZE(tcp_streams);
+	     tcp++)
+		tcp_stream_poll(tcp, time);
 }
 
 /**
@@ -549,7 +594,7 @@ void net_set_syn_options(struct tcp_stream *tcp, union tcp_build_pkt *b)
 	b->ip.mss.len = TCP_OPT_LEN_4;
 	b->ip.mss.mss = htons(TCP_MSS);
 	b->ip.scale.kind = TCP_O_SCL;
-	b->ip.scale.scale = TCP_SCALE;
+	b->ip.scale.scale = tcp->loc_win_scale;
 	b->ip.scale.len = TCP_OPT_LEN_3;
 	if (IS_ENABLED(CONFIG_PROT_TCP_SACK)) {
 		b->ip.sack_p.kind = TCP_P_SACK;
@@ -656,7 +701,11 @@ int tcp_set_tcp_header(struct tcp_stream *tcp, uchar *pkt, int payload_len,
 	 * it is, then the u-boot tftp or nfs kernel netboot should be
 	 * considered.
 	 */
-	b->ip.hdr.tcp_win = htons(tcp->rcv_wnd >> TCP_SCALE);
+	if (action & TCP_SYN)
+		b->ip.hdr.tcp_win = htons(min_t(u32, tcp->rcv_wnd, 0xffff));
+	else
+		b->ip.hdr.tcp_win = htons(min_t(u32, tcp->rcv_wnd >>
+						tcp->loc_win_scale, 0xffff));
 
 	b->ip.hdr.tcp_xsum = 0;
 	b->ip.hdr.tcp_ugr = 0;
@@ -794,8 +843,14 @@ void tcp_parse_options(struct tcp_stream *tcp, uchar *o, int o_len)
 		case TCP_V_SACK:
 			break;
 		case TCP_O_SCL:
+			/* only valid in a SYN, which we wait for in these */
+			if (tcp->state != TCP_CLOSED &&
+			    tcp->state != TCP_SYN_SENT)
+				break;
 			wsopt = (struct tcp_scale *)p;
-			tcp->rmt_win_scale = wsopt->scale;
+			tcp->rmt_win_scale = min_t(u8, wsopt->scale,
+						   TCP_SCALE_MAX);
+			tcp->win_scale_ok = 1;
 			break;
 		case TCP_O_TS:
 			tsopt = (struct tcp_t_opt *)p;
@@ -984,10 +1039,13 @@ void tcp_rx_state_machine(struct tcp_stream *tcp,
 	 */
 	tcp_seq_num = ntohl(b->ip.hdr.tcp_seq);
 	tcp_ack_num = ntohl(b->ip.hdr.tcp_ack);
-	tcp_win_size = ntohs(b->ip.hdr.tcp_win) << tcp->rmt_win_scale;
-
 	tcp_flags = b->ip.hdr.tcp_flags;
 
+	/* the window in a SYN is never scaled */
+	tcp_win_size = ntohs(b->ip.hdr.tcp_win);
+	if (!(tcp_flags & TCP_SYN))
+		tcp_win_size <<= tcp->rmt_win_scale;
+
 //	printf("pkt: seq=%d, ack=%d, flags=%x, len=%d\n",
 //		tcp_seq_num - tcp->irs, tcp_ack_num - tcp->iss, tcp_flags, pkt_len);
 //	printf("tcp: rcv_nxt=%d, snd_una=%d, snd_nxt=%d\n\n",
@@ -1014,6 +1072,11 @@ void tcp_rx_state_machine(struct tcp_stream *tcp,
 		tcp->snd_nxt = tcp->iss + 1;
 		tcp->snd_wnd = tcp_win_size;
 
+		/* our SYN-ACK does not offer window scaling */
+		tcp->loc_win_scale = 0;
+		tcp->rmt_win_scale = 0;
+		tcp->win_scale_ok = 0;
+
 		tcp_stream_restart_rx_timer(tcp);
 
 		tcp_stream_set_state(tcp, TCP_SYN_RECEIVED);
@@ -1048,6 +1111,12 @@ void tcp_rx_state_machine(struct tcp_stream *tcp,
 		tcp->rcv_nxt = tcp->irs + 1;
 		tcp->snd_una = tcp_ack_num;
 
+		/* windows are scaled only if both ends asked for it */
+		if (!tcp->win_scale_ok) {
+			tcp->loc_win_scale = 0;
+			tcp->rmt_win_scale = 0;
+		}
+
 		tcp_stream_restart_rx_timer(tcp);
 
 		/* our SYN has been ACKed */
@@ -1211,8 +1280,15 @@ void rxhand_tcp_f(union tcp_build_pkt *b, unsigned int pkt_len)
 struct tcp_stream *tcp_stream_connect(struct in_addr rhost, u16 rport)
 {
 	struct tcp_stream *tcp;
+	uint lport;
+
+	/* connections opened together must not share a local port */
+	lport = random_port();
+	while (tcp_stream_find(rhost, rport, lport))
+		lport = RANDOM_PORT_START +
+			(lport + 1 - RANDOM_PORT_START) % RANDOM_PORT_RANGE;
 
-	tcp = tcp_stream_add(rhost, rport, random_port());
+	tcp = tcp_stream_add(rhost, rport, lport);
 	if (!tcp)
 		return NULL;
 
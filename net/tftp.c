@@ -16,6 +16,7 @@
 #include <mapmem.h>
 #include <net.h>
 #include <net6.h>
+#include <net/sink.h>
 #include <net/tftp.h>
 #include "bootp.h"
 
@@ -32,6 +33,12 @@
 #define WELL_KNOWN_PORT	69
 /* Millisecs to timeout for lost pkt */
 #define TIMEOUT		5000UL
+/*
+ * Millisecs to wait for the rest of a window before asking for it again, at
+ * least, and as a multiple of the usual time between blocks
+ */
+#define GAP_TIMEOUT_MIN	100UL
+#define GAP_TIMEOUT_MULT	4
 /* Number of "loading" hashes per line (for checking the image size) */
 #define HASHES_PER_LINE	65
 
@@ -101,6 +108,18 @@ static ushort	tftp_windowsize;
 static ushort	tftp_next_ack;
 /* Last nack block we send */
 static ushort	tftp_last_nack;
+/* Window size to ask for, learned from earlier transfers (0 = the maximum) */
+static ushort	tftp_window_learned;
+/* Maximum window size which tftp_window_learned was learned with */
+static ushort	tftp_window_learned_max;
+/* Number of times we asked the server to send blocks again */
+static uint	tftp_retransmits;
+/* Time the last block in order arrived, in ms */
+static ulong	tftp_block_time;
+/* Average time between blocks of a window, in 1/8 ms */
+static ulong	tftp_block_gap;
+/* 1 once tftp_block_gap has been measured */
+static int	tftp_block_gap_known;
 #ifdef CMD_TFTPPUT
 /* 1 if writing, else 0 */
 static int	tftp_put_active;
@@ -164,6 +183,12 @@ static inline int store_block(int block, uchar *src, unsigned int len)
 	ulong store_addr = tftp_load_addr + offset;
 	void *ptr;
 
+	if (net_sink_active()) {
+		if (net_sink_write(offset, src, len))
+			return -1;
+		goto done;
+	}
+
 	if (CONFIG_IS_ENABLED(LMB)) {
 		if (store_addr < tftp_load_addr ||
 		    lmb_read_check(store_addr, len)) {
@@ -176,7 +201,9 @@ static inline int store_block(int block, uchar *src, unsigned int len)
 	ptr = map_sysmem(store_addr, len);
 	memcpy(ptr, src, len);
 	unmap_sysmem(ptr);
+	net_rx_copied(len);
 
+done:
 	if (net_boot_file_size < newsize)
 		net_boot_file_size = newsize;
 
@@ -189,6 +216,8 @@ static void new_transfer(void)
 	tftp_prev_block = 0;
 	tftp_block_wrap = 0;
 	tftp_block_wrap_offset = 0;
+	tftp_retransmits = 0;
+	tftp_block_gap_known = 0;
 #ifdef CMD_TFTPPUT
 	tftp_put_final_block_sent = 0;
 #endif
@@ -283,6 +312,59 @@ static void update_block_number(void)
 	show_block_marker();
 }
 
+/* Get the window size to ask the server for */
+static int tftp_window_size_wanted(void)
+{
+	if (IS_ENABLED(CONFIG_TFTP_WINDOWSIZE_AUTO) && tftp_window_learned)
+		return min_t(int, tftp_window_learned, tftp_window_size_option);
+
+	return tftp_window_size_option;
+}
+
+/*
+ * Ask the server to send the blocks after the last one received in order.
+ * With an adaptive window, the first loss in a transfer halves the window
+ * asked for next time.
+ */
+static void tftp_resend_ack(void)
+{
+	if (!tftp_retransmits++ && IS_ENABLED(CONFIG_TFTP_WINDOWSIZE_AUTO))
+		tftp_window_learned = max(tftp_windowsize / 2, 1);
+	tftp_send();
+	tftp_last_nack = tftp_cur_block;
+	tftp_next_ack = (ushort)(tftp_cur_block + tftp_windowsize);
+	net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
+}
+
+/*
+ * Note the arrival of the next block in order. The time since the previous
+ * block is only measured within a window, since the server waits for our ACK
+ * between windows.
+ */
+static void tftp_block_arrived(int first_in_window)
+{
+	ulong now = get_timer(0);
+	ulong gap = (now - tftp_block_time) * 8;
+
+	if (!first_in_window) {
+		/* moving average over about eight blocks */
+		if (tftp_block_gap_known)
+			tftp_block_gap += (gap >> 3) - (tftp_block_gap >> 3);
+		else
+			tftp_block_gap = gap;
+		tftp_block_gap_known = 1;
+	}
+	tftp_block_time = now;
+}
+
+/* Get the time to wait for the rest of a window before asking for it again */
+static ulong tftp_gap_timeout(void)
+{
+	ulong gap = tftp_block_gap * GAP_TIMEOUT_MULT / 8;
+
+	return clamp(gap, GAP_TIMEOUT_MIN, timeout_ms);
+}
+
 /* The TFTP get or put is complete */
 static void tftp_complete(void)
 {
@@ -301,11 +383,19 @@ static void tftp_complete(void)
 		print_size(net_boot_file_size /
 			time_start * 1000, "/s");
 	}
+	if (tftp_windowsize > 1 || tftp_retransmits)
+		printf("\n\t Window size %d, %u retransmit requests",
+		       tftp_windowsize, tftp_retransmits);
+	/* a window without loss may be too small, so try a larger one */
+	if (IS_ENABLED(CONFIG_TFTP_WINDOWSIZE_AUTO) && !tftp_put_active &&
+	    !tftp_retransmits)
+		tftp_window_learned = min_t(int, tftp_windowsize * 2,
+					    tftp_window_size_option);
 	puts("\ndone\n");
 
 	led_activity_off();
 
-	if (!tftp_put_active)
+	if (!tftp_put_active && !net_sink_active())
 		efi_set_bootdev("Net", "", tftp_filename,
 				map_sysmem(tftp_load_addr, 0),
 				net_boot_file_size);
@@ -363,9 +453,9 @@ static void tftp_send(void)
 		 * Implemented only for tftp get.
 		 * Don't bother sending if it's 1
 		 */
-		if (tftp_state == STATE_SEND_RRQ && tftp_window_size_option > 1)
+		if (tftp_state == STATE_SEND_RRQ && tftp_window_size_wanted() > 1)
 			pkt += sprintf((char *)pkt, "windowsize%c%d%c",
-					0, tftp_window_size_option, 0);
+					0, tftp_window_size_wanted(), 0);
 		len = pkt - xp;
 		break;
 
@@ -616,12 +706,8 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			 * that will arrive will cause a sending NACK.
 			 * This just overwellms the server, let's just send one.
 			 */
-			if (tftp_last_nack != tftp_cur_block) {
-				tftp_send();
-				tftp_last_nack = tftp_cur_block;
-				tftp_next_ack = (ushort)(tftp_cur_block +
-							 tftp_windowsize);
-			}
+			if (tftp_last_nack != tftp_cur_block)
+				tftp_resend_ack();
 			break;
 		}
 
@@ -656,6 +742,8 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		}
 
 		update_block_number();
+		tftp_block_arrived((ushort)(tftp_next_ack - tftp_cur_block) ==
+				   tftp_windowsize - 1);
 		tftp_prev_block = tftp_cur_block;
 		timeout_count_max = tftp_timeout_count_max;
 		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
@@ -680,6 +768,15 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		if (tftp_cur_block == tftp_next_ack) {
 			tftp_send();
 			tftp_next_ack += tftp_windowsize;
+		} else if (tftp_windowsize > 1 && tftp_block_gap_known) {
+			/*
+			 * If the end of the window is lost, no later block
+			 * shows the gap, so do not wait for a full timeout.
+			 * The server may pace its blocks, so wait for a few
+			 * times the usual time between them.
+			 */
+			net_set_timeout_handler(tftp_gap_timeout(),
+						tftp_resend_ack);
 		}
 		break;
 
@@ -715,7 +812,9 @@ static void tftp_timeout_handler(void)
 	} else {
 		puts("T ");
 		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
-		if (tftp_state != STATE_RECV_WRQ)
+		if (tftp_state == STATE_DATA && !tftp_put_active)
+			tftp_resend_ack();
+		else if (tftp_state != STATE_RECV_WRQ)
 			tftp_send();
 	}
 }
@@ -811,8 +910,14 @@ void tftp_start(enum proto_t protocol)
 
 	sanitize_tftp_block_size_option(protocol);
 
+	/* start learning again if the maximum window size has changed */
+	if (tftp_window_size_option != tftp_window_learned_max) {
+		tftp_window_learned_max = tftp_window_size_option;
+		tftp_window_learned = 0;
+	}
+
 	debug("TFTP blocksize = %i, TFTP windowsize = %d timeout = %ld ms\n",
-	      tftp_block_size_option, tftp_window_size_option, timeout_ms);
+	      tftp_block_size_option, tftp_window_size_wanted(), timeout_ms);
 
 	if (IS_ENABLED(CONFIG_IPV6))
 		tftp_remote_ip6 = net_server_ip6;
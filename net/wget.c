@@ -12,9 +12,11 @@
 #include <lmb.h>
 #include <mapmem.h>
 #include <net.h>
+#include <net/sink.h>
 #include <net/tcp.h>
 #include <net/wget.h>
 #include <stdlib.h>
+#include <linux/sizes.h>
 
 /* The default, change with environment variable 'httpdstp' */
 #define SERVER_PORT		80
@@ -25,19 +27,78 @@
 
 #define HTTP_STATUS_BAD		0
 #define HTTP_STATUS_OK		200
+#define HTTP_STATUS_PARTIAL	206
+
+#if IS_ENABLED(CONFIG_WGET_RANGES)
+#define WGET_MAX_CONNS		CONFIG_PROT_TCP_STREAMS
+#else
+#define WGET_MAX_CONNS		1
+#endif
+/* Smallest part worth a connection of its own */
+#define WGET_MIN_SEGMENT	SZ_64K
+/* The default, change with environment variable 'wgetretries' */
+#define WGET_RESUME_COUNT	3
+#define WGET_RESUME_DELAY	500UL
 
 static const char http_proto[] = "HTTP/1.0";
 static const char http_eom[] = "\r\n\r\n";
 static const char content_len[] = "Content-Length:";
+static const char content_range[] = "Content-Range:";
+static const char accept_ranges[] = "Accept-Ranges: bytes";
 static const char linefeed[] = "\r\n";
 static struct in_addr web_server_ip;
 static unsigned int server_port;
 static unsigned long content_length;
-static u32 http_hdr_size, max_rx_pos;
 static int wget_tsize_num_hash;
 
 static char *image_url;
-static enum net_loop_state wget_loop_state;
+
+/**
+ * struct wget_conn - a connection fetching part of the file
+ *
+ * The first connection asks for the whole file. The others, and connections
+ * which resume a part, ask for a range of bytes.
+ *
+ * @tcp: TCP stream, or NULL if not connected
+ * @start: Offset in the file of the first byte of the part
+ * @end: Offset in the file after the last byte of the part, or 0 if the file
+ *	size is not known
+ * @req: Offset in the file of the first byte asked for by the current
+ *	request, which is after @start if the part has been resumed
+ * @rcvd: Number of bytes of the body received so far in reply to the current
+ *	request, without gaps
+ * @range: true if the current request asks for a range
+ * @pending: true if waiting to connect
+ * @done: true once the whole part has been received
+ * @hdr_size: Size of the reply header, 0 until it has been accepted
+ * @hdr_rx: Number of bytes of the reply held in @hdr
+ * @hdr: Start of the reply, kept here until the end of the header is found
+ */
+struct wget_conn {
+	struct tcp_stream *tcp;
+	ulong start;
+	ulong end;
+	ulong req;
+	ulong rcvd;
+	bool range;
+	bool pending;
+	bool done;
+	u32 hdr_size;
+	u32 hdr_rx;
+	char hdr[HTTP_MAX_HDR_LEN + 1];
+};
+
+static struct wget_conn wget_conns[WGET_MAX_CONNS];
+static int wget_num_conns;
+/* number of connections made and packets received on closed connections */
+static int wget_connects;
+static u32 wget_packets;
+/* true if the server accepts range requests for the file */
+static bool wget_ranges;
+static int wget_retries;
+/* true if the transfer cannot succeed, so must not be resumed */
+static bool wget_fatal;
+static bool wget_aborting;
 
 /**
  * store_block() - store block in memory
@@ -67,10 +128,41 @@ static inline int store_block(uchar *src, unsigned int offset, unsigned int len)
 	ptr = map_sysmem(store_addr, len);
 	memcpy(ptr, src, len);
 	unmap_sysmem(ptr);
+	net_rx_copied(len);
 
 	return 0;
 }
 
+/* Store part of the body which starts @offs bytes into the reply's body */
+static int wget_store(struct wget_conn *conn, ulong offs, uchar *src,
+		      uint len)
+{
+	ulong pos = conn->req + offs;
+
+	/* the first connection may be sent more than its part */
+	if (conn->end) {
+		if (pos >= conn->end)
+			return 0;
+		len = min_t(ulong, len, conn->end - pos);
+	}
+	if (net_sink_active())
+		return net_sink_write(pos, src, len) ? -1 : 0;
+
+	return store_block(src, pos, len);
+}
+
+/* Get the number of bytes of the file received so far */
+static ulong wget_received(void)
+{
+	struct wget_conn *conn;
+	ulong total = 0;
+
+	for (conn = wget_conns; conn < wget_conns + wget_num_conns; conn++)
+		total += conn->req + conn->rcvd - conn->start;
+
+	return total;
+}
+
 static void show_block_marker(u32 packets)
 {
 	int cnt;
@@ -95,25 +187,101 @@ static void show_block_marker(u32 packets)
 	}
 }
 
-static void tcp_stream_on_closed(struct tcp_stream *tcp)
+static void wget_connect_pending(void);
+
+static int wget_connect(struct wget_conn *conn)
+{
+	struct tcp_stream *tcp;
+
+	tcp = tcp_stream_connect(web_server_ip, server_port);
+	if (!tcp) {
+		if (!wget_info->silent)
+			printf("No free tcp streams\n");
+		return -ENOSPC;
+	}
+	conn->tcp = tcp;
+	conn->range = conn->req || conn->end;
+	conn->pending = false;
+	wget_connects++;
+	tcp->priv = conn;
+	tcp_stream_put(tcp);
+
+	return 0;
+}
+
+/*
+ * Ask for the rest of a part again after its connection failed, if the server
+ * accepts range requests. Returns true if the part will be resumed.
+ */
+static bool wget_resume(struct wget_conn *conn, struct tcp_stream *tcp)
+{
+	if (!IS_ENABLED(CONFIG_WGET_RANGES) || !wget_ranges || wget_fatal ||
+	    tcp->status == TCP_ERR_IO || wget_retries <= 0)
+		return false;
+
+	wget_retries--;
+	conn->req += conn->rcvd;
+	conn->rcvd = 0;
+	conn->hdr_size = 0;
+	conn->hdr_rx = 0;
+	conn->pending = true;
+	if (!wget_info->silent)
+		printf("\nwget: resuming from byte %lu\n", conn->req);
+	net_set_timeout_handler(WGET_RESUME_DELAY, wget_connect_pending);
+
+	return true;
+}
+
+/* Close the other connections after one has failed */
+static void wget_abort(void)
 {
-	if (tcp->status != TCP_ERR_OK)
-		wget_loop_state = NETLOOP_FAIL;
+	struct wget_conn *conn;
+
+	wget_aborting = true;
+	net_set_timeout_handler(0, NULL);
+	for (conn = wget_conns; conn < wget_conns + wget_num_conns; conn++) {
+		conn->pending = false;
+		if (conn->tcp) {
+			tcp_stream_reset(conn->tcp);
+			tcp_stream_put(conn->tcp);
+		}
+	}
+}
 
-	net_set_state(wget_loop_state);
-	if (wget_loop_state != NETLOOP_SUCCESS) {
+/* Finish the transfer once no connection is open or waiting to be opened */
+static void wget_finish(enum tcp_status status)
+{
+	enum net_loop_state state = NETLOOP_SUCCESS;
+	struct wget_conn *conn;
+
+	for (conn = wget_conns; conn < wget_conns + wget_num_conns; conn++) {
+		if (conn->tcp || conn->pending)
+			return;
+		if (!conn->done)
+			state = NETLOOP_FAIL;
+	}
+
+	net_set_state(state);
+	if (state != NETLOOP_SUCCESS) {
 		net_boot_file_size = 0;
 		if (!wget_info->silent)
 			printf("\nwget: Transfer Fail, TCP status - %d\n",
-			       tcp->status);
+			       status);
 		return;
 	}
 
-	if (!wget_info->silent)
-		printf("\nPackets received %d, Transfer Successful\n",
-		       tcp->rx_packets);
+	net_boot_file_size = wget_received();
+	if (!wget_info->silent) {
+		if (wget_connects > 1)
+			printf("\nPackets received %d on %d connections, Transfer Successful\n",
+			       wget_packets, wget_connects);
+		else
+			printf("\nPackets received %d, Transfer Successful\n",
+			       wget_packets);
+	}
 	wget_info->file_size = net_boot_file_size;
-	if (wget_info->method == WGET_HTTP_METHOD_GET && wget_info->set_bootdev) {
+	if (wget_info->method == WGET_HTTP_METHOD_GET && wget_info->set_bootdev &&
+	    !net_sink_active()) {
 		efi_set_bootdev("Http", NULL, image_url,
 				map_sysmem(image_load_addr, 0),
 				net_boot_file_size);
@@ -121,87 +289,182 @@ static void tcp_stream_on_closed(struct tcp_stream *tcp)
 	}
 }
 
-static void tcp_stream_on_rcv_nxt_update(struct tcp_stream *tcp, u32 rx_bytes)
+static void wget_connect_pending(void)
 {
-	char	*pos, *tail;
-	uchar	saved, *ptr;
-	int	reply_len;
+	struct wget_conn *conn;
+
+	for (conn = wget_conns; conn < wget_conns + wget_num_conns; conn++) {
+		if (conn->pending && wget_connect(conn)) {
+			conn->pending = false;
+			wget_abort();
+			wget_finish(TCP_ERR_RST);
+			return;
+		}
+	}
+}
 
-	if (http_hdr_size) {
-		net_boot_file_size = rx_bytes - http_hdr_size;
-		show_block_marker(tcp->rx_packets);
+static void tcp_stream_on_closed(struct tcp_stream *tcp)
+{
+	struct wget_conn *conn = tcp->priv;
+
+	conn->tcp = NULL;
+	wget_packets += tcp->rx_packets;
+
+	/* without a size, the server closes the connection at the end */
+	if (!conn->done && conn->hdr_size && !conn->end &&
+	    tcp->status == TCP_ERR_OK)
+		conn->done = true;
+
+	if (wget_aborting)
+		return;
+	if (!conn->done) {
+		if (wget_resume(conn, tcp))
+			return;
+		wget_abort();
+	}
+	wget_finish(tcp->status);
+}
+
+/*
+ * Split the file into parts once the first reply shows that the server
+ * accepts range requests. The first connection keeps the first part.
+ */
+static void wget_split(struct wget_conn *first)
+{
+	struct wget_conn *conn;
+	ulong seg;
+	int i, n;
+
+	n = min_t(ulong, env_get_ulong("wgetsegments", 10, 1), WGET_MAX_CONNS);
+	/* a block device is written in order, so one part at a time */
+	if (net_sink_active())
+		n = 1;
+	if (n < 2 || content_length < n * WGET_MIN_SEGMENT)
 		return;
+
+	seg = ALIGN(DIV_ROUND_UP(content_length, n), SZ_4K);
+	first->end = seg;
+	for (i = 1; i < n; i++) {
+		conn = &wget_conns[i];
+		memset(conn, '\0', sizeof(*conn));
+		conn->start = i * seg;
+		conn->req = conn->start;
+		conn->end = min(content_length, (i + 1) * seg);
+		conn->pending = true;
 	}
+	wget_num_conns = n;
+	debug_cond(DEBUG_WGET, "wget: %d parts of %lu bytes\n", n, seg);
+
+	/*
+	 * Connect from the net loop rather than from this callback, so that a
+	 * failure can close the first connection
+	 */
+	net_set_timeout_handler(1, wget_connect_pending);
+}
+
+/* Check that a range reply starts at the byte asked for */
+static bool wget_check_range(struct wget_conn *conn, char *hdr)
+{
+	char *pos, *tail;
+
+	pos = strstr(hdr, content_range);
+	if (!pos)
+		return false;
+	pos += strlen(content_range);
+	while (*pos == ' ')
+		pos++;
+	if (strncmp(pos, "bytes ", 6))
+		return false;
 
-	ptr = map_sysmem(image_load_addr, rx_bytes + 1);
+	return simple_strtoul(pos + 6, &tail, 10) == conn->req && *tail == '-';
+}
+
+/*
+ * Parse the reply header, which is in conn->hdr. Returns 0 if it is accepted,
+ * -EAGAIN if more is needed, or another error if the reply is not wanted.
+ */
+static int wget_parse_header(struct tcp_stream *tcp, struct wget_conn *conn,
+			     u32 rx_bytes)
+{
+	char	*pos, *tail, *ptr = conn->hdr;
+	bool	first = conn == wget_conns && !conn->range;
+	u32	hdr_size, status;
+	int	reply_len;
+	char	saved;
 
 	saved = ptr[rx_bytes];
 	ptr[rx_bytes] = '\0';
-	pos = strstr((char *)ptr, http_eom);
+	pos = strstr(ptr, http_eom);
 	ptr[rx_bytes] = saved;
-
 	if (!pos) {
 		if (rx_bytes < HTTP_MAX_HDR_LEN &&
 		    tcp->state == TCP_ESTABLISHED)
-			goto end;
+			return -EAGAIN;
 
 		if (!wget_info->silent)
 			printf("ERROR: misssed HTTP header\n");
-		tcp_stream_close(tcp);
-		goto end;
+		return -EBADMSG;
 	}
 
-	http_hdr_size = pos - (char *)ptr + strlen(http_eom);
+	hdr_size = pos - ptr + strlen(http_eom);
 	*pos = '\0';
 
-	if (wget_info->headers && http_hdr_size < MAX_HTTP_HEADERS_SIZE)
+	if (first && wget_info->headers && hdr_size < MAX_HTTP_HEADERS_SIZE)
 		strcpy(wget_info->headers, ptr);
 
 	/* check for HTTP proto */
-	if (strncasecmp((char *)ptr, "HTTP/", 5)) {
+	if (strncasecmp(ptr, "HTTP/", 5)) {
 		debug_cond(DEBUG_WGET, "wget: Connected Bad Xfer "
 				       "(no HTTP Status Line found)\n");
-		tcp_stream_close(tcp);
-		goto end;
+		return -EBADMSG;
 	}
 
 	/* get HTTP reply len */
-	pos = strstr((char *)ptr, linefeed);
+	pos = strstr(ptr, linefeed);
 	if (pos)
-		reply_len = pos - (char *)ptr;
+		reply_len = pos - ptr;
 	else
-		reply_len = http_hdr_size - strlen(http_eom);
+		reply_len = hdr_size - strlen(http_eom);
 
-	pos = strchr((char *)ptr, ' ');
-	if (!pos || pos - (char *)ptr > reply_len) {
+	pos = strchr(ptr, ' ');
+	if (!pos || pos - ptr > reply_len) {
 		debug_cond(DEBUG_WGET, "wget: Connected Bad Xfer "
 				       "(no HTTP Status Code found)\n");
-		tcp_stream_close(tcp);
-		goto end;
+		return -EBADMSG;
 	}
 
-	wget_info->status_code = (u32)simple_strtoul(pos + 1, &tail, 10);
+	status = (u32)simple_strtoul(pos + 1, &tail, 10);
 	if (tail == pos + 1 || *tail != ' ') {
 		debug_cond(DEBUG_WGET, "wget: Connected Bad Xfer "
 				       "(bad HTTP Status Code)\n");
-		tcp_stream_close(tcp);
-		goto end;
+		return -EBADMSG;
 	}
+	if (first)
+		wget_info->status_code = status;
 
-	debug_cond(DEBUG_WGET,
-		   "wget: HTTP Status Code %d\n", wget_info->status_code);
+	debug_cond(DEBUG_WGET, "wget: HTTP Status Code %d\n", status);
 
-	if (wget_info->status_code != HTTP_STATUS_OK) {
+	if (conn->range) {
+		if (status != HTTP_STATUS_PARTIAL ||
+		    !wget_check_range(conn, ptr)) {
+			debug_cond(DEBUG_WGET, "wget: Range not satisfied\n");
+			return -ERANGE;
+		}
+		conn->hdr_size = hdr_size;
+
+		return 0;
+	}
+
+	if (status != HTTP_STATUS_OK) {
 		debug_cond(DEBUG_WGET, "wget: Connected Bad Xfer\n");
-		tcp_stream_close(tcp);
-		goto end;
+		return -EBADMSG;
 	}
 
 	debug_cond(DEBUG_WGET, "wget: Connctd pkt %p  hlen %x\n",
-		   ptr, http_hdr_size);
+		   ptr, hdr_size);
 
 	content_length = -1;
-	pos = strstr((char *)ptr, content_len);
+	pos = strstr(ptr, content_len);
 	if (pos) {
 		pos += strlen(content_len) + 1;
 		while (*pos == ' ')
@@ -216,35 +479,124 @@ static void tcp_stream_on_rcv_nxt_update(struct tcp_stream *tcp, u32 rx_bytes)
 			   "wget: Connected Len %lu\n",
 			   content_length);
 		wget_info->hdr_cont_len = content_length;
-		if (wget_info->buffer_size && wget_info->buffer_size < wget_info->hdr_cont_len){
+		if (wget_info->buffer_size && wget_info->buffer_size < wget_info->hdr_cont_len)
+			return -EFBIG;
+	}
+	conn->hdr_size = hdr_size;
+
+	if (wget_info->method != WGET_HTTP_METHOD_GET || content_length == -1)
+		return 0;
+
+	/* a body shorter than this means that the transfer failed */
+	conn->end = content_length;
+	if (IS_ENABLED(CONFIG_WGET_RANGES) && strstr(ptr, accept_ranges)) {
+		wget_ranges = true;
+		wget_split(conn);
+	}
+
+	return 0;
+}
+
+/* Note that @rx_bytes of the reply have been received without gaps */
+static void wget_update(struct tcp_stream *tcp, struct wget_conn *conn,
+			u32 rx_bytes)
+{
+	conn->rcvd = rx_bytes - conn->hdr_size;
+	if (conn->end && conn->req + conn->rcvd >= conn->end) {
+		conn->rcvd = conn->end - conn->req;
+		conn->done = true;
+		/* the first part is cut short, so stop the rest of the file */
+		if (!conn->range && conn->end < content_length)
 			tcp_stream_reset(tcp);
-			goto end;
-		}
+	}
+	net_boot_file_size = wget_received();
+}
+
+static void tcp_stream_on_rcv_nxt_update(struct tcp_stream *tcp, u32 rx_bytes)
+{
+	struct wget_conn *conn = tcp->priv;
+	int ret;
 
+	if (conn->hdr_size) {
+		wget_update(tcp, conn, rx_bytes);
+		show_block_marker(tcp->rx_packets);
+		return;
 	}
 
-	net_boot_file_size = rx_bytes - http_hdr_size;
-	memmove(ptr, ptr + http_hdr_size, max_rx_pos + 1 - http_hdr_size);
-	wget_loop_state = NETLOOP_SUCCESS;
+	ret = wget_parse_header(tcp, conn, rx_bytes);
+	if (ret == -EAGAIN)
+		return;
+	if (ret) {
+		wget_fatal = true;
+		if (ret == -EFBIG)
+			tcp_stream_reset(tcp);
+		else
+			tcp_stream_close(tcp);
+		return;
+	}
 
-end:
-	unmap_sysmem(ptr);
+	/* store the start of the body, which came with the header */
+	if (conn->hdr_rx > conn->hdr_size &&
+	    wget_store(conn, 0, conn->hdr + conn->hdr_size,
+		       conn->hdr_rx - conn->hdr_size) < 0) {
+		wget_fatal = true;
+		tcp_stream_reset(tcp);
+		return;
+	}
+	wget_update(tcp, conn, rx_bytes);
 }
 
 static int tcp_stream_rx(struct tcp_stream *tcp, u32 rx_offs, void *buf, int len)
 {
-	if ((max_rx_pos == (u32)(-1)) || (max_rx_pos < rx_offs + len - 1))
-		max_rx_pos = rx_offs + len - 1;
+	struct wget_conn *conn = tcp->priv;
+	u32 skip;
+
+	/* drop the rest of a reply which is not wanted */
+	if (wget_fatal)
+		return len;
+
+	/*
+	 * A block device is written in order, so data after a gap is not
+	 * accepted and the server sends it again
+	 */
+	if (net_sink_active() && rx_offs > tcp_stream_rx_offs(tcp))
+		return 0;
+
+	/*
+	 * Keep the start of the reply apart until the end of the header is
+	 * found. Later data is not accepted until then, so the server sends
+	 * it again.
+	 */
+	if (!conn->hdr_size) {
+		if (rx_offs >= HTTP_MAX_HDR_LEN)
+			return 0;
+		len = min_t(u32, len, HTTP_MAX_HDR_LEN - rx_offs);
+		memcpy(conn->hdr + rx_offs, buf, len);
+		conn->hdr_rx = max(conn->hdr_rx, rx_offs + len);
+		net_rx_copied(len);
+
+		return len;
+	}
+
+	/* a segment sent again may include the end of the header */
+	skip = rx_offs < conn->hdr_size ? conn->hdr_size - rx_offs : 0;
+	if (skip >= len)
+		return len;
 
 	// Avoid overflow
-	if (store_block(buf, rx_offs - http_hdr_size, len) < 0)
+	if (wget_store(conn, rx_offs + skip - conn->hdr_size, buf + skip,
+		       len - skip) < 0) {
+		wget_fatal = true;
 		return -1;
+	}
 
 	return len;
 }
 
 static int tcp_stream_tx(struct tcp_stream *tcp, u32 tx_offs, void *buf, int maxlen)
 {
+	struct wget_conn *conn = tcp->priv;
+	char range[48] = "";
 	int ret;
 	const char *method;
 
@@ -261,8 +613,15 @@ static int tcp_stream_tx(struct tcp_stream *tcp, u32 tx_offs, void *buf, int max
 		break;
 	}
 
-	ret = snprintf(buf, maxlen, "%s %s %s\r\n\r\n",
-		       method, image_url, http_proto);
+	if (conn->range && conn->end)
+		snprintf(range, sizeof(range), "Range: bytes=%lu-%lu\r\n",
+			 conn->req, conn->end - 1);
+	else if (conn->range)
+		snprintf(range, sizeof(range), "Range: bytes=%lu-\r\n",
+			 conn->req);
+
+	ret = snprintf(buf, maxlen, "%s %s %s\r\n%s\r\n",
+		       method, image_url, http_proto, range);
 
 	return ret;
 }
@@ -287,8 +646,6 @@ static int tcp_stream_on_create(struct tcp_stream *tcp)
 
 void wget_start(void)
 {
-	struct tcp_stream *tcp;
-
 	if (!wget_info)
 		wget_info = &default_wget_info;
 
@@ -337,11 +694,16 @@ void wget_start(void)
 
 	memset(net_server_ethaddr, 0, 6);
 
-	max_rx_pos = (u32)(-1);
 	net_boot_file_size = 0;
-	http_hdr_size = 0;
 	wget_tsize_num_hash = 0;
-	wget_loop_state = NETLOOP_FAIL;
+	memset(wget_conns, '\0', sizeof(wget_conns[0]));
+	wget_num_conns = 1;
+	wget_connects = 0;
+	wget_packets = 0;
+	wget_ranges = false;
+	wget_fatal = false;
+	wget_aborting = false;
+	wget_retries = env_get_ulong("wgetretries", 10, WGET_RESUME_COUNT);
 
 	wget_info->status_code = HTTP_STATUS_BAD;
 	wget_info->file_size = 0;
@@ -351,14 +713,8 @@ void wget_start(void)
 
 	server_port = env_get_ulong("httpdstp", 10, SERVER_PORT) & 0xffff;
 	tcp_stream_set_on_create_handler(tcp_stream_on_create);
-	tcp = tcp_stream_connect(web_server_ip, server_port);
-	if (!tcp) {
-		if (!wget_info->silent)
-			printf("No free tcp streams\n");
+	if (wget_connect(&wget_conns[0]))
 		net_set_state(NETLOOP_FAIL);
-		return;
-	}
-	tcp_stream_put(tcp);
 }
 
 int wget_do_request(ulong dst_addr, char *uri)
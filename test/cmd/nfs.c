@@ -0,0 +1,315 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the nfs command, using a stand-in NFSv3 server
+ */
+
+#include <command.h>
+#include <dm.h>
+#include <env.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <net.h>
+#include <asm/eth.h>
+#include <test/cmd.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define PROG_PORTMAP		100000
+#define PROG_NFS		100003
+#define PROG_MOUNT		100005
+
+#define PORTMAP_GETPORT		3
+#define MOUNT_ADDENTRY		1
+#define NFS3PROC_LOOKUP		3
+#define NFS3PROC_READ		6
+#define NFS3PROC_FSINFO		19
+
+#define NFS_TEST_ADDR		0x20000
+#define NFS_TEST_SIZE		0x6000
+#define NFS_TEST_RTMAX		512
+#define NFS_TEST_RTT		2	/* simulated round-trip time in ms */
+#define NFS_TEST_QUEUE		256
+#define NFS_TEST_FH_SIZE	32
+
+/**
+ * struct nfs_test_server - state of the stand-in NFS server
+ *
+ * The server replies at once, but keeps a simulated clock: each reply arrives
+ * NFS_TEST_RTT after U-Boot sent its request, which is when U-Boot finished
+ * handling the packet that caused the request.
+ *
+ * @data: Contents of the file being served
+ * @reads: Number of READ requests received
+ * @max_count: Largest number of bytes asked for by a READ
+ * @dropped: Number of replies dropped since the receive queue was full
+ * @queued: Number of packets queued for U-Boot so far
+ * @clock: Simulated time at which U-Boot sent the last request, in ms
+ * @arrival: Simulated time at which each queued packet arrives, in ms
+ */
+struct nfs_test_server {
+	const u8 *data;
+	uint reads;
+	uint max_count;
+	uint dropped;
+	uint queued;
+	ulong clock;
+	ulong arrival[NFS_TEST_QUEUE];
+};
+
+/* Skip the credential and verifier of an RPC call */
+static const u32 *nfs_test_skip_auth(const u32 *p)
+{
+	int i;
+
+	for (i = 0; i < 2; i++)
+		p += 2 + DIV_ROUND_UP(ntohl(p[1]), 4);
+
+	return p;
+}
+
+/* Build the result of a call in @res, returning the number of words */
+static int nfs_test_call(struct nfs_test_server *srv, uint prog, uint proc,
+			 const u32 *args, u32 *res)
+{
+	uint offset, count, eof;
+	u32 *p = res;
+
+	switch (prog) {
+	case PROG_PORTMAP:
+		if (proc != PORTMAP_GETPORT)
+			return -EINVAL;
+		*p++ = htonl(ntohl(args[0]) == PROG_MOUNT ? 635 : 2049);
+		break;
+	case PROG_MOUNT:
+		*p++ = 0;		/* status */
+		if (proc == MOUNT_ADDENTRY) {
+			*p++ = htonl(NFS_TEST_FH_SIZE);
+			memset(p, 'f', NFS_TEST_FH_SIZE);
+			p += NFS_TEST_FH_SIZE / 4;
+			*p++ = 0;	/* no auth flavours */
+		}
+		break;
+	case PROG_NFS:
+		*p++ = 0;		/* status */
+		switch (proc) {
+		case NFS3PROC_LOOKUP:
+			*p++ = htonl(NFS_TEST_FH_SIZE);
+			memset(p, 'f', NFS_TEST_FH_SIZE);
+			p += NFS_TEST_FH_SIZE / 4;
+			*p++ = 0;	/* no object attributes */
+			*p++ = 0;	/* no directory attributes */
+			break;
+		case NFS3PROC_FSINFO:
+			*p++ = 0;	/* no attributes */
+			*p++ = htonl(NFS_TEST_RTMAX);	/* rtmax */
+			*p++ = htonl(NFS_TEST_RTMAX);	/* rtpref */
+			*p++ = htonl(4);		/* rtmult */
+			memset(p, '\0', 10 * sizeof(u32));
+			p += 10;
+			break;
+		case NFS3PROC_READ:
+			/* skip the file handle and top half of the offset */
+			args += 2 + DIV_ROUND_UP(ntohl(args[0]), 4);
+			offset = ntohl(args[0]);
+			count = ntohl(args[1]);
+			srv->reads++;
+			srv->max_count = max(srv->max_count, count);
+			count = min(count, (uint)NFS_TEST_RTMAX);
+			if (offset >= NFS_TEST_SIZE)
+				count = 0;
+			count = min(count, NFS_TEST_SIZE - offset);
+			eof = offset + count >= NFS_TEST_SIZE;
+
+			*p++ = 0;	/* no attributes */
+			*p++ = htonl(count);
+			*p++ = htonl(eof);
+			*p++ = htonl(count);
+			memcpy(p, srv->data + offset, count);
+			p += DIV_ROUND_UP(count, 4);
+			break;
+		default:
+			return -EINVAL;
+		}
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return p - res;
+}
+
+static int nfs_test_rpc(struct udevice *dev, struct nfs_test_server *srv,
+			void *packet, unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct ethernet_hdr *eth_reply;
+	struct ip_udp_hdr *ip_reply;
+	u32 call[128], reply[6 + 32 + NFS_TEST_RTMAX / 4];
+	uint proc, prog;
+	int size, n;
+
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return -EPROTONOSUPPORT;
+
+	/* copy the call, so that it is aligned */
+	size = min_t(int, len - ETHER_HDR_SIZE - IP_UDP_HDR_SIZE, sizeof(call));
+	memcpy(call, (void *)ip + IP_UDP_HDR_SIZE, size);
+	prog = ntohl(call[3]);
+	proc = ntohl(call[5]);
+
+	/* xid, reply, accepted, null verifier, success */
+	reply[0] = call[0];
+	reply[1] = htonl(1);
+	memset(&reply[2], '\0', 4 * sizeof(u32));
+	size = nfs_test_call(srv, prog, proc, nfs_test_skip_auth(&call[6]),
+			     &reply[6]);
+	if (size < 0)
+		return size;
+	size = (6 + size) * sizeof(u32);
+
+	if (priv->recv_packets >= PKTBUFSRX) {
+		srv->dropped++;
+		return 0;
+	}
+	n = priv->recv_packets;
+	eth_reply = (void *)priv->recv_packet_buffer[n];
+	memcpy(eth_reply->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_reply->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_reply->et_protlen = htons(PROT_IP);
+	ip_reply = (void *)eth_reply + ETHER_HDR_SIZE;
+	memcpy((void *)ip_reply + IP_UDP_HDR_SIZE, reply, size);
+	net_set_ip_header((uchar *)ip_reply, net_read_ip(&ip->ip_src),
+			  net_read_ip(&ip->ip_dst), IP_UDP_HDR_SIZE + size,
+			  IPPROTO_UDP);
+	ip_reply->udp_src = ip->udp_dst;
+	ip_reply->udp_dst = ip->udp_src;
+	ip_reply->udp_len = htons(UDP_HDR_SIZE + size);
+	ip_reply->udp_xsum = 0;
+	priv->recv_packet_length[n] = ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + size;
+	priv->recv_packets++;
+
+	/*
+	 * Swap every other READ reply with the one before, if U-Boot has not
+	 * started on that yet, so that replies arrive out of order
+	 */
+	if (prog == PROG_NFS && proc == NFS3PROC_READ && n >= 2 &&
+	    (srv->reads & 1)) {
+		uchar tmp[PKTSIZE_ALIGN];
+		int tmp_len = priv->recv_packet_length[n];
+
+		memcpy(tmp, priv->recv_packet_buffer[n], tmp_len);
+		memcpy(priv->recv_packet_buffer[n],
+		       priv->recv_packet_buffer[n - 1],
+		       priv->recv_packet_length[n - 1]);
+		priv->recv_packet_length[n] = priv->recv_packet_length[n - 1];
+		memcpy(priv->recv_packet_buffer[n - 1], tmp, tmp_len);
+		priv->recv_packet_length[n - 1] = tmp_len;
+	}
+
+	return 0;
+}
+
+static int sb_nfs_handler(struct udevice *dev, void *packet,
+			  unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct nfs_test_server *srv = priv->priv;
+	int before = priv->recv_packets;
+	int ret;
+
+	/*
+	 * The packet being handled by U-Boot stays at the start of the queue
+	 * until it is finished with, so that is what caused this request
+	 */
+	if (before)
+		srv->clock = max(srv->clock,
+				 srv->arrival[(srv->queued - before) %
+					      NFS_TEST_QUEUE]);
+
+	ret = sandbox_eth_arp_req_to_reply(dev, packet, len);
+	if (ret == -EAGAIN)
+		ret = nfs_test_rpc(dev, srv, packet, len);
+
+	for (; before < priv->recv_packets; before++)
+		srv->arrival[srv->queued++ % NFS_TEST_QUEUE] =
+			srv->clock + NFS_TEST_RTT;
+
+	return ret;
+}
+
+/* Load the file with a window size, returning the simulated time taken */
+static int nfs_test_load(struct unit_test_state *uts,
+			 struct nfs_test_server *srv, const char *window,
+			 ulong *timep)
+{
+	const u8 *data = srv->data;
+	void *buf;
+
+	memset(srv, '\0', sizeof(*srv));
+	srv->data = data;
+	buf = map_sysmem(NFS_TEST_ADDR, NFS_TEST_SIZE);
+	memset(buf, '\0', NFS_TEST_SIZE);
+
+	env_set("nfswindowsize", window);
+	ut_assertok(run_command("nfs 20000 1.1.2.2:/export/test.bin", 0));
+	ut_assert_skip_to_line("Bytes transferred = 24576 (6000 hex)");
+
+	ut_asserteq(NFS_TEST_SIZE, env_get_hex("filesize", 0));
+	ut_asserteq_mem(data, buf, NFS_TEST_SIZE);
+	unmap_sysmem(buf);
+
+	/* the reads are limited to the server's rtmax */
+	ut_asserteq(NFS_TEST_RTMAX, srv->max_count);
+	ut_assert(srv->reads >= NFS_TEST_SIZE / NFS_TEST_RTMAX);
+	ut_asserteq(0, srv->dropped);
+	*timep = srv->arrival[(srv->queued - 1) % NFS_TEST_QUEUE];
+
+	/* each byte of the file is copied once, straight to the load address */
+	ut_asserteq(NFS_TEST_SIZE, net_rx_stats.copied);
+	ut_assert(net_rx_stats.bytes > NFS_TEST_SIZE);
+	ut_assertok(run_command("net stats", 0));
+	ut_assert_skip_to_linen("  rx_copied: %d (0.", NFS_TEST_SIZE);
+
+	return 0;
+}
+
+static int net_test_nfs(struct unit_test_state *uts)
+{
+	char *prev_ethact = env_get("ethact");
+	char *prev_ethrotate = env_get("ethrotate");
+	struct nfs_test_server srv;
+	ulong single, pipelined;
+	u8 *data;
+	int i;
+
+	data = malloc(NFS_TEST_SIZE);
+	ut_assertnonnull(data);
+	for (i = 0; i < NFS_TEST_SIZE; i++)
+		data[i] = i * 7 + (i >> 9);
+	srv.data = data;
+
+	sandbox_eth_set_tx_handler(0, sb_nfs_handler);
+	sandbox_eth_set_priv(0, &srv);
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+
+	/* one READ at a time, so each needs a round trip */
+	ut_assertok(nfs_test_load(uts, &srv, "1", &single));
+
+	/* three READs in flight, with replies arriving out of order */
+	ut_assertok(nfs_test_load(uts, &srv, "3", &pipelined));
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set("nfswindowsize", NULL);
+	env_set("ethact", prev_ethact);
+	env_set("ethrotate", prev_ethrotate);
+	free(data);
+
+	/* with a window of three, the round trips should mostly overlap */
+	ut_assert(pipelined * 2 < single);
+
+	return 0;
+}
+CMD_TEST(net_test_nfs, UTF_CONSOLE);
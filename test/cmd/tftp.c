@@ -0,0 +1,358 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for TFTP, using a stand-in TFTP server which loses blocks
+ */
+
+#include <blk.h>
+#include <command.h>
+#include <dm.h>
+#include <env.h>
+#include <hexdump.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <net.h>
+#include <part.h>
+#include <asm/eth.h>
+#include <test/cmd.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include <u-boot/sha256.h>
+
+#define TFTP_RRQ		1
+#define TFTP_DATA		3
+#define TFTP_ACK		4
+#define TFTP_OACK		6
+
+#define TFTP_TEST_PORT		69
+#define TFTP_TEST_TID		3000
+#define TFTP_TEST_ADDR		0x20000
+#define TFTP_TEST_BLKSIZE	512
+#define TFTP_TEST_BLOCKS	17
+#define TFTP_TEST_SIZE		((TFTP_TEST_BLOCKS - 1) * TFTP_TEST_BLKSIZE + 100)
+/* the receive queue holds four packets, one of which U-Boot is handling */
+#define TFTP_TEST_MAX_WINDOW	3
+#define TFTP_TEST_MAX_DROP	2
+
+/**
+ * struct tftp_test_server - state of the stand-in TFTP server
+ *
+ * @data: Contents of the file being served
+ * @window: Window size agreed with U-Boot
+ * @asked: Window size U-Boot asked for, 1 if it did not use the option
+ * @sent: Number of data blocks sent, including those dropped
+ * @drop: Blocks to drop the first time they are sent, 0 for none
+ */
+struct tftp_test_server {
+	const u8 *data;
+	int window;
+	int asked;
+	int sent;
+	int drop[TFTP_TEST_MAX_DROP];
+};
+
+/* Queue a UDP packet from the server, in reply to @packet */
+static int tftp_test_reply(struct udevice *dev, void *packet, const void *data,
+			   int size)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct ethernet_hdr *eth_reply;
+	struct ip_udp_hdr *ip_reply;
+
+	if (priv->recv_packets >= PKTBUFSRX)
+		return -ENOSPC;
+	eth_reply = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_reply->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_reply->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_reply->et_protlen = htons(PROT_IP);
+	ip_reply = (void *)eth_reply + ETHER_HDR_SIZE;
+	memcpy((void *)ip_reply + IP_UDP_HDR_SIZE, data, size);
+	net_set_ip_header((uchar *)ip_reply, net_read_ip(&ip->ip_src),
+			  net_read_ip(&ip->ip_dst), IP_UDP_HDR_SIZE + size,
+			  IPPROTO_UDP);
+	ip_reply->udp_src = htons(TFTP_TEST_TID);
+	ip_reply->udp_dst = ip->udp_src;
+	ip_reply->udp_len = htons(UDP_HDR_SIZE + size);
+	ip_reply->udp_xsum = 0;
+	priv->recv_packet_length[priv->recv_packets] = ETHER_HDR_SIZE +
+		IP_UDP_HDR_SIZE + size;
+	priv->recv_packets++;
+
+	return 0;
+}
+
+/* Reply to a read request with the options the server supports */
+static int tftp_test_rrq(struct udevice *dev, struct tftp_test_server *srv,
+			 void *packet, const char *req, int len)
+{
+	char oack[128], *p = oack;
+	const char *opt, *val;
+
+	*(__be16 *)p = htons(TFTP_OACK);
+	p += 2;
+	srv->window = 1;
+
+	/* skip the opcode, filename and mode */
+	opt = req + 2;
+	opt += strlen(opt) + 1;
+	opt += strlen(opt) + 1;
+	for (; opt < req + len; opt = val + strlen(val) + 1) {
+		val = opt + strlen(opt) + 1;
+		if (!strcmp(opt, "blksize")) {
+			p += sprintf(p, "blksize%c%d%c", 0, TFTP_TEST_BLKSIZE,
+				     0);
+		} else if (!strcmp(opt, "timeout")) {
+			p += sprintf(p, "timeout%c%s%c", 0, val, 0);
+		} else if (!strcmp(opt, "windowsize")) {
+			srv->window = min_t(int, dectoul(val, NULL),
+					    TFTP_TEST_MAX_WINDOW);
+			p += sprintf(p, "windowsize%c%d%c", 0, srv->window, 0);
+		}
+	}
+	srv->asked = srv->window;
+
+	return tftp_test_reply(dev, packet, oack, p - oack);
+}
+
+/* Send the window of blocks after @block, dropping some */
+static int tftp_test_ack(struct udevice *dev, struct tftp_test_server *srv,
+			 void *packet, int block)
+{
+	u8 buf[4 + TFTP_TEST_BLKSIZE];
+	int i, last, size, ret;
+
+	last = min(block + srv->window, TFTP_TEST_BLOCKS);
+	for (block++; block <= last; block++) {
+		srv->sent++;
+		for (i = 0; i < TFTP_TEST_MAX_DROP; i++) {
+			if (srv->drop[i] == block)
+				break;
+		}
+		if (i < TFTP_TEST_MAX_DROP) {
+			srv->drop[i] = 0;
+			continue;
+		}
+
+		size = min(TFTP_TEST_SIZE - (block - 1) * TFTP_TEST_BLKSIZE,
+			   TFTP_TEST_BLKSIZE);
+		*(__be16 *)buf = htons(TFTP_DATA);
+		*(__be16 *)(buf + 2) = htons(block);
+		memcpy(buf + 4, srv->data + (block - 1) * TFTP_TEST_BLKSIZE,
+		       size);
+		ret = tftp_test_reply(dev, packet, buf, 4 + size);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int sb_tftp_handler(struct udevice *dev, void *packet,
+			   unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct tftp_test_server *srv = priv->priv;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	char req[256];
+	int size, ret;
+
+	ret = sandbox_eth_arp_req_to_reply(dev, packet, len);
+	if (ret != -EAGAIN)
+		return ret;
+
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return -EPROTONOSUPPORT;
+
+	/* copy the request, so that it is aligned and terminated */
+	size = min_t(int, len - ETHER_HDR_SIZE - IP_UDP_HDR_SIZE,
+		     sizeof(req) - 1);
+	memcpy(req, (void *)ip + IP_UDP_HDR_SIZE, size);
+	req[size] = '\0';
+
+	switch (ntohs(*(__be16 *)req)) {
+	case TFTP_RRQ:
+		if (ntohs(ip->udp_dst) != TFTP_TEST_PORT)
+			return -EINVAL;
+		return tftp_test_rrq(dev, srv, packet, req, size);
+	case TFTP_ACK:
+		if (ntohs(ip->udp_dst) != TFTP_TEST_TID)
+			return -EINVAL;
+		return tftp_test_ack(dev, srv, packet,
+				     ntohs(*(__be16 *)(req + 2)));
+	}
+
+	return -EINVAL;
+}
+
+/*
+ * Load the file, checking that it arrives intact and that the window summary
+ * is @summary, if not NULL
+ */
+static int tftp_test_load(struct unit_test_state *uts,
+			  struct tftp_test_server *srv, const char *summary)
+{
+	void *buf;
+
+	srv->sent = 0;
+	buf = map_sysmem(TFTP_TEST_ADDR, TFTP_TEST_SIZE);
+	memset(buf, '\0', TFTP_TEST_SIZE);
+
+	ut_assertok(run_command("tftpboot 20000 1.1.2.2:test.bin", 0));
+	if (summary) {
+		ut_assert_skip_to_line(summary);
+		ut_assert_nextline("done");
+	}
+	ut_assert_skip_to_line("Bytes transferred = 8292 (2064 hex)");
+
+	ut_asserteq(TFTP_TEST_SIZE, env_get_hex("filesize", 0));
+	ut_asserteq_mem(srv->data, buf, TFTP_TEST_SIZE);
+	unmap_sysmem(buf);
+
+	return 0;
+}
+
+static int net_test_tftp_window(struct unit_test_state *uts)
+{
+	char *prev_ethact = env_get("ethact");
+	char *prev_ethrotate = env_get("ethrotate");
+	struct tftp_test_server srv;
+	u8 *data;
+	int i;
+
+	memset(&srv, '\0', sizeof(srv));
+	data = malloc(TFTP_TEST_SIZE);
+	ut_assertnonnull(data);
+	for (i = 0; i < TFTP_TEST_SIZE; i++)
+		data[i] = i * 7 + (i >> 9);
+	srv.data = data;
+
+	sandbox_eth_set_tx_handler(0, sb_tftp_handler);
+	sandbox_eth_set_priv(0, &srv);
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+
+	/* one block at a time */
+	env_set("tftpwindowsize", "1");
+	ut_assertok(tftp_test_load(uts, &srv, NULL));
+	ut_asserteq(1, srv.asked);
+	ut_asserteq(TFTP_TEST_BLOCKS, srv.sent);
+
+	/*
+	 * Lose the last block of the first window, which only a timer can
+	 * notice, then a block in the middle of a later window, which the next
+	 * block shows up
+	 */
+	env_set("tftpwindowsize", "3");
+	srv.drop[0] = 3;
+	srv.drop[1] = 7;
+	ut_assertok(tftp_test_load(uts, &srv,
+				   "\t Window size 3, 2 retransmit requests"));
+	ut_asserteq(3, srv.asked);
+	ut_assert(srv.sent > TFTP_TEST_BLOCKS);
+
+	/* the loss halves the window, then it grows back without loss */
+	ut_assertok(tftp_test_load(uts, &srv, NULL));
+	ut_asserteq(1, srv.asked);
+	ut_assertok(tftp_test_load(uts, &srv,
+				   "\t Window size 2, 0 retransmit requests"));
+	ut_asserteq(2, srv.asked);
+	ut_assertok(tftp_test_load(uts, &srv,
+				   "\t Window size 3, 0 retransmit requests"));
+	ut_asserteq(3, srv.asked);
+	ut_asserteq(TFTP_TEST_BLOCKS, srv.sent);
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set("tftpwindowsize", NULL);
+	env_set("ethact", prev_ethact);
+	env_set("ethrotate", prev_ethrotate);
+	free(data);
+
+	return 0;
+}
+CMD_TEST(net_test_tftp_window, UTF_CONSOLE);
+
+/* Write the file to a block device, with its digest checked */
+static int net_test_tftp_sink(struct unit_test_state *uts)
+{
+	char *prev_ethact = env_get("ethact");
+	char *prev_ethrotate = env_get("ethrotate");
+	char hex[SHA256_SUM_LEN * 2 + 1];
+	u8 digest[SHA256_SUM_LEN];
+	struct tftp_test_server srv;
+	struct blk_desc *desc;
+	u8 *data, *buf, *orig;
+	int blocks, i;
+
+	ut_assertok(blk_get_device_by_str("mmc", "0", &desc));
+	blocks = DIV_ROUND_UP(TFTP_TEST_SIZE, desc->blksz);
+
+	memset(&srv, '\0', sizeof(srv));
+	data = malloc(TFTP_TEST_SIZE);
+	ut_assertnonnull(data);
+	for (i = 0; i < TFTP_TEST_SIZE; i++)
+		data[i] = i * 7 + (i >> 9);
+	srv.data = data;
+	sha256_csum_wd(data, TFTP_TEST_SIZE, digest, CHUNKSZ_SHA256);
+	*bin2hex(hex, digest, SHA256_SUM_LEN) = '\0';
+
+	/* the end of the last block must be kept */
+	buf = malloc(blocks * desc->blksz);
+	orig = malloc(blocks * desc->blksz);
+	ut_assertnonnull(buf);
+	ut_assertnonnull(orig);
+	ut_asserteq(blocks, blk_dread(desc, 0, blocks, orig));
+	memset(buf, 0xaa, blocks * desc->blksz);
+	ut_asserteq(blocks, blk_dwrite(desc, 0, blocks, buf));
+
+	sandbox_eth_set_tx_handler(0, sb_tftp_handler);
+	sandbox_eth_set_priv(0, &srv);
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+
+	ut_asserteq(1, run_command("net sink mmc 0 1234", 0));
+	ut_assert_nextline("Invalid SHA-256 digest");
+	ut_assert_console_end();
+
+	ut_assertok(run_commandf("net sink mmc 0 %s", hex));
+	ut_assertok(run_command("net sink", 0));
+	ut_assert_nextline("Next download is written to mmc 0, SHA-256 digest checked");
+	ut_assert_console_end();
+
+	ut_assertok(run_command("tftpboot 20000 1.1.2.2:test.bin", 0));
+	ut_assert_skip_to_line("Writing to mmc 0");
+	ut_assert_skip_to_line("Written 8292 bytes to mmc 0");
+	ut_assert_nextline("sha256 ==> %s", hex);
+	ut_assert_nextline("Digest OK");
+	ut_assert_nextline("Bytes transferred = 8292 (2064 hex)");
+	ut_asserteq(TFTP_TEST_SIZE, env_get_hex("filesize", 0));
+
+	memset(buf, '\0', blocks * desc->blksz);
+	ut_asserteq(blocks, blk_dread(desc, 0, blocks, buf));
+	ut_asserteq_mem(data, buf, TFTP_TEST_SIZE);
+	for (i = TFTP_TEST_SIZE; i < blocks * desc->blksz; i++)
+		ut_asserteq(0xaa, buf[i]);
+
+	/* the sink is only used once */
+	ut_assertok(run_command("net sink", 0));
+	ut_assert_nextline("Downloads are written to memory");
+	ut_assert_console_end();
+
+	/* a digest which does not match fails the download */
+	ut_assertok(run_commandf("net sink mmc 0 %064x", 0));
+	ut_asserteq(1, run_command("tftpboot 20000 1.1.2.2:test.bin", 0));
+	ut_assert_skip_to_line("sha256 ==> %s", hex);
+	ut_assert_nextline("Digest mismatch, expected %064x", 0);
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set("ethact", prev_ethact);
+	env_set("ethrotate", prev_ethrotate);
+	ut_asserteq(blocks, blk_dwrite(desc, 0, blocks, orig));
+	free(orig);
+	free(buf);
+	free(data);
+
+	return 0;
+}
+CMD_TEST(net_test_tftp_sink, UTF_CONSOLE);
@@ -12,6 +12,7 @@
 #include <fdtdec.h>
 #include <log.h>
 #include <malloc.h>
+#include <mapmem.h>
 #include <net.h>
 #include <net/tcp.h>
 #include <net/wget.h>
@@ -73,7 +74,7 @@ static int sb_syn_handler(struct udevice *dev, void *packet,
 	tcp_send->tcp_ack = htonl(priv->irs + 1);
 	tcp_send->tcp_hlen = SHIFT_TO_TCPHDRLEN_FIELD(LEN_B_TO_DW(TCP_HDR_SIZE));
 	tcp_send->tcp_flags = TCP_SYN | TCP_ACK;
-	tcp_send->tcp_win = htons(PKTBUFSRX * TCP_MSS >> TCP_SCALE);
+	tcp_send->tcp_win = htons(PKTBUFSRX * TCP_MSS);
 	tcp_send->tcp_xsum = 0;
 	tcp_send->tcp_ugr = 0;
 	tcp_send->tcp_xsum = tcp_set_pseudo_header((uchar *)tcp_send,
@@ -166,7 +167,7 @@ static int sb_ack_handler(struct udevice *dev, void *packet,
 	}
 
 	tcp_send->tcp_hlen = SHIFT_TO_TCPHDRLEN_FIELD(LEN_B_TO_DW(TCP_HDR_SIZE));
-	tcp_send->tcp_win = htons(PKTBUFSRX * TCP_MSS >> TCP_SCALE);
+	tcp_send->tcp_win = htons(PKTBUFSRX * TCP_MSS);
 	tcp_send->tcp_xsum = 0;
 	tcp_send->tcp_ugr = 0;
 	pkt_len = IP_TCP_HDR_SIZE + payload_len;
@@ -242,6 +243,356 @@ static int net_test_wget(struct unit_test_state *uts)
 }
 CMD_TEST(net_test_wget, UTF_CONSOLE);
 
+#define WGET_TEST_ADDR		0x20000
+#define WGET_TEST_SIZE		0x30000
+#define WGET_TEST_MSS		1024
+#define WGET_TEST_CONNS		8
+
+/**
+ * struct wget_test_conn - a connection to the stand-in HTTP server
+ *
+ * @port: Port used by U-Boot
+ * @iss: Initial sequence number of the server
+ * @rcv_nxt: Next sequence number expected from U-Boot
+ * @hdr: Header of the reply
+ * @hdr_len: Length of @hdr, 0 until the request has been received
+ * @range: true if the request asked for a range
+ * @start: Offset in the file of the first byte sent
+ * @len: Number of bytes of the file sent in the reply
+ * @sent: Number of bytes of the reply sent so far
+ * @fin: true once the end of the reply has been sent
+ * @closed: true once the connection is closed or reset
+ */
+struct wget_test_conn {
+	u16 port;
+	u32 iss;
+	u32 rcv_nxt;
+	char hdr[256];
+	int hdr_len;
+	bool range;
+	ulong start;
+	ulong len;
+	ulong sent;
+	bool fin;
+	bool closed;
+};
+
+/**
+ * struct wget_test_server - state of the stand-in HTTP server
+ *
+ * The server sends one segment at a time on each connection, as soon as the
+ * previous one is acknowledged, so that the receive queue cannot overflow.
+ *
+ * @data: Contents of the file being served
+ * @reset_conn: Connection to reset part way through its reply
+ * @reset_at: Number of bytes of the reply to send before resetting
+ * @conns: Number of connections opened by U-Boot
+ * @packets: Number of TCP packets sent by the server
+ * @dropped: Number of packets dropped since the receive queue was full
+ * @conn: Connections, in the order in which they were opened
+ */
+struct wget_test_server {
+	const u8 *data;
+	int reset_conn;
+	ulong reset_at;
+	int conns;
+	uint packets;
+	uint dropped;
+	struct wget_test_conn conn[WGET_TEST_CONNS];
+};
+
+/* Queue a TCP packet from the server, in reply to @packet */
+static int wget_test_send(struct udevice *dev, struct wget_test_server *srv,
+			  void *packet, struct wget_test_conn *conn, u8 flags,
+			  u32 seq, const void *data, int size)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ip_tcp_hdr *tcp = packet + ETHER_HDR_SIZE;
+	struct ethernet_hdr *eth_send;
+	struct ip_tcp_hdr *tcp_send;
+	int pkt_len = IP_TCP_HDR_SIZE + size;
+
+	if (priv->recv_packets >= PKTBUFSRX) {
+		srv->dropped++;
+		return 0;
+	}
+
+	eth_send = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_send->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_send->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_send->et_protlen = htons(PROT_IP);
+	tcp_send = (void *)eth_send + ETHER_HDR_SIZE;
+	tcp_send->tcp_src = tcp->tcp_dst;
+	tcp_send->tcp_dst = tcp->tcp_src;
+	tcp_send->tcp_seq = htonl(conn->iss + seq);
+	tcp_send->tcp_ack = htonl(conn->rcv_nxt);
+	tcp_send->tcp_hlen = SHIFT_TO_TCPHDRLEN_FIELD(LEN_B_TO_DW(TCP_HDR_SIZE));
+	tcp_send->tcp_flags = flags;
+	tcp_send->tcp_win = htons(0xffff);
+	tcp_send->tcp_ugr = 0;
+	memcpy((void *)tcp_send + IP_TCP_HDR_SIZE, data, size);
+	tcp_send->tcp_xsum = 0;
+	tcp_send->tcp_xsum = tcp_set_pseudo_header((uchar *)tcp_send,
+						   tcp->ip_src, tcp->ip_dst,
+						   pkt_len - IP_HDR_SIZE,
+						   pkt_len);
+	net_set_ip_header((uchar *)tcp_send, tcp->ip_src, tcp->ip_dst,
+			  pkt_len, IPPROTO_TCP);
+
+	priv->recv_packet_length[priv->recv_packets] = ETHER_HDR_SIZE + pkt_len;
+	priv->recv_packets++;
+	srv->packets++;
+
+	return 0;
+}
+
+/* Set up the reply to a request, honouring a Range header */
+static void wget_test_request(struct wget_test_conn *conn, const char *req)
+{
+	const char *pos;
+	char *tail;
+	ulong last;
+
+	conn->start = 0;
+	last = WGET_TEST_SIZE - 1;
+	pos = strstr(req, "Range: bytes=");
+	if (pos) {
+		conn->range = true;
+		conn->start = simple_strtoul(pos + 13, &tail, 10);
+		if (*tail == '-' && tail[1] != '\r')
+			last = simple_strtoul(tail + 1, NULL, 10);
+	}
+	conn->len = last + 1 - conn->start;
+
+	if (conn->range)
+		conn->hdr_len = sprintf(conn->hdr,
+			"HTTP/1.1 206 Partial Content\r\n"
+			"Content-Range: bytes %lu-%lu/%d\r\n"
+			"Content-Length: %lu\r\n"
+			"\r\n", conn->start, last, WGET_TEST_SIZE, conn->len);
+	else
+		conn->hdr_len = sprintf(conn->hdr,
+			"HTTP/1.1 200 OK\r\n"
+			"Accept-Ranges: bytes\r\n"
+			"Content-Length: %d\r\n"
+			"\r\n", WGET_TEST_SIZE);
+}
+
+/* Send the next segment of the reply, or the end of it */
+static int wget_test_next(struct udevice *dev, struct wget_test_server *srv,
+			  void *packet, struct wget_test_conn *conn)
+{
+	ulong total = conn->hdr_len + conn->len;
+	u8 buf[WGET_TEST_MSS];
+	int i, size;
+
+	if (conn->sent == total) {
+		if (conn->fin)
+			return 0;
+		conn->fin = true;
+		return wget_test_send(dev, srv, packet, conn, TCP_ACK | TCP_FIN,
+				      1 + total, NULL, 0);
+	}
+
+	if (conn == &srv->conn[srv->reset_conn] &&
+	    conn->sent >= srv->reset_at) {
+		conn->closed = true;
+		return wget_test_send(dev, srv, packet, conn, TCP_RST,
+				      1 + conn->sent, NULL, 0);
+	}
+
+	size = min_t(ulong, total - conn->sent, WGET_TEST_MSS);
+	for (i = 0; i < size; i++) {
+		ulong pos = conn->sent + i;
+
+		buf[i] = pos < conn->hdr_len ? conn->hdr[pos] :
+			srv->data[conn->start + pos - conn->hdr_len];
+	}
+	conn->sent += size;
+
+	return wget_test_send(dev, srv, packet, conn, TCP_ACK, 1 + conn->sent -
+			      size, buf, size);
+}
+
+static int wget_test_tcp(struct udevice *dev, struct wget_test_server *srv,
+			 void *packet)
+{
+	struct ip_tcp_hdr *tcp = packet + ETHER_HDR_SIZE;
+	struct wget_test_conn *conn;
+	char req[256];
+	u32 seq, ack;
+	int i, len, size;
+
+	seq = ntohl(tcp->tcp_seq);
+	ack = ntohl(tcp->tcp_ack);
+	len = ntohs(tcp->ip_len) - IP_HDR_SIZE -
+		GET_TCP_HDR_LEN_IN_BYTES(tcp->tcp_hlen);
+
+	if (tcp->tcp_flags == TCP_SYN) {
+		if (srv->conns == WGET_TEST_CONNS)
+			return -ENOSPC;
+		conn = &srv->conn[srv->conns++];
+		conn->port = ntohs(tcp->tcp_src);
+		conn->iss = srv->conns << 24;
+		conn->rcv_nxt = seq + 1;
+
+		return wget_test_send(dev, srv, packet, conn,
+				      TCP_SYN | TCP_ACK, 0, NULL, 0);
+	}
+
+	for (i = 0, conn = NULL; i < srv->conns; i++) {
+		if (srv->conn[i].port == ntohs(tcp->tcp_src) &&
+		    !srv->conn[i].closed)
+			conn = &srv->conn[i];
+	}
+	if (!conn)
+		return 0;
+
+	if (tcp->tcp_flags & TCP_RST) {
+		conn->closed = true;
+		return 0;
+	}
+
+	if (len && !conn->hdr_len) {
+		size = min_t(int, len, sizeof(req) - 1);
+		memcpy(req, (void *)tcp + ntohs(tcp->ip_len) - len, size);
+		req[size] = '\0';
+		wget_test_request(conn, req);
+		conn->rcv_nxt = seq + len;
+	}
+
+	if (tcp->tcp_flags & TCP_FIN) {
+		conn->closed = true;
+		conn->rcv_nxt = seq + len + 1;
+		return wget_test_send(dev, srv, packet, conn, TCP_ACK,
+				      2 + conn->hdr_len + conn->len, NULL, 0);
+	}
+
+	/* send more once everything sent has been acknowledged */
+	if (!conn->hdr_len || ack != conn->iss + 1 + conn->sent)
+		return 0;
+
+	return wget_test_next(dev, srv, packet, conn);
+}
+
+static int sb_range_handler(struct udevice *dev, void *packet,
+			    unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ip_tcp_hdr *tcp = packet + ETHER_HDR_SIZE;
+	int ret;
+
+	ret = sandbox_eth_arp_req_to_reply(dev, packet, len);
+	if (ret != -EAGAIN)
+		return ret;
+
+	if (ntohs(eth->et_protlen) != PROT_IP || tcp->ip_p != IPPROTO_TCP)
+		return -EPROTONOSUPPORT;
+
+	return wget_test_tcp(dev, priv->priv, packet);
+}
+
+/*
+ * Fetch the file, checking that it arrives intact over @conns connections and
+ * that the reset connection is resumed
+ */
+static int wget_test_load(struct unit_test_state *uts,
+			  struct wget_test_server *srv, int conns)
+{
+	const u8 *data = srv->data;
+	int reset_conn = srv->reset_conn;
+	ulong reset_at = srv->reset_at;
+	struct wget_test_conn *conn;
+	void *buf;
+
+	memset(srv, '\0', sizeof(*srv));
+	srv->data = data;
+	srv->reset_conn = reset_conn;
+	srv->reset_at = reset_at;
+	buf = map_sysmem(WGET_TEST_ADDR, WGET_TEST_SIZE);
+	memset(buf, '\0', WGET_TEST_SIZE);
+
+	ut_assertok(run_command("wget 20000 1.1.2.2:/test.bin", 0));
+	conn = &srv->conn[reset_conn];
+	ut_assert_skip_to_line("wget: resuming from byte %lu",
+			       conn->start + conn->sent - conn->hdr_len);
+	ut_assert_skip_to_line("Packets received %u on %d connections, Transfer Successful",
+			       srv->packets, conns);
+	ut_assert_nextline("Bytes transferred = 196608 (30000 hex)");
+
+	ut_asserteq(conns, srv->conns);
+	ut_asserteq(0, srv->dropped);
+	ut_asserteq(WGET_TEST_SIZE, env_get_hex("filesize", 0));
+	ut_asserteq_mem(data, buf, WGET_TEST_SIZE);
+	unmap_sysmem(buf);
+
+	return 0;
+}
+
+static int net_test_wget_range(struct unit_test_state *uts)
+{
+	char *prev_ethact = env_get("ethact");
+	char *prev_ethrotate = env_get("ethrotate");
+	struct wget_test_server srv;
+	struct wget_test_conn *conn;
+	ulong pos;
+	u8 *data;
+	int i;
+
+	data = malloc(WGET_TEST_SIZE);
+	ut_assertnonnull(data);
+	for (i = 0; i < WGET_TEST_SIZE; i++)
+		data[i] = i * 7 + (i >> 9);
+	srv.data = data;
+
+	sandbox_eth_set_tx_handler(0, sb_range_handler);
+	sandbox_eth_set_priv(0, &srv);
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+
+	/* the connection is reset part way, so the rest is asked for */
+	srv.reset_conn = 0;
+	srv.reset_at = 8 * WGET_TEST_MSS;
+	ut_assertok(wget_test_load(uts, &srv, 2));
+	conn = &srv.conn[0];
+	pos = conn->sent - conn->hdr_len;
+	ut_assert(!conn->range);
+	ut_assert(srv.conn[1].range);
+	ut_asserteq(pos, srv.conn[1].start);
+	ut_asserteq(WGET_TEST_SIZE - pos, srv.conn[1].len);
+
+	/*
+	 * Fetch the file in three parts; the first connection is cut short
+	 * once it has its part and the second is reset, then resumed
+	 */
+	env_set("wgetsegments", "3");
+	srv.reset_conn = 1;
+	srv.reset_at = 16 * WGET_TEST_MSS;
+	ut_assertok(wget_test_load(uts, &srv, 4));
+	ut_assert(srv.conn[0].sent < srv.conn[0].hdr_len + WGET_TEST_SIZE);
+	for (i = 1; i < 3; i++) {
+		ut_assert(srv.conn[i].range);
+		ut_asserteq(i * 0x10000, srv.conn[i].start);
+		ut_asserteq(0x10000, srv.conn[i].len);
+	}
+	conn = &srv.conn[1];
+	pos = conn->start + conn->sent - conn->hdr_len;
+	ut_assert(srv.conn[3].range);
+	ut_asserteq(pos, srv.conn[3].start);
+	ut_asserteq(0x20000 - pos, srv.conn[3].len);
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set("wgetsegments", NULL);
+	env_set("ethact", prev_ethact);
+	env_set("ethrotate", prev_ethrotate);
+	free(data);
+
+	return 0;
+}
+CMD_TEST(net_test_wget_range, UTF_CONSOLE);
+
 static int net_test_wget_uri_validate(struct unit_test_state *uts)
 {
 	ut_asserteq(true, wget_validate_uri("http://foo.com/bar.html"));
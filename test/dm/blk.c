@@ -5,6 +5,8 @@
 
 #include <blk.h>
 #include <dm.h>
+#include <malloc.h>
+#include <os.h>
 #include <part.h>
 #include <sandbox_host.h>
 #include <usb.h>
@@ -291,3 +293,138 @@ static int dm_test_blk_foreach(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_blk_foreach, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+
+/* Test the hashed block cache */
+static int dm_test_blk_cache(struct unit_test_state *uts)
+{
+	struct block_cache_dev_stats dev_stats;
+	struct block_cache_stats stats;
+	char buf[5][512], out[2 * 512];
+	int i;
+
+	if (!CONFIG_IS_ENABLED(BLOCK_CACHE))
+		return -EAGAIN;
+
+	for (i = 0; i < ARRAY_SIZE(buf); i++)
+		memset(buf[i], 'a' + i, sizeof(buf[i]));
+
+	/* A single set of four blocks, so that eviction is predictable */
+	blkcache_configure(4 * 512, 4, 8, 0);
+	ut_asserteq(0, blkcache_read(UCLASS_HOST, 0, 0, 1, 512, out));
+	blkcache_fill(UCLASS_HOST, 0, 0, 4, 512, buf);
+	ut_asserteq(1, blkcache_read(UCLASS_HOST, 0, 1, 2, 512, out));
+	ut_assertok(memcmp(buf[1], out, 2 * 512));
+
+	/* Reads larger than the limit are never cached */
+	blkcache_fill(UCLASS_HOST, 1, 0, 9, 512, buf);
+	ut_asserteq(-ENOENT, blkcache_dev_stats(1, &dev_stats, false));
+
+	/* Touch block 0 so that block 3 is evicted instead */
+	ut_asserteq(1, blkcache_read(UCLASS_HOST, 0, 0, 1, 512, out));
+	blkcache_fill(UCLASS_HOST, 0, 4, 1, 512, buf[4]);
+	ut_asserteq(0, blkcache_read(UCLASS_HOST, 0, 3, 1, 512, out));
+	ut_asserteq(1, blkcache_read(UCLASS_HOST, 0, 4, 1, 512, out));
+	ut_assertok(memcmp(buf[4], out, 512));
+
+	/* Writes update the cached copy */
+	blkcache_write(UCLASS_HOST, 0, 1, 1, 512, buf[3]);
+	ut_asserteq(1, blkcache_read(UCLASS_HOST, 0, 1, 1, 512, out));
+	ut_assertok(memcmp(buf[3], out, 512));
+
+	blkcache_stats(&stats);
+	ut_asserteq(4, stats.hits);
+	ut_asserteq(2, stats.misses);
+	ut_asserteq(1, stats.evictions);
+	ut_asserteq(1, stats.writes);
+	ut_asserteq(4, stats.entries);
+	ut_asserteq(4 * 512, stats.bytes);
+	ut_asserteq(1, stats.sets);
+
+	ut_assertok(blkcache_dev_stats(0, &dev_stats, true));
+	ut_asserteq(UCLASS_HOST, dev_stats.iftype);
+	ut_asserteq(0, dev_stats.devnum);
+	ut_asserteq(4, dev_stats.hits);
+	ut_asserteq(1, dev_stats.misses);
+	ut_asserteq(4, dev_stats.entries);
+
+	/* Both the cache and device counters are reset once read */
+	blkcache_stats(&stats);
+	ut_asserteq(0, stats.hits);
+	ut_asserteq(0, stats.misses);
+	ut_assertok(blkcache_dev_stats(0, &dev_stats, false));
+	ut_asserteq(0, dev_stats.hits);
+	ut_asserteq(0, dev_stats.misses);
+	ut_asserteq(4, dev_stats.entries);
+
+	/* A device over its share only evicts its own blocks */
+	blkcache_configure(4 * 512, 4, 8, 2 * 512);
+	blkcache_fill(UCLASS_HOST, 1, 0, 2, 512, buf);
+	blkcache_fill(UCLASS_HOST, 1, 2, 1, 512, buf[2]);
+	ut_asserteq(0, blkcache_read(UCLASS_HOST, 1, 0, 1, 512, out));
+	ut_asserteq(1, blkcache_read(UCLASS_HOST, 1, 1, 2, 512, out));
+	ut_asserteq(1, blkcache_read(UCLASS_HOST, 0, 4, 1, 512, out));
+	ut_assertok(blkcache_dev_stats(1, &dev_stats, false));
+	ut_asserteq(2, dev_stats.entries);
+
+	blkcache_invalidate(UCLASS_HOST, 0);
+	ut_asserteq(0, blkcache_read(UCLASS_HOST, 0, 0, 1, 512, out));
+	ut_asserteq(1, blkcache_read(UCLASS_HOST, 1, 2, 1, 512, out));
+	ut_assertok(memcmp(buf[2], out, 512));
+
+	blkcache_configure(CONFIG_BLOCK_CACHE_SIZE, CONFIG_BLOCK_CACHE_WAYS, 32,
+			   0);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_cache, 0);
+
+/* Test read-ahead on sequential reads */
+static int dm_test_blk_readahead(struct unit_test_state *uts)
+{
+	struct blk_readahead_stats stats;
+	struct udevice *dev, *blk;
+	char fname[256];
+	char *ref, *buf;
+	int i;
+
+	if (!CONFIG_IS_ENABLED(BLK_READAHEAD))
+		return -EAGAIN;
+
+	ut_assertok(host_create_device("test", true, DEFAULT_BLKSZ, &dev));
+	ut_assertok(os_persistent_file(fname, sizeof(fname), "2MB.ext2.img"));
+	ut_assertok(host_attach_file(dev, fname));
+	ut_assertok(blk_get_from_parent(dev, &blk));
+
+	/* Drop anything read ahead while looking for a partition table */
+	blk_readahead_invalidate(dev_get_uclass_plat(blk));
+	ut_assertok(blk_readahead_stats(blk, &stats, true));
+
+	ref = malloc(64 * DEFAULT_BLKSZ);
+	buf = malloc(DEFAULT_BLKSZ);
+	ut_assertnonnull(ref);
+	ut_assertnonnull(buf);
+
+	/* A read which does not follow on from the previous one is direct */
+	ut_asserteq(64, blk_read(blk, 10, 64, ref));
+	ut_assertok(blk_readahead_stats(blk, &stats, true));
+	ut_asserteq(0, stats.windows);
+
+	/* The second of a run of sequential reads fetches a whole window */
+	for (i = 0; i < 11; i++) {
+		ut_asserteq(1, blk_read(blk, 10 + i, 1, buf));
+		ut_assertok(memcmp(ref + i * DEFAULT_BLKSZ, buf,
+				   DEFAULT_BLKSZ));
+	}
+	ut_assertok(blk_readahead_stats(blk, &stats, true));
+	ut_asserteq(1, stats.windows);
+	ut_asserteq(CONFIG_BLK_READAHEAD_SIZE / DEFAULT_BLKSZ - 1,
+		    stats.fetched);
+	ut_asserteq(9, stats.used);
+
+	free(buf);
+	free(ref);
+	ut_assertok(host_detach_file(dev));
+
+	return 0;
+}
+DM_TEST(dm_test_blk_readahead, UTF_SCAN_FDT);
@@ -48,3 +48,55 @@ static int dm_test_cpu(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_cpu, UTF_SCAN_FDT);
+
+static int cpu_test_job(void *arg)
+{
+	int *val = arg;
+
+	return (*val)++;
+}
+
+static int dm_test_cpu_run(struct unit_test_state *uts)
+{
+	struct cpu_job jobs[5];
+	struct udevice *dev;
+	int vals[5] = { };
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(jobs); i++) {
+		jobs[i].func = cpu_test_job;
+		jobs[i].arg = &vals[i];
+	}
+
+	/* A job cannot be started on the current CPU */
+	ut_assertok(uclass_get_device_by_name(UCLASS_CPU, "cpu@1", &dev));
+	ut_asserteq(-EBUSY, cpu_run(dev, &jobs[0]));
+
+	ut_assertok(uclass_get_device_by_name(UCLASS_CPU, "cpu@2", &dev));
+	ut_assertok(cpu_run(dev, &jobs[0]));
+	ut_asserteq_ptr(dev, jobs[0].cpu);
+	ut_assertok(cpu_job_wait(&jobs[0]));
+	ut_asserteq(1, vals[0]);
+	vals[0] = 0;
+
+	/* This CPU and the two others can run jobs */
+	ut_asserteq(3, cpu_job_cores());
+
+	/* The first job runs here, then one on each other CPU, then the rest */
+	ut_assertok(cpu_run_jobs(jobs, ARRAY_SIZE(jobs)));
+	ut_assertnull(jobs[0].cpu);
+	ut_asserteq_str("cpu@2", jobs[1].cpu->name);
+	ut_asserteq_str("cpu@3", jobs[2].cpu->name);
+	ut_assertnull(jobs[3].cpu);
+	ut_assertnull(jobs[4].cpu);
+	for (i = 0; i < ARRAY_SIZE(jobs); i++) {
+		ut_assert(jobs[i].done);
+		ut_asserteq(1, vals[i]);
+	}
+
+	/* The first failure is reported */
+	ut_asserteq(1, cpu_run_jobs(jobs, ARRAY_SIZE(jobs)));
+
+	return 0;
+}
+DM_TEST(dm_test_cpu_run, UTF_SCAN_FDT);
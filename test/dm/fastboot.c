@@ -7,6 +7,8 @@
 #include <env.h>
 #include <fastboot.h>
 #include <fb_mmc.h>
+#include <image-sparse.h>
+#include <malloc.h>
 #include <mmc.h>
 #include <part.h>
 #include <part_efi.h>
@@ -93,3 +95,199 @@ static int dm_test_fastboot_mmc_part(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_fastboot_mmc_part, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+/* sparse image with raw, fill and don't-care chunks, in 512-byte blocks */
+#define STREAM_RAW1_BLKS	8
+#define STREAM_FILL_BLKS	16
+#define STREAM_SKIP_BLKS	8
+#define STREAM_RAW2_BLKS	80
+#define STREAM_FILL_VAL		0x12345678
+
+static void *fastboot_stream_add_chunk(void *ptr, u16 type, u32 blks,
+				       u32 data_sz)
+{
+	chunk_header_t *chunk = ptr;
+
+	chunk->chunk_type = type;
+	chunk->reserved1 = 0;
+	chunk->chunk_sz = blks;
+	chunk->total_sz = sizeof(*chunk) + data_sz;
+
+	return ptr + sizeof(*chunk);
+}
+
+/* Download an image as the host does, in pieces of an awkward size */
+static int fastboot_stream_download(struct unit_test_state *uts,
+				    const void *image, u32 size,
+				    const char *expect)
+{
+	char response[FASTBOOT_RESPONSE_LEN] = {0};
+	char cmd[FASTBOOT_COMMAND_LEN];
+	u32 n;
+
+	snprintf(cmd, sizeof(cmd), "download:%08x", size);
+	ut_asserteq(FASTBOOT_COMMAND_DOWNLOAD,
+		    fastboot_handle_command(cmd, response));
+	ut_asserteq_strn("DATA", response);
+
+	while (fastboot_data_remaining()) {
+		n = min(fastboot_data_remaining(), 999U);
+		fastboot_data_download(image, n, response);
+		ut_asserteq_str("", response);
+		image += n;
+	}
+	fastboot_data_complete(response);
+	ut_asserteq_str(expect, response);
+
+	return 0;
+}
+
+static int dm_test_fastboot_stream(struct unit_test_state *uts)
+{
+	char response[FASTBOOT_RESPONSE_LEN] = {0};
+	char str_disk_guid[UUID_STR_LEN + 1];
+	char cmd[FASTBOOT_COMMAND_LEN];
+	struct blk_desc *mmc_dev_desc;
+	sparse_header_t *hdr;
+	u8 *image, *ptr, *raw1, *raw2, *buf, *expect;
+	u32 *fill;
+	int i, size, blks;
+	struct disk_partition parts[2] = {
+		{
+			.start = 48,
+			.size = 128,
+			.name = "test1",
+		},
+		{
+			.start = 176,
+			.size = 1,
+			.name = "test2",
+		},
+	};
+
+	ut_assertok(blk_get_device_by_str("mmc", "0", &mmc_dev_desc));
+	if (CONFIG_IS_ENABLED(RANDOM_UUID)) {
+		gen_rand_uuid_str(parts[0].uuid, UUID_STR_FORMAT_STD);
+		gen_rand_uuid_str(parts[1].uuid, UUID_STR_FORMAT_STD);
+		gen_rand_uuid_str(str_disk_guid, UUID_STR_FORMAT_STD);
+	}
+	ut_assertok(gpt_restore(mmc_dev_desc, str_disk_guid, parts,
+				ARRAY_SIZE(parts)));
+	fastboot_init(NULL, 0);
+
+	blks = parts[0].size;
+	size = blks * 512;
+	image = calloc(1, size * 2);
+	buf = calloc(1, size);
+	expect = calloc(1, size);
+	ut_assertnonnull(image);
+	ut_assertnonnull(buf);
+	ut_assertnonnull(expect);
+
+	/* build the image and what the partition should hold afterwards */
+	hdr = (sparse_header_t *)image;
+	hdr->magic = SPARSE_HEADER_MAGIC;
+	hdr->major_version = 1;
+	hdr->file_hdr_sz = sizeof(*hdr);
+	hdr->chunk_hdr_sz = sizeof(chunk_header_t);
+	hdr->blk_sz = 512;
+	hdr->total_blks = STREAM_RAW1_BLKS + STREAM_FILL_BLKS +
+			  STREAM_SKIP_BLKS + STREAM_RAW2_BLKS;
+	hdr->total_chunks = 4;
+	ptr = image + sizeof(*hdr);
+
+	ptr = fastboot_stream_add_chunk(ptr, CHUNK_TYPE_RAW, STREAM_RAW1_BLKS,
+					STREAM_RAW1_BLKS * 512);
+	raw1 = ptr;
+	for (i = 0; i < STREAM_RAW1_BLKS * 512; i++)
+		raw1[i] = i * 7;
+	ptr += STREAM_RAW1_BLKS * 512;
+
+	ptr = fastboot_stream_add_chunk(ptr, CHUNK_TYPE_FILL, STREAM_FILL_BLKS,
+					sizeof(u32));
+	*(u32 *)ptr = STREAM_FILL_VAL;
+	ptr += sizeof(u32);
+
+	ptr = fastboot_stream_add_chunk(ptr, CHUNK_TYPE_DONT_CARE,
+					STREAM_SKIP_BLKS, 0);
+
+	ptr = fastboot_stream_add_chunk(ptr, CHUNK_TYPE_RAW, STREAM_RAW2_BLKS,
+					STREAM_RAW2_BLKS * 512);
+	raw2 = ptr;
+	for (i = 0; i < STREAM_RAW2_BLKS * 512; i++)
+		raw2[i] = i * 13 + 5;
+	ptr += STREAM_RAW2_BLKS * 512;
+
+	memset(expect, 0xaa, size);
+	memcpy(expect, raw1, STREAM_RAW1_BLKS * 512);
+	fill = (u32 *)(expect + STREAM_RAW1_BLKS * 512);
+	for (i = 0; i < STREAM_FILL_BLKS * 512 / sizeof(u32); i++)
+		fill[i] = STREAM_FILL_VAL;
+	memcpy(expect + (STREAM_RAW1_BLKS + STREAM_FILL_BLKS +
+			 STREAM_SKIP_BLKS) * 512,
+	       raw2, STREAM_RAW2_BLKS * 512);
+
+	/* the image does not fit in the download buffer */
+	ut_assert(ptr - image > CONFIG_FASTBOOT_BUF_SIZE);
+
+	memset(buf, 0xaa, size);
+	ut_asserteq(blks, blk_dwrite(mmc_dev_desc, parts[0].start, blks, buf));
+
+	strcpy(cmd, "oem stream:test1");
+	ut_asserteq(FASTBOOT_COMMAND_OEM_STREAM,
+		    fastboot_handle_command(cmd, response));
+	ut_asserteq_str("OKAY", response);
+	strcpy(cmd, "getvar:max-download-size");
+	fastboot_handle_command(cmd, response);
+	ut_asserteq_str("OKAY0xffffffff", response);
+
+	ut_assertok(fastboot_stream_download(uts, image, ptr - image, "OKAY"));
+	strcpy(cmd, "flash:test1");
+	ut_asserteq(FASTBOOT_COMMAND_FLASH,
+		    fastboot_handle_command(cmd, response));
+	ut_asserteq_str("OKAY", response);
+
+	ut_asserteq(blks, blk_dread(mmc_dev_desc, parts[0].start, blks, buf));
+	ut_asserteq_mem(expect, buf, size);
+
+	/* a raw image is written from the start, padding the last block */
+	memset(image, 0x11, 1000);
+	ut_assertok(fastboot_stream_download(uts, image, 1000, "OKAY"));
+	strcpy(cmd, "flash:test2");
+	fastboot_handle_command(cmd, response);
+	ut_asserteq_str("FAILdownloads go to 'test1'", response);
+
+	ut_asserteq(2, blk_dread(mmc_dev_desc, parts[0].start, 2, buf));
+	memset(expect, 0x11, 1000);
+	memset(expect + 1000, '\0', 24);
+	ut_asserteq_mem(expect, buf, 1024);
+
+	/* an image larger than the partition fails once it is downloaded */
+	memset(image, 0x22, size * 2);
+	ut_assertok(fastboot_stream_download(uts, image, size * 2,
+					     "FAILRequest would exceed partition size!"));
+	strcpy(cmd, "flash:test1");
+	fastboot_handle_command(cmd, response);
+	ut_asserteq_str("FAILno image written", response);
+
+	/* back to downloading to memory */
+	strcpy(cmd, "oem stream");
+	fastboot_handle_command(cmd, response);
+	ut_asserteq_str("OKAY", response);
+	strcpy(cmd, "getvar:max-download-size");
+	fastboot_handle_command(cmd, response);
+	snprintf(cmd, sizeof(cmd), "OKAY0x%08x", CONFIG_FASTBOOT_BUF_SIZE);
+	ut_asserteq_str(cmd, response);
+	snprintf(cmd, sizeof(cmd), "download:%08x", size * 2);
+	fastboot_handle_command(cmd, response);
+	ut_asserteq_strn("FAIL", response);
+
+	free(expect);
+	free(buf);
+	free(image);
+
+	return 0;
+}
+DM_TEST(dm_test_fastboot_stream, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+#endif
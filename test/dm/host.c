@@ -8,6 +8,7 @@
 #include <dm.h>
 #include <fs.h>
 #include <os.h>
+#include <part.h>
 #include <sandbox_host.h>
 #include <asm/test.h>
 #include <dm/device-internal.h>
@@ -74,6 +75,69 @@ static int dm_test_host(struct unit_test_state *uts)
 }
 DM_TEST(dm_test_host, UTF_SCAN_FDT);
 
+/* Test that a filesystem is kept mounted between accesses */
+static int dm_test_host_fs_cache(struct unit_test_state *uts)
+{
+	static char label[] = "test";
+	struct fs_cache_stats start, stats;
+	struct udevice *dev, *blk;
+	struct blk_desc *desc;
+	char fname[256];
+	ulong mem_start;
+
+	if (!IS_ENABLED(CONFIG_FS_MOUNT_CACHE))
+		return -EAGAIN;
+
+	mem_start = ut_check_delta(0);
+	ut_assertok(host_create_device(label, true, DEFAULT_BLKSZ, &dev));
+	ut_assertok(os_persistent_file(fname, sizeof(fname), "2MB.ext2.img"));
+	ut_assertok(host_attach_file(dev, fname));
+	ut_assertok(blk_get_from_parent(dev, &blk));
+	ut_assertok(device_probe(blk));
+	desc = dev_get_uclass_plat(blk);
+
+	/* the first access probes the filesystem and leaves it mounted */
+	fs_cache_get_stats(&start);
+	ut_assertok(fs_set_blk_dev_with_part(desc, 0));
+	ut_asserteq(0, fs_exists("/no-such-file"));
+	fs_cache_get_stats(&stats);
+	ut_asserteq(start.misses + 1, stats.misses);
+	ut_asserteq(start.hits, stats.hits);
+	ut_asserteq_ptr(desc, stats.desc);
+	ut_asserteq(0, stats.part);
+	ut_asserteq_str("ext4", stats.fstype_name);
+
+	/* the next one uses it */
+	ut_assertok(fs_set_blk_dev_with_part(desc, 0));
+	ut_asserteq(FS_TYPE_EXT, fs_get_type());
+	ut_asserteq(0, fs_exists("/no-such-file"));
+	fs_cache_get_stats(&stats);
+	ut_asserteq(start.misses + 1, stats.misses);
+	ut_asserteq(start.hits + 1, stats.hits);
+
+	/* reading the partition table again means the medium may have changed */
+	part_init(desc);
+	fs_cache_get_stats(&stats);
+	ut_assertnull(stats.desc);
+	ut_asserteq(start.invalidations + 1, stats.invalidations);
+	ut_assertok(fs_set_blk_dev_with_part(desc, 0));
+	ut_asserteq(0, fs_exists("/no-such-file"));
+	fs_cache_get_stats(&stats);
+	ut_asserteq(start.misses + 2, stats.misses);
+	ut_asserteq_ptr(desc, stats.desc);
+
+	/* removing the device closes it, without leaking memory */
+	ut_assertok(host_detach_file(dev));
+	fs_cache_get_stats(&stats);
+	ut_assertnull(stats.desc);
+	ut_asserteq(start.invalidations + 2, stats.invalidations);
+	ut_assertok(device_unbind(dev));
+	ut_asserteq(0, ut_check_delta(mem_start));
+
+	return 0;
+}
+DM_TEST(dm_test_host_fs_cache, UTF_SCAN_FDT);
+
 /* reusing the same label should work */
 static int dm_test_host_dup(struct unit_test_state *uts)
 {
@@ -23,6 +23,7 @@
 #include <dm/device-internal.h>
 #include <dm/lists.h>
 #include <dm/of_extra.h>
+#include <dm/of_index.h>
 #include <dm/ofnode_graph.h>
 #include <dm/root.h>
 #include <dm/test.h>
@@ -1304,6 +1305,93 @@ static int dm_test_ofnode_find_subnode(struct unit_test_state *uts)
 }
 DM_TEST(dm_test_ofnode_find_subnode, UTF_SCAN_FDT);
 
+/* check that lookups using the devicetree index match the tree */
+static int dm_test_ofnode_index(struct unit_test_state *uts)
+{
+	const char *compat = "u-boot,index-test";
+	struct of_index_info info, before;
+	ofnode node, check;
+	oftree tree;
+	char buf[128];
+	uint phandle;
+	u32 val;
+
+	if (!CONFIG_IS_ENABLED(OF_INDEX))
+		return -EAGAIN;
+
+	/* each phandle finds its node, which can also be found by path */
+	for (phandle = 1; node = ofnode_get_by_phandle(phandle),
+	     ofnode_valid(node); phandle++) {
+		ut_assertok(ofnode_read_u32(node, "phandle", &val));
+		ut_asserteq(phandle, val);
+		ut_assertok(ofnode_get_path(node, buf, sizeof(buf)));
+		check = ofnode_path(buf);
+		ut_assert(ofnode_equal(node, check));
+	}
+	ut_assert(phandle > 10);
+
+	of_index_get_info(&info);
+	tree = oftree_default();
+	ut_asserteq_ptr(of_live_active() ? (void *)tree.np : tree.fdt,
+			info.tree);
+	ut_asserteq(of_live_active(), info.live);
+	ut_assert(info.nodes > 0);
+
+	ut_assert(!ofnode_valid(ofnode_path("/no-such-node")));
+	ut_assert(!ofnode_valid(ofnode_by_compatible(ofnode_null(), compat)));
+
+	/* changes to the tree are seen by later lookups */
+	ut_assertok(ofnode_add_subnode(ofnode_path("/lcd"), "index", &node));
+	ut_assert(ofnode_equal(node, ofnode_path("/lcd/index")));
+	ut_assertok(ofnode_write_string(node, "compatible", compat));
+	ut_assert(ofnode_equal(node, ofnode_by_compatible(ofnode_null(),
+							  compat)));
+	ut_assert(!ofnode_valid(ofnode_by_compatible(node, compat)));
+	ut_assertok(ofnode_delete(&node));
+	ut_assert(!ofnode_valid(ofnode_path("/lcd/index")));
+	ut_assert(!ofnode_valid(ofnode_by_compatible(ofnode_null(), compat)));
+
+	/* a compatible string changed in place with libfdt is still found */
+	if (!of_live_active()) {
+		char old[32], new[32];
+		const char *prop;
+		int len;
+
+		node = ofnode_path("/lcd");
+		prop = ofnode_read_prop(node, "compatible", &len);
+		ut_assertnonnull(prop);
+		ut_assert(len <= sizeof(old));
+		memcpy(old, prop, len);
+		memcpy(new, prop, len);
+		new[0] = 'S';
+		ut_assertok(fdt_setprop_inplace(ofnode_to_fdt(node),
+						ofnode_to_offset(node),
+						"compatible", new, len));
+		ut_assert(ofnode_equal(node, ofnode_by_compatible(ofnode_null(),
+								  new)));
+		ut_assert(!ofnode_valid(ofnode_by_compatible(ofnode_null(),
+							     old)));
+		ut_assertok(fdt_setprop_inplace(ofnode_to_fdt(node),
+						ofnode_to_offset(node),
+						"compatible", old, len));
+		ut_assert(ofnode_equal(node, ofnode_by_compatible(ofnode_null(),
+								  old)));
+	}
+
+	if (CONFIG_IS_ENABLED(DM_STATS)) {
+		of_index_get_info(&before);
+		ut_assert(ofnode_valid(ofnode_path("/lcd")));
+		of_index_get_info(&info);
+		ut_asserteq(before.lookup[OF_LOOKUP_PATH].calls + 1,
+			    info.lookup[OF_LOOKUP_PATH].calls);
+		ut_asserteq(before.lookup[OF_LOOKUP_PATH].indexed + 1,
+			    info.lookup[OF_LOOKUP_PATH].indexed);
+	}
+
+	return 0;
+}
+DM_TEST(dm_test_ofnode_index, UTF_SCAN_FDT);
+
 /* check ofnode_find_subnode() with unit addresses */
 static int dm_test_ofnode_find_subnode_unit(struct unit_test_state *uts)
 {
@@ -224,6 +224,67 @@ static int dm_test_fdt_pre_reloc(struct unit_test_state *uts)
 }
 DM_TEST(dm_test_fdt_pre_reloc, 0);
 
+/* Test binding devices when they are first used */
+static int dm_test_fdt_lazy(struct unit_test_state *uts)
+{
+	struct dm_stats stats;
+	struct udevice *dev;
+	struct uclass *uc;
+
+	if (!CONFIG_IS_ENABLED(DM_LAZY_BIND))
+		return -EAGAIN;
+
+	ut_assertok(dm_lazy_init());
+	ut_assertok(dm_extended_scan(false));
+
+	/* leaf nodes are only recorded; buses are bound as usual */
+	dm_get_mem(&stats);
+	ut_assert(stats.lazy_count > 0);
+	ut_asserteq(-ENODEV, device_find_child_by_name(dm_root(), "gen_phy@0",
+						       &dev));
+	ut_asserteq(-ENODEV, device_find_child_by_name(dm_root(), "g-test",
+						       &dev));
+	ut_assertok(device_find_child_by_name(dm_root(), "some-bus", &dev));
+
+	/*
+	 * The children of some-bus are bound at once, so the nodes before
+	 * them in their uclass are too
+	 */
+	ut_assert(stats.lazy_bound > 0);
+	ut_assertok(device_find_child_by_name(dm_root(), "b-test", &dev));
+
+	/* looking up a node binds all the nodes in its uclass */
+	ut_assertok(device_find_global_by_ofnode(ofnode_path("/gen_phy@2"),
+						 &dev));
+	ut_asserteq_str("gen_phy@2", dev->name);
+	ut_assertok(device_find_child_by_name(dm_root(), "gen_phy@0", &dev));
+	ut_asserteq(-ENODEV, device_find_child_by_name(dm_root(), "g-test",
+						       &dev));
+
+	/* using a uclass binds its devices */
+	ut_assertok(uclass_get(UCLASS_TEST_FDT, &uc));
+	ut_asserteq(9, list_count_nodes(&uc->dev_head));
+	ut_assertok(device_find_child_by_name(dm_root(), "g-test", &dev));
+
+	/* the devices are in devicetree order, as without lazy binding */
+	ut_assertok(uclass_find_first_device(UCLASS_TEST_FDT, &dev));
+	ut_asserteq_str("a-test", dev->name);
+	uclass_find_next_device(&dev);
+	ut_asserteq_str("b-test", dev->name);
+	uclass_find_next_device(&dev);
+	ut_asserteq_str("c-test@5", dev->name);
+	ut_assertok(dm_check_devices(uts, 9));
+
+	dm_get_mem(&stats);
+	ut_assert(stats.lazy_bound > 0);
+	ut_assert(stats.lazy_bound < stats.lazy_count);
+
+	dm_lazy_uninit();
+
+	return 0;
+}
+DM_TEST(dm_test_fdt_lazy, 0);
+
 /* Test that sequence numbers are allocated properly */
 static int dm_test_fdt_uclass_seq(struct unit_test_state *uts)
 {
@@ -84,6 +84,31 @@ static int dm_test_usb_flash(struct unit_test_state *uts)
 }
 DM_TEST(dm_test_usb_flash, UTF_SCAN_PDATA | UTF_SCAN_FDT);
 
+/* Test the usb bench command */
+static int dm_test_usb_bench(struct unit_test_state *uts)
+{
+	struct blk_desc *dev_desc;
+
+	state_set_skip_delays(true);
+	ut_assertok(usb_init());
+	ut_assertok(blk_get_device_by_str("usb", "0", &dev_desc));
+
+	/* the emulated flash stick is not SuperSpeed */
+	ut_asserteq(240, usb_stor_get_max_xfer_blk(dev_desc));
+
+	ut_assertok(run_command("usb dev 0", 0));
+	console_record_reset();
+	ut_assertok(run_command("usb bench 0 0 2", 0));
+	ut_assert_nextlinen("2 blocks of 512 bytes read in ");
+	ut_assert_nextline("up to 240 blocks per command");
+	ut_assert_console_end();
+
+	ut_assertok(usb_stop());
+
+	return 0;
+}
+DM_TEST(dm_test_usb_bench, UTF_SCAN_PDATA | UTF_SCAN_FDT | UTF_CONSOLE);
+
 /* test that we can handle multiple storage devices */
 static int dm_test_usb_multi(struct unit_test_state *uts)
 {
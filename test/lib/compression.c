@@ -7,12 +7,15 @@
 #include <bootm.h>
 #include <command.h>
 #include <gzip.h>
+#include <hash.h>
 #include <image.h>
 #include <log.h>
 #include <malloc.h>
 #include <mapmem.h>
 #include <asm/io.h>
+#include <asm/unaligned.h>
 
+#include <u-boot/crc.h>
 #include <u-boot/lz4.h>
 #include <u-boot/zlib.h>
 #include <bzlib.h>
@@ -138,6 +141,30 @@ static const char zstd_compressed[] =
 	"\x01\xe4\xf4\x6e\xfa";
 static const unsigned long zstd_compressed_size = sizeof(zstd_compressed) - 1;
 
+/*
+ * split -b 160 /tmp/plain.txt /tmp/part.
+ * for f in /tmp/part.*; do zstd -19 -c $f >> /tmp/plain-frames.zst; done
+ */
+static const char zstd_frames_compressed[] =
+	"\x28\xb5\x2f\xfd\x24\xa0\x3d\x02\x00\x02\x85\x0f\x11\xa0\xed\x78"
+	"\xb8\x5e\xdd\x2c\x5a\xdd\xd2\x8d\xfa\xb7\xbc\xdf\x33\x23\x8f\x7d"
+	"\x6e\xee\xb1\x93\xbc\x9c\xe5\x81\xd9\x59\xf5\x7a\x6d\xcb\xce\x70"
+	"\xcf\x90\x13\x01\x42\x52\x96\x3f\xee\xb2\xcb\x79\x95\x8d\x91\xe1"
+	"\x63\xce\xbc\xae\x84\x3a\x7d\xcf\xf6\x23\x01\x00\xe8\x85\xaa\x32"
+	"\xe9\x73\xbf\x86\x28\xb5\x2f\xfd\x24\xa0\x9d\x03\x00\x02\xca\x1b"
+	"\x16\xa0\x39\x07\x0d\x5a\x93\x5b\x9b\xa4\x17\x8a\x6d\x3e\xb1\x42"
+	"\x2e\x60\x65\x11\x55\x72\x46\xcf\xb5\x22\x33\xa9\xad\xc5\xfc\x05"
+	"\xf3\x86\xd7\xda\x35\x3c\x63\xe8\x3c\x28\x1f\x20\x30\xf8\x18\x45"
+	"\x0b\xab\x49\xce\x45\xcf\xeb\xf0\xc9\x4b\x78\xf8\xc1\xc4\xbc\xae"
+	"\x21\xc4\xcf\xb5\x22\x5f\x39\x51\xe4\xdc\x1b\x53\xeb\x00\x8a\x7c"
+	"\xa7\x77\xce\xa3\x28\xdf\xf0\x06\x7a\x24\x65\x3d\xbf\x3d\xd7\x42"
+	"\xfb\xb6\x95\xce\x8c\xa2\xdf\xfe\x5c\x18\x29\x80\xe1\x8a\x54\x00"
+	"\x69\xe4\xa0\x42\x28\xb5\x2f\xfd\x24\x1e\xf1\x00\x00\x20\x66\x61"
+	"\x63\x65\x20\x6f\x66\x20\x73\x68\x6f\x72\x74\x20\x74\x65\x78\x74"
+	"\x0a\x6d\x65\x73\x73\x61\x67\x65\x73\x2e\x0a\xa5\x9e\xab\x07";
+static const unsigned long zstd_frames_compressed_size =
+	sizeof(zstd_frames_compressed) - 1;
+
 #define TEST_BUFFER_SIZE	512
 
 typedef int (*mutate_func)(struct unit_test_state *uts, void *, unsigned long,
@@ -331,6 +358,25 @@ static int compress_using_zstd(struct unit_test_state *uts,
 	return 0;
 }
 
+static int compress_using_zstd_frames(struct unit_test_state *uts,
+				      void *in, unsigned long in_size,
+				      void *out, unsigned long out_max,
+				      unsigned long *out_size)
+{
+	/* There is no zstd compression in u-boot, so fake it. */
+	ut_asserteq(in_size, strlen(plain));
+	ut_asserteq_mem(plain, in, in_size);
+
+	if (zstd_frames_compressed_size > out_max)
+		return -1;
+
+	memcpy(out, zstd_frames_compressed, zstd_frames_compressed_size);
+	if (out_size)
+		*out_size = zstd_frames_compressed_size;
+
+	return 0;
+}
+
 static int uncompress_using_zstd(struct unit_test_state *uts,
 				 void *in, unsigned long in_size,
 				 void *out, unsigned long out_max,
@@ -505,6 +551,13 @@ static int compression_test_zstd(struct unit_test_state *uts)
 }
 LIB_TEST(compression_test_zstd, 0);
 
+static int compression_test_zstd_frames(struct unit_test_state *uts)
+{
+	return run_test(uts, "zstd_frames", compress_using_zstd_frames,
+			uncompress_using_zstd);
+}
+LIB_TEST(compression_test_zstd_frames, 0);
+
 static int compress_using_none(struct unit_test_state *uts,
 			       void *in, unsigned long in_size,
 			       void *out, unsigned long out_max,
@@ -606,3 +659,119 @@ static int compression_test_bootm_none(struct unit_test_state *uts)
 	return run_bootm_test(uts, IH_COMP_NONE, compress_using_none);
 }
 LIB_TEST(compression_test_bootm_none, 0);
+
+/**
+ * struct stream_test - compressed data for the streaming decompression tests
+ *
+ * @data: Compressed data
+ * @size: Size of @data in bytes
+ * @reads: Number of reads done
+ */
+struct stream_test {
+	const void *data;
+	ulong size;
+	int reads;
+};
+
+static long stream_test_read(struct image_stream *strm, void *buf,
+			     ulong offset, ulong len)
+{
+	struct stream_test *st = strm->priv;
+
+	if (offset + len > st->size)
+		return -EIO;
+	memcpy(buf, st->data + offset, len);
+	st->reads++;
+
+	return len;
+}
+
+/**
+ * run_stream_test() - Run tests on the streaming decompression function
+ *
+ * @comp_type:	Compression type to test
+ * @compress:	Our function to compress data
+ * Return: 0 if OK, non-zero on failure
+ */
+static int run_stream_test(struct unit_test_state *uts, int comp_type,
+			   mutate_func compress)
+{
+	char compress_buff[1024], load_buff[TEST_BUFFER_SIZE];
+	struct stream_test st = { .data = compress_buff };
+	struct image_stream strm = {
+		.read = stream_test_read,
+		.priv = &st,
+		.window = 16,
+	};
+	ulong compress_size = sizeof(compress_buff);
+	ulong unc_len = strlen(plain);
+	ulong len;
+
+	if (!IS_ENABLED(CONFIG_IMAGE_DECOMP_STREAM))
+		return -EAGAIN;
+
+	printf("Testing: %s\n", genimg_get_comp_name(comp_type));
+	ut_assertok(compress(uts, (void *)plain, unc_len, compress_buff,
+			     compress_size, &compress_size));
+	st.size = compress_size;
+	strm.size = compress_size;
+	ut_assertok(hash_lookup_algo("crc32", &strm.algo));
+
+	/* The data is read a small window at a time, and hashed as it goes */
+	ut_assertok(image_decomp_stream(&strm, comp_type, load_buff,
+					sizeof(load_buff), &len));
+	ut_asserteq(unc_len, len);
+	ut_asserteq_mem(plain, load_buff, unc_len);
+	ut_assert(st.reads > 1);
+	ut_asserteq(crc32(0, (void *)compress_buff, compress_size),
+		    get_unaligned_be32(strm.digest));
+
+	ut_assert(image_decomp_stream(&strm, comp_type, load_buff, unc_len - 1,
+				      &len));
+
+	/* We can't detect corruption when not decompressing */
+	if (comp_type == IH_COMP_NONE)
+		return 0;
+	memset(compress_buff + compress_size / 2, '\x49',
+	       compress_size / 2);
+	ut_assert(image_decomp_stream(&strm, comp_type, load_buff,
+				      sizeof(load_buff), &len));
+
+	return 0;
+}
+
+static int compression_test_stream_gzip(struct unit_test_state *uts)
+{
+	return run_stream_test(uts, IH_COMP_GZIP, compress_using_gzip);
+}
+LIB_TEST(compression_test_stream_gzip, 0);
+
+static int compression_test_stream_lzma(struct unit_test_state *uts)
+{
+	return run_stream_test(uts, IH_COMP_LZMA, compress_using_lzma);
+}
+LIB_TEST(compression_test_stream_lzma, 0);
+
+static int compression_test_stream_lz4(struct unit_test_state *uts)
+{
+	return run_stream_test(uts, IH_COMP_LZ4, compress_using_lz4);
+}
+LIB_TEST(compression_test_stream_lz4, 0);
+
+static int compression_test_stream_zstd(struct unit_test_state *uts)
+{
+	return run_stream_test(uts, IH_COMP_ZSTD, compress_using_zstd);
+}
+LIB_TEST(compression_test_stream_zstd, 0);
+
+static int compression_test_stream_zstd_frames(struct unit_test_state *uts)
+{
+	return run_stream_test(uts, IH_COMP_ZSTD, compress_using_zstd_frames);
+}
+LIB_TEST(compression_test_stream_zstd_frames, 0);
+
+static int compression_test_stream_none(struct unit_test_state *uts)
+{
+	return run_stream_test(uts, IH_COMP_NONE, compress_using_none);
+}
+LIB_TEST(compression_test_stream_none, 0);
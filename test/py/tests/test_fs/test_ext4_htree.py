@@ -0,0 +1,98 @@
+# SPDX-License-Identifier:      GPL-2.0+
+
+"""Test looking up files in an ext4 directory with a hash tree index
+"""
+
+import os
+import re
+import pytest
+from tests.fs_helper import FsHelper
+import utils
+
+NUM_FILES = 5000
+
+# Reads for a lookup by the index: the path, the index blocks, a leaf block and
+# the inodes. A search of the whole directory reads each of its entries.
+MAX_READS = 100
+
+def fname(i):
+    """Get the name of a test file, of varying length"""
+    return f'mod_{i:05d}_{"x" * (i % 40)}.ko'
+
+def count_reads(ubman, cmd):
+    """Run a command and count the block reads it does
+
+    Args:
+        ubman (ConsoleBase): U-Boot console
+        cmd (str): Command to run
+
+    Returns:
+        tuple:
+            str: Output of the command
+            int: Number of reads, from the block-cache statistics
+    """
+    ubman.run_command('blkcache show')
+    output = ubman.run_command(cmd)
+    stats = ubman.run_command('blkcache show')
+    hits = int(re.search(r'^hits: (\d+)', stats, re.M).group(1))
+    misses = int(re.search(r'^misses: (\d+)', stats, re.M).group(1))
+    return output, hits + misses
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('fs_ext4')
+@pytest.mark.buildconfigspec('cmd_block_cache')
+@pytest.mark.slow
+def test_ext4_htree(ubman):
+    """Look up files in a large directory with an index
+
+    Args:
+        ubman (ConsoleBase): U-Boot console
+    """
+    with FsHelper(ubman.config, 'ext4', 64, 'ext4_htree') as fsh:
+        moddir = os.path.join(fsh.srcdir, 'modules')
+        os.mkdir(moddir)
+        for i in range(NUM_FILES):
+            with open(os.path.join(moddir, fname(i)), 'wb') as outf:
+                outf.write(b'\0' * (i % 100 + 1))
+        with open(os.path.join(fsh.srcdir, 'top.bin'), 'wb') as outf:
+            outf.write(b'\0' * 0x123)
+        os.symlink('../top.bin', os.path.join(moddir, 'link.bin'))
+        fsh.mk_fs()
+
+        # Make sure that the directory has an index
+        utils.run_and_log(ubman, f'e2fsck -fyD {fsh.fs_img}',
+                          ignore_errors=True)
+        output = utils.run_and_log(ubman,
+                                   ['debugfs', '-R', 'htree modules',
+                                    fsh.fs_img])
+        assert 'Root node dump' in output
+
+        ubman.run_command(f'host bind 0 {fsh.fs_img}')
+        # Mount the filesystem, so that only the lookups are counted
+        ubman.run_command('size host 0:0 /top.bin')
+        for i in (0, 1, 39, 40, 1234, NUM_FILES // 2, NUM_FILES - 1):
+            output, reads = count_reads(
+                ubman, f'size host 0:0 /modules/{fname(i)}; echo $filesize')
+            assert output.split()[-1] == f'{i % 100 + 1:x}'
+            assert reads < MAX_READS
+
+        # "." and ".." are outside the index, as used by a relative symlink
+        for path, size in ((f'/modules/./{fname(7)}', 8),
+                           ('/modules/../top.bin', 0x123),
+                           ('/modules/link.bin', 0x123)):
+            output = ubman.run_command(
+                f'size host 0:0 {path}; echo $filesize')
+            assert output.split()[-1] == f'{size:x}'
+
+        # Missing files, including a name which almost matches. Without the
+        # index, each of these would read every entry in the directory
+        for name in ('missing.ko', 'mod_00001_.ko', 'MOD_00000_.ko'):
+            output, reads = count_reads(
+                ubman, f'size host 0:0 /modules/{name}; echo rc=$?')
+            assert 'rc=1' in output
+            assert reads < MAX_READS
+
+        output = ubman.run_command('ls host 0:0 /modules')
+        assert f'{NUM_FILES + 1} file(s)' in output
+
+        ubman.run_command('host unbind 0')
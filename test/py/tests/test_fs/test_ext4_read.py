@@ -0,0 +1,89 @@
+# SPDX-License-Identifier:      GPL-2.0+
+
+"""Test and measure reading files which use extents from an ext4 filesystem
+"""
+
+import hashlib
+import os
+import re
+import pytest
+from tests.fs_helper import FsHelper
+
+ADDR = 0x1000000
+BIG_SIZE = 64 << 20
+
+def md5(data):
+    """Get the MD5 digest of some data, as shown by the md5sum command"""
+    return hashlib.md5(data).hexdigest()
+
+def load(ubman, fname, size=0, offset=0):
+    """Load (part of) a file and return the time taken and its MD5 digest
+
+    Args:
+        ubman (ConsoleBase): U-Boot console
+        fname (str): Filename to read
+        size (int): Number of bytes to read, 0 for the whole file
+        offset (int): Offset in the file to read from
+
+    Returns:
+        tuple:
+            int: Time taken to read the file, in milliseconds
+            str: MD5 digest of the data read
+    """
+    output = ubman.run_command(
+        f'load host 0:0 {ADDR:x} {fname} {size:x} {offset:x}')
+    match = re.search(r'(\d+) bytes read in (\d+) ms', output)
+    assert match, output
+    read = int(match.group(1))
+    output = ubman.run_command(f'md5sum {ADDR:x} {read:x}')
+    return int(match.group(2)), output.split()[-1]
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('fs_ext4')
+@pytest.mark.buildconfigspec('cmd_md5sum')
+@pytest.mark.slow
+def test_ext4_read(ubman):
+    """Read large and sparse files by extents
+
+    The time taken to read the large file is logged, as a benchmark.
+
+    Args:
+        ubman (ConsoleBase): U-Boot console
+    """
+    with FsHelper(ubman.config, 'ext4', 128, 'ext4_read') as fsh:
+        big = os.urandom(BIG_SIZE)
+        with open(os.path.join(fsh.srcdir, 'big'), 'wb') as outf:
+            outf.write(big)
+
+        # Holes at the start, in the middle and at the end
+        sparse = bytearray(8 << 20)
+        sparse[1 << 20:2 << 20] = big[:1 << 20]
+        sparse[5 << 20:(5 << 20) + 12345] = big[:12345]
+        with open(os.path.join(fsh.srcdir, 'sparse'), 'wb') as outf:
+            outf.seek(1 << 20)
+            outf.write(big[:1 << 20])
+            outf.seek(5 << 20)
+            outf.write(big[:12345])
+            outf.truncate(len(sparse))
+        fsh.mk_fs()
+
+        ubman.run_command(f'host bind 0 {fsh.fs_img}')
+
+        msecs, digest = load(ubman, 'big')
+        assert digest == md5(big)
+        rate = BIG_SIZE // 1024 * 1000 // max(msecs, 1)
+        ubman.log.info(f'ext4: read {BIG_SIZE} bytes in {msecs} ms, '
+                       f'{rate} KiB/s')
+
+        # Unaligned parts, within and across extents
+        for size, offset in ((0x1234, 0x567), (0x300001, 0xfff),
+                             (0x1000, BIG_SIZE - 0x1000)):
+            _, digest = load(ubman, 'big', size, offset)
+            assert digest == md5(big[offset:offset + size])
+
+        _, digest = load(ubman, 'sparse')
+        assert digest == md5(sparse)
+        _, digest = load(ubman, 'sparse', 0x200000, 0x180000)
+        assert digest == md5(sparse[0x180000:0x380000])
+
+        ubman.run_command('host unbind 0')
@@ -0,0 +1,94 @@
+# SPDX-License-Identifier:      GPL-2.0+
+
+"""Test reading fragmented files from a FAT filesystem
+"""
+
+import os
+import random
+import pytest
+from tests.fs_helper import FsHelper
+
+# Memory for the source data and for reading the file back
+SRC_ADDR = 0x1000000
+DST_ADDR = 0x2000000
+
+CHUNK = 0x1800
+NUM_CHUNKS = 16
+DATA_SIZE = CHUNK * NUM_CHUNKS
+
+def check_read(ubman, offset, size):
+    """Read part of /frag.bin to an unaligned address and compare it
+
+    Args:
+        ubman (ConsoleBase): U-Boot console
+        offset (int): Offset in the file to read from
+        size (int): Number of bytes to read
+    """
+    output = ubman.run_command(
+        f'load host 0:0 {DST_ADDR + 1:x} /frag.bin {size:x} {offset:x}; '
+        f'echo $filesize')
+    assert output.split()[-1] == f'{size:x}'
+    output = ubman.run_command(
+        f'cmp.b {SRC_ADDR + offset:x} {DST_ADDR + 1:x} {size:x}; echo rc=$?')
+    assert 'rc=0' in output
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_fat')
+@pytest.mark.buildconfigspec('fat_write')
+@pytest.mark.buildconfigspec('cmd_fs_generic')
+@pytest.mark.parametrize('fs_type,size_mb', [('fat12', 2), ('fat16', 9),
+                                             ('fat32', 8)])
+def test_fat_frag(ubman, fs_type, size_mb):
+    """Read a file made of many cluster runs, before and after it changes
+
+    Args:
+        ubman (ConsoleBase): U-Boot console
+        fs_type (str): Filesystem type
+        size_mb (int): Size of the filesystem in MB
+    """
+    with FsHelper(ubman.config, fs_type, size_mb, 'fat_frag') as fsh:
+        rand = random.Random(size_mb)
+        with open(os.path.join(fsh.srcdir, 'data.bin'), 'wb') as outf:
+            outf.write(rand.randbytes(DATA_SIZE + CHUNK * 4))
+        fsh.mk_fs()
+
+        ubman.run_command(f'host bind 0 {fsh.fs_img}')
+        ubman.run_command(f'load host 0:0 {SRC_ADDR:x} /data.bin')
+
+        # Write the file a chunk at a time between other files, then delete
+        # every other one of those to leave holes
+        for i in range(NUM_CHUNKS):
+            output = ubman.run_command(
+                f'fatwrite host 0:0 {SRC_ADDR + i * CHUNK:x} /frag.bin '
+                f'{CHUNK:x} {i * CHUNK:x}; echo rc=$?')
+            assert 'rc=0' in output
+            output = ubman.run_command(
+                f'fatwrite host 0:0 {SRC_ADDR:x} /fill{i}.bin {CHUNK:x}; '
+                f'echo rc=$?')
+            assert 'rc=0' in output
+        for i in range(1, NUM_CHUNKS, 2):
+            output = ubman.run_command(f'rm host 0:0 /fill{i}.bin; echo rc=$?')
+            assert 'rc=0' in output
+
+        # The whole file, then parts starting and ending inside clusters and
+        # crossing from one run to the next
+        check_read(ubman, 0, DATA_SIZE)
+        for offset, size in ((1, 0x10), (CHUNK - 3, 7),
+                             (CHUNK * 3 - 0x101, CHUNK * 2 + 0x203),
+                             (CHUNK * 7 + 0x1ff, CHUNK * 5 + 1),
+                             (DATA_SIZE - 5, 5)):
+            check_read(ubman, offset, size)
+
+        # Make the file longer, filling the holes, so that its cluster chain
+        # changes after it has been read
+        output = ubman.run_command(
+            f'fatwrite host 0:0 {SRC_ADDR + DATA_SIZE:x} /frag.bin '
+            f'{CHUNK * 4:x} {DATA_SIZE:x}; echo rc=$?')
+        assert 'rc=0' in output
+        check_read(ubman, 0, DATA_SIZE + CHUNK * 4)
+        for offset, size in ((DATA_SIZE - 0x11, 0x22),
+                             (CHUNK * 2 + 5, DATA_SIZE),
+                             (DATA_SIZE + CHUNK * 3 + 1, CHUNK - 1)):
+            check_read(ubman, offset, size)
+
+        ubman.run_command('host unbind 0')
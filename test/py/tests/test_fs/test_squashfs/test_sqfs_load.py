@@ -92,6 +92,21 @@ def sqfs_load_files_at_subdir(ubman):
     address = '$kernel_addr_r'
     sqfs_load_files(ubman, files, sizes, address)
 
+def sqfs_load_files_again(ubman):
+    """ Calls sqfs_load_files passing files which have already been loaded.
+
+    This test checks the tables and blocks kept from the previous loads, since
+    the image stays mounted between them. Small files and the ends of larger
+    files are usually packed into a shared fragment block.
+
+    Args:
+        ubman: provides the means to interact with U-Boot's console.
+    """
+    files = ['f1000', 'subdir/subdir-file', 'f5096', 'f4096', 'f1000']
+    sizes = ['1000', '100', '5096', '4096', '1000']
+    address = '$kernel_addr_r'
+    sqfs_load_files(ubman, files, sizes, address)
+
 def sqfs_load_non_existent_file(ubman):
     """ Calls sqfs_load_files passing an non-existent file to raise an error.
 
@@ -114,6 +129,7 @@ def sqfs_run_all_load_tests(ubman):
     """
     sqfs_load_files_at_root(ubman)
     sqfs_load_files_at_subdir(ubman)
+    sqfs_load_files_again(ubman)
     sqfs_load_non_existent_file(ubman)
 
 @pytest.mark.boardspec('sandbox')
@@ -138,6 +138,14 @@ def test_sqfs_ls(ubman):
             image_path = os.path.join(build_dir, image)
             ubman.run_command('host bind 0 {}'.format(image_path))
             sqfs_run_all_ls_tests(ubman)
+            if ubman.config.buildconfig.get('config_fs_mount_cache') == 'y':
+                # Read directories after the filesystem has been closed, as
+                # without CONFIG_FS_MOUNT_CACHE
+                ubman.run_command('fs cache off')
+                try:
+                    sqfs_run_all_ls_tests(ubman)
+                finally:
+                    ubman.run_command('fs cache on')
         except:
             clean_all_images(build_dir)
             clean_sqfs_src_dir(build_dir)
@@ -91,6 +91,20 @@ For example:
         'pattern': 'Linux',
     }
 
+    # Details of an HTTP server which test_net_wget_throughput starts on the host
+    # to measure the download speed of wget. U-Boot must be able to reach the
+    # host at 'host'; 'min_rate' is an optional minimum speed in bytes per
+    # second. This variable may be omitted or set to None if the test is not
+    # possible or desired.
+    env__net_wget_local_server = {
+        'host': '10.0.0.1',
+        'port': 8080,
+        'addr': 0x10000000,
+        'size': 16 * 1024 * 1024,
+        'min_rate': 10 * 1024 * 1024,
+        'timeout': 50000,
+    }
+
     # True if a router advertisement service is connected to the network, and should
     # be tested. If router advertisement testing is not possible or desired, this
     variable may be omitted or set to False.
@@ -101,8 +115,13 @@ import pytest
 import utils
 import uuid
 import datetime
+import functools
+import http.server
+import os
 import re
 import tempfile
+import threading
+import time
 import zlib
 
 net_set_up = False
@@ -554,3 +573,74 @@ def test_net_tftpsrv(ubman):
 
     output = ubman.run_command("crc32 $fileaddr $filesize")
     assert crc in output
+
+class QuietHTTPRequestHandler(http.server.SimpleHTTPRequestHandler):
+    """Serve files without logging each request to stderr"""
+
+    def log_message(self, format, *args):
+        pass
+
+@pytest.mark.buildconfigspec("cmd_crc32")
+@pytest.mark.buildconfigspec("cmd_wget")
+@pytest.mark.buildconfigspec("net_legacy")
+def test_net_wget_throughput(ubman):
+    """Test the download speed of the wget command.
+
+    A file is generated on the host and served by an HTTP server which the
+    test starts there. U-Boot downloads it with wget and validates it using
+    its size and CRC32. The speed is logged and checked against a minimum, if
+    one is given.
+
+    The details of the server are provided by the boardenv_* file; see the
+    comment at the beginning of this file.
+    """
+
+    if not net_set_up:
+        pytest.skip("Network not initialized")
+
+    f = ubman.config.env.get("env__net_wget_local_server", None)
+    if not f:
+        pytest.skip("No local HTTP server to test with")
+
+    addr = f.get("addr", None)
+    if not addr:
+        addr = utils.find_ram_base(ubman)
+
+    host = f["host"]
+    port = f.get("port", 8080)
+    size = f.get("size", 16 * 1024 * 1024)
+    timeout = f.get("timeout", ubman.p.timeout)
+    fn = "ubtest-wget.bin"
+    data = os.urandom(size)
+    crc = "%08x" % (zlib.crc32(data) & 0xffffffff)
+
+    with tempfile.TemporaryDirectory() as tmpdir:
+        with open(os.path.join(tmpdir, fn), "wb") as fd:
+            fd.write(data)
+
+        handler = functools.partial(QuietHTTPRequestHandler, directory=tmpdir)
+        server = http.server.ThreadingHTTPServer(("", port), handler)
+        thread = threading.Thread(target=server.serve_forever, daemon=True)
+        thread.start()
+        try:
+            ubman.run_command("setenv httpdstp %d" % port)
+            with ubman.temporary_timeout(timeout):
+                start = time.monotonic()
+                output = ubman.run_command("wget %x %s:/%s" % (addr, host, fn))
+                elapsed = time.monotonic() - start
+        finally:
+            ubman.run_command("setenv httpdstp")
+            server.shutdown()
+            server.server_close()
+
+    assert "Bytes transferred = %d" % size in output
+
+    output = ubman.run_command("crc32 $fileaddr $filesize")
+    assert crc in output
+
+    rate = size / elapsed
+    ubman.log.info("wget: %d bytes in %.3f s (%.1f MiB/s)" %
+                   (size, elapsed, rate / (1024 * 1024)))
+    min_rate = f.get("min_rate", None)
+    if min_rate:
+        assert rate >= min_rate
@@ -0,0 +1,70 @@
+# SPDX-License-Identifier: GPL-2.0+
+
+# Test reading from an NVMe namespace and measure the read throughput, e.g.
+# on QEMU with an emulated NVMe drive:
+#
+#   -drive file=nvme.img,if=none,id=nvm -device nvme,serial=deadbeef,drive=nvm
+
+import time
+
+import pytest
+import utils
+
+"""
+This test relies on boardenv_* containing configuration values to define
+which NVMe namespace to read and how much. The test is skipped without this.
+
+For example:
+
+# Configuration data for test_nvme_read_speed; defines a region of an NVMe
+# device to read, with an optional CRC32 of the data and minimum throughput in
+# MB/s. Use a large count so that the transfer is split into several commands.
+env__nvme_rd_config = {
+    'devnum': 0,
+    'sector': 0,
+    'count': 0x20000,
+    'crc32': '9c7c3d4e',
+    'min_mbps': 100,
+}
+"""
+
+def nvme_setup(ubman):
+    f = ubman.config.env.get('env__nvme_rd_config', None)
+    if not f:
+        pytest.skip('No NVMe device to test')
+
+    return (f.get('devnum', 0), f.get('sector', 0), f.get('count', 0x800),
+            f.get('crc32', None), f.get('min_mbps', 0))
+
+@pytest.mark.buildconfigspec('cmd_nvme')
+def test_nvme_read_speed(ubman):
+    """Read a region of an NVMe device and check the throughput
+
+    The read is large enough to need several commands, which the driver
+    submits in batches.
+    """
+    devnum, sector, count, crc32, min_mbps = nvme_setup(ubman)
+    addr = '0x%08x' % utils.find_ram_base(ubman)
+
+    ubman.run_command('nvme scan')
+    response = ubman.run_command('nvme dev %d' % devnum)
+    assert 'is now current device' in response
+
+    # Read the region twice and time the second pass, so that any one-off
+    # setup does not distort the result
+    cmd = 'nvme read %s %x %x' % (addr, sector, count)
+    ubman.run_command(cmd)
+    tstart = time.time()
+    response = ubman.run_command(cmd)
+    elapsed = time.time() - tstart
+    assert '%d blocks read: OK' % count in response
+
+    if crc32:
+        response = ubman.run_command('crc32 %s 0x%x' % (addr, count * 512))
+        assert crc32 in response
+
+    mbps = count * 512 / elapsed / 1e6
+    ubman.log.info('Read %d blocks in %f seconds: %.1f MB/s' %
+                   (count, elapsed, mbps))
+    if min_mbps:
+        assert mbps >= min_mbps
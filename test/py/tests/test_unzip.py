@@ -0,0 +1,84 @@
+# SPDX-License-Identifier: GPL-2.0+
+
+"""Measure the gzip decompression speed of the unzip command
+
+A fixed corpus is generated, so that results can be compared between builds:
+pseudo-random text made of a fixed vocabulary, which compresses much like
+source code or logs, followed by a block of short repeated patterns, which
+exercises matches at small distances.
+"""
+
+import gzip
+import os
+import random
+import re
+import zlib
+
+import pytest
+import utils
+
+CORPUS_TEXT_SIZE = 12 << 20
+CORPUS_RUNS_SIZE = 4 << 20
+
+def make_corpus():
+    """Generate the corpus, which is the same on every run"""
+    rand = random.Random(0x75627a69)
+    letters = 'abcdefghijklmnopqrstuvwxyz'
+    vocab = [''.join(rand.choice(letters)
+                     for _ in range(rand.randint(1, 10)))
+             for _ in range(4000)]
+    text = bytearray()
+    while len(text) < CORPUS_TEXT_SIZE:
+        line = ' '.join(rand.choice(vocab) for _ in range(rand.randint(1, 16)))
+        text += line.encode() + b'\n'
+    del text[CORPUS_TEXT_SIZE:]
+
+    runs = bytearray()
+    while len(runs) < CORPUS_RUNS_SIZE:
+        pattern = rand.randbytes(rand.randint(1, 24))
+        runs += pattern * rand.randint(1, 40)
+        runs += rand.randbytes(rand.randint(0, 30))
+    del runs[CORPUS_RUNS_SIZE:]
+
+    return bytes(text + runs)
+
+@pytest.fixture(scope='session')
+def gzip_corpus(u_boot_config):
+    """Write the compressed corpus to a host file"""
+    data = make_corpus()
+    path = os.path.join(u_boot_config.persistent_data_dir, 'unzip-corpus.gz')
+    with open(path, 'wb') as outf:
+        outf.write(gzip.compress(data, mtime=0))
+    yield path, len(data), zlib.crc32(data)
+    os.remove(path)
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_unzip')
+@pytest.mark.buildconfigspec('cmd_time')
+def test_unzip_speed(ubman, gzip_corpus):
+    """Decompress the corpus, check the result and report the throughput"""
+    path, size, crc = gzip_corpus
+    base = utils.find_ram_base(ubman)
+    src = base + 0x1000000
+    dst = base + 0x2000000
+
+    response = ubman.run_command('load sandbox - %x %s' % (src, path))
+    assert 'bytes read' in response
+
+    # Run twice and time the second pass, so that the pages of the output
+    # buffer are already mapped by the host
+    cmd = 'unzip %x %x' % (src, dst)
+    ubman.run_command(cmd)
+    response = ubman.run_command('time ' + cmd)
+    assert 'Uncompressed size: %d' % size in response
+    match = re.search(r'time: (?:(\d+) minutes, )?(\d+\.\d+) seconds',
+                      response)
+    assert match
+    elapsed = int(match.group(1) or 0) * 60 + float(match.group(2))
+
+    response = ubman.run_command('crc32 %x %x' % (dst, size))
+    assert '==> %08x' % crc in response
+
+    mbps = size / max(elapsed, 0.001) / 1e6
+    ubman.log.info('Decompressed %d bytes in %.3f seconds: %.1f MB/s' %
+                   (size, elapsed, mbps))
@@ -16,6 +16,7 @@
 #include <os.h>
 #include <spl.h>
 #include <usb.h>
+#include <dm/of_index.h>
 #include <dm/ofnode.h>
 #include <dm/root.h>
 #include <dm/test.h>
@@ -119,6 +120,7 @@ static int dm_test_pre_run(struct unit_test_state *uts)
 	/* Determine whether to make the live tree available */
 	gd_set_of_root(of_live ? uts->of_root : NULL);
 	oftree_reset();
+	of_index_invalidate();
 	ut_assertok(dm_init(of_live));
 	uts->root = dm_root();
 
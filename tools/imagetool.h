@@ -103,6 +103,8 @@ struct image_tool_params {
 	unsigned int fit_tfa_bl31_addr;	/* TFA BL31 load and entry point address */
 	char *fit_tee;		/* TEE file to include */
 	unsigned int fit_tee_addr;	/* TEE load and entry point address */
+	unsigned long zstd_frames;	/* Compress data with zstd in frames of this size */
+	char *zstd_file;	/* Temporary file holding the compressed data */
 };
 
 /*
@@ -14,6 +14,8 @@
 #include <getopt.h>
 #include <image.h>
 #include <version.h>
+#include <signal.h>
+#include <sys/wait.h>
 #ifdef __linux__
 #include <sys/ioctl.h>
 #endif
@@ -105,7 +107,8 @@ static void usage(const char *msg)
 		"          -Y ==> set TFA BL31 file load and entry point address\n"
 		"          -z ==> append raw TEE file to the image\n"
 		"          -Z ==> set raw TEE file load and entry point address\n"
-		"          -v ==> verbose\n",
+		"          -v ==> verbose\n"
+		"          --zstd-frames size ==> with -C zstd, compress the data in frames of 'size' bytes (hex)\n",
 		params.cmdname);
 	fprintf(stderr,
 		"       %s [-D dtc_options] [-f fit-image.its|-f auto|-f auto-conf|-F] [-b <dtb> [-b <dtb>]] [-E] [-B size] [-i <ramdisk.cpio.gz>] fit-image\n"
@@ -163,6 +166,11 @@ static int add_content(int type, const char *fname)
 	return 0;
 }
 
+/* Options which only have a long form */
+enum {
+	OPT_ZSTD_FRAMES = 0x100,
+};
+
 static const char optstring[] =
 	"a:A:b:B:c:C:d:D:e:Ef:Fg:G:i:k:K:ln:N:o:O:p:qrR:stT:vVxy:Y:z:Z:";
 
@@ -204,6 +212,7 @@ static const struct option longopts[] = {
 	{ "tfa-bl31-addr", no_argument, NULL, 'Y' },
 	{ "tee-file", no_argument, NULL, 'z' },
 	{ "tee-addr", no_argument, NULL, 'Z' },
+	{ "zstd-frames", required_argument, NULL, OPT_ZSTD_FRAMES },
 	{ /* sentinel */ },
 };
 
@@ -397,6 +406,14 @@ static void process_args(int argc, char **argv)
 				exit(EXIT_FAILURE);
 			}
 			break;
+		case OPT_ZSTD_FRAMES:
+			params.zstd_frames = strtoull(optarg, &ptr, 16);
+			if (*ptr || !params.zstd_frames) {
+				fprintf(stderr, "%s: invalid zstd frame size %s\n",
+					params.cmdname, optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
 		default:
 			usage("Invalid option");
 		}
@@ -435,6 +452,151 @@ static void process_args(int argc, char **argv)
 
 	if (!params.imagefile)
 		usage("Missing output filename");
+
+	if (params.zstd_frames) {
+		if (params.comp != IH_COMP_ZSTD)
+			usage("--zstd-frames needs zstd compression (use -C zstd)");
+		if (!params.datafile || strchr(params.datafile, ':') ||
+		    (params.type == IH_TYPE_FLATDT && !params.auto_fit))
+			usage("--zstd-frames needs a single data file (use -d)");
+	}
+}
+
+/* Read up to @len bytes, stopping short only at the end of the file */
+static ssize_t read_full(int fd, void *buf, size_t len)
+{
+	size_t done = 0;
+	ssize_t ret;
+
+	while (done < len) {
+		ret = read(fd, buf + done, len - done);
+		if (ret < 0)
+			return ret;
+		if (!ret)
+			break;
+		done += ret;
+	}
+
+	return done;
+}
+
+static void zstd_frames_cleanup(void)
+{
+	unlink(params.zstd_file);
+}
+
+/*
+ * Compress @len bytes of @buf into one zstd frame appended to @zfd. This runs
+ * zstd directly, without a shell, with the data on a pipe to its stdin.
+ * Returns 0 if OK, -1 if zstd cannot be run or fails
+ */
+static int zstd_frame_write(int zfd, const void *buf, ssize_t len)
+{
+	char size_arg[40];
+	int pipefd[2], status;
+	ssize_t done, ret;
+	pid_t pid;
+
+	snprintf(size_arg, sizeof(size_arg), "--stream-size=%zd", len);
+	if (pipe(pipefd) < 0) {
+		fprintf(stderr, "%s: Can't create pipe: %s\n", params.cmdname,
+			strerror(errno));
+		return -1;
+	}
+	pid = fork();
+	if (pid < 0) {
+		fprintf(stderr, "%s: Can't fork: %s\n", params.cmdname,
+			strerror(errno));
+		close(pipefd[0]);
+		close(pipefd[1]);
+		return -1;
+	}
+	if (pid == 0) {
+		/* child: read the data from the pipe, write the frame to zfd */
+		char *argv[] = { "zstd", "-q", "-c", "-19", size_arg, NULL };
+
+		close(pipefd[1]);
+		if (dup2(pipefd[0], STDIN_FILENO) < 0 ||
+		    dup2(zfd, STDOUT_FILENO) < 0)
+			_exit(127);
+		close(pipefd[0]);
+		execvp(argv[0], argv);
+		fprintf(stderr, "%s: Can't run zstd: %s\n", params.cmdname,
+			strerror(errno));
+		_exit(127);
+	}
+
+	close(pipefd[0]);
+	for (done = 0; done < len; done += ret) {
+		ret = write(pipefd[1], buf + done, len - done);
+		if (ret < 0)
+			break;
+	}
+	close(pipefd[1]);
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+	    WEXITSTATUS(status)) {
+		fprintf(stderr, "%s: zstd failed\n", params.cmdname);
+		return -1;
+	}
+	if (done != len) {
+		fprintf(stderr, "%s: Can't write to zstd: %s\n",
+			params.cmdname, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Compress the data file with zstd into a temporary file which is then used in
+ * its place. Each params.zstd_frames bytes of data go in a separate frame which
+ * records its decompressed size, so that U-Boot can decompress the frames in
+ * parallel.
+ */
+static void zstd_frames_compress(void)
+{
+	unsigned long chunk = params.zstd_frames;
+	ssize_t len;
+	char *buf;
+	int dfd, zfd;
+
+	if (asprintf(&params.zstd_file, "%s.zst.tmp", params.imagefile) < 0 ||
+	    !(buf = malloc(chunk))) {
+		fprintf(stderr, "%s: Out of memory\n", params.cmdname);
+		exit(EXIT_FAILURE);
+	}
+	dfd = open(params.datafile, O_RDONLY | O_BINARY);
+	if (dfd < 0) {
+		fprintf(stderr, "%s: Can't open %s: %s\n",
+			params.cmdname, params.datafile, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	zfd = open(params.zstd_file, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY,
+		   0666);
+	if (zfd < 0) {
+		fprintf(stderr, "%s: Can't open %s: %s\n",
+			params.cmdname, params.zstd_file, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	atexit(zstd_frames_cleanup);
+
+	/* report a zstd which exits early as a failure, rather than dying */
+	signal(SIGPIPE, SIG_IGN);
+	while ((len = read_full(dfd, buf, chunk)) > 0) {
+		if (zstd_frame_write(zfd, buf, len))
+			exit(EXIT_FAILURE);
+	}
+	signal(SIGPIPE, SIG_DFL);
+	if (len < 0) {
+		fprintf(stderr, "%s: Can't read %s: %s\n",
+			params.cmdname, params.datafile, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	close(zfd);
+	close(dfd);
+	free(buf);
+
+	params.datafile = params.zstd_file;
 }
 
 static void verify_image(const struct image_type_params *tparams)
@@ -510,6 +672,8 @@ int main(int argc, char **argv)
 	params.ep = 0;
 
 	process_args(argc, argv);
+	if (params.zstd_frames)
+		zstd_frames_compress();
 
 	/* set tparams as per input type_id */
 	tparams = imagetool_get_type(params.type);